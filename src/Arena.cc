@@ -0,0 +1,145 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include "Arena.h"
+
+Arena packet_arena;
+
+uint64 Arena::num_heap_allocs = 0;
+
+Arena::Arena(size_t arg_chunk_size)
+	{
+	chunk_size = Align(arg_chunk_size);
+	current = in_use = free_chunks = 0;
+	num_in_use = num_free = 0;
+
+	stats.allocs = stats.bytes = stats.heap_allocs = stats.releases = 0;
+	stats.chunks = stats.pinned = 0;
+	}
+
+Arena::~Arena()
+	{
+	Recycle();
+
+	if ( current && current->live == 0 )
+		{
+		// Recycle() leaves it on the in-use list.
+		Chunk** cp = &in_use;
+		while ( *cp != current )
+			cp = &(*cp)->next;
+
+		*cp = current->next;
+		free(current);
+		}
+
+	current = 0;
+
+	while ( free_chunks )
+		{
+		Chunk* c = free_chunks;
+		free_chunks = c->next;
+		free(c);
+		}
+	}
+
+void* Arena::HeapAllocate(size_t size)
+	{
+	++num_heap_allocs;
+	char* p = (char*) safe_malloc(size + HEADER_SIZE);
+	return SetHeader(p, 0);
+	}
+
+void* Arena::AllocateSlow(size_t size)
+	{
+	// Large objects would waste too much of a chunk.
+	if ( Align(size) + HEADER_SIZE > chunk_size / 4 )
+		return HeapAllocate(size);
+
+	Recycle();
+
+	if ( current && current->used + Align(size) + HEADER_SIZE <= chunk_size )
+		return Allocate(size);
+
+	Chunk* c = free_chunks;
+
+	if ( c )
+		{
+		free_chunks = c->next;
+		--num_free;
+		}
+	else
+		c = (Chunk*) safe_malloc(Align(sizeof(Chunk)) + chunk_size);
+
+	c->used = 0;
+	c->live = 0;
+	c->next = in_use;
+	in_use = c;
+	++num_in_use;
+
+	current = c;
+	return Allocate(size);
+	}
+
+void Arena::Recycle()
+	{
+	Chunk** cp = &in_use;
+
+	while ( *cp )
+		{
+		Chunk* c = *cp;
+
+		if ( c->live > 0 )
+			{
+			cp = &c->next;
+			continue;
+			}
+
+		c->used = 0;
+
+		if ( c == current )
+			{
+			cp = &c->next;
+			continue;
+			}
+
+		*cp = c->next;
+		--num_in_use;
+
+		c->next = free_chunks;
+		free_chunks = c;
+		++num_free;
+		}
+	}
+
+void Arena::Release()
+	{
+	++stats.releases;
+	Recycle();
+
+	while ( num_free > MAX_FREE_CHUNKS )
+		{
+		Chunk* c = free_chunks;
+		free_chunks = c->next;
+		--num_free;
+		free(c);
+		}
+	}
+
+void Arena::GetStats(Stats* s) const
+	{
+	*s = stats;
+	s->heap_allocs = num_heap_allocs;
+	s->chunks = num_in_use + num_free;
+	s->pinned = 0;
+
+	for ( Chunk* c = in_use; c; c = c->next )
+		if ( c->live > 0 )
+			++s->pinned;
+	}
+
+unsigned int Arena::MemoryAllocation() const
+	{
+	return (num_in_use + num_free) *
+		pad_size(Align(sizeof(Chunk)) + chunk_size);
+	}
@@ -0,0 +1,157 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+#include <new>
+
+#include "util.h"
+
+// A bump-pointer allocator for short-lived objects, such as the ones
+// created while processing a single packet and the events it raises.
+//
+// Memory is carved out of large chunks.  Each allocation is preceded by
+// a small header pointing back to its chunk, and every chunk counts its
+// live allocations.  Freeing an object merely decrements that count;
+// the chunk's memory becomes available again once Release() finds the
+// count at zero.  Objects that outlive the packet (e.g., an event held
+// back by a plugin) are thus safe: they just pin their chunk until they
+// go away.
+//
+// Classes opt in with DECLARE_ARENA_ALLOCATION, after which plain "new"
+// still allocates from the heap (with the same header, so that "delete"
+// can tell the two apart) while "new (arena) T(...)" allocates from the
+// given arena.
+//
+// An arena is not thread-safe; use it from the main thread only.
+class Arena {
+public:
+	Arena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+	// Frees all chunks that don't hold live objects anymore.  Chunks
+	// that still do are intentionally leaked, as we may still see
+	// them freed later during shutdown.
+	~Arena();
+
+	// Returns memory for an object of the given size.  Requests too
+	// large to be served from a chunk fall back to the heap.
+	void* Allocate(size_t size)
+		{
+		size_t n = Align(size) + HEADER_SIZE;
+
+		if ( current && current->used + n <= chunk_size )
+			{
+			char* p = current->Data() + current->used;
+			current->used += n;
+			++current->live;
+			++stats.allocs;
+			stats.bytes += n;
+			return SetHeader(p, current);
+			}
+
+		return AllocateSlow(size);
+		}
+
+	// Returns heap memory for an object of the given size, laid out
+	// such that Free() accepts it.
+	static void* HeapAllocate(size_t size);
+
+	// Frees memory returned by Allocate() or HeapAllocate().
+	static void Free(void* p)
+		{
+		if ( ! p )
+			return;
+
+		Chunk* c = GetHeader(p);
+
+		if ( c )
+			--c->live;
+		else
+			free((char*) p - HEADER_SIZE);
+		}
+
+	// Marks the end of a unit of work (such as a packet) and recycles
+	// all chunks that no longer hold any live objects.
+	void Release();
+
+	struct Stats {
+		uint64 allocs;	// allocations served from chunks
+		uint64 bytes;	// bytes served from chunks, incl. headers
+		uint64 heap_allocs;	// allocations that went to the heap,
+					// across all arenas
+		uint64 releases;	// calls to Release()
+		unsigned int chunks;	// chunks currently allocated
+		unsigned int pinned;	// of those, held by live objects
+	};
+
+	void GetStats(Stats* s) const;
+
+	// Includes the chunks on the free list.
+	unsigned int MemoryAllocation() const;
+
+	static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+private:
+	struct Chunk {
+		Chunk* next;
+		size_t used;	// bytes handed out since last recycled
+		int live;	// number of allocations not yet freed
+
+		char* Data()	{ return (char*) this + Align(sizeof(Chunk)); }
+	};
+
+	// Large enough to keep the alignment that malloc() guarantees.
+	static const size_t HEADER_SIZE = 16;
+
+	// Chunks we keep around for reuse beyond those currently needed.
+	static const unsigned int MAX_FREE_CHUNKS = 4;
+
+	static size_t Align(size_t size)
+		{ return (size + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1); }
+
+	static void* SetHeader(char* p, Chunk* c)
+		{
+		*(Chunk**) p = c;
+		return p + HEADER_SIZE;
+		}
+
+	static Chunk* GetHeader(void* p)
+		{ return *(Chunk**) ((char*) p - HEADER_SIZE); }
+
+	void* AllocateSlow(size_t size);
+
+	// Moves chunks without live objects from the in-use list to the
+	// free list, except for the current one, which we just rewind.
+	void Recycle();
+
+	size_t chunk_size;	// usable bytes per chunk
+	Chunk* current;		// chunk we're bumping into, also on in_use
+	Chunk* in_use;
+	Chunk* free_chunks;
+	unsigned int num_in_use;
+	unsigned int num_free;
+
+	Stats stats;
+
+	// Shared by all arenas, as plain "new" isn't tied to any.
+	static uint64 num_heap_allocs;
+};
+
+// Arena for objects that live no longer than the packet that created
+// them; released at the end of net_packet_dispatch().
+extern Arena packet_arena;
+
+// Adds class-specific operator new/delete so that instances can be
+// placed into an Arena.
+#define DECLARE_ARENA_ALLOCATION \
+	static void* operator new(size_t size) \
+		{ return Arena::HeapAllocate(size); } \
+	static void* operator new(size_t size, Arena& arena) \
+		{ return arena.Allocate(size); } \
+	static void operator delete(void* p) \
+		{ Arena::Free(p); } \
+	static void operator delete(void* p, Arena& arena) \
+		{ Arena::Free(p); }
+
+#endif
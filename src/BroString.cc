@@ -20,6 +20,9 @@
 const int BroString::EXPANDED_STRING;
 const int BroString::BRO_STRING_LITERAL;
 
+// Substrings shorter than this get their own copy of the bytes.
+static const int min_shared_substring = 64;
+
 // This constructor forces the user to specify arg_final_NUL.  When str
 // is a *normal* NUL-terminated string, make arg_n == strlen(str) and
 // arg_final_NUL == 1; when str is a sequence of n bytes, make
@@ -29,6 +32,8 @@ BroString::BroString(int arg_final_NUL, byte_vec str, int arg_n)
 	{
 	b = str;
 	n = arg_n;
+	buffer = 0;
+	terminated = 0;
 	final_NUL = arg_final_NUL;
 	use_free_to_delete = 0;
 	}
@@ -37,6 +42,8 @@ BroString::BroString(const u_char* str, int arg_n, int add_NUL)
 	{
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	use_free_to_delete = 0;
 	Set(str, arg_n, add_NUL);
 	}
@@ -45,6 +52,8 @@ BroString::BroString(const char* str)
 	{
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	use_free_to_delete = 0;
 	Set(str);
 	}
@@ -53,6 +62,8 @@ BroString::BroString(const string &str)
 	{
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	use_free_to_delete = 0;
 	Set(str);
 	}
@@ -61,6 +72,8 @@ BroString::BroString(const BroString& bs)
 	{
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	use_free_to_delete = 0;
 	*this = bs;
 	}
@@ -69,35 +82,124 @@ BroString::BroString()
 	{
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	final_NUL = 0;
 	use_free_to_delete = 0;
 	}
 
 void BroString::Reset()
 	{
-	if ( use_free_to_delete )
+	if ( buffer )
+		{
+		if ( --buffer->refs == 0 )
+			{
+			if ( buffer->use_free_to_delete )
+				free(buffer->bytes);
+			else
+				delete [] buffer->bytes;
+
+			delete buffer;
+			}
+		}
+
+	else if ( use_free_to_delete )
 		free(b);
 	else
 		delete [] b;
 
+	delete [] terminated;
+
 	b = 0;
 	n = 0;
+	buffer = 0;
+	terminated = 0;
 	final_NUL = 0;
 	use_free_to_delete = 0;
 	}
 
 const BroString& BroString::operator=(const BroString &bs)
 	{
+	if ( &bs == this )
+		return *this;
+
 	Reset();
+
+	if ( ! bs.b )
+		{
+		// Nothing to share.
+		b = new u_char[1];
+		b[0] = '\0';
+		final_NUL = 1;
+		return *this;
+		}
+
+	bs.Share();
+
+	buffer = bs.buffer;
+	++buffer->refs;
+
+	b = bs.b;
 	n = bs.n;
-	b = new u_char[n+1];
+	final_NUL = bs.final_NUL;
 
-	memcpy(b, bs.b, n);
-	b[n] = '\0';
+	return *this;
+	}
+
+void BroString::Share() const
+	{
+	if ( buffer || ! b )
+		return;
+
+	buffer = new Buffer;
+	buffer->refs = 1;
+	buffer->bytes = b;
+	buffer->size = n + final_NUL;
+	buffer->use_free_to_delete = use_free_to_delete;
 
-	final_NUL = 1;
 	use_free_to_delete = 0;
-	return *this;
+	}
+
+void BroString::Unshare()
+	{
+	if ( ! buffer )
+		return;
+
+	if ( buffer->refs == 1 && b == buffer->bytes && final_NUL &&
+	     n + 1 == buffer->size )
+		{
+		// We're the only one left, so the bytes are ours again.
+		use_free_to_delete = buffer->use_free_to_delete;
+		delete buffer;
+		buffer = 0;
+		return;
+		}
+
+	byte_vec copy = new u_char[n + 1];
+	memcpy(copy, b, n);
+	copy[n] = '\0';
+
+	int len = n;
+	Reset();
+
+	b = copy;
+	n = len;
+	final_NUL = 1;
+	}
+
+byte_vec BroString::MutableBytes()
+	{
+	Unshare();
+	return b;
+	}
+
+unsigned int BroString::MemoryAllocation() const
+	{
+	if ( buffer )
+		return padded_sizeof(*this) + pad_size(buffer->size) / buffer->refs +
+			(terminated ? pad_size(n + 1) : 0);
+
+	return padded_sizeof(*this) + pad_size(n + final_NUL);
 	}
 
 bool BroString::operator==(const BroString &bs) const
@@ -169,7 +271,27 @@ const char* BroString::CheckString() const
 	if ( n == 0 )
 		return "";
 
-	if ( memchr(b, '\0', n + final_NUL) != &b[n] )
+	const u_char* s = b;
+	int len = n + final_NUL;
+
+	if ( buffer && ! final_NUL )
+		{
+		// Substrings of shared bytes usually aren't followed by a
+		// NUL, and we can't write one there.  Instead we keep a
+		// terminated copy of our own, for the caller to use for as
+		// long as the string lives.
+		if ( ! terminated )
+			{
+			terminated = new u_char[n + 1];
+			memcpy(terminated, b, n);
+			terminated[n] = '\0';
+			}
+
+		s = terminated;
+		len = n + 1;
+		}
+
+	if ( memchr(s, '\0', len) != &s[n] )
 		{
 		// Either an embedded NUL, or no final NUL.
 		char* exp_s = Render();
@@ -182,7 +304,7 @@ const char* BroString::CheckString() const
 		return "<string-with-NUL>";
 		}
 
-	return (const char*) b;
+	return (const char*) s;
 	}
 
 char* BroString::Render(int format, int* len) const
@@ -279,6 +401,8 @@ istream& BroString::Read(istream &is, int format)
 
 void BroString::ToUpper()
 	{
+	MutableBytes();
+
 	for ( int i = 0; i < n; ++i )
 		if ( islower(b[i]) )
 			b[i] = toupper(b[i]);
@@ -293,7 +417,23 @@ BroString* BroString::GetSubstring(int start, int len) const
 	if ( len < 0 || len > n - start )
 		len = n - start;
 
-	return new BroString(&b[start], len, 1);
+	// Small substrings get copied instead, so that they don't keep
+	// large strings alive and don't need to allocate a Buffer.
+	if ( len < min_shared_substring ||
+	     len * 4 < (buffer ? buffer->size : n) )
+		return new BroString(&b[start], len, 1);
+
+	Share();
+
+	BroString* s = new BroString();
+	s->buffer = buffer;
+	++buffer->refs;
+
+	s->b = b + start;
+	s->n = len;
+	s->final_NUL = (start + len == n) ? final_NUL : 0;
+
+	return s;
 	}
 
 int BroString::FindSubstring(const BroString* s) const
@@ -38,6 +38,8 @@ public:
 	BroString(const u_char* str, int arg_n, int add_NUL);
 	BroString(const char* str);
 	BroString(const string& str);
+
+	// Copies share the bytes of the original (see below).
 	BroString(const BroString& bs);
 
 	// Constructor that takes owernship of the vector passed in.
@@ -50,9 +52,20 @@ public:
 	bool operator==(const BroString& bs) const;
 	bool operator<(const BroString& bs) const;
 
+	// Strings can share their bytes with copies of themselves and
+	// with substrings of them, in which case the bytes get copied only
+	// once a string gets modified.  Hence the bytes returned by Bytes()
+	// must not be modified; use MutableBytes() for that.
 	byte_vec Bytes() const	{ return b; }
 	int Len() const	{ return n; }
 
+	// Returns bytes that only this string refers to, copying them if
+	// they're shared.
+	byte_vec MutableBytes();
+
+	// True if the string shares its bytes with other strings.
+	bool IsShared() const	{ return buffer && buffer->refs > 1; }
+
 	// Releases the string's current contents, if any, and
 	// adopts the byte vector of given length.  The string will
 	// manage the memory occupied by the string afterwards.
@@ -69,7 +82,12 @@ public:
 	void Set(const BroString &str);
 
 	void SetUseFreeToDelete(int use_it)
-		{ use_free_to_delete = use_it; }
+		{
+		if ( buffer )
+			buffer->use_free_to_delete = use_it;
+		else
+			use_free_to_delete = use_it;
+		}
 
 	const char* CheckString() const;
 
@@ -116,13 +134,15 @@ public:
 	// XXX and to_upper; the latter doesn't use BroString::ToUpper().
 	void ToUpper();
 
-	unsigned int MemoryAllocation() const
-		{ return padded_sizeof(*this) + pad_size(n + final_NUL); }
+	// Shared bytes get accounted to the strings sharing them in equal
+	// parts.
+	unsigned int MemoryAllocation() const;
 
 	// Returns new string containing the substring of this string,
 	// starting at @start >= 0 for going up to @length elements,
 	// A negative @length means "until end of string".  Other invalid
-	// values result in a return value of 0.
+	// values result in a return value of 0.  Substrings that aren't
+	// small compared to the bytes they come from share them.
 	//
 	BroString* GetSubstring(int start, int length) const;
 
@@ -144,12 +164,34 @@ public:
 	static char* VecToString(const Vec* vec);
 
 protected:
+	// Bytes that several strings refer to.
+	struct Buffer {
+		int refs;
+		u_char* bytes;
+		int size;
+		bool use_free_to_delete;	// free() vs. operator delete
+	};
+
 	void Reset();
 
+	// Moves the string's bytes into a Buffer, if they aren't yet.
+	void Share() const;
+
+	// Replaces shared bytes with a NUL-terminated copy of them.
+	void Unshare();
+
 	byte_vec b;
 	int n;
+
+	// Sharing the bytes doesn't change the string's value, so const
+	// strings can do it, too.
+	mutable Buffer* buffer;	// nil if we own b
+
+	// A NUL-terminated copy of a shared substring's bytes, made by
+	// CheckString() when needed.
+	mutable byte_vec terminated;
 	unsigned int final_NUL:1;	// whether we have added a final NUL
-	unsigned int use_free_to_delete:1;	// free() vs. operator delete
+	mutable unsigned int use_free_to_delete:1;	// free() vs. operator delete
 };
 
 // A comparison class that sorts pointers to BroString's according to
@@ -0,0 +1,1232 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <climits>
+#include <string.h>
+
+#include "Bytecode.h"
+#include "Expr.h"
+#include "Stmt.h"
+#include "Func.h"
+#include "Frame.h"
+#include "Scope.h"
+#include "Reporter.h"
+#include "Traverse.h"
+
+// Register numbering: temporaries count up from zero.  Parameters are
+// always set, so they're used in place from the frame, as -1 - offset.
+static const int NO_REG = INT_MIN;
+
+static inline bool is_temp(int r)
+	{
+	return r >= 0;
+	}
+
+static bool is_comparison(BroExprTag tag)
+	{
+	return tag == EXPR_LT || tag == EXPR_LE || tag == EXPR_EQ ||
+		tag == EXPR_NE || tag == EXPR_GE || tag == EXPR_GT;
+	}
+
+// Finds expressions that may change a local variable.
+class LocalWriteFinder : public TraversalCallback {
+public:
+	LocalWriteFinder()	{ found = false; }
+
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		switch ( e->Tag() ) {
+		case EXPR_ASSIGN:
+		case EXPR_INCR:
+		case EXPR_DECR:
+		case EXPR_ADD_TO:
+		case EXPR_REMOVE_FROM:
+			found = true;
+			return TC_ABORTALL;
+
+		default:
+			return TC_CONTINUE;
+		}
+		}
+
+	bool found;
+};
+
+static bool writes_locals(const Expr* e)
+	{
+	LocalWriteFinder finder;
+	e->Traverse(&finder);
+	return finder.found;
+	}
+
+class BytecodeCompiler {
+public:
+	BytecodeCompiler(Bytecode* arg_code)
+		{
+		code = arg_code;
+		num_temps = 0;
+		null_jumps = 0;
+		}
+
+	void CompileStmt(const Stmt* s);
+	void Finish();
+
+protected:
+	struct Loop {
+		int next;
+		std::vector<int> breaks;
+	};
+
+	int Emit(Bytecode::Opcode op, int dst = NO_REG, int a = NO_REG,
+		 int b = NO_REG, int n = 0, const BroObj* obj = 0);
+
+	int Here() const	{ return code->instructions.size(); }
+	void SetTarget(int jump, int target)
+		{ code->instructions[jump].target = target; }
+	void PatchJumps(const std::vector<int>& jumps, int target);
+
+	int NewTemp();
+	int Dst(bool want_value)	{ return want_value ? NewTemp() : NO_REG; }
+
+	// Evaluates an expression for its side effects.
+	void CompileEffect(const Expr* e);
+
+	// Evaluates an expression into a register, falling back to the
+	// interpreter if necessary.  Sets may_be_null if the result
+	// can come out nil.
+	int CompileExpr(const Expr* e, bool* may_be_null);
+
+	// Same, but leaves the value's register non-nil, bailing out
+	// through null_jumps otherwise.
+	int CompileOperand(const Expr* e);
+
+	// Jumps through false_jumps if the condition doesn't hold.
+	void CompileCondition(const Expr* e, std::vector<int>* false_jumps);
+
+	// These return false if the expression has no bytecode equivalent.
+	bool CompileNative(const Expr* e, bool want_value, int* result,
+			   bool* may_be_null);
+	bool CompileName(const NameExpr* e, bool want_value, int* result);
+	bool CompileUnary(const UnaryExpr* e, bool want_value, int* result,
+			  bool* may_be_null);
+	bool CompileBinary(const BinaryExpr* e, bool want_value, int* result,
+			   bool* may_be_null);
+	bool CompileBool(const BinaryExpr* e, bool want_value, int* result,
+			 bool* may_be_null);
+	bool CompileList(const ListExpr* e, bool want_value, int* result,
+			 bool* may_be_null);
+	bool CompileCall(const CallExpr* e, bool want_value, int* result,
+			 bool* may_be_null);
+	bool CompileIncr(const UnaryExpr* e, bool want_value, int* result);
+	bool CompileAssign(const AssignExpr* e);
+
+	// Loads the first operand of a binary operator; copies it if
+	// evaluating the second one may change it in place.
+	int CompileFirstOperand(const BinaryExpr* e);
+
+	void AddFallback()	{ ++code->num_fallbacks; }
+
+	Bytecode* code;
+	int num_temps;	// temporaries used by the current statement
+
+	// Where to record jumps to take when a value unexpectedly comes
+	// out nil, which aborts the current statement or list.
+	std::vector<int>* null_jumps;
+
+	std::vector<Loop*> loops;
+};
+
+int BytecodeCompiler::Emit(Bytecode::Opcode op, int dst, int a, int b, int n,
+				const BroObj* obj)
+	{
+	Bytecode::Instruction i;
+	i.op = op;
+	i.dst = dst;
+	i.a = a;
+	i.b = b;
+	i.n = n;
+	i.target = -1;
+	i.obj = obj;
+
+	code->instructions.push_back(i);
+	return code->instructions.size() - 1;
+	}
+
+void BytecodeCompiler::PatchJumps(const std::vector<int>& jumps, int target)
+	{
+	for ( size_t i = 0; i < jumps.size(); ++i )
+		SetTarget(jumps[i], target);
+	}
+
+int BytecodeCompiler::NewTemp()
+	{
+	int r = num_temps++;
+
+	if ( num_temps > code->num_regs )
+		code->num_regs = num_temps;
+
+	return r;
+	}
+
+void BytecodeCompiler::CompileStmt(const Stmt* s)
+	{
+	// No values stay in temporaries from one statement to the next.
+	num_temps = 0;
+	null_jumps = 0;
+
+	std::vector<int> nulls;
+
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		{
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+
+		const stmt_list& stmts = s->AsStmtList()->Stmts();
+		loop_over_list(stmts, i)
+			CompileStmt(stmts[i]);
+		break;
+		}
+
+	case STMT_EXPR:
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+		null_jumps = &nulls;
+		CompileEffect(((const ExprStmt*) s)->StmtExpr());
+		PatchJumps(nulls, Here());
+		break;
+
+	case STMT_IF:
+		{
+		const IfStmt* is = (const IfStmt*) s;
+		std::vector<int> falses;
+
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+		null_jumps = &nulls;
+		CompileCondition(is->StmtExpr(), &falses);
+
+		CompileStmt(is->TrueBranch());
+
+		if ( is->FalseBranch() )
+			{
+			int skip = Emit(Bytecode::BC_JUMP);
+			PatchJumps(falses, Here());
+			CompileStmt(is->FalseBranch());
+			SetTarget(skip, Here());
+			}
+		else
+			PatchJumps(falses, Here());
+
+		// A nil condition executes neither branch.
+		PatchJumps(nulls, Here());
+		break;
+		}
+
+	case STMT_WHILE:
+		{
+		const WhileStmt* ws = (const WhileStmt*) s;
+		std::vector<int> falses;
+		Loop loop;
+
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+		loop.next = Here();
+		null_jumps = &nulls;
+		CompileCondition(ws->Condition(), &falses);
+
+		loops.push_back(&loop);
+		CompileStmt(ws->Body());
+		loops.pop_back();
+
+		Emit(Bytecode::BC_JUMP);
+		SetTarget(Here() - 1, loop.next);
+
+		PatchJumps(falses, Here());
+		PatchJumps(nulls, Here());
+		PatchJumps(loop.breaks, Here());
+		break;
+		}
+
+	case STMT_RETURN:
+		{
+		const Expr* e = ((const ReturnStmt*) s)->StmtExpr();
+
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+
+		if ( ! e )
+			{
+			Emit(Bytecode::BC_RETURN);
+			break;
+			}
+
+		bool may_be_null;
+		null_jumps = &nulls;
+		Emit(Bytecode::BC_RETURN, NO_REG, CompileExpr(e, &may_be_null));
+
+		if ( nulls.size() )
+			{
+			PatchJumps(nulls, Here());
+			Emit(Bytecode::BC_RETURN);
+			}
+
+		break;
+		}
+
+	case STMT_NEXT:
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+
+		if ( loops.size() )
+			SetTarget(Emit(Bytecode::BC_JUMP), loops.back()->next);
+		else
+			Emit(Bytecode::BC_EXIT, NO_REG, NO_REG, NO_REG, FLOW_LOOP);
+		break;
+
+	case STMT_BREAK:
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+
+		if ( loops.size() )
+			loops.back()->breaks.push_back(Emit(Bytecode::BC_JUMP));
+		else
+			Emit(Bytecode::BC_EXIT, NO_REG, NO_REG, NO_REG, FLOW_BREAK);
+		break;
+
+	case STMT_NULL:
+		Emit(Bytecode::BC_STMT, NO_REG, NO_REG, NO_REG, 0, s);
+		break;
+
+	default:
+		{
+		// Everything else (loops over containers, switches, when,
+		// print, event, add, delete, ...) is interpreted.  If the
+		// statement breaks out of or continues one of our loops, the
+		// VM follows the jumps recorded here.
+		int next = loops.size() ? loops.back()->next : -1;
+		int i = Emit(Bytecode::BC_EXEC, NO_REG, NO_REG, NO_REG, next, s);
+
+		if ( loops.size() )
+			loops.back()->breaks.push_back(i);
+
+		AddFallback();
+		break;
+		}
+	}
+
+	null_jumps = 0;
+	}
+
+void BytecodeCompiler::Finish()
+	{
+	Emit(Bytecode::BC_EXIT, NO_REG, NO_REG, NO_REG, FLOW_NEXT);
+	}
+
+void BytecodeCompiler::CompileEffect(const Expr* e)
+	{
+	int result;
+	bool may_be_null;
+
+	if ( e->Tag() == EXPR_ASSIGN && ! e->IsError() &&
+	     CompileAssign(e->AsAssignExpr()) )
+		return;
+
+	if ( CompileNative(e, false, &result, &may_be_null) )
+		return;
+
+	Emit(Bytecode::BC_EVAL, NO_REG, NO_REG, NO_REG, 0, e);
+	AddFallback();
+	}
+
+int BytecodeCompiler::CompileExpr(const Expr* e, bool* may_be_null)
+	{
+	int result;
+
+	if ( CompileNative(e, true, &result, may_be_null) )
+		return result;
+
+	result = NewTemp();
+	Emit(Bytecode::BC_EVAL, result, NO_REG, NO_REG, 0, e);
+	AddFallback();
+
+	*may_be_null = true;
+	return result;
+	}
+
+int BytecodeCompiler::CompileOperand(const Expr* e)
+	{
+	bool may_be_null;
+	int r = CompileExpr(e, &may_be_null);
+
+	if ( may_be_null )
+		null_jumps->push_back(Emit(Bytecode::BC_JUMP_IF_NULL, NO_REG, r));
+
+	return r;
+	}
+
+int BytecodeCompiler::CompileFirstOperand(const BinaryExpr* e)
+	{
+	int a = CompileOperand(e->Op1());
+
+	if ( ! is_temp(a) && writes_locals(e->Op2()) )
+		{
+		int t = NewTemp();
+		Emit(Bytecode::BC_MOVE, t, a);
+		a = t;
+		}
+
+	return a;
+	}
+
+void BytecodeCompiler::CompileCondition(const Expr* e,
+					std::vector<int>* false_jumps)
+	{
+	BroExprTag tag = e->Tag();
+
+	if ( (tag == EXPR_AND || tag == EXPR_OR) && ! e->IsError() &&
+	     e->Type()->Tag() == TYPE_BOOL )
+		{
+		const BinaryExpr* be = (const BinaryExpr*) e;
+
+		if ( ! IsVector(be->Op1()->Type()->Tag()) &&
+		     ! IsVector(be->Op2()->Type()->Tag()) )
+			{
+			if ( tag == EXPR_AND )
+				{
+				CompileCondition(be->Op1(), false_jumps);
+				CompileCondition(be->Op2(), false_jumps);
+				return;
+				}
+
+			std::vector<int> first_false;
+			CompileCondition(be->Op1(), &first_false);
+			int is_true = Emit(Bytecode::BC_JUMP);
+			PatchJumps(first_false, Here());
+			CompileCondition(be->Op2(), false_jumps);
+			SetTarget(is_true, Here());
+			return;
+			}
+		}
+
+	if ( is_comparison(tag) && ! e->IsError() )
+		{
+		const BinaryExpr* be = (const BinaryExpr*) e;
+		InternalTypeTag it = be->ScalarType();
+
+		if ( it != TYPE_INTERNAL_VOID )
+			{
+			int a = CompileFirstOperand(be);
+			int b = CompileOperand(be->Op2());
+
+			Bytecode::Opcode op =
+				it == TYPE_INTERNAL_INT ? Bytecode::BC_INT_CMP_BRANCH :
+				it == TYPE_INTERNAL_UNSIGNED ? Bytecode::BC_UINT_CMP_BRANCH :
+					Bytecode::BC_DOUBLE_CMP_BRANCH;
+
+			false_jumps->push_back(Emit(op, NO_REG, a, b, tag, e));
+			return;
+			}
+		}
+
+	int r = CompileOperand(e);
+	false_jumps->push_back(Emit(Bytecode::BC_BRANCH_IF_ZERO, NO_REG, r));
+	}
+
+bool BytecodeCompiler::CompileNative(const Expr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	*may_be_null = false;
+
+	if ( e->IsError() )
+		return false;
+
+	switch ( e->Tag() ) {
+	case EXPR_CONST:
+		*result = Dst(want_value);
+		Emit(Bytecode::BC_CONST, *result, NO_REG, NO_REG, 0,
+		     ((const ConstExpr*) e)->Value());
+		return true;
+
+	case EXPR_NAME:
+		return CompileName(e->AsNameExpr(), want_value, result);
+
+	case EXPR_NOT:
+	case EXPR_NEGATE:
+	case EXPR_POSITIVE:
+	case EXPR_FIELD:
+	case EXPR_HAS_FIELD:
+	case EXPR_ARITH_COERCE:
+		return CompileUnary((const UnaryExpr*) e, want_value, result,
+				    may_be_null);
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+	case EXPR_IN:
+	case EXPR_INDEX:
+		return CompileBinary((const BinaryExpr*) e, want_value, result,
+				     may_be_null);
+
+	case EXPR_AND:
+	case EXPR_OR:
+		return CompileBool((const BinaryExpr*) e, want_value, result,
+				   may_be_null);
+
+	case EXPR_LIST:
+		return CompileList(e->AsListExpr(), want_value, result,
+				   may_be_null);
+
+	case EXPR_CALL:
+		return CompileCall((const CallExpr*) e, want_value, result,
+				   may_be_null);
+
+	case EXPR_INCR:
+	case EXPR_DECR:
+		return CompileIncr((const UnaryExpr*) e, want_value, result);
+
+	default:
+		return false;
+	}
+	}
+
+bool BytecodeCompiler::CompileName(const NameExpr* e, bool want_value,
+					int* result)
+	{
+	const ID* id = e->Id();
+
+	if ( id->AsType() )
+		return false;
+
+	if ( id->IsGlobal() )
+		{
+		*result = Dst(want_value);
+		null_jumps->push_back(Emit(Bytecode::BC_LOAD_GLOBAL, *result,
+					   NO_REG, NO_REG, 0, e));
+		}
+
+	else if ( id->Offset() < code->num_params )
+		*result = want_value ? -1 - id->Offset() : NO_REG;
+
+	else
+		{
+		*result = Dst(want_value);
+		null_jumps->push_back(Emit(Bytecode::BC_LOAD_LOCAL, *result,
+					   NO_REG, NO_REG, id->Offset(), e));
+		}
+
+	return true;
+	}
+
+bool BytecodeCompiler::CompileUnary(const UnaryExpr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	int a = CompileOperand(e->Op());
+
+	*result = want_value ? (is_temp(a) ? a : NewTemp()) : NO_REG;
+	Emit(Bytecode::BC_UNARY, *result, a, NO_REG, 0, e);
+
+	// A missing field may come out of a &default expression.
+	*may_be_null = (e->Tag() == EXPR_FIELD);
+	return true;
+	}
+
+bool BytecodeCompiler::CompileBinary(const BinaryExpr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	int a = CompileFirstOperand(e);
+	int b = CompileOperand(e->Op2());
+
+	if ( ! want_value )
+		*result = NO_REG;
+	else if ( is_temp(a) )
+		*result = a;
+	else if ( is_temp(b) )
+		*result = b;
+	else
+		*result = NewTemp();
+
+	Bytecode::Opcode op =
+		e->Tag() == EXPR_INDEX ? Bytecode::BC_INDEX : Bytecode::BC_BINARY;
+
+	bool is_cmp = is_comparison(e->Tag());
+
+	switch ( e->ScalarType() ) {
+	case TYPE_INTERNAL_INT:
+		op = is_cmp ? Bytecode::BC_INT_CMP : Bytecode::BC_INT_ARITH;
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		op = is_cmp ? Bytecode::BC_UINT_CMP : Bytecode::BC_UINT_ARITH;
+		break;
+
+	case TYPE_INTERNAL_DOUBLE:
+		op = is_cmp ? Bytecode::BC_DOUBLE_CMP : Bytecode::BC_DOUBLE_ARITH;
+		break;
+
+	default:
+		// Folding element-wise over vectors of different size, or
+		// indexing, may fail without raising an exception.
+		*may_be_null = true;
+		break;
+	}
+
+	Emit(op, *result, a, b, e->Tag(), e);
+	return true;
+	}
+
+bool BytecodeCompiler::CompileBool(const BinaryExpr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	// Vector and pattern operands don't short-circuit.
+	if ( e->Type()->Tag() != TYPE_BOOL ||
+	     IsVector(e->Op1()->Type()->Tag()) ||
+	     IsVector(e->Op2()->Type()->Tag()) )
+		return false;
+
+	int r = CompileOperand(e->Op1());
+
+	if ( ! is_temp(r) )
+		{
+		int t = NewTemp();
+		Emit(Bytecode::BC_MOVE, t, r);
+		r = t;
+		}
+
+	int done = Emit(e->Tag() == EXPR_AND ?
+				Bytecode::BC_JUMP_IF_ZERO :
+				Bytecode::BC_JUMP_IF_NOT_ZERO,
+			NO_REG, r);
+
+	int r2 = CompileExpr(e->Op2(), may_be_null);
+
+	if ( r2 != r )
+		Emit(Bytecode::BC_MOVE, r, r2);
+
+	SetTarget(done, Here());
+
+	*result = want_value ? r : NO_REG;
+	return true;
+	}
+
+bool BytecodeCompiler::CompileList(const ListExpr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	const expr_list& exprs = e->Exprs();
+	int base = num_temps;
+
+	for ( int i = 0; i < exprs.length(); ++i )
+		NewTemp();
+
+	// A nil element fails the list rather than the statement.
+	std::vector<int> nulls;
+	std::vector<int>* outer_nulls = null_jumps;
+	null_jumps = &nulls;
+
+	loop_over_list(exprs, i)
+		{
+		int r = CompileOperand(exprs[i]);
+
+		if ( r != base + i )
+			Emit(Bytecode::BC_MOVE, base + i, r);
+		}
+
+	null_jumps = outer_nulls;
+
+	*result = Dst(want_value);
+	Emit(Bytecode::BC_LIST, *result, base, NO_REG, exprs.length(), e);
+
+	if ( nulls.size() )
+		{
+		int skip = Emit(Bytecode::BC_JUMP);
+		PatchJumps(nulls, Here());
+		Emit(Bytecode::BC_LIST_ERROR, *result, NO_REG, NO_REG, 0, e);
+		SetTarget(skip, Here());
+		*may_be_null = true;
+		}
+
+	return true;
+	}
+
+bool BytecodeCompiler::CompileCall(const CallExpr* e, bool want_value,
+					int* result, bool* may_be_null)
+	{
+	// We only call functions by their global name.  Such a global
+	// always has a value, so looking it up can't fail.
+	const Expr* func = e->Func();
+
+	if ( func->Tag() != EXPR_NAME )
+		return false;
+
+	// Calls that the script optimizer inlined are cheaper to leave
+	// to CallExpr::Eval().
+	if ( e->InlineBody() )
+		return false;
+
+	const ID* id = func->AsNameExpr()->Id();
+
+	if ( ! id->IsGlobal() || ! id->HasVal() || id->AsType() )
+		return false;
+
+	*result = Dst(want_value);
+	int cached = Emit(Bytecode::BC_CALL_CACHED, *result, NO_REG, NO_REG,
+			  0, e);
+
+	int f = NewTemp();
+	null_jumps->push_back(Emit(Bytecode::BC_LOAD_GLOBAL, f, NO_REG, NO_REG,
+				   0, func));
+
+	const expr_list& args = e->Args()->Exprs();
+	int base = num_temps;
+
+	for ( int i = 0; i < args.length(); ++i )
+		NewTemp();
+
+	loop_over_list(args, i)
+		{
+		int r = CompileOperand(args[i]);
+
+		if ( r != base + i )
+			Emit(Bytecode::BC_MOVE, base + i, r);
+		}
+
+	Emit(Bytecode::BC_CALL, *result, f, base, args.length(), e);
+	SetTarget(cached, Here());
+
+	// Void functions and delayed calls return nil.
+	*may_be_null = true;
+	return true;
+	}
+
+bool BytecodeCompiler::CompileIncr(const UnaryExpr* e, bool want_value,
+					int* result)
+	{
+	// The operand is a reference to the variable.
+	const Expr* op = e->Op();
+
+	if ( op->Tag() != EXPR_REF || IsVector(op->Type()->Tag()) )
+		return false;
+
+	const Expr* var = ((const UnaryExpr*) op)->Op();
+
+	if ( var->Tag() != EXPR_NAME || var->AsNameExpr()->Id()->IsGlobal() )
+		return false;
+
+	int a = CompileOperand(var);
+
+	*result = Dst(want_value);
+	Emit(Bytecode::BC_INCR, *result, a, NO_REG,
+	     var->AsNameExpr()->Id()->Offset(), e);
+
+	return true;
+	}
+
+bool BytecodeCompiler::CompileAssign(const AssignExpr* e)
+	{
+	if ( e->IsInit() )
+		return false;
+
+	const Expr* lhs = e->Op1();
+	int a = CompileOperand(e->Op2());
+
+	if ( lhs->Tag() == EXPR_REF )
+		{
+		const Expr* var = ((const UnaryExpr*) lhs)->Op();
+
+		if ( var->Tag() == EXPR_NAME &&
+		     ! var->AsNameExpr()->Id()->IsGlobal() )
+			{
+			Emit(Bytecode::BC_STORE_LOCAL, NO_REG, a, NO_REG,
+			     var->AsNameExpr()->Id()->Offset(), e);
+			return true;
+			}
+		}
+
+	Emit(Bytecode::BC_ASSIGN, NO_REG, a, NO_REG, 0, lhs);
+	return true;
+	}
+
+Bytecode::Bytecode(const BroFunc* func, const Stmt* arg_body)
+	{
+	body = arg_body;
+	num_params = func->FType()->Args()->NumFields();
+	num_regs = 0;
+	num_fallbacks = 0;
+
+	BytecodeCompiler compiler(this);
+	compiler.CompileStmt(body);
+	compiler.Finish();
+	}
+
+Bytecode::~Bytecode()
+	{
+	}
+
+// The temporaries of one execution.  Instructions take ownership of the
+// values in their operand registers, or release them when done.
+class Registers {
+public:
+	Registers(Frame* arg_f, int n)
+		{
+		f = arg_f;
+		num = n;
+		regs = n <= MAX_STACK_REGS ? stack_regs : new Val*[n];
+		memset(regs, 0, n * sizeof(Val*));
+		}
+
+	~Registers()
+		{
+		for ( int i = 0; i < num; ++i )
+			Unref(regs[i]);
+
+		if ( regs != stack_regs )
+			delete [] regs;
+		}
+
+	Val* Get(int r) const
+		{ return is_temp(r) ? regs[r] : f->NthElement(-1 - r); }
+
+	Val* Take(int r)
+		{
+		if ( ! is_temp(r) )
+			return r == NO_REG ? 0 : f->NthElement(-1 - r)->Ref();
+
+		Val* v = regs[r];
+		regs[r] = 0;
+		return v;
+		}
+
+	void Release(int r)
+		{
+		if ( is_temp(r) )
+			{
+			Unref(regs[r]);
+			regs[r] = 0;
+			}
+		}
+
+	// Setting NO_REG discards the value.
+	void Set(int r, Val* v)
+		{
+		if ( is_temp(r) )
+			{
+			Unref(regs[r]);
+			regs[r] = v;
+			}
+		else
+			Unref(v);
+		}
+
+private:
+	static const int MAX_STACK_REGS = 32;
+
+	Frame* f;
+	Val** regs;
+	int num;
+	Val* stack_regs[MAX_STACK_REGS];
+};
+
+template<typename T>
+static inline T int_arith(const Bytecode::Instruction& i, T x, T y)
+	{
+	switch ( i.n ) {
+	case EXPR_ADD:	return x + y;
+	case EXPR_SUB:	return x - y;
+	case EXPR_TIMES:	return x * y;
+
+	case EXPR_DIVIDE:
+		if ( y == 0 )
+			reporter->ExprRuntimeError((const Expr*) i.obj,
+						   "division by zero");
+		return x / y;
+
+	case EXPR_MOD:
+		if ( y == 0 )
+			reporter->ExprRuntimeError((const Expr*) i.obj,
+						   "modulo by zero");
+		return x % y;
+
+	default:
+		reporter->InternalError("bad bytecode arithmetic");
+		return 0;
+	}
+	}
+
+static inline double double_arith(const Bytecode::Instruction& i,
+				   double x, double y)
+	{
+	switch ( i.n ) {
+	case EXPR_ADD:	return x + y;
+	case EXPR_SUB:	return x - y;
+	case EXPR_TIMES:	return x * y;
+
+	case EXPR_DIVIDE:
+		if ( y == 0 )
+			reporter->ExprRuntimeError((const Expr*) i.obj,
+						   "division by zero");
+		return x / y;
+
+	default:
+		reporter->InternalError("bad bytecode arithmetic");
+		return 0;
+	}
+	}
+
+template<typename T>
+static inline bool compare(int tag, T x, T y)
+	{
+	switch ( tag ) {
+	case EXPR_LT:	return x < y;
+	case EXPR_LE:	return x <= y;
+	case EXPR_EQ:	return x == y;
+	case EXPR_NE:	return x != y;
+	case EXPR_GE:	return x >= y;
+	case EXPR_GT:	return x > y;
+
+	default:
+		reporter->InternalError("bad bytecode comparison");
+		return false;
+	}
+	}
+
+Val* Bytecode::Exec(Frame* f, stmt_flow_type& flow) const
+	{
+	// Parameters are used in place; should one be missing, leave the
+	// body to the interpreter.
+	for ( int i = 0; i < num_params; ++i )
+		if ( ! f->NthElement(i) )
+			return body->Exec(f, flow);
+
+	Registers r(f, num_regs);
+	const Instruction* code = &instructions[0];
+	int pc = 0;
+
+	flow = FLOW_NEXT;
+
+	for ( ; ; )
+		{
+		const Instruction& i = code[pc++];
+
+		switch ( i.op ) {
+		case BC_STMT:
+			((const Stmt*) i.obj)->RegisterAccess();
+			break;
+
+		case BC_CONST:
+			r.Set(i.dst, ((Val*) i.obj)->Ref());
+			break;
+
+		case BC_LOAD_LOCAL:
+			{
+			Val* v = f->NthElement(i.n);
+
+			if ( ! v )
+				{
+				i.obj->Error("value used but not set");
+				pc = i.target;
+				break;
+				}
+
+			r.Set(i.dst, v->Ref());
+			break;
+			}
+
+		case BC_LOAD_GLOBAL:
+			{
+			Val* v = ((const NameExpr*) i.obj)->Id()->ID_Val();
+
+			if ( ! v )
+				{
+				i.obj->Error("value used but not set");
+				pc = i.target;
+				break;
+				}
+
+			r.Set(i.dst, v->Ref());
+			break;
+			}
+
+		case BC_MOVE:
+			r.Set(i.dst, r.Take(i.a));
+			break;
+
+		case BC_STORE_LOCAL:
+			f->SetElement(i.n, r.Take(i.a));
+			break;
+
+		case BC_ASSIGN:
+			((Expr*) i.obj)->Assign(f, r.Take(i.a));
+			break;
+
+		case BC_INCR:
+			{
+			Val* v = ((const IncrExpr*) i.obj)->DoSingleEval(f, r.Get(i.a));
+			r.Release(i.a);
+			f->SetElement(i.n, v);
+
+			if ( is_temp(i.dst) )
+				r.Set(i.dst, v->Ref());
+			break;
+			}
+
+		case BC_EVAL:
+			r.Set(i.dst, ((const Expr*) i.obj)->Eval(f));
+
+			if ( f->HasDelayed() )
+				return 0;
+			break;
+
+		case BC_UNARY:
+			r.Set(i.dst, ((const UnaryExpr*) i.obj)->EvalOperand(r.Take(i.a)));
+			break;
+
+		case BC_BINARY:
+			{
+			Val* v1 = r.Take(i.a);
+			Val* v2 = r.Take(i.b);
+			r.Set(i.dst, ((const BinaryExpr*) i.obj)->EvalOperands(v1, v2));
+			break;
+			}
+
+		case BC_INDEX:
+			{
+			Val* v1 = r.Take(i.a);
+			Val* v2 = r.Take(i.b);
+			r.Set(i.dst, ((const IndexExpr*) i.obj)->EvalOperands(v1, v2));
+			break;
+			}
+
+		case BC_INT_ARITH:
+			{
+			BroValUnion v;
+			v.int_val = int_arith(i, r.Get(i.a)->ForceAsInt(),
+					      r.Get(i.b)->ForceAsInt());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, ((const BinaryExpr*) i.obj)->BoxScalar(v));
+			break;
+			}
+
+		case BC_UINT_ARITH:
+			{
+			BroValUnion v;
+			v.uint_val = int_arith(i, r.Get(i.a)->ForceAsUInt(),
+					       r.Get(i.b)->ForceAsUInt());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, ((const BinaryExpr*) i.obj)->BoxScalar(v));
+			break;
+			}
+
+		case BC_DOUBLE_ARITH:
+			{
+			BroValUnion v;
+			v.double_val = double_arith(i, r.Get(i.a)->ForceAsDouble(),
+						    r.Get(i.b)->ForceAsDouble());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, ((const BinaryExpr*) i.obj)->BoxScalar(v));
+			break;
+			}
+
+		case BC_INT_CMP:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsInt(),
+					 r.Get(i.b)->ForceAsInt());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, val_mgr->GetBool(v));
+			break;
+			}
+
+		case BC_UINT_CMP:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsUInt(),
+					 r.Get(i.b)->ForceAsUInt());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, val_mgr->GetBool(v));
+			break;
+			}
+
+		case BC_DOUBLE_CMP:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsDouble(),
+					 r.Get(i.b)->ForceAsDouble());
+			r.Release(i.a);
+			r.Release(i.b);
+			r.Set(i.dst, val_mgr->GetBool(v));
+			break;
+			}
+
+		case BC_INT_CMP_BRANCH:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsInt(),
+					 r.Get(i.b)->ForceAsInt());
+			r.Release(i.a);
+			r.Release(i.b);
+
+			if ( ! v )
+				pc = i.target;
+			break;
+			}
+
+		case BC_UINT_CMP_BRANCH:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsUInt(),
+					 r.Get(i.b)->ForceAsUInt());
+			r.Release(i.a);
+			r.Release(i.b);
+
+			if ( ! v )
+				pc = i.target;
+			break;
+			}
+
+		case BC_DOUBLE_CMP_BRANCH:
+			{
+			bool v = compare(i.n, r.Get(i.a)->ForceAsDouble(),
+					 r.Get(i.b)->ForceAsDouble());
+			r.Release(i.a);
+			r.Release(i.b);
+
+			if ( ! v )
+				pc = i.target;
+			break;
+			}
+
+		case BC_LIST:
+			{
+			ListVal* l = new ListVal(TYPE_ANY);
+
+			for ( int k = 0; k < i.n; ++k )
+				l->Append(r.Take(i.a + k));
+
+			r.Set(i.dst, l);
+			break;
+			}
+
+		case BC_LIST_ERROR:
+			i.obj->Error("uninitialized list value");
+			r.Set(i.dst, 0);
+			break;
+
+		case BC_CALL_CACHED:
+			{
+			if ( ! f->GetTrigger() )
+				break;
+
+			Val* v = ((const CallExpr*) i.obj)->CachedResult(f);
+
+			if ( v )
+				{
+				r.Set(i.dst, v);
+				pc = i.target;
+				}
+			break;
+			}
+
+		case BC_CALL:
+			{
+			val_list* args = new val_list(i.n);
+
+			for ( int k = 0; k < i.n; ++k )
+				args->append(r.Take(i.b + k));
+
+			Val* v = ((const CallExpr*) i.obj)->Invoke(r.Get(i.a)->AsFunc(), args, f);
+			r.Release(i.a);
+			r.Set(i.dst, v);
+
+			// A delayed call ends the body's execution.
+			if ( f->HasDelayed() )
+				return 0;
+			break;
+			}
+
+		case BC_JUMP:
+			pc = i.target;
+			break;
+
+		case BC_JUMP_IF_NULL:
+			if ( ! r.Get(i.a) )
+				pc = i.target;
+			break;
+
+		case BC_JUMP_IF_ZERO:
+			if ( r.Get(i.a)->IsZero() )
+				pc = i.target;
+			break;
+
+		case BC_JUMP_IF_NOT_ZERO:
+			if ( ! r.Get(i.a)->IsZero() )
+				pc = i.target;
+			break;
+
+		case BC_BRANCH_IF_ZERO:
+			{
+			bool zero = r.Get(i.a)->IsZero();
+			r.Release(i.a);
+
+			if ( zero )
+				pc = i.target;
+			break;
+			}
+
+		case BC_EXEC:
+			{
+			Val* v = ((const Stmt*) i.obj)->Exec(f, flow);
+
+			if ( flow == FLOW_NEXT && ! v && ! f->HasDelayed() )
+				break;
+
+			if ( v || flow == FLOW_RETURN || f->HasDelayed() )
+				return v;
+
+			// Break out of, or continue, the enclosing loop.
+			if ( flow == FLOW_BREAK && i.target >= 0 )
+				{
+				flow = FLOW_NEXT;
+				pc = i.target;
+				break;
+				}
+
+			if ( flow == FLOW_LOOP && i.n >= 0 )
+				{
+				flow = FLOW_NEXT;
+				pc = i.n;
+				break;
+				}
+
+			return 0;
+			}
+
+		case BC_RETURN:
+			flow = FLOW_RETURN;
+			return r.Take(i.a);
+
+		case BC_EXIT:
+			flow = (stmt_flow_type) i.n;
+			return 0;
+		}
+		}
+	}
+
+void compile_script_functions()
+	{
+	PDict(ID)* globals = global_scope()->Vars();
+	IterCookie* c = globals->InitForIteration();
+	ID* id;
+
+	while ( (id = globals->NextEntry(c)) )
+		{
+		if ( ! id->HasVal() || id->Type()->Tag() != TYPE_FUNC )
+			continue;
+
+		Func* func = id->ID_Val()->AsFunc();
+
+		if ( func->GetKind() == Func::BRO_FUNC )
+			((BroFunc*) func)->Compile();
+		}
+	}
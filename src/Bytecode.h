@@ -0,0 +1,96 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// An alternative execution engine for script functions: function and event
+// bodies are lowered to a compact register-based bytecode that a single
+// dispatch loop executes, instead of walking the statement and expression
+// trees.
+
+#ifndef bytecode_h
+#define bytecode_h
+
+#include <vector>
+
+#include "StmtEnums.h"
+#include "Type.h"
+
+class BroFunc;
+class BroObj;
+class Frame;
+class Stmt;
+class Val;
+
+class Bytecode {
+public:
+	// Compiles the given body of the function.  This can't fail:
+	// statements and expressions without a bytecode equivalent are
+	// executed by handing them back to the AST interpreter.
+	Bytecode(const BroFunc* func, const Stmt* body);
+	~Bytecode();
+
+	// Same interface and semantics as body->Exec().
+	Val* Exec(Frame* f, stmt_flow_type& flow) const;
+
+	int NumInstructions() const	{ return instructions.size(); }
+
+	// Number of statements and expressions left to the interpreter.
+	int NumFallbacks() const	{ return num_fallbacks; }
+
+	enum Opcode {
+		BC_STMT,	// record execution of statement obj
+		BC_CONST,	// dst = constant obj
+		BC_LOAD_LOCAL,	// dst = frame[n], else error & jump to target
+		BC_LOAD_GLOBAL,	// dst = value of name obj, same
+		BC_MOVE,	// dst = a
+		BC_STORE_LOCAL,	// frame[n] = a
+		BC_ASSIGN,	// assign a to lvalue obj
+		BC_INCR,	// frame[n] = ++/-- a (per obj); dst = result
+		BC_EVAL,	// dst = obj->Eval()
+		BC_UNARY,	// dst = obj->EvalOperand(a)
+		BC_BINARY,	// dst = obj->EvalOperands(a, b)
+		BC_INDEX,	// same, for index expressions
+		BC_INT_ARITH,	// dst = a <n> b, per binary expression obj
+		BC_UINT_ARITH,
+		BC_DOUBLE_ARITH,
+		BC_INT_CMP,	// dst = a <n> b, as bool
+		BC_UINT_CMP,
+		BC_DOUBLE_CMP,
+		BC_INT_CMP_BRANCH,	// if ( ! (a <n> b) ) jump to target
+		BC_UINT_CMP_BRANCH,
+		BC_DOUBLE_CMP_BRANCH,
+		BC_LIST,	// dst = list of n values starting at a
+		BC_LIST_ERROR,	// report list obj incomplete; dst = nil
+		BC_CALL_CACHED,	// dst = trigger's result for call obj & jump
+		BC_CALL,	// dst = a(n arguments starting at b)
+		BC_JUMP,	// jump to target
+		BC_JUMP_IF_NULL,	// if ( ! a ) jump to target
+		BC_JUMP_IF_ZERO,	// if ( a is zero ) jump to target
+		BC_JUMP_IF_NOT_ZERO,	// if ( a isn't zero ) jump to target
+		BC_BRANCH_IF_ZERO,	// same, but releases a
+		BC_EXEC,	// interpret statement obj
+		BC_RETURN,	// return a with FLOW_RETURN
+		BC_EXIT,	// return nil with flow n
+	};
+
+	struct Instruction {
+		Opcode op;
+		int dst;	// destination register
+		int a, b;	// operand registers
+		int n;		// frame offset, count, tag, or flow
+		int target;	// jump target
+		const BroObj* obj;	// associated AST node or constant
+	};
+
+protected:
+	friend class BytecodeCompiler;
+
+	const Stmt* body;
+	std::vector<Instruction> instructions;
+	int num_params;
+	int num_regs;
+	int num_fallbacks;
+};
+
+// Compiles the bodies of all script functions, events, and hooks.
+extern void compile_script_functions();
+
+#endif
@@ -686,6 +686,8 @@ const char* CompositeHash::RecoverOneVal(const HashKey* k, const char* kp0,
 
 		if ( tag == TYPE_ENUM )
 			pval = new EnumVal(*kp, t->AsEnumType());
+		else if ( tag == TYPE_BOOL )
+			pval = val_mgr->GetBool(*kp);
 		else
 			pval = new Val(*kp, tag);
 		}
@@ -698,12 +700,15 @@ const char* CompositeHash::RecoverOneVal(const HashKey* k, const char* kp0,
 
 		switch ( tag ) {
 		case TYPE_COUNT:
+			pval = val_mgr->GetCount(*kp);
+			break;
+
 		case TYPE_COUNTER:
 			pval = new Val(*kp, tag);
 			break;
 
 		case TYPE_PORT:
-			pval = new PortVal(*kp);
+			pval = val_mgr->GetPort(*kp);
 			break;
 
 		default:
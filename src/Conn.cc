@@ -353,20 +353,20 @@ RecordVal* Connection::BuildConnVal()
 		TransportProto prot_type = ConnTransport();
 
 		RecordVal* id_val = new RecordVal(conn_id);
-		id_val->Assign(0, new AddrVal(orig_addr));
-		id_val->Assign(1, new PortVal(ntohs(orig_port), prot_type));
-		id_val->Assign(2, new AddrVal(resp_addr));
-		id_val->Assign(3, new PortVal(ntohs(resp_port), prot_type));
+		id_val->AssignAddr(0, orig_addr);
+		id_val->AssignUnsigned(1, PortVal::Mask(ntohs(orig_port), prot_type));
+		id_val->AssignAddr(2, resp_addr);
+		id_val->AssignUnsigned(3, PortVal::Mask(ntohs(resp_port), prot_type));
 
 		RecordVal *orig_endp = new RecordVal(endpoint);
-		orig_endp->Assign(0, new Val(0, TYPE_COUNT));
-		orig_endp->Assign(1, new Val(0, TYPE_COUNT));
-		orig_endp->Assign(4, new Val(orig_flow_label, TYPE_COUNT));
+		orig_endp->AssignUnsigned(0, 0);
+		orig_endp->AssignUnsigned(1, 0);
+		orig_endp->AssignUnsigned(4, orig_flow_label);
 
 		RecordVal *resp_endp = new RecordVal(endpoint);
-		resp_endp->Assign(0, new Val(0, TYPE_COUNT));
-		resp_endp->Assign(1, new Val(0, TYPE_COUNT));
-		resp_endp->Assign(4, new Val(resp_flow_label, TYPE_COUNT));
+		resp_endp->AssignUnsigned(0, 0);
+		resp_endp->AssignUnsigned(1, 0);
+		resp_endp->AssignUnsigned(4, resp_flow_label);
 
 		conn_val->Assign(0, id_val);
 		conn_val->Assign(1, orig_endp);
@@ -384,17 +384,17 @@ RecordVal* Connection::BuildConnVal()
 			conn_val->Assign(8, encapsulation->GetVectorVal());
 
 		if ( vlan != 0 )
-			conn_val->Assign(9, new Val(vlan, TYPE_INT));
+			conn_val->AssignInt(9, vlan);
 
 		if ( inner_vlan != 0 )
-			conn_val->Assign(10, new Val(inner_vlan, TYPE_INT));
+			conn_val->AssignInt(10, inner_vlan);
 		}
 
 	if ( root_analyzer )
 		root_analyzer->UpdateConnVal(conn_val);
 
-	conn_val->Assign(3, new Val(start_time, TYPE_TIME));	// ###
-	conn_val->Assign(4, new Val(last_time - start_time, TYPE_INTERVAL));
+	conn_val->AssignDouble(3, start_time);	// ###
+	conn_val->AssignDouble(4, last_time - start_time);
 	conn_val->Assign(6, new StringVal(history.c_str()));
 
 	conn_val->SetOrigin(this);
@@ -6,9 +6,12 @@
 
 #include "EquivClass.h"
 #include "DFA.h"
+#include "NetVar.h"
 
 unsigned int DFA_State::transition_counter = 0;
 
+declare(PList,CacheEntry);
+
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 			NFA_state_list* arg_nfa_states,
 			AcceptingSet* arg_accept)
@@ -19,6 +22,7 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 	accept = arg_accept;
 	mark = 0;
 	centry = 0;
+	referenced = true;
 
 	SymPartition(ec);
 
@@ -100,6 +104,25 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 		next_d = 0;	// Jam
 		}
 
+	DFA_State_Cache* cache = machine->Cache();
+
+	if ( cache->OverBudget() )
+		{
+		// Our caller is about to move from us to the new state,
+		// so neither may go away.
+		Ref(this);
+
+		if ( next_d )
+			Ref(next_d);
+
+		cache->Evict();
+
+		if ( next_d )
+			Unref(next_d);
+
+		Unref(this);
+		}
+
 	AddXtion(equiv_sym, next_d);
 	if ( sym != equiv_sym )
 		AddXtion(sym, next_d);
@@ -293,6 +316,9 @@ unsigned int DFA_State::Size()
 DFA_State_Cache::DFA_State_Cache()
 	{
 	hits = misses = 0;
+	evictions = recomputes = 0;
+	mem = 0;
+	next_eviction = 0;
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
@@ -344,6 +370,16 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas,
 	if ( ! e )
 		{
 		++misses;
+
+		if ( ! evicted.empty() )
+			{
+			uint64 prefix;
+			memcpy(&prefix, digest, sizeof(prefix));
+
+			if ( evicted.erase(prefix) )
+				++recomputes;
+			}
+
 		return 0;
 		}
 
@@ -364,10 +400,110 @@ DFA_State* DFA_State_Cache::Insert(DFA_State* state, HashKey* hash)
 	e->hash = hash;
 
 	states.Insert(hash, e);
+	mem += pad_size(state->Size()) + padded_sizeof(*state);
 
 	return e->state;
 	}
 
+bool DFA_State_Cache::OverBudget() const
+	{
+	if ( dfa_state_cache_budget <= 0 )
+		return false;
+
+	unsigned int budget = dfa_state_cache_budget;
+	return mem > (next_eviction > budget ? next_eviction : budget);
+	}
+
+void DFA_State_Cache::Evict()
+	{
+	unsigned int budget = dfa_state_cache_budget;
+	unsigned int target = budget / EVICT_TO_DEN * EVICT_TO_NUM;
+	unsigned int freed = 0;
+
+	PList(CacheEntry) victims;
+
+	// Clock-style: the first pass gives recently used states a second
+	// chance, the second one takes what's needed regardless.
+	for ( int pass = 0; pass < 2 && mem - freed > target; ++pass )
+		{
+		IterCookie* i = states.InitForIteration();
+		CacheEntry* e;
+
+		while ( (e = (CacheEntry*) states.NextEntry(i)) )
+			{
+			DFA_State* s = e->state;
+
+			if ( ! s->centry || s->RefCnt() > 1 )
+				// Already picked, or in use.
+				continue;
+
+			if ( s->referenced )
+				{
+				s->referenced = false;
+				continue;
+				}
+
+			if ( mem - freed <= target )
+				continue;	// finish clearing the marks
+
+			freed += pad_size(s->Size()) + padded_sizeof(*s);
+			s->centry = 0;
+			victims.append(e);
+			}
+		}
+
+	if ( victims.length() == 0 )
+		{
+		// Everything's in use; don't try again right away.
+		next_eviction = mem + budget / EVICT_TO_DEN;
+		return;
+		}
+
+	loop_over_list(victims, j)
+		{
+		CacheEntry* e = victims[j];
+
+		if ( evicted.size() >= MAX_EVICTED_HASHES )
+			evicted.clear();
+
+		uint64 prefix;
+		memcpy(&prefix, e->hash->Key(), sizeof(prefix));
+		evicted.insert(prefix);
+
+		states.Remove(e->hash);
+		delete e->hash;
+		}
+
+	// Forget all transitions into the victims.
+	IterCookie* i = states.InitForIteration();
+	CacheEntry* e;
+
+	while ( (e = (CacheEntry*) states.NextEntry(i)) )
+		{
+		DFA_State* s = e->state;
+
+		for ( int sym = 0; sym < s->num_sym; ++sym )
+			{
+			DFA_State* x = s->xtions[sym];
+
+			if ( x && x != DFA_UNCOMPUTED_STATE_PTR && ! x->centry )
+				s->xtions[sym] = DFA_UNCOMPUTED_STATE_PTR;
+			}
+		}
+
+	loop_over_list(victims, k)
+		{
+		Unref(victims[k]->state);
+		delete victims[k];
+		}
+
+	evictions += victims.length();
+	mem -= freed;
+
+	// If we couldn't free enough, wait for some more growth.
+	next_eviction = mem + (mem > target ? budget / EVICT_TO_DEN : 0);
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -377,6 +513,8 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->evictions = evictions;
+	s->recomputes = recomputes;
 
 	CacheEntry* e;
 
@@ -400,6 +538,7 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 	ec = arg_ec;
 
 	dfa_state_cache = new DFA_State_Cache();
+	start_state = 0;
 
 	NFA_state_list* ns = new NFA_state_list;
 	ns->append(n->FirstState());
@@ -408,6 +547,10 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 		{
 		NFA_state_list* state_set = epsilon_closure(ns);
 		(void) StateSetToDFA_State(state_set, start_state, ec);
+
+		// Keeps it from being evicted.
+		if ( start_state )
+			Ref(start_state);
 		}
 	else
 		{
@@ -419,6 +562,7 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 DFA_Machine::~DFA_Machine()
 	{
 	delete dfa_state_cache;
+	Unref(start_state);
 	Unref(nfa);
 	}
 
@@ -442,8 +586,8 @@ void DFA_Machine::DumpStats(FILE* f)
 		stats.dfa_states, EC()->NumClasses(),
 		stats.computed, stats.uncomputed);
 
-	fprintf(f, "DFA cache hits = %d; misses = %d\n",
-		stats.hits, stats.misses);
+	fprintf(f, "DFA cache hits = %d; misses = %d; evictions = %d; recomputes = %d\n",
+		stats.hits, stats.misses, stats.evictions, stats.recomputes);
 	}
 
 unsigned int DFA_Machine::MemoryAllocation() const
@@ -5,6 +5,7 @@
 #define dfa_h
 
 #include <assert.h>
+#include <set>
 
 class DFA_State;
 
@@ -64,7 +65,8 @@ protected:
 	NFA_state_list* nfa_states;
 	EquivClass* meta_ec;	// which ec's make same transition
 	DFA_State* mark;
-	CacheEntry* centry;
+	CacheEntry* centry;	// null once evicted from the cache
+	bool referenced;	// for the cache's clock eviction
 
 	static unsigned int transition_counter;	// see Xtion()
 };
@@ -88,6 +90,18 @@ public:
 
 	int NumEntries() const	{ return states.Length(); }
 
+	// Returns true if the cache has grown beyond its budget (see
+	// dfa_state_cache_budget) and Evict() should be called.
+	bool OverBudget() const;
+
+	// Evicts states not used recently until the cache is comfortably
+	// within its budget again, and resets all transitions into them
+	// so that they'll get recomputed when needed.  States referenced
+	// from outside the cache (i.e., with a reference count above one)
+	// are never evicted; the caller must hold references to any states
+	// it is going to use afterwards.
+	void Evict();
+
 	struct Stats {
 		unsigned int dfa_states;
 
@@ -98,6 +112,8 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int evictions;	// # states evicted
+		unsigned int recomputes;	// # evicted states computed again
 	};
 
 	void GetStats(Stats* s);
@@ -105,6 +121,22 @@ public:
 private:
 	int hits;	// Statistics
 	int misses;
+	unsigned int evictions;
+	unsigned int recomputes;
+
+	unsigned int mem;	// bytes used by cached states
+	unsigned int next_eviction;	// mem above which we evict
+
+	// Prefixes of the hashes of evicted states, for counting
+	// recomputations.  Bounded by MAX_EVICTED_HASHES, beyond which
+	// we start over and may miss some.
+	std::set<uint64> evicted;
+
+	// Below this fraction of the budget, we stop evicting.
+	static const unsigned int EVICT_TO_NUM = 3;
+	static const unsigned int EVICT_TO_DEN = 4;
+
+	static const unsigned int MAX_EVICTED_HASHES = 100000;
 
 	declare(PDict,CacheEntry);
 
@@ -122,6 +154,7 @@ public:
 			int* acc_array);
 	~DFA_Machine();
 
+	// The start state is never evicted from the cache.
 	DFA_State* StartState() const	{ return start_state; }
 
 	int NumStates() const	{ return dfa_state_cache->NumEntries(); }
@@ -156,6 +189,8 @@ protected:
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
 	{
+	referenced = true;
+
 	if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
 		return ComputeXtion(sym, machine);
 	else
@@ -436,6 +436,9 @@ void DNS_Mgr::InitPostScript()
 
 	iosource_mgr->Register(this, true);
 
+	if ( nb_dns )
+		RegisterFd(nb_dns_fd(nb_dns));
+
 	// We never set idle to false, having the main loop only calling us from
 	// time to time. If we're issuing more DNS requests than we can handle
 	// in this way, we are having problems anyway ...
@@ -5,6 +5,7 @@
 
 #include "EventRegistry.h"
 #include "Serializer.h"
+#include "Arena.h"
 
 #include "analyzer/Tag.h"
 #include "analyzer/Analyzer.h"
@@ -13,6 +14,8 @@ class EventMgr;
 
 class Event : public BroObj {
 public:
+	DECLARE_ARENA_ALLOCATION
+
 	Event(EventHandlerPtr handler, val_list* args,
 		SourceID src = SOURCE_LOCAL, analyzer::ID aid = 0,
 		TimerMgr* mgr = 0, BroObj* obj = 0);
@@ -85,7 +88,8 @@ public:
 			TimerMgr* mgr = 0, BroObj* obj = 0)
 		{
 		if ( h )
-			QueueEvent(new Event(h, vl, src, aid, mgr, obj));
+			// Most events don't outlive the packet raising them.
+			QueueEvent(new (packet_arena) Event(h, vl, src, aid, mgr, obj));
 		else
 			delete_vals(vl);
 		}
@@ -4,6 +4,7 @@
 #include "Scope.h"
 #include "RemoteSerializer.h"
 #include "NetVar.h"
+#include "ScriptProfiler.h"
 
 #ifdef ENABLE_BROKER
 #include "broker/Manager.h"
@@ -73,6 +74,8 @@ void EventHandler::Call(val_list* vl, bool no_remote)
 	DEBUG_MSG("Event: %s\n", Name());
 #endif
 
+	ScriptProfiler::Scope profile(script_profiler, this);
+
 	if ( new_event )
 		NewEvent(vl);
 
@@ -15,6 +15,10 @@
 #include "Traverse.h"
 #include "Trigger.h"
 #include "IPAddr.h"
+#include "SortedIndex.h"
+#include "ScriptOpt.h"
+#include "Stats.h"
+#include "plugin/Manager.h"
 
 const char* expr_name(BroExprTag t)
 	{
@@ -96,6 +100,39 @@ void Expr::EvalIntoAggregate(const BroType* /* t */, Val* /* aggr */,
 	Internal("Expr::EvalIntoAggregate called");
 	}
 
+// Copies the number held by a Val into the corresponding field of v.
+static inline void get_scalar(const Val* val, BroValUnion& v)
+	{
+	switch ( val->Type()->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		v.int_val = val->ForceAsInt();
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		v.uint_val = val->ForceAsUInt();
+		break;
+
+	case TYPE_INTERNAL_DOUBLE:
+		v.double_val = val->ForceAsDouble();
+		break;
+
+	default:
+		reporter->InternalError("non-scalar value in get_scalar");
+	}
+	}
+
+bool Expr::EvalScalar(Frame* f, BroValUnion& v) const
+	{
+	Val* val = Eval(f);
+
+	if ( ! val )
+		return false;
+
+	get_scalar(val, v);
+	Unref(val);
+	return true;
+	}
+
 void Expr::Assign(Frame* /* f */, Val* /* v */, Opcode /* op */)
 	{
 	Internal("Expr::Assign called");
@@ -116,6 +153,11 @@ int Expr::IsPure() const
 	return 1;
 	}
 
+Expr* Expr::Optimize(ScriptOptimizer* opt)
+	{
+	return this;
+	}
+
 Val* Expr::InitVal(const BroType* t, Val* aggr) const
 	{
 	if ( aggr )
@@ -275,6 +317,29 @@ Val* NameExpr::Eval(Frame* f) const
 		}
 	}
 
+bool NameExpr::EvalScalar(Frame* f, BroValUnion& v) const
+	{
+	Val* val;
+
+	if ( id->IsGlobal() )
+		val = id->ID_Val();
+
+	else if ( f )
+		val = f->NthElement(id->Offset());
+
+	else
+		return false;
+
+	if ( ! val )
+		{
+		Error("value used but not set");
+		return false;
+		}
+
+	get_scalar(val, v);
+	return true;
+	}
+
 Expr* NameExpr::MakeLvalue()
 	{
 	if ( id->AsType() )
@@ -299,6 +364,14 @@ int NameExpr::IsPure() const
 	return id->IsConst();
 	}
 
+Expr* NameExpr::Optimize(ScriptOptimizer* opt)
+	{
+	if ( opt->IsFoldable(id) )
+		return opt->Fold(this);
+
+	return this;
+	}
+
 TraversalCode NameExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -403,6 +476,12 @@ Val* ConstExpr::Eval(Frame* /* f */) const
 	return Value()->Ref();
 	}
 
+bool ConstExpr::EvalScalar(Frame* /* f */, BroValUnion& v) const
+	{
+	get_scalar(val, v);
+	return true;
+	}
+
 TraversalCode ConstExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -450,6 +529,11 @@ Val* UnaryExpr::Eval(Frame* f) const
 	if ( ! v )
 		return 0;
 
+	return EvalOperand(v);
+	}
+
+Val* UnaryExpr::EvalOperand(Val* v) const
+	{
 	if ( is_vector(v) )
 		{
 		VectorVal* v_op = v->AsVectorVal();
@@ -477,6 +561,18 @@ int UnaryExpr::IsPure() const
 	return op->IsPure();
 	}
 
+Expr* UnaryExpr::Optimize(ScriptOptimizer* opt)
+	{
+	// Leave alone operands that get assigned to.
+	if ( tag != EXPR_INCR && tag != EXPR_DECR && tag != EXPR_REF )
+		op = opt->Reduce(op);
+
+	if ( op->IsConst() )
+		return opt->Fold(this);
+
+	return this;
+	}
+
 TraversalCode UnaryExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -546,6 +642,14 @@ Val* BinaryExpr::Eval(Frame* f) const
 	if ( IsError() )
 		return 0;
 
+	if ( ScalarType() != TYPE_INTERNAL_VOID )
+		{
+		// Operate on the operands' plain values, avoiding the
+		// intermediary Vals of nested arithmetic.
+		BroValUnion v;
+		return EvalScalar(f, v) ? BoxScalar(v) : 0;
+		}
+
 	Val* v1 = op1->Eval(f);
 	if ( ! v1 )
 		return 0;
@@ -557,6 +661,11 @@ Val* BinaryExpr::Eval(Frame* f) const
 		return 0;
 		}
 
+	return EvalOperands(v1, v2);
+	}
+
+Val* BinaryExpr::EvalOperands(Val* v1, Val* v2) const
+	{
 	Val* result = 0;
 
 	int is_vec1 = is_vector(v1);
@@ -627,6 +736,21 @@ int BinaryExpr::IsPure() const
 	return op1->IsPure() && op2->IsPure();
 	}
 
+Expr* BinaryExpr::Optimize(ScriptOptimizer* opt)
+	{
+	// Leave alone operands that get assigned to.
+	if ( tag != EXPR_ASSIGN && tag != EXPR_ADD_TO &&
+	     tag != EXPR_REMOVE_FROM )
+		op1 = opt->Reduce(op1);
+
+	op2 = opt->Reduce(op2);
+
+	if ( op1->IsConst() && op2->IsConst() )
+		return opt->Fold(this);
+
+	return this;
+	}
+
 TraversalCode BinaryExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -788,18 +912,200 @@ Val* BinaryExpr::Fold(Val* v1, Val* v2) const
 		BadTag("BinaryExpr::Fold", expr_name(tag));
 	}
 
+	BroValUnion result;
+	InternalTypeTag ret_it = type->InternalType();
+
+	if ( IsVector(type->Tag()) )
+		ret_it = type->YieldType()->InternalType();
+
+	if ( ret_it == TYPE_INTERNAL_DOUBLE )
+		result.double_val = d3;
+	else if ( ret_it == TYPE_INTERNAL_UNSIGNED )
+		result.uint_val = u3;
+	else
+		result.int_val = i3;
+
+	return BoxScalar(result);
+	}
+
+InternalTypeTag BinaryExpr::ScalarType() const
+	{
+	if ( scalar_type >= 0 )
+		return InternalTypeTag(scalar_type);
+
+	scalar_type = TYPE_INTERNAL_VOID;
+
+	bool is_cmp = false;
+
+	switch ( tag ) {
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+		break;
+
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		is_cmp = true;
+		break;
+
+	default:
+		return TYPE_INTERNAL_VOID;
+	}
+
+	if ( IsError() || IsVector(type->Tag()) ||
+	     IsVector(op1->Type()->Tag()) || IsVector(op2->Type()->Tag()) )
+		return TYPE_INTERNAL_VOID;
+
+	InternalTypeTag it = op1->Type()->InternalType();
+
+	if ( it != op2->Type()->InternalType() ||
+	     (it != TYPE_INTERNAL_INT && it != TYPE_INTERNAL_UNSIGNED &&
+	      it != TYPE_INTERNAL_DOUBLE) )
+		return TYPE_INTERNAL_VOID;
+
+	if ( is_cmp )
+		{
+		if ( type->Tag() != TYPE_BOOL )
+			return TYPE_INTERNAL_VOID;
+		}
+
+	else if ( type->InternalType() != it ||
+		  (tag == EXPR_MOD && it == TYPE_INTERNAL_DOUBLE) )
+		return TYPE_INTERNAL_VOID;
+
+	scalar_type = it;
+	return it;
+	}
+
+bool BinaryExpr::EvalScalar(Frame* f, BroValUnion& v) const
+	{
+	InternalTypeTag it = ScalarType();
+
+	if ( it == TYPE_INTERNAL_VOID )
+		return Expr::EvalScalar(f, v);
+
+	BroValUnion v1, v2;
+
+	if ( ! op1->EvalScalar(f, v1) || ! op2->EvalScalar(f, v2) )
+		return false;
+
+	bool is_cmp = (type->Tag() == TYPE_BOOL);
+
+	switch ( it ) {
+	case TYPE_INTERNAL_INT:
+		if ( is_cmp )
+			v.int_val = ScalarCompare(v1.int_val, v2.int_val);
+		else
+			v.int_val = ScalarArith(v1.int_val, v2.int_val);
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		if ( is_cmp )
+			v.int_val = ScalarCompare(v1.uint_val, v2.uint_val);
+		else
+			v.uint_val = ScalarArith(v1.uint_val, v2.uint_val);
+		break;
+
+	default:
+		if ( is_cmp )
+			v.int_val = ScalarCompare(v1.double_val, v2.double_val);
+		else
+			v.double_val = ScalarArith(v1.double_val, v2.double_val);
+		break;
+	}
+
+	return true;
+	}
+
+// ScalarType() rules out the modulo of doubles.
+static inline bro_int_t scalar_mod(bro_int_t x, bro_int_t y)	{ return x % y; }
+static inline bro_uint_t scalar_mod(bro_uint_t x, bro_uint_t y)	{ return x % y; }
+
+static inline double scalar_mod(double x, double y)
+	{
+	reporter->InternalError("bad type in scalar_mod");
+	return 0;
+	}
+
+template<typename T>
+T BinaryExpr::ScalarArith(T x, T y) const
+	{
+	switch ( tag ) {
+	case EXPR_ADD:		return x + y;
+	case EXPR_SUB:		return x - y;
+	case EXPR_TIMES:	return x * y;
+
+	case EXPR_DIVIDE:
+		if ( y == 0 )
+			reporter->ExprRuntimeError(this, "division by zero");
+
+		return x / y;
+
+	case EXPR_MOD:
+		if ( y == 0 )
+			reporter->ExprRuntimeError(this, "modulo by zero");
+
+		return scalar_mod(x, y);
+
+	default:
+		BadTag("BinaryExpr::ScalarArith", expr_name(tag));
+		return 0;
+	}
+	}
+
+template<typename T>
+bool BinaryExpr::ScalarCompare(T x, T y) const
+	{
+	switch ( tag ) {
+	case EXPR_LT:	return x < y;
+	case EXPR_LE:	return x <= y;
+	case EXPR_EQ:	return x == y;
+	case EXPR_NE:	return x != y;
+	case EXPR_GE:	return x >= y;
+	case EXPR_GT:	return x > y;
+
+	default:
+		BadTag("BinaryExpr::ScalarCompare", expr_name(tag));
+		return false;
+	}
+	}
+
+Val* BinaryExpr::BoxScalar(const BroValUnion& v) const
+	{
 	BroType* ret_type = type;
 	if ( IsVector(ret_type->Tag()) )
 	     ret_type = ret_type->YieldType();
 
-	if ( ret_type->Tag() == TYPE_INTERVAL )
-		return new IntervalVal(d3, 1.0);
-	else if ( ret_type->InternalType() == TYPE_INTERNAL_DOUBLE )
-		return new Val(d3, ret_type->Tag());
-	else if ( ret_type->InternalType() == TYPE_INTERNAL_UNSIGNED )
-		return new Val(u3, ret_type->Tag());
-	else
-		return new Val(i3, ret_type->Tag());
+	switch ( ret_type->Tag() ) {
+	case TYPE_BOOL:
+		return val_mgr->GetBool(v.int_val);
+
+	case TYPE_COUNT:
+		return val_mgr->GetCount(v.uint_val);
+
+	case TYPE_INTERVAL:
+		return new IntervalVal(v.double_val, 1.0);
+
+	default:
+		break;
+	}
+
+	switch ( ret_type->InternalType() ) {
+	case TYPE_INTERNAL_DOUBLE:
+		return new Val(v.double_val, ret_type->Tag());
+
+	case TYPE_INTERNAL_UNSIGNED:
+		return new Val(v.uint_val, ret_type->Tag());
+
+	default:
+		return new Val(v.int_val, ret_type->Tag());
+	}
 	}
 
 Val* BinaryExpr::StringFold(Val* v1, Val* v2) const
@@ -833,7 +1139,7 @@ Val* BinaryExpr::StringFold(Val* v1, Val* v2) const
 		BadTag("BinaryExpr::StringFold", expr_name(tag));
 	}
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 Val* BinaryExpr::AddrFold(Val* v1, Val* v2) const
@@ -867,7 +1173,7 @@ Val* BinaryExpr::AddrFold(Val* v1, Val* v2) const
 		BadTag("BinaryExpr::AddrFold", expr_name(tag));
 	}
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 Val* BinaryExpr::SubNetFold(Val* v1, Val* v2) const
@@ -880,7 +1186,7 @@ Val* BinaryExpr::SubNetFold(Val* v1, Val* v2) const
 	if ( tag == EXPR_NE )
 		result = ! result;
 
-	return new Val(result, TYPE_BOOL);
+	return val_mgr->GetBool(result);
 	}
 
 void BinaryExpr::SwapOps()
@@ -1020,6 +1326,9 @@ Val* IncrExpr::DoSingleEval(Frame* f, Val* v) const
 	 if ( IsVector(ret_type->Tag()) )
 		 ret_type = Type()->YieldType();
 
+	 if ( ret_type->Tag() == TYPE_COUNT )
+		 return val_mgr->GetCount(k);
+
 	 return new Val(k, ret_type->Tag());
 	 }
 
@@ -1092,7 +1401,7 @@ NotExpr::NotExpr(Expr* arg_op) : UnaryExpr(EXPR_NOT, arg_op)
 
 Val* NotExpr::Fold(Val* v) const
 	{
-	return new Val(! v->InternalInt(), type->Tag());
+	return val_mgr->GetBool(! v->InternalInt());
 	}
 
 IMPLEMENT_SERIAL(NotExpr, SER_NOT_EXPR);
@@ -1700,6 +2009,34 @@ Val* BoolExpr::DoSingleEval(Frame* f, Val* v1, Expr* op2) const
 	}
 
 
+Expr* BoolExpr::Optimize(ScriptOptimizer* opt)
+	{
+	Expr* e = BinaryExpr::Optimize(opt);
+
+	if ( e != this || is_vector(op1) || is_vector(op2) )
+		return e;
+
+	bool is_and = (tag == EXPR_AND);
+
+	// A constant left operand either decides the result, or leaves
+	// it to the right one.
+	if ( op1->IsConst() )
+		{
+		if ( op1->ExprVal()->AsBool() == is_and )
+			return op2->Ref();
+		else
+			return op1->Ref();
+		}
+
+	// A constant right operand that doesn't decide the result can
+	// go.  One that does needs the left one evaluated for its side
+	// effects.
+	if ( op2->IsConst() && op2->ExprVal()->AsBool() == is_and )
+		return op1->Ref();
+
+	return this;
+	}
+
 Val* BoolExpr::Eval(Frame* f) const
 	{
 	if ( IsError() )
@@ -1786,7 +2123,7 @@ Val* BoolExpr::Eval(Frame* f) const
 				(! op1->IsZero() && ! op2->IsZero()) :
 				(! op1->IsZero() || ! op2->IsZero());
 
-			result->Assign(i, new Val(local_result, TYPE_BOOL));
+			result->Assign(i, val_mgr->GetBool(local_result));
 			}
 		else
 			result->Assign(i, 0);
@@ -1891,9 +2228,9 @@ Val* EqExpr::Fold(Val* v1, Val* v2) const
 		RE_Matcher* re = v1->AsPattern();
 		const BroString* s = v2->AsString();
 		if ( tag == EXPR_EQ )
-			return new Val(re->MatchExactly(s), TYPE_BOOL);
+			return val_mgr->GetBool(re->MatchExactly(s));
 		else
-			return new Val(! re->MatchExactly(s), TYPE_BOOL);
+			return val_mgr->GetBool(! re->MatchExactly(s));
 		}
 
 	else
@@ -2094,6 +2431,23 @@ int CondExpr::IsPure() const
 	return op1->IsPure() && op2->IsPure() && op3->IsPure();
 	}
 
+Expr* CondExpr::Optimize(ScriptOptimizer* opt)
+	{
+	op1 = opt->Reduce(op1);
+	op2 = opt->Reduce(op2);
+	op3 = opt->Reduce(op3);
+
+	if ( ! op1->IsConst() || is_vector(op1) )
+		return this;
+
+	Expr* e = op1->ExprVal()->AsBool() ? op2 : op3;
+
+	if ( ! same_type(e->Type(), Type()) )
+		return this;
+
+	return e->Ref();
+	}
+
 TraversalCode CondExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -2717,6 +3071,11 @@ Val* IndexExpr::Eval(Frame* f) const
 		return 0;
 		}
 
+	return EvalOperands(v1, v2);
+	}
+
+Val* IndexExpr::EvalOperands(Val* v1, Val* v2) const
+	{
 	Val* result;
 
 	Val* indv = v2->AsListVal()->Index(0);
@@ -2982,6 +3341,35 @@ void FieldExpr::Delete(Frame* f)
 	Assign(f, 0, OP_ASSIGN_IDX);
 	}
 
+bool FieldExpr::EvalScalar(Frame* f, BroValUnion& v) const
+	{
+	if ( IsError() )
+		return false;
+
+	Val* rec = op->Eval(f);
+
+	if ( ! rec )
+		return false;
+
+	bool ok = rec->AsRecordVal()->LookupScalar(field, v);
+
+	if ( ! ok )
+		{
+		// Leave &default and missing fields to Fold().
+		Val* val = Fold(rec);
+
+		if ( val )
+			{
+			get_scalar(val, v);
+			Unref(val);
+			ok = true;
+			}
+		}
+
+	Unref(rec);
+	return ok;
+	}
+
 Val* FieldExpr::Fold(Val* v) const
 	{
 	Val* result = v->AsRecordVal()->Lookup(field);
@@ -3075,10 +3463,10 @@ Val* HasFieldExpr::Fold(Val* v) const
 	rec_to_look_at = v->AsRecordVal();
 
 	if ( ! rec_to_look_at )
-		return new Val(0, TYPE_BOOL);
+		return val_mgr->GetBool(0);
 
 	RecordVal* r = rec_to_look_at->Ref()->AsRecordVal();
-	Val* ret = new Val(r->Lookup(field) != 0, TYPE_BOOL);
+	Val* ret = val_mgr->GetBool(r->IsSet(field));
 	Unref(r);
 
 	return ret;
@@ -3690,7 +4078,7 @@ Val* ArithCoerceExpr::FoldSingleVal(Val* v, InternalTypeTag t) const
 		return new Val(v->CoerceToInt(), TYPE_INT);
 
 	case TYPE_INTERNAL_UNSIGNED:
-		return new Val(v->CoerceToUnsigned(), TYPE_COUNT);
+		return val_mgr->GetCount(v->CoerceToUnsigned());
 
 	default:
 		Internal("bad type in CoerceExpr::Fold");
@@ -4259,6 +4647,11 @@ bool ScheduleExpr::DoUnserialize(UnserialInfo* info)
 InExpr::InExpr(Expr* arg_op1, Expr* arg_op2)
 : BinaryExpr(EXPR_IN, arg_op1, arg_op2)
 	{
+	const_set = 0;
+	set_index = 0;
+	indexed_set = 0;
+	indexed_version = 0;
+
 	if ( IsError() )
 		return;
 
@@ -4333,17 +4726,91 @@ InExpr::InExpr(Expr* arg_op1, Expr* arg_op2)
 			{
 			op1 = lop1;
 			SetType(base_type(TYPE_BOOL));
+
+			if ( op2->Tag() == EXPR_NAME &&
+			     op2->Type()->Tag() == TYPE_TABLE &&
+			     lop1->Exprs().length() == 1 )
+				{
+				ID* id = op2->AsNameExpr()->Id();
+				const TableType* tt = op2->Type()->AsTableType();
+				const type_list* it = tt->IndexTypes();
+
+				// Sets indexed by subnets already get
+				// looked up through a prefix table.
+				if ( id->IsGlobal() && id->IsConst() &&
+				     is_atomic_type((*it)[0]) &&
+				     ! tt->IsSubNetIndex() )
+					const_set = id;
+				}
 			}
 		}
 	}
 
+InExpr::~InExpr()
+	{
+	delete set_index;
+	}
+
+Val* InExpr::Eval(Frame* f) const
+	{
+	const SortedIndex* si =
+		const_set && ! IsError() ? ConstSetIndex(const_set->ID_Val()) : 0;
+
+	if ( ! si )
+		return BinaryExpr::Eval(f);
+
+	// Skip building the ListVal for the index.
+	Val* v = op1->AsListExpr()->Exprs()[0]->Eval(f);
+
+	if ( ! v )
+		return 0;
+
+	Val* result = val_mgr->GetBool(si->Lookup(v) >= 0);
+	Unref(v);
+	return result;
+	}
+
+const SortedIndex* InExpr::ConstSetIndex(const Val* set) const
+	{
+	if ( ! set || set != const_set->ID_Val() )
+		return 0;
+
+	const TableVal* tv = set->AsTableVal();
+
+	// Lookups affect the expiration of entries.
+	if ( tv->FindAttr(ATTR_EXPIRE_READ) || tv->FindAttr(ATTR_EXPIRE_WRITE) ||
+	     tv->FindAttr(ATTR_EXPIRE_CREATE) )
+		return 0;
+
+	// Constants can still change through redefs and remote state.
+	if ( set_index && set == indexed_set &&
+	     tv->LastModified() == indexed_version )
+		return set_index;
+
+	const TableType* tt = tv->Type()->AsTableType();
+	delete set_index;
+	set_index = new SortedIndex((*tt->IndexTypes())[0]);
+
+	ListVal* elements = tv->ConvertToPureList();
+
+	for ( int i = 0; i < elements->Length(); ++i )
+		set_index->Insert(elements->Index(i), 1);
+
+	Unref(elements);
+
+	indexed_set = set;
+	indexed_version = tv->LastModified();
+
+	return set_index;
+	}
+
 Val* InExpr::Fold(Val* v1, Val* v2) const
 	{
 	if ( v1->Type()->Tag() == TYPE_PATTERN )
 		{
 		RE_Matcher* re = v1->AsPattern();
 		const BroString* s = v2->AsString();
-		return new Val(re->MatchAnywhere(s) != 0, TYPE_BOOL);
+		return val_mgr->GetBool(re->MatchAnywhere(s) != 0);
 		}
 
 	if ( v2->Type()->Tag() == TYPE_STRING )
@@ -4353,12 +4820,20 @@ Val* InExpr::Fold(Val* v1, Val* v2) const
 
 		// Could do better here - either roll our own, to deal with
 		// NULs, and/or Boyer-Moore if done repeatedly.
-		return new Val(strstr(s2->CheckString(), s1->CheckString()) != 0, TYPE_BOOL);
+		return val_mgr->GetBool(strstr(s2->CheckString(), s1->CheckString()) != 0);
 		}
 
 	if ( v1->Type()->Tag() == TYPE_ADDR &&
 	     v2->Type()->Tag() == TYPE_SUBNET )
-		return new Val(v2->AsSubNetVal()->Contains(v1->AsAddr()), TYPE_BOOL);
+		return val_mgr->GetBool(v2->AsSubNetVal()->Contains(v1->AsAddr()));
+
+	if ( const_set )
+		{
+		const SortedIndex* si = ConstSetIndex(v2);
+
+		if ( si )
+			return val_mgr->GetBool(si->Lookup(v1->AsListVal()->Index(0)) >= 0);
+		}
 
 	Val* res;
 
@@ -4368,9 +4843,9 @@ Val* InExpr::Fold(Val* v1, Val* v2) const
 		res = v2->AsTableVal()->Lookup(v1, false);
 
 	if ( res )
-		return new Val(1, TYPE_BOOL);
+		return val_mgr->GetBool(1);
 	else
-		return new Val(0, TYPE_BOOL);
+		return val_mgr->GetBool(0);
 	}
 
 IMPLEMENT_SERIAL(InExpr, SER_IN_EXPR);
@@ -4387,11 +4862,22 @@ bool InExpr::DoUnserialize(UnserialInfo* info)
 	return true;
 	}
 
+// True if something needs to see all calls of script functions, in which
+// case inlined calls go through Func::Call() as well.
+static bool calls_observed()
+	{
+	return script_profiler || sample_logger || segment_logger ||
+		g_trace_state.DoTrace() ||
+		plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION);
+	}
+
 CallExpr::CallExpr(Expr* arg_func, ListExpr* arg_args, bool in_hook)
 : Expr(EXPR_CALL)
 	{
 	func = arg_func;
 	args = arg_args;
+	inline_func = 0;
+	inline_body = 0;
 
 	if ( func->IsError() || args->IsError() )
 		{
@@ -4475,6 +4961,8 @@ CallExpr::~CallExpr()
 	{
 	Unref(func);
 	Unref(args);
+	Unref(inline_func);
+	Unref(inline_body);
 	}
 
 int CallExpr::IsPure() const
@@ -4508,57 +4996,148 @@ Val* CallExpr::Eval(Frame* f) const
 	if ( IsError() )
 		return 0;
 
-	// If we are inside a trigger condition, we may have already been
-	// called, delayed, and then produced a result which is now cached.
-	// Check for that.
-	if ( f )
+	Val* ret = CachedResult(f);
+	if ( ret )
+		return ret;
+
+	if ( inline_body && ! calls_observed() )
+		return EvalInline(f);
+
+	Val* func_val = func->Eval(f);
+	val_list* v = eval_list(f, args);
+
+	if ( func_val && v )
+		ret = Invoke(func_val->AsFunc(), v, f);
+	else
+		delete_vals(v);
+
+	Unref(func_val);
+
+	return ret;
+	}
+
+Val* CallExpr::EvalInline(Frame* f) const
+	{
+	Frame* inner = new Frame(inline_func->FrameSize(), inline_func, 0);
+
+	const expr_list& a = args->Exprs();
+
+	loop_over_list(a, i)
 		{
-		Trigger* trigger = f->GetTrigger();
+		Val* v;
 
-		if ( trigger )
+		try
 			{
-			Val* v = trigger->Lookup(this);
-			if ( v )
-				{
-				DBG_LOG(DBG_NOTIFIERS,
-					"%s: provides cached function result",
-					trigger->Name());
-				return v->Ref();
-				}
+			v = a[i]->Eval(f);
+			}
+
+		catch ( InterpreterException& e )
+			{
+			Unref(inner);
+			throw;
 			}
+
+		if ( ! v )
+			{
+			Unref(inner);
+			return 0;
+			}
+
+		inner->SetElement(i, v);
+		}
+
+	// Set up the frame the way BroFunc::Call() and Invoke() would.
+	if ( f )
+		{
+		inner->SetTrigger(f->GetTrigger());
+		inner->SetCall(this);
 		}
 
 	Val* ret = 0;
-	Val* func_val = func->Eval(f);
-	val_list* v = eval_list(f, args);
 
-	if ( func_val && v )
+	try
 		{
-		const ::Func* func = func_val->AsFunc();
-		calling_expr = this;
-		const CallExpr* current_call = f ? f->GetCall() : 0;
+		ret = inline_body->Eval(inner);
+		}
 
-		if ( f )
-			f->SetCall(this);
+	catch ( InterpreterException& e )
+		{
+		// Already reported.
+		}
 
-		ret = func->Call(v, f); // No try/catch here; we pass exceptions upstream.
+	if ( inner->HasDelayed() )
+		{
+		assert(! ret);
+		assert(f);
+		f->SetDelayed();
+		}
 
-		if ( f )
-			f->SetCall(current_call);
+	else if ( ! ret )
+		reporter->Warning("non-void function returns without a value: %s",
+				  inline_func->Name());
 
-		// Don't Unref() the arguments, as Func::Call already did that.
-		delete v;
+	Unref(inner);
 
-		calling_expr = 0;
-		}
-	else
-		delete_vals(v);
+	return ret;
+	}
 
-	Unref(func_val);
+Val* CallExpr::CachedResult(Frame* f) const
+	{
+	Trigger* trigger = f ? f->GetTrigger() : 0;
+
+	if ( ! trigger )
+		return 0;
+
+	Val* v = trigger->Lookup(this);
+	if ( ! v )
+		return 0;
+
+	DBG_LOG(DBG_NOTIFIERS, "%s: provides cached function result",
+		trigger->Name());
+	return v->Ref();
+	}
+
+Val* CallExpr::Invoke(const ::Func* func, val_list* args, Frame* f) const
+	{
+	calling_expr = this;
+	const CallExpr* current_call = f ? f->GetCall() : 0;
+
+	if ( f )
+		f->SetCall(this);
+
+	Val* ret = func->Call(args, f); // No try/catch here; we pass exceptions upstream.
+
+	if ( f )
+		f->SetCall(current_call);
+
+	// Don't Unref() the arguments, as Func::Call already did that.
+	delete args;
+
+	calling_expr = 0;
 
 	return ret;
 	}
 
+Expr* CallExpr::Optimize(ScriptOptimizer* opt)
+	{
+	args->Optimize(opt);
+	opt->Inline(this);
+
+	return this;
+	}
+
+void CallExpr::SetInlineBody(BroFunc* f, Expr* body)
+	{
+	Unref(inline_func);
+	Unref(inline_body);
+
+	inline_func = f;
+	inline_body = body;
+
+	::Ref(inline_func);
+	::Ref(inline_body);
+	}
+
 TraversalCode CallExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -4666,6 +5245,12 @@ Val* EventExpr::Eval(Frame* f) const
 	return 0;
 	}
 
+Expr* EventExpr::Optimize(ScriptOptimizer* opt)
+	{
+	args->Optimize(opt);
+	return this;
+	}
+
 TraversalCode EventExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
@@ -4752,6 +5337,14 @@ int ListExpr::IsPure() const
 	return 1;
 	}
 
+Expr* ListExpr::Optimize(ScriptOptimizer* opt)
+	{
+	loop_over_list(exprs, i)
+		exprs.replace(i, opt->Reduce(exprs[i]));
+
+	return this;
+	}
+
 int ListExpr::AllConst() const
 	{
 	loop_over_list(exprs, i)
@@ -56,6 +56,9 @@ class NameExpr;
 class AssignExpr;
 class CallExpr;
 class EventExpr;
+class SortedIndex;
+class ScriptOptimizer;
+class BroFunc;
 
 
 class Expr : public BroObj {
@@ -71,6 +74,12 @@ public:
 	// or nil if the expression's value isn't fixed.
 	virtual Val* Eval(Frame* f) const = 0;
 
+	// Evaluates an expression whose type is represented internally
+	// as an int, unsigned, or double directly into the corresponding
+	// field of v, without necessarily creating a Val.  Returns false
+	// if the expression's value isn't fixed.
+	virtual bool EvalScalar(Frame* f, BroValUnion& v) const;
+
 	// Same, but the context is that we are adding an element
 	// into the given aggregate of the given type.  Note that
 	// return type is void since it's updating an existing
@@ -102,6 +111,11 @@ public:
 	// True if the expression has no side effects, false otherwise.
 	virtual int IsPure() const;
 
+	// Optimizes the expression's operands in place (see ScriptOpt.h)
+	// and returns the expression to use instead of this one: either
+	// the expression itself, or a new reference to an equivalent one.
+	virtual Expr* Optimize(ScriptOptimizer* opt);
+
 	// True if the expression is a constant, false otherwise.
 	int IsConst() const	{ return tag == EXPR_CONST; }
 
@@ -221,9 +235,11 @@ public:
 	ID* Id() const		{ return id; }
 
 	Val* Eval(Frame* f) const override;
+	bool EvalScalar(Frame* f, BroValUnion& v) const override;
 	void Assign(Frame* f, Val* v, Opcode op = OP_ASSIGN) override;
 	Expr* MakeLvalue() override;
 	int IsPure() const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -247,6 +263,7 @@ public:
 	Val* Value() const	{ return val; }
 
 	Val* Eval(Frame* f) const override;
+	bool EvalScalar(Frame* f, BroValUnion& v) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -269,7 +286,14 @@ public:
 	// vectors correctly as necessary.
 	Val* Eval(Frame* f) const override;
 
+	// Computes the expression's value from its already evaluated
+	// operand, taking ownership of it.  For expressions that don't
+	// override Eval(), this is equivalent to evaluating the operand
+	// and then Eval().
+	Val* EvalOperand(Val* v) const;
+
 	int IsPure() const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -296,20 +320,39 @@ public:
 	Expr* Op2() const	{ return op2; }
 
 	int IsPure() const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	// BinaryExpr::Eval correctly handles vector types.  Any child
 	// class that overrides Eval() should be modified to handle
 	// vectors correctly as necessary.
 	Val* Eval(Frame* f) const override;
 
+	// Computes the expression's value from its already evaluated
+	// operands, taking ownership of them.  For expressions that don't
+	// override Eval(), this is equivalent to evaluating the operands
+	// and then Eval().
+	Val* EvalOperands(Val* v1, Val* v2) const;
+
+	// Returns the internal type in which the expression computes its
+	// result when that's a plain number operation on scalars, and
+	// TYPE_INTERNAL_VOID otherwise.  Such expressions can evaluate
+	// their operands through EvalScalar().
+	InternalTypeTag ScalarType() const;
+
+	bool EvalScalar(Frame* f, BroValUnion& v) const override;
+
+	// Returns a Val for a result of the expression's type computed
+	// by EvalScalar().
+	Val* BoxScalar(const BroValUnion& v) const;
+
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
 	friend class Expr;
-	BinaryExpr()	{ op1 = op2 = 0; }
+	BinaryExpr()	{ op1 = op2 = 0; scalar_type = -1; }
 
 	BinaryExpr(BroExprTag arg_tag, Expr* arg_op1, Expr* arg_op2)
-	    : Expr(arg_tag), op1(arg_op1), op2(arg_op2)
+	    : Expr(arg_tag), op1(arg_op1), op2(arg_op2), scalar_type(-1)
 		{
 		if ( ! (arg_op1 && arg_op2) )
 			return;
@@ -328,6 +371,10 @@ protected:
 	virtual Val* AddrFold(Val* v1, Val* v2) const;
 	virtual Val* SubNetFold(Val* v1, Val* v2) const;
 
+	// Helpers for EvalScalar().
+	template<typename T> T ScalarArith(T x, T y) const;
+	template<typename T> bool ScalarCompare(T x, T y) const;
+
 	int BothConst() const	{ return op1->IsConst() && op2->IsConst(); }
 
 	// Exchange op1 and op2.
@@ -346,6 +393,8 @@ protected:
 
 	Expr* op1;
 	Expr* op2;
+
+	mutable int scalar_type;	// cached ScalarType(), or -1
 };
 
 class CloneExpr : public UnaryExpr {
@@ -523,6 +572,8 @@ public:
 	Val* Eval(Frame* f) const override;
 	Val* DoSingleEval(Frame* f, Val* v1, Expr* op2) const;
 
+	Expr* Optimize(ScriptOptimizer* opt) override;
+
 protected:
 	friend class Expr;
 	BoolExpr()	{ }
@@ -567,6 +618,7 @@ public:
 
 	Val* Eval(Frame* f) const override;
 	int IsPure() const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -607,6 +659,7 @@ public:
 	Val* Eval(Frame* f) const override;
 	void EvalIntoAggregate(const BroType* t, Val* aggr, Frame* f) const override;
 	BroType* InitType() const override;
+	int IsInit() const	{ return is_init; }
 	int IsRecordElement(TypeDecl* td) const override;
 	Val* InitVal(const BroType* t, Val* aggr) const override;
 	int IsPure() const override;
@@ -641,6 +694,10 @@ public:
 	// not necessarily return a vector.
 	Val* Eval(Frame* f) const override;
 
+	// Same as BinaryExpr::EvalOperands(), for the vector handling
+	// of our Eval().
+	Val* EvalOperands(Val* v1, Val* v2) const;
+
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
@@ -667,6 +724,9 @@ public:
 	void Assign(Frame* f, Val* v, Opcode op = OP_ASSIGN) override;
 	void Delete(Frame* f) override;
 
+	// Reads numeric fields directly out of the record's slab.
+	bool EvalScalar(Frame* f, BroValUnion& v) const override;
+
 	Expr* MakeLvalue() override;
 
 protected:
@@ -931,15 +991,30 @@ protected:
 class InExpr : public BinaryExpr {
 public:
 	InExpr(Expr* op1, Expr* op2);
+	~InExpr() override;
+
+	Val* Eval(Frame* f) const override;
 
 protected:
 	friend class Expr;
-	InExpr()	{ }
+	InExpr()	{ const_set = 0; set_index = 0; indexed_set = 0; }
 
 	Val* Fold(Val* v1, Val* v2) const override;
 
+	// If the set is the current value of const_set, returns an index
+	// of its elements, (re)building it as needed.  Otherwise returns
+	// nil.
+	const SortedIndex* ConstSetIndex(const Val* set) const;
+
 	DECLARE_SERIAL(InExpr);
 
+	// For tests of a single atomic value against a constant set, the
+	// set's identifier.
+	ID* const_set;
+
+	mutable SortedIndex* set_index;
+	mutable const Val* indexed_set;
+	mutable uint64 indexed_version;
 };
 
 class CallExpr : public Expr {
@@ -954,18 +1029,40 @@ public:
 
 	Val* Eval(Frame* f) const override;
 
+	// If we are inside a trigger condition, we may have already been
+	// called, delayed, and then produced a result which is now cached.
+	// Returns a new reference to that result, or nil if there's none.
+	Val* CachedResult(Frame* f) const;
+
+	// Calls the function with already evaluated arguments, taking
+	// ownership of the list.
+	Val* Invoke(const ::Func* func, val_list* args, Frame* f) const;
+
+	Expr* Optimize(ScriptOptimizer* opt) override;
+
+	// Makes Eval() compute the call's result by evaluating the given
+	// expression, which the callee's body returns, in a frame of the
+	// callee's, instead of calling it.  Set up by the script optimizer.
+	void SetInlineBody(BroFunc* f, Expr* body);
+	const Expr* InlineBody() const	{ return inline_body; }
+
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
 	friend class Expr;
-	CallExpr()	{ func = 0; args = 0; }
+	CallExpr()	{ func = 0; args = 0; inline_func = 0; inline_body = 0; }
 
 	void ExprDescribe(ODesc* d) const override;
 
+	Val* EvalInline(Frame* f) const;
+
 	DECLARE_SERIAL(CallExpr);
 
 	Expr* func;
 	ListExpr* args;
+
+	BroFunc* inline_func;
+	Expr* inline_body;
 };
 
 class EventExpr : public Expr {
@@ -978,6 +1075,7 @@ public:
 	EventHandlerPtr Handler()  const	{ return handler; }
 
 	Val* Eval(Frame* f) const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -1012,6 +1110,7 @@ public:
 	int AllConst() const;
 
 	Val* Eval(Frame* f) const override;
+	Expr* Optimize(ScriptOptimizer* opt) override;
 
 	BroType* InitType() const override;
 	Val* InitVal(const BroType* t, Val* aggr) const override;
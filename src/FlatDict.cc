@@ -0,0 +1,382 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <algorithm>
+
+#include "FlatDict.h"
+#include "Reporter.h"
+#include "util.h"
+
+// Smallest index we allocate; must be a power of two.
+#define MIN_INDEX_SIZE 8
+
+// The index is grown once more than this fraction of its slots is in
+// use.  Robin hood hashing keeps probe sequences short even at high
+// loads, but we trade a bit of memory for fewer collisions here.
+#define MAX_LOAD_NUM 3
+#define MAX_LOAD_DEN 4
+
+// Fraction of dead entries in a full dense array above which we compact
+// it rather than grow it.
+#define COMPACT_THRESH_DEN 4
+
+// The value of an iteration cookie is simply the position in the dense
+// entry array at which to start looking for the next live entry.
+class FlatIterCookie {
+public:
+	FlatIterCookie()	{ pos = 0; }
+
+	int pos;
+};
+
+FlatDictionary::FlatDictionary(dict_order ordering, int initial_size)
+	{
+	delete_func = 0;
+	Init(initial_size);
+	}
+
+FlatDictionary::~FlatDictionary()
+	{
+	DeInit();
+	}
+
+void FlatDictionary::Clear()
+	{
+	DeInit();
+	Init(MIN_INDEX_SIZE);
+	}
+
+void FlatDictionary::Init(int size)
+	{
+	unsigned int index_size = MIN_INDEX_SIZE;
+
+	while ( index_size * MAX_LOAD_NUM < (unsigned int) size * MAX_LOAD_DEN )
+		index_size <<= 1;
+
+	index = new Slot[index_size];
+	index_mask = index_size - 1;
+
+	for ( unsigned int i = 0; i < index_size; ++i )
+		index[i].entry = -1;
+
+	entries_size = index_size * MAX_LOAD_NUM / MAX_LOAD_DEN;
+	entries = (Entry*) safe_malloc(entries_size * sizeof(Entry));
+	num_slots_used = 0;
+
+	num_entries = max_num_entries = 0;
+	}
+
+void FlatDictionary::DeInit()
+	{
+	for ( int i = 0; i < num_slots_used; ++i )
+		{
+		Entry* e = &entries[i];
+
+		if ( e->len < 0 )
+			continue;
+
+		if ( delete_func )
+			delete_func(e->value);
+
+		if ( e->len > FLAT_DICT_INLINE_KEY )
+			delete [] e->k.key;
+		}
+
+	free(entries);
+	delete [] index;
+
+	entries = 0;
+	index = 0;
+	}
+
+int FlatDictionary::FindSlot(const void* key, int key_size, hash_t hash) const
+	{
+	uint32 h = uint32(hash);
+	unsigned int pos = h & index_mask;
+
+	for ( unsigned int dist = 0; ; ++dist, pos = (pos + 1) & index_mask )
+		{
+		const Slot& s = index[pos];
+
+		if ( s.entry < 0 )
+			return -1;
+
+		// Under robin hood ordering, our key would have displaced
+		// any entry closer to its home slot than we are to ours.
+		if ( ProbeDistance(s.hash, pos) < dist )
+			return -1;
+
+		if ( s.hash == h && entries[s.entry].Matches(key, key_size, hash) )
+			return pos;
+		}
+	}
+
+void FlatDictionary::IndexEntry(uint32 hash, int entry)
+	{
+	unsigned int pos = hash & index_mask;
+
+	for ( unsigned int dist = 0; ; ++dist, pos = (pos + 1) & index_mask )
+		{
+		Slot& s = index[pos];
+
+		if ( s.entry < 0 )
+			{
+			s.hash = hash;
+			s.entry = entry;
+			return;
+			}
+
+		unsigned int s_dist = ProbeDistance(s.hash, pos);
+
+		if ( s_dist < dist )
+			{
+			// Take the slot from the richer entry and continue
+			// with finding a place for that one instead.
+			std::swap(s.hash, hash);
+			std::swap(s.entry, entry);
+			dist = s_dist;
+			}
+		}
+	}
+
+void* FlatDictionary::Lookup(const void* key, int key_size, hash_t hash) const
+	{
+	int pos = FindSlot(key, key_size, hash);
+	return pos < 0 ? 0 : entries[index[pos].entry].value;
+	}
+
+void* FlatDictionary::Insert(const void* key, int key_size, hash_t hash,
+				void* val)
+	{
+	int pos = FindSlot(key, key_size, hash);
+
+	if ( pos >= 0 )
+		{
+		Entry* e = &entries[index[pos].entry];
+		void* old_value = e->value;
+		e->value = val;
+		return old_value;
+		}
+
+	Reserve();
+
+	int n = num_slots_used++;
+	Entry* e = &entries[n];
+	e->hash = hash;
+	e->value = val;
+	e->len = key_size;
+
+	if ( key_size > FLAT_DICT_INLINE_KEY )
+		{
+		e->k.key = new char[key_size];
+		memcpy(e->k.key, key, key_size);
+		}
+	else
+		memcpy(e->k.inline_key, key, key_size);
+
+	IndexEntry(uint32(hash), n);
+
+	if ( max_num_entries < ++num_entries )
+		max_num_entries = num_entries;
+
+	// Ongoing iterations pick up the new entry once they reach the end
+	// of the dense array, no need to adjust any cookies.
+	return 0;
+	}
+
+void* FlatDictionary::Remove(const void* key, int key_size, hash_t hash)
+	{
+	int pos = FindSlot(key, key_size, hash);
+
+	if ( pos < 0 )
+		return 0;
+
+	Entry* e = &entries[index[pos].entry];
+	void* entry_value = e->value;
+
+	if ( e->len > FLAT_DICT_INLINE_KEY )
+		delete [] e->k.key;
+
+	e->len = -1;
+	e->value = 0;
+	--num_entries;
+
+	// Backward-shift deletion: pull the following entries of the
+	// cluster one slot closer to home until we hit one that's already
+	// there (or an empty slot).  This avoids the need for tombstones
+	// in the index.
+	unsigned int cur = pos;
+
+	for ( ; ; )
+		{
+		unsigned int next = (cur + 1) & index_mask;
+		const Slot& s = index[next];
+
+		if ( s.entry < 0 || ProbeDistance(s.hash, next) == 0 )
+			break;
+
+		index[cur] = s;
+		cur = next;
+		}
+
+	index[cur].entry = -1;
+
+	// Cookies skip over the dead entry, so there's nothing to adjust
+	// for them either.
+	return entry_value;
+	}
+
+void FlatDictionary::Reserve()
+	{
+	unsigned int index_size = index_mask + 1;
+
+	if ( (unsigned int) (num_entries + 1) * MAX_LOAD_DEN > index_size * MAX_LOAD_NUM )
+		Reindex(index_size * 2);
+
+	if ( num_slots_used < entries_size )
+		return;
+
+	// Renumbering the entries would make ongoing robust iterations skip
+	// or repeat some of them, so we just grow in that case.
+	int num_dead = num_slots_used - num_entries;
+
+	if ( cookies.length() == 0 &&
+	     num_dead > entries_size / COMPACT_THRESH_DEN )
+		{
+		Compact();
+		return;
+		}
+
+	entries_size *= 2;
+	entries = (Entry*) safe_realloc(entries, entries_size * sizeof(Entry));
+	}
+
+void FlatDictionary::Reindex(int new_index_size)
+	{
+	delete [] index;
+	index = new Slot[new_index_size];
+	index_mask = new_index_size - 1;
+
+	for ( int i = 0; i < new_index_size; ++i )
+		index[i].entry = -1;
+
+	for ( int i = 0; i < num_slots_used; ++i )
+		if ( entries[i].len >= 0 )
+			IndexEntry(uint32(entries[i].hash), i);
+	}
+
+void FlatDictionary::Compact()
+	{
+	int n = 0;
+
+	for ( int i = 0; i < num_slots_used; ++i )
+		{
+		if ( entries[i].len < 0 )
+			continue;
+
+		if ( i != n )
+			entries[n] = entries[i];
+
+		++n;
+		}
+
+	if ( n != num_entries )
+		reporter->InternalError("FlatDictionary::Compact: %d live entries, expected %d",
+					n, num_entries);
+
+	num_slots_used = n;
+	Reindex(index_mask + 1);
+	}
+
+void* FlatDictionary::NthEntry(int n, const void*& key, int& key_len) const
+	{
+	if ( n < 0 || n >= num_entries )
+		return 0;
+
+	const Entry* e = 0;
+
+	if ( num_slots_used == num_entries )
+		// No dead entries, so we can go straight to it.
+		e = &entries[n];
+	else
+		{
+		for ( int i = 0; i < num_slots_used; ++i )
+			if ( entries[i].len >= 0 && n-- == 0 )
+				{
+				e = &entries[i];
+				break;
+				}
+		}
+
+	key = e->Key();
+	key_len = e->len;
+	return e->value;
+	}
+
+FlatIterCookie* FlatDictionary::InitForIteration() const
+	{
+	return new FlatIterCookie();
+	}
+
+void FlatDictionary::StopIteration(FlatIterCookie* cookie) const
+	{
+	const_cast<PList(FlatIterCookie)*>(&cookies)->remove(cookie);
+	delete cookie;
+	}
+
+void* FlatDictionary::NextEntry(HashKey*& h, FlatIterCookie*& cookie,
+				int return_hash) const
+	{
+	while ( cookie->pos < num_slots_used )
+		{
+		const Entry* e = &entries[cookie->pos++];
+
+		if ( e->len < 0 )
+			continue;
+
+		if ( return_hash )
+			h = new HashKey(e->Key(), e->len, e->hash);
+
+		return e->value;
+		}
+
+	// All done.
+	StopIteration(cookie);
+	cookie = 0;
+	return 0;
+	}
+
+void* FlatDictionary::NextEntry(const void*& key, int& key_len,
+				FlatIterCookie*& cookie) const
+	{
+	while ( cookie->pos < num_slots_used )
+		{
+		const Entry* e = &entries[cookie->pos++];
+
+		if ( e->len < 0 )
+			continue;
+
+		key = e->Key();
+		key_len = e->len;
+		return e->value;
+		}
+
+	StopIteration(cookie);
+	cookie = 0;
+	return 0;
+	}
+
+unsigned int FlatDictionary::MemoryAllocation() const
+	{
+	unsigned int size = padded_sizeof(*this);
+
+	size += pad_size(entries_size * sizeof(Entry));
+	size += pad_size((index_mask + 1) * sizeof(Slot));
+
+	for ( int i = 0; i < num_slots_used; ++i )
+		if ( entries[i].len > FLAT_DICT_INLINE_KEY )
+			size += pad_size(entries[i].len);
+
+	return size;
+	}
@@ -0,0 +1,203 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef flatdict_h
+#define flatdict_h
+
+#include <string.h>
+
+#include "Dict.h"
+
+class FlatIterCookie;
+
+declare(PList,FlatIterCookie);
+
+// An open-addressing alternative to Dictionary for hot, large tables
+// (such as the connection tables), offering the same interface.
+//
+// Entries live in a dense array in insertion order, each holding its
+// full hash, its value, and - for keys of up to FLAT_DICT_INLINE_KEY
+// bytes - the key itself, so that a successful lookup touches a single
+// cache line of entry data.  They are located through a power-of-two
+// sized index of (hash, entry) slots using robin hood linear probing
+// with backward-shift deletion.
+//
+// Since the index is separate from the entries, growing it never moves
+// an entry.  Removing an entry just marks its slot in the dense array
+// dead; dead slots are only reclaimed when the array is full and no
+// robust iteration is in progress.  Iterating over the dense array
+// thus naturally provides the robust cookie semantics of Dictionary.
+#define FLAT_DICT_INLINE_KEY 40
+
+class FlatDictionary {
+public:
+	// The ordering argument is accepted for compatibility with
+	// Dictionary; the dense array always preserves insertion order.
+	FlatDictionary(dict_order ordering = UNORDERED,
+			int initial_size = DEFAULT_DICT_SIZE);
+	virtual ~FlatDictionary();
+
+	// Lookup, insertion and removal work just like Dictionary's.
+	// Note that Insert() copies the key rather than taking it over
+	// from the HashKey, as short keys are stored inline.
+	void* Lookup(const HashKey* key) const
+		{ return Lookup(key->Key(), key->Size(), key->Hash()); }
+	void* Lookup(const void* key, int key_size, hash_t hash) const;
+
+	// Returns previous value, or 0 if none.
+	void* Insert(const HashKey* key, void* val)
+		{ return Insert(key->Key(), key->Size(), key->Hash(), val); }
+	void* Insert(const void* key, int key_size, hash_t hash, void* val);
+
+	// Removes the given element.  Returns a pointer to the element in
+	// case it needs to be deleted.  Returns 0 if no such element exists.
+	void* Remove(const HashKey* key)
+		{ return Remove(key->Key(), key->Size(), key->Hash()); }
+	void* Remove(const void* key, int key_size, hash_t hash);
+
+	// Number of entries.
+	int Length() const		{ return num_entries; }
+
+	// Largest it's ever been.
+	int MaxLength() const		{ return max_num_entries; }
+
+	// Returns the n'th entry's value (in insertion order) and,
+	// for the second method, its key.  Returns nil if "n" is out
+	// of range.
+	void* NthEntry(int n) const
+		{
+		const void* key;
+		int key_len;
+		return NthEntry(n, key, key_len);
+		}
+	void* NthEntry(int n, const void*& key, int& key_len) const;
+
+	// Iteration works as with Dictionary.  Entries are returned in
+	// insertion order.
+	FlatIterCookie* InitForIteration() const;
+	void* NextEntry(HashKey*& h, FlatIterCookie*& cookie,
+			int return_hash) const;
+	void* NextEntry(const void*& key, int& key_len,
+			FlatIterCookie*& cookie) const;
+	void StopIteration(FlatIterCookie* cookie) const;
+
+	void SetDeleteFunc(dict_delete_func f)		{ delete_func = f; }
+
+	// With a robust cookie, it is safe to change the dictionary while
+	// iterating: we will eventually visit all unmodified entries as
+	// well as all entries added during iteration, and won't visit any
+	// still-unseen entries which are getting removed.  Unlike with
+	// Dictionary, this comes almost for free; registering the cookie
+	// merely keeps the dense array from being compacted underneath it.
+	void MakeRobustCookie(FlatIterCookie* cookie)
+		{ cookies.append(cookie); }
+
+	// Remove all entries.
+	void Clear();
+
+	unsigned int MemoryAllocation() const;
+
+private:
+	struct Entry {
+		hash_t hash;
+		void* value;
+		int len;	// < 0 for a removed entry
+
+		union {
+			char inline_key[FLAT_DICT_INLINE_KEY];
+			char* key;
+		} k;
+
+		const void* Key() const
+			{ return len > FLAT_DICT_INLINE_KEY ? k.key : k.inline_key; }
+
+		bool Matches(const void* key, int key_size, hash_t h) const
+			{
+			return hash == h && len == key_size &&
+				memcmp(Key(), key, key_size) == 0;
+			}
+	};
+
+	// An empty index slot has a negative entry.  We keep the low bits
+	// of the hash with the slot, so probing rarely touches entries
+	// that don't match and we can compute probe distances without
+	// going to the entry.
+	struct Slot {
+		uint32 hash;
+		int entry;
+	};
+
+	void Init(int size);
+	void DeInit();
+
+	// Returns the index slot for the given key, or -1 if not found.
+	int FindSlot(const void* key, int key_size, hash_t hash) const;
+
+	// Places the given entry into the index, which must have room.
+	void IndexEntry(uint32 hash, int entry);
+
+	// Makes room for one more entry, growing the index and either
+	// compacting or growing the dense array as necessary.
+	void Reserve();
+	void Reindex(int new_index_size);
+	void Compact();
+
+	unsigned int ProbeDistance(uint32 hash, unsigned int pos) const
+		{ return (pos - (hash & index_mask)) & index_mask; }
+
+	Entry* entries;
+	int num_slots_used;	// high-water mark in entries, including dead ones
+	int entries_size;
+
+	Slot* index;
+	unsigned int index_mask;
+
+	int num_entries;
+	int max_num_entries;
+
+	dict_delete_func delete_func;
+
+	PList(FlatIterCookie) cookies;
+};
+
+#define FlatPDict(type) type ## FlatPDict
+#define FlatPDictdeclare(type)	\
+class FlatPDict(type) : public FlatDictionary {	\
+public:	\
+	FlatPDict(type)(dict_order ordering = UNORDERED,	\
+			int initial_size = DEFAULT_DICT_SIZE) :	\
+		FlatDictionary(ordering, initial_size) {}	\
+	type* Lookup(const char* key) const	\
+		{	\
+		HashKey h(key);	\
+		return (type*) FlatDictionary::Lookup(&h);	\
+		}	\
+	type* Lookup(const HashKey* key) const	\
+		{ return (type*) FlatDictionary::Lookup(key); }	\
+	type* Insert(const char* key, type* val)	\
+		{	\
+		HashKey h(key);	\
+		return (type*) FlatDictionary::Insert(&h, (void*) val);	\
+		}	\
+	type* Insert(const HashKey* key, type* val)	\
+		{ return (type*) FlatDictionary::Insert(key, (void*) val); }\
+	type* NthEntry(int n) const	\
+		{ return (type*) FlatDictionary::NthEntry(n); }	\
+	type* NthEntry(int n, const char*& key) const	\
+		{	\
+		int key_len;	\
+		return (type*) FlatDictionary::NthEntry(n, (const void*&) key,\
+							key_len);	\
+		}	\
+	type* NextEntry(FlatIterCookie*& cookie) const	\
+		{	\
+		HashKey* h; \
+		return (type*) FlatDictionary::NextEntry(h, cookie, 0);	\
+		} \
+	type* NextEntry(HashKey*& h, FlatIterCookie*& cookie) const	\
+		{ return (type*) FlatDictionary::NextEntry(h, cookie, 1); } \
+	type* RemoveEntry(const HashKey* key)	\
+		{ return (type*) Remove(key->Key(), key->Size(),	\
+					key->Hash()); } \
+}
+
+#endif
@@ -186,6 +186,15 @@ void FragReassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 		Weird("fragment_overlap");
 	}
 
+void FragReassembler::Evict()
+	{
+	// Without the buffered fragments, the packet can't ever be put
+	// back together, so there's no use in keeping any state for it.
+	Weird("reassembly_buffer_evicted");
+	DeleteTimer();
+	sessions->Remove(this);
+	}
+
 void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 	{
 	if ( blocks->seq > 0 || ! frag_size )
@@ -300,12 +309,7 @@ void FragReassembler::BlockInserted(DataBlock* /* start_block */)
 
 void FragReassembler::Expire(double t)
 	{
-	while ( blocks )
-		{
-		DataBlock* b = blocks->next;
-		delete blocks;
-		blocks = b;
-		}
+	ClearBlocks();
 
 	expire_timer->ClearReassembler();
 	expire_timer = 0;	// timer manager will delete it
@@ -35,6 +35,7 @@ public:
 protected:
 	void BlockInserted(DataBlock* start_block);
 	void Overlap(const u_char* b1, const u_char* b2, uint64 n);
+	void Evict() override;
 	void Weird(const char* name) const;
 
 	u_char* proto_hdr;
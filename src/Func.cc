@@ -30,6 +30,7 @@
 #include <algorithm>
 
 #include "Base64.h"
+#include "Bytecode.h"
 #include "Stmt.h"
 #include "Scope.h"
 #include "Net.h"
@@ -46,6 +47,8 @@
 #include "Event.h"
 #include "Traverse.h"
 #include "Reporter.h"
+#include "ScriptProfiler.h"
+#include "ScriptOpt.h"
 #include "plugin/Manager.h"
 
 extern	RETSIGTYPE sig_handler(int signo);
@@ -155,6 +158,7 @@ bool Func::DoUnserialize(UnserialInfo* info)
 		{
 		Body b;
 		b.stmts = Stmt::Unserialize(info);
+		b.code = 0;
 		if ( ! b.stmts )
 			return false;
 
@@ -312,6 +316,7 @@ BroFunc::BroFunc(ID* arg_id, Stmt* arg_body, id_list* aggr_inits,
 		{
 		Body b;
 		b.stmts = AddInits(arg_body, aggr_inits);
+		b.code = 0;
 		b.priority = priority;
 		bodies.push_back(b);
 		}
@@ -320,7 +325,10 @@ BroFunc::BroFunc(ID* arg_id, Stmt* arg_body, id_list* aggr_inits,
 BroFunc::~BroFunc()
 	{
 	for ( unsigned int i = 0; i < bodies.size(); ++i )
+		{
 		Unref(bodies[i].stmts);
+		delete bodies[i].code;
+		}
 	}
 
 int BroFunc::IsPure() const
@@ -400,7 +408,13 @@ Val* BroFunc::Call(val_list* args, Frame* parent) const
 
 		try
 			{
-			result = bodies[i].stmts->Exec(f, flow);
+			ScriptProfiler::Scope profile(script_profiler, this,
+							bodies[i].stmts);
+
+			if ( bodies[i].code )
+				result = bodies[i].code->Exec(f, flow);
+			else
+				result = bodies[i].stmts->Exec(f, flow);
 			}
 
 		catch ( InterpreterException& e )
@@ -475,12 +489,16 @@ void BroFunc::AddBody(Stmt* new_body, id_list* new_inits, int new_frame_size,
 		// For functions, we replace the old body with the new one.
 		assert(bodies.size() <= 1);
 		for ( unsigned int i = 0; i < bodies.size(); ++i )
+			{
 			Unref(bodies[i].stmts);
+			delete bodies[i].code;
+			}
 		bodies.clear();
 		}
 
 	Body b;
 	b.stmts = new_body;
+	b.code = 0;
 	b.priority = priority;
 
 	bodies.push_back(b);
@@ -500,6 +518,19 @@ void BroFunc::Describe(ODesc* d) const
 		}
 	}
 
+void BroFunc::Optimize(ScriptOptimizer* opt)
+	{
+	for ( unsigned int i = 0; i < bodies.size(); ++i )
+		bodies[i].stmts = opt->Reduce(bodies[i].stmts);
+	}
+
+void BroFunc::Compile()
+	{
+	for ( unsigned int i = 0; i < bodies.size(); ++i )
+		if ( ! bodies[i].code )
+			bodies[i].code = new Bytecode(this, bodies[i].stmts);
+	}
+
 Stmt* BroFunc::AddInits(Stmt* body, id_list* inits)
 	{
 	if ( ! inits || inits->length() == 0 )
@@ -583,7 +614,13 @@ Val* BuiltinFunc::Call(val_list* args, Frame* parent) const
 		g_trace_state.LogTrace("\tBuiltin Function called: %s\n", d.Description());
 		}
 
-	Val* result = func(parent, args);
+	Val* result;
+
+		{
+		ScriptProfiler::Scope profile(script_profiler, this);
+		result = func(parent, args);
+		}
+
 	loop_over_list(*args, i)
 		Unref((*args)[i]);
 
@@ -16,6 +16,8 @@ class Stmt;
 class Frame;
 class ID;
 class CallExpr;
+class Bytecode;
+class ScriptOptimizer;
 
 class Func : public BroObj {
 public:
@@ -31,6 +33,7 @@ public:
 
 	struct Body {
 		Stmt* stmts;
+		Bytecode* code;	// compiled form of stmts, or nil
 		int priority;
 		bool operator<(const Body& other) const
 			{ return priority > other.priority; } // reverse sort
@@ -100,6 +103,14 @@ public:
 
 	int FrameSize() const {	return frame_size; }
 
+	// Optimizes the bodies' statements.  Needs to happen before
+	// Compile().
+	void Optimize(ScriptOptimizer* opt);
+
+	// Compiles the bodies to bytecode, which Call() then executes
+	// instead of the statements.
+	void Compile();
+
 	void Describe(ODesc* d) const override;
 
 protected:
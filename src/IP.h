@@ -9,6 +9,7 @@
 #include "Reporter.h"
 #include "Val.h"
 #include "Type.h"
+#include "Arena.h"
 #include <vector>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -34,6 +35,8 @@ struct ip6_mobility {
  */
 class IPv6_Hdr {
 public:
+	DECLARE_ARENA_ALLOCATION
+
 	/**
 	 * Construct an IPv6 header or extension header from assigned type number.
 	 */
@@ -138,14 +141,18 @@ protected:
 
 class IPv6_Hdr_Chain {
 public:
+	DECLARE_ARENA_ALLOCATION
+
 	/**
 	 * Initializes the header chain from an IPv6 header structure.
+	 * @param a if given, the arena to allocate the individual headers
+	 * from; the chain must then not outlive the packet data either.
 	 */
-	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, int len) :
+	IPv6_Hdr_Chain(const struct ip6_hdr* ip6, int len, Arena* a = 0) :
 #ifdef ENABLE_MOBILE_IPV6
 		homeAddr(0),
 #endif
-		finalDst(0)
+		finalDst(0), arena(a)
 		{ Init(ip6, len, false); }
 
 	~IPv6_Hdr_Chain()
@@ -275,7 +282,7 @@ protected:
 #ifdef ENABLE_MOBILE_IPV6
 		homeAddr(0),
 #endif
-		finalDst(0)
+		finalDst(0), arena(0)
 		{}
 
 	/**
@@ -286,7 +293,7 @@ protected:
 #ifdef ENABLE_MOBILE_IPV6
 		homeAddr(0),
 #endif
-		finalDst(0)
+		finalDst(0), arena(0)
 		{ Init(ip6, len, true, next); }
 
 	/**
@@ -330,6 +337,11 @@ protected:
 	 * non-zero segments left.
 	 */
 	IPAddr* finalDst;
+
+	/**
+	 * Arena to allocate the chain's headers from, or null for the heap.
+	 */
+	Arena* arena;
 };
 
 /**
@@ -338,6 +350,8 @@ protected:
  */
 class IP_Hdr {
 public:
+	DECLARE_ARENA_ALLOCATION
+
 	/**
 	 * Construct the header wrapper from an IPv4 packet.  Caller must have
 	 * already checked that the header is not truncated.
@@ -363,7 +377,7 @@ public:
 	IP_Hdr(const struct ip6_hdr* arg_ip6, bool arg_del, int len,
 	       const IPv6_Hdr_Chain* c = 0)
 		: ip4(0), ip6(arg_ip6), del(arg_del),
-		  ip6_hdrs(c ? c : new IPv6_Hdr_Chain(ip6, len))
+		  ip6_hdrs(c ? c : NewChain(arg_ip6, arg_del, len))
 		{
 		}
 
@@ -581,6 +595,17 @@ public:
 	RecordVal* BuildPktHdrVal(RecordVal* pkt_hdr, int sindex) const;
 
 private:
+	// If we don't own the packet data, it won't outlive the packet
+	// currently being processed, and neither will the chain.
+	static const IPv6_Hdr_Chain* NewChain(const struct ip6_hdr* ip6,
+					      bool del, int len)
+		{
+		if ( del )
+			return new IPv6_Hdr_Chain(ip6, len);
+
+		return new (packet_arena) IPv6_Hdr_Chain(ip6, len, &packet_arena);
+		}
+
 	const struct ip* ip4;
 	const struct ip6_hdr* ip6;
 	bool del;
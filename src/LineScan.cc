@@ -0,0 +1,251 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "LineScan.h"
+#include "Reporter.h"
+
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define LINE_SCAN_SSE2
+#include <emmintrin.h>
+
+// Older compilers can't build AVX2 code into functions of their own
+// while leaving the rest of the binary generic.
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define LINE_SCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+static const u_char* scan_scalar(const u_char* data, const u_char* end,
+					bool stop_at_NUL)
+	{
+	for ( ; data < end; ++data )
+		{
+		u_char c = *data;
+
+		if ( c == '\r' || c == '\n' || (c == '\0' && stop_at_NUL) )
+			break;
+		}
+
+	return data;
+	}
+
+#ifdef LINE_SCAN_SSE2
+static const u_char* scan_sse2(const u_char* data, const u_char* end,
+				bool stop_at_NUL)
+	{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i nul_mask = stop_at_NUL ? _mm_set1_epi8(-1) : nul;
+
+	for ( ; end - data >= 16; data += 16 )
+		{
+		__m128i v = _mm_loadu_si128((const __m128i*) data);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+					 _mm_cmpeq_epi8(v, lf));
+		m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(v, nul),
+						  nul_mask));
+
+		int bits = _mm_movemask_epi8(m);
+
+		if ( bits )
+			return data + __builtin_ctz(bits);
+		}
+
+	return scan_scalar(data, end, stop_at_NUL);
+	}
+#endif
+
+#ifdef LINE_SCAN_AVX2
+__attribute__((target("avx2")))
+static const u_char* scan_avx2(const u_char* data, const u_char* end,
+				bool stop_at_NUL)
+	{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i nul = _mm256_setzero_si256();
+	const __m256i nul_mask = stop_at_NUL ? _mm256_set1_epi8(-1) : nul;
+
+	for ( ; end - data >= 32; data += 32 )
+		{
+		__m256i v = _mm256_loadu_si256((const __m256i*) data);
+		__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+					    _mm256_cmpeq_epi8(v, lf));
+		m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(v, nul),
+							nul_mask));
+
+		unsigned int bits = _mm256_movemask_epi8(m);
+
+		if ( bits )
+			return data + __builtin_ctz(bits);
+		}
+
+	// Lines are short, so the remainder is often worth another look
+	// at 16 bytes.  This must not call scan_sse2(), as switching from
+	// AVX to legacy SSE instructions is expensive.
+	if ( end - data >= 16 )
+		{
+		__m128i v = _mm_loadu_si128((const __m128i*) data);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(cr)),
+					 _mm_cmpeq_epi8(v, _mm256_castsi256_si128(lf)));
+		m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+						  _mm256_castsi256_si128(nul_mask)));
+
+		int bits = _mm_movemask_epi8(m);
+
+		if ( bits )
+			return data + __builtin_ctz(bits);
+
+		data += 16;
+		}
+
+	return scan_scalar(data, end, stop_at_NUL);
+	}
+#endif
+
+namespace {
+
+struct Scanner {
+	const char* name;
+	line_scanner_func func;
+	bool supported;
+};
+
+}
+
+static Scanner scanners[] = {
+#ifdef LINE_SCAN_AVX2
+	{ "avx2", scan_avx2, false },
+#endif
+#ifdef LINE_SCAN_SSE2
+	{ "sse2", scan_sse2, true },
+#endif
+	{ "scalar", scan_scalar, true },
+};
+
+static const int num_scanners = sizeof(scanners) / sizeof(scanners[0]);
+
+// Returns the index of the fastest implementation the CPU supports.
+static int select_scanner()
+	{
+#ifdef LINE_SCAN_AVX2
+	__builtin_cpu_init();
+	scanners[0].supported = __builtin_cpu_supports("avx2");
+#endif
+
+	for ( int i = 0; i < num_scanners; ++i )
+		if ( scanners[i].supported )
+			return i;
+
+	return num_scanners - 1;
+	}
+
+static int cur_scanner = select_scanner();
+
+line_scanner_func line_scanner = scanners[cur_scanner].func;
+
+const char* line_scanner_name()
+	{
+	return scanners[cur_scanner].name;
+	}
+
+bool line_scan_benchmark(const char* file)
+	{
+	FILE* f = fopen(file, "r");
+
+	if ( ! f )
+		{
+		reporter->Error("can't open %s: %s", file, strerror(errno));
+		return false;
+		}
+
+	std::string data;
+	char buf[65536];
+	size_t n;
+
+	while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+		data.append(buf, n);
+
+	fclose(f);
+
+	if ( data.empty() )
+		{
+		reporter->Error("%s is empty", file);
+		return false;
+		}
+
+	// We split the file the way the ContentLine analyzer would if it
+	// got the file as a TCP stream in segments of a typical size.
+	const int chunk_size = 1460;
+	const u_char* bytes = (const u_char*) data.data();
+	unsigned int expected_lines = 0;
+	bool ok = true;
+
+	for ( int i = 0; i < num_scanners; ++i )
+		{
+		if ( ! scanners[i].supported )
+			{
+			fprintf(stderr, "%s: not supported by this CPU\n",
+				scanners[i].name);
+			continue;
+			}
+
+		line_scanner_func scan = scanners[i].func;
+		unsigned int num_lines = 0;
+		int passes = 0;
+		double start = current_time(true);
+		double elapsed;
+
+		// Repeat until we have a meaningful measurement.
+		do
+			{
+			num_lines = 0;
+
+			for ( std::string::size_type pos = 0; pos < data.size();
+			      pos += chunk_size )
+				{
+				const u_char* p = bytes + pos;
+				const u_char* end = bytes +
+					std::min(pos + chunk_size, data.size());
+
+				while ( (p = scan(p, end, false)) < end )
+					{
+					++num_lines;
+					++p;
+					}
+				}
+
+			++passes;
+			elapsed = current_time(true) - start;
+			}
+		while ( elapsed < 1.0 );
+
+		double total = double(data.size()) * passes;
+
+		fprintf(stderr, "%s: %.1f MB/s (%d bytes x %d in %.2fs), %u line terminators%s\n",
+			scanners[i].name, total / elapsed / 1e6,
+			int(data.size()), passes, elapsed, num_lines,
+			i == cur_scanner ? " [in use]" : "");
+
+		if ( expected_lines && num_lines != expected_lines )
+			{
+			fprintf(stderr, "%s: expected %u line terminators\n",
+				scanners[i].name, expected_lines);
+			ok = false;
+			}
+
+		expected_lines = num_lines;
+		}
+
+	return ok;
+	}
@@ -0,0 +1,37 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Finds the bytes that end lines in a chunk of stream data.  On x86, the
+// search uses SSE2 or, if the CPU supports it, AVX2 to look at 16 or 32
+// bytes at a time; elsewhere it falls back to a byte-wise loop.  The
+// implementation is picked at startup.
+
+#ifndef linescan_h
+#define linescan_h
+
+#include "util.h"
+
+typedef const u_char* (*line_scanner_func)(const u_char* data,
+						const u_char* end,
+						bool stop_at_NUL);
+
+extern line_scanner_func line_scanner;
+
+// Returns a pointer to the first CR or LF in [data, end), also stopping
+// at NULs if stop_at_NUL is true, or end if there's none.
+inline const u_char* find_line_delim(const u_char* data, const u_char* end,
+					bool stop_at_NUL)
+	{
+	return line_scanner(data, end, stop_at_NUL);
+	}
+
+// Returns the name of the implementation in use ("avx2", "sse2", or
+// "scalar").
+extern const char* line_scanner_name();
+
+// Splits the contents of the file into lines with each implementation
+// the CPU supports, delivering the file in chunks of a typical segment
+// size, and prints the throughput of each.  Returns false if the file
+// can't be read or the implementations disagree.
+extern bool line_scan_benchmark(const char* file);
+
+#endif
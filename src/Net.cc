@@ -28,6 +28,7 @@
 #include "Net.h"
 #include "Anon.h"
 #include "Serializer.h"
+#include "Reassem.h"
 #include "PacketDumper.h"
 #include "iosource/Manager.h"
 #include "iosource/PktSrc.h"
@@ -271,8 +272,13 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 		}
 
 	sessions->NextPacket(t, pkt);
+	Reassembler::CheckMemoryBudget();
 	mgr.Drain();
 
+	// Whatever this packet allocated from the arena has usually been
+	// freed by now, so the memory can go to the next one.
+	packet_arena.Release();
+
 	if ( sp )
 		{
 		delete sp;
@@ -50,6 +50,8 @@ int tcp_max_initial_window;
 int tcp_max_above_hole_without_any_acks;
 int tcp_excessive_data_without_further_acks;
 int tcp_max_old_segments;
+int tcp_max_buffered_bytes;
+bro_uint_t reassembly_memory_budget;
 
 RecordType* socks_address;
 
@@ -202,6 +204,8 @@ RecordType* gap_info;
 int packet_filter_default;
 
 int sig_max_group_size;
+int sig_prefilter;
+int dfa_state_cache_budget;
 
 int enable_syslog;
 
@@ -286,6 +290,8 @@ void init_general_global_var()
 	packet_filter_default = opt_internal_int("packet_filter_default");
 
 	sig_max_group_size = opt_internal_int("sig_max_group_size");
+	sig_prefilter = opt_internal_int("sig_prefilter");
+	dfa_state_cache_budget = opt_internal_int("dfa_state_cache_budget");
 	enable_syslog = opt_internal_int("enable_syslog");
 
 	check_for_unused_event_handlers =
@@ -354,6 +360,8 @@ void init_net_var()
 	tcp_excessive_data_without_further_acks =
 		opt_internal_int("tcp_excessive_data_without_further_acks");
 	tcp_max_old_segments = opt_internal_int("tcp_max_old_segments");
+	tcp_max_buffered_bytes = opt_internal_int("tcp_max_buffered_bytes");
+	reassembly_memory_budget = opt_internal_unsigned("reassembly_memory_budget");
 
 	socks_address = internal_type("SOCKS::Address")->AsRecordType();
 
@@ -53,6 +53,8 @@ extern int tcp_max_initial_window;
 extern int tcp_max_above_hole_without_any_acks;
 extern int tcp_excessive_data_without_further_acks;
 extern int tcp_max_old_segments;
+extern int tcp_max_buffered_bytes;
+extern bro_uint_t reassembly_memory_budget;
 
 extern RecordType* socks_address;
 
@@ -206,6 +208,8 @@ extern RecordType* gap_info;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern int sig_prefilter;
+extern int dfa_state_cache_budget;
 
 extern int enable_syslog;
 
@@ -273,6 +273,30 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	SetState(0);
+	accepted_matches.clear();
+	}
+
+void RE_Match_State::SetState(DFA_State* s)
+	{
+	if ( s == current_state )
+		return;
+
+	if ( s )
+		Ref(s);
+
+	Unref(current_state);
+	current_state = s;
+	}
+
 bool RE_Match_State::Match(const u_char* bv, int n,
 				bool bol, bool eol, bool clear)
 	{
@@ -284,7 +308,7 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 
 		// Initialize state and copy the accepting states of the start
 		// state into the acceptance set.
-		current_state = dfa->StartState();
+		SetState(dfa->StartState());
 
 		const AcceptingSet* ac = current_state->Accept();
 
@@ -293,7 +317,7 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 		}
 
 	else if ( clear )
-		current_state = dfa->StartState();
+		SetState(dfa->StartState());
 
 	if ( ! current_state )
 		return false;
@@ -302,6 +326,11 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 
 	size_t old_matches = accepted_matches.size();
 
+	// We only update our reference to the current state once we're
+	// done with the chunk.  In between, the DFA won't evict the state
+	// we're moving from (see DFA_State::ComputeXtion()).
+	DFA_State* state = current_state;
+
 	int ec;
 	int m = bol ? n + 1 : n;
 	int e = eol ? -1 : 0;
@@ -315,11 +344,11 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 		else
 			ec = ecs[*(bv++)];
 
-		DFA_State* next_state = current_state->Xtion(ec,dfa);
+		DFA_State* next_state = state->Xtion(ec,dfa);
 
 		if ( ! next_state )
 			{
-			current_state = 0;
+			state = 0;
 			break;
 			}
 
@@ -330,9 +359,11 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 
 		++current_pos;
 
-		current_state = next_state;
+		state = next_state;
 		}
 
+	SetState(state);
+
 	return accepted_matches.size() != old_matches;
 	}
 
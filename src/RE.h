@@ -141,6 +141,8 @@ public:
 		current_state = 0;
 		}
 
+	~RE_Match_State();
+
 	const AcceptingMatchSet& AcceptedMatches() const
 		{ return accepted_matches; }
 
@@ -151,22 +153,26 @@ public:
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = 0;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	// Holds a reference to the state so that the DFA doesn't evict
+	// it while we're sitting there between chunks.
+	void SetState(DFA_State* s);
+
 	DFA_Machine* dfa;
 	int* ecs;
 
 	AcceptingMatchSet accepted_matches;
 	DFA_State* current_state;
 	int current_pos;
+
+private:
+	// Disable, copies would share the reference to current_state.
+	RE_Match_State(const RE_Match_State&);
+	RE_Match_State& operator=(const RE_Match_State&);
 };
 
 class RE_Matcher : SerialObj {
@@ -5,18 +5,37 @@
 #include "bro-config.h"
 
 #include "Reassem.h"
+#include "NetVar.h"
 #include "Serializer.h"
 
 static const bool DEBUG_reassem = false;
 
+// Blocks waiting on a hole get merged with their neighbors up to this size.
+static const uint64 max_coalesced_size = 16384;
+
+// With fewer blocks than this, walking the list is cheaper than keeping
+// an index.  Once built, the index stays until the blocks are all gone.
+static const uint32 min_indexed_blocks = 32;
+
 DataBlock::DataBlock(const u_char* data, uint64 size, uint64 arg_seq,
 			DataBlock* arg_prev, DataBlock* arg_next)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
 
-	memcpy((void*) block, (const void*) data, size);
+	if ( data )
+		{
+		block = new u_char[size];
+		capacity = size;
+		memcpy((void*) block, (const void*) data, size);
+		Reassembler::total_size += pad_size(capacity);
+		Reassembler::bytes_buffered += size;
+		}
+	else
+		{
+		block = 0;
+		capacity = 0;
+		}
 
 	prev = arg_prev;
 	next = arg_next;
@@ -26,17 +45,50 @@ DataBlock::DataBlock(const u_char* data, uint64 size, uint64 arg_seq,
 	if ( next )
 		next->prev = this;
 
-	Reassembler::total_size += pad_size(size) + padded_sizeof(DataBlock);
+	Reassembler::total_size += padded_sizeof(DataBlock);
+	}
+
+void DataBlock::Append(const u_char* data, uint64 size)
+	{
+	uint64 new_size = Size() + size;
+
+	if ( new_size > capacity )
+		{
+		// Grow geometrically so that a run of appends doesn't
+		// keep copying the data we already have.
+		uint64 new_capacity = max(new_size, 2 * capacity);
+		u_char* new_block = new u_char[new_capacity];
+		memcpy((void*) new_block, (const void*) block, Size());
+		delete [] block;
+
+		Reassembler::total_size += pad_size(new_capacity) - pad_size(capacity);
+		block = new_block;
+		capacity = new_capacity;
+		}
+
+	memcpy((void*) (block + Size()), (const void*) data, size);
+	upper += size;
+
+	Reassembler::bytes_buffered += size;
 	}
 
 uint64 Reassembler::total_size = 0;
+uint64 Reassembler::bytes_buffered = 0;
+uint64 Reassembler::bytes_in_place = 0;
+uint64 Reassembler::num_evictions = 0;
+uint64 Reassembler::bytes_evicted = 0;
+BufferingMap Reassembler::buffering_reassemblers;
 
 Reassembler::Reassembler(uint64 init_seq)
 	{
 	blocks = last_block = 0;
 	old_blocks = last_old_block = 0;
 	total_old_blocks = max_old_blocks = 0;
+	coalesce_blocks = false;
 	trim_seq = last_reassem_seq = init_seq;
+	num_blocks = 0;
+	buffered_size = 0;
+	buffering = false;
 	}
 
 Reassembler::~Reassembler()
@@ -55,12 +107,16 @@ void Reassembler::CheckOverlap(DataBlock *head, DataBlock *tail,
 
 	for ( DataBlock* b = head; b; b = b->next )
 		{
+		if ( ! b->block )
+			continue;
+
 		uint64 nseq = seq;
 		uint64 nupper = upper;
 		const u_char* ndata = data;
 
 		if ( nupper <= b->seq )
-			continue;
+			// The blocks are sorted, so we're done.
+			break;
 
 		if ( nseq >= b->upper )
 			continue;
@@ -95,7 +151,7 @@ void Reassembler::NewBlock(double t, uint64 seq, uint64 len, const u_char* data)
 		// Old data, don't do any work for it.
 		return;
 
-	CheckOverlap(blocks, last_block, seq, len, data);
+	CheckOverlap(FindBlock(seq), last_block, seq, len, data);
 
 	if ( seq < trim_seq )
 		{ // Partially old data, just keep the good stuff.
@@ -106,17 +162,23 @@ void Reassembler::NewBlock(double t, uint64 seq, uint64 len, const u_char* data)
 		len -= amount_old;
 		}
 
-	DataBlock* start_block;
-
-	if ( ! blocks )
-		blocks = last_block = start_block =
-			new DataBlock(data, len, seq, 0, 0);
-	else
-		start_block = AddAndCheck(blocks, seq, upper_seq, data);
+	DataBlock* start_block = AddAndCheck(seq, upper_seq, data);
 
 	BlockInserted(start_block);
 	}
 
+void Reassembler::AddDeliveredRange(uint64 seq, uint64 len)
+	{
+	if ( last_block && ! last_block->block && last_block->upper == seq )
+		{
+		// Extend the previous range rather than adding another.
+		last_block->upper += len;
+		return;
+		}
+
+	InsertBlock(0, len, seq, last_block, 0);
+	}
+
 uint64 Reassembler::TrimToSeq(uint64 seq)
 	{
 	uint64 num_missing = 0;
@@ -149,6 +211,14 @@ uint64 Reassembler::TrimToSeq(uint64 seq)
 		{
 		DataBlock* b = blocks->next;
 
+		if ( ! block_map.empty() )
+			block_map.erase(block_map.begin());
+
+		--num_blocks;
+
+		if ( blocks->block )
+			buffered_size -= blocks->Size();
+
 		if ( b && b->seq <= seq )
 			{
 			if ( blocks->upper != b->seq )
@@ -197,6 +267,8 @@ uint64 Reassembler::TrimToSeq(uint64 seq)
 		blocks = b;
 		}
 
+	UpdateBuffering();
+
 	if ( blocks )
 		{
 		blocks->prev = 0;
@@ -227,6 +299,10 @@ void Reassembler::ClearBlocks()
 		}
 
 	last_block = 0;
+	block_map.clear();
+	num_blocks = 0;
+	buffered_size = 0;
+	UpdateBuffering();
 	}
 
 void Reassembler::ClearOldBlocks()
@@ -241,14 +317,74 @@ void Reassembler::ClearOldBlocks()
 	last_old_block = 0;
 	}
 
-uint64 Reassembler::TotalSize() const
+uint64 Reassembler::TrimToSize(uint64 max_size)
+	{
+	uint64 num_missing = 0;
+
+	if ( buffered_size > max_size && last_reassem_seq > trim_seq )
+		num_missing += TrimToSeq(last_reassem_seq);
+
+	// Each round gets rid of at least the lowest block.
+	while ( buffered_size > max_size && blocks )
+		num_missing += TrimToSeq(blocks->upper);
+
+	return num_missing;
+	}
+
+void Reassembler::CheckMemoryBudget()
+	{
+	if ( ! reassembly_memory_budget ||
+	     total_size <= reassembly_memory_budget )
+		return;
+
+	uint64 low_water = reassembly_memory_budget / 10 * 9;
+
+	while ( total_size > low_water && ! buffering_reassemblers.empty() )
+		{
+		// Picks the one buffering the most.  Ties go to the one
+		// that's been buffering that much the longest, which comes
+		// first among equal sizes.
+		BufferingMap::iterator it = --buffering_reassemblers.end();
+		it = buffering_reassemblers.lower_bound(it->first);
+		Reassembler* r = it->second;
+
+		uint64 old_total_size = total_size;
+
+		++num_evictions;
+		bytes_evicted += r->buffered_size;
+
+		// Delivering what's buffered may end up deleting the
+		// reassembler, so we don't touch it afterwards.
+		r->Evict();
+
+		if ( total_size >= old_total_size )
+			break;
+		}
+	}
+
+void Reassembler::Evict()
+	{
+	TrimToSize(0);
+	}
+
+void Reassembler::UpdateBuffering()
 	{
-	uint64 size = 0;
+	if ( buffering )
+		{
+		if ( buffering_pos->first == buffered_size )
+			return;
 
-	for ( DataBlock* b = blocks; b; b = b->next )
-		size += b->Size();
+		buffering_reassemblers.erase(buffering_pos);
+		buffering = false;
+		}
 
-	return size;
+	if ( buffered_size )
+		{
+		// Goes behind any others buffering as much.
+		buffering_pos = buffering_reassemblers.insert(
+				BufferingMap::value_type(buffered_size, this));
+		buffering = true;
+		}
 	}
 
 void Reassembler::Describe(ODesc* d) const
@@ -262,84 +398,124 @@ void Reassembler::Undelivered(uint64 up_to_seq)
 	last_reassem_seq = up_to_seq;
 	}
 
-DataBlock* Reassembler::AddAndCheck(DataBlock* b, uint64 seq, uint64 upper,
-					const u_char* data)
+DataBlock* Reassembler::FindBlock(uint64 seq) const
 	{
-	if ( DEBUG_reassem )
+	if ( block_map.empty() )
 		{
-		DEBUG_MSG("%.6f Reassembler::AddAndCheck seq=%" PRIu64", upper=%" PRIu64"\n",
-		          network_time, seq, upper);
+		DataBlock* b = blocks;
+
+		while ( b && b->upper <= seq )
+			b = b->next;
+
+		return b;
 		}
 
-	// Special check for the common case of appending to the end.
-	if ( last_block && seq == last_block->upper )
+	DataBlockMap::const_iterator it = block_map.upper_bound(seq);
+
+	if ( it == block_map.begin() )
+		// All blocks start above seq.
+		return blocks;
+
+	// The block before starts at or below seq.
+	DataBlock* b = (--it)->second;
+	return b->upper > seq ? b : b->next;
+	}
+
+DataBlock* Reassembler::InsertBlock(const u_char* data, uint64 size,
+					uint64 seq, DataBlock* prev,
+					DataBlock* next)
+	{
+	if ( coalesce_blocks && data && prev && prev->block &&
+	     prev->upper == seq && prev->seq > last_reassem_seq &&
+	     prev->Size() + size <= max_coalesced_size )
 		{
-		last_block = new DataBlock(data, upper - seq, seq,
-						last_block, 0);
-		return last_block;
+		prev->Append(data, size);
+		buffered_size += size;
+		UpdateBuffering();
+		return prev;
 		}
 
-	// Find the first block that doesn't come completely before the
-	// new data.
-	while ( b->next && b->upper <= seq )
-		b = b->next;
+	DataBlock* b = new DataBlock(data, size, seq, prev, next);
 
-	if ( b->upper <= seq )
+	if ( data )
 		{
-		// b is the last block, and it comes completely before
-		// the new block.
-		last_block = new DataBlock(data, upper - seq, seq, b, 0);
-		return last_block;
+		buffered_size += size;
+		UpdateBuffering();
 		}
 
-	DataBlock* new_b = 0;
+	if ( ! prev )
+		blocks = b;
+
+	if ( ! next )
+		last_block = b;
+
+	++num_blocks;
+
+	if ( ! block_map.empty() )
+		block_map[seq] = b;
 
-	if ( upper <= b->seq )
+	else if ( num_blocks > min_indexed_blocks )
 		{
-		// The new block comes completely before b.
-		new_b = new DataBlock(data, upper - seq, seq, b->prev, b);
-		if ( b == blocks )
-			blocks = new_b;
-		return new_b;
+		for ( DataBlock* i = blocks; i; i = i->next )
+			block_map[i->seq] = i;
 		}
 
-	// The blocks overlap.
-	if ( seq < b->seq )
+	return b;
+	}
+
+DataBlock* Reassembler::AddAndCheck(uint64 seq, uint64 upper,
+					const u_char* data)
+	{
+	if ( DEBUG_reassem )
 		{
-		// The new block has a prefix that comes before b.
-		uint64 prefix_len = b->seq - seq;
-		new_b = new DataBlock(data, prefix_len, seq, b->prev, b);
-		if ( b == blocks )
-			blocks = new_b;
-
-		data += prefix_len;
-		seq += prefix_len;
+		DEBUG_MSG("%.6f Reassembler::AddAndCheck seq=%" PRIu64", upper=%" PRIu64"\n",
+		          network_time, seq, upper);
 		}
-	else
-		new_b = b;
 
-	uint64 overlap_start = seq;
-	uint64 overlap_offset = overlap_start - b->seq;
-	uint64 new_b_len = upper - seq;
-	uint64 b_len = b->upper - overlap_start;
-	uint64 overlap_len = min(new_b_len, b_len);
+	// Special check for the common case of appending to the end.
+	if ( ! last_block || seq >= last_block->upper )
+		return InsertBlock(data, upper - seq, seq, last_block, 0);
+
+	// The first block that doesn't come completely before the new
+	// data.  There is one, as the data doesn't go after the last.
+	DataBlock* b = FindBlock(seq);
+	DataBlock* start_block = 0;
 
-	if ( overlap_len < new_b_len )
+	while ( seq < upper )
 		{
-		// Recurse to resolve remainder of the new data.
+		if ( ! b || upper <= b->seq )
+			{
+			// The rest of the new data comes completely
+			// before b (or after the last block).
+			DataBlock* new_b = InsertBlock(data, upper - seq, seq,
+						b ? b->prev : last_block, b);
+			return start_block ? start_block : new_b;
+			}
+
+		if ( seq < b->seq )
+			{
+			// The new data has a prefix that comes before b.
+			uint64 prefix_len = b->seq - seq;
+			DataBlock* new_b = InsertBlock(data, prefix_len, seq,
+							b->prev, b);
+			if ( ! start_block )
+				start_block = new_b;
+
+			data += prefix_len;
+			seq += prefix_len;
+			}
+
+		// The new data overlaps b; we keep what b has.
+		if ( ! start_block )
+			start_block = b;
+
+		uint64 overlap_len = min(upper, b->upper) - seq;
 		data += overlap_len;
 		seq += overlap_len;
-
-		if ( new_b == b )
-			new_b = AddAndCheck(b, seq, upper, data);
-		else
-			(void) AddAndCheck(b, seq, upper, data);
+		b = b->next;
 		}
 
-	if ( new_b->prev == last_block )
-		last_block = new_b;
-
-	return new_b;
+	return start_block;
 	}
 
 bool Reassembler::Serialize(SerialInfo* info) const
@@ -367,6 +543,10 @@ bool Reassembler::DoUnserialize(UnserialInfo* info)
 	DO_UNSERIALIZE(BroObj);
 
 	blocks = last_block = 0;
+	num_blocks = 0;
+	buffered_size = 0;
+	buffering = false;
+	coalesce_blocks = false;
 
 	int dummy; // For backwards compatibility.
 	if ( ! UNSERIALIZE(&trim_seq) || ! UNSERIALIZE(&dummy) )
@@ -3,11 +3,15 @@
 #ifndef reassem_h
 #define reassem_h
 
+#include <map>
+
 #include "Obj.h"
 #include "IPAddr.h"
 
 class DataBlock {
 public:
+	// If data is nil, the block stands for a range that was passed on
+	// without being copied, and holds no data of its own.
 	DataBlock(const u_char* data, uint64 size, uint64 seq,
 			DataBlock* prev, DataBlock* next);
 
@@ -15,12 +19,20 @@ public:
 
 	uint64 Size() const	{ return upper - seq; }
 
+	// Adds data directly following the block's current upper end.
+	void Append(const u_char* data, uint64 size);
+
 	DataBlock* next;	// next block with higher seq #
 	DataBlock* prev;	// previous block with lower seq #
 	uint64 seq, upper;
-	u_char* block;
+	u_char* block;	// nil if delivered in place
+	uint64 capacity;	// bytes allocated for block
 };
 
+typedef std::map<uint64, DataBlock*> DataBlockMap;
+
+class Reassembler;
+typedef std::multimap<uint64, Reassembler*> BufferingMap;
 
 
 class Reassembler : public BroObj {
@@ -41,7 +53,15 @@ public:
 	int HasBlocks() const		{ return blocks != 0; }
 	uint64 LastReassemSeq() const	{ return last_reassem_seq; }
 
-	uint64 TotalSize() const;	// number of bytes buffered up
+	uint64 TotalSize() const	// number of bytes buffered up
+		{ return buffered_size; }
+
+	// Gives up on data until no more than max_size bytes remain
+	// buffered: first on data that's been delivered but not trimmed
+	// yet, then on the holes in front of the buffered blocks, lowest
+	// first, as though we'd gotten acks for them.  Returns the number
+	// of bytes that were skipped as missing.
+	uint64 TrimToSize(uint64 max_size);
 
 	void Describe(ODesc* d) const;
 
@@ -51,10 +71,32 @@ public:
 	// Sum over all data buffered in some reassembler.
 	static uint64 TotalMemoryAllocation()	{ return total_size; }
 
+	// Number of bytes that got copied into blocks, and that got
+	// delivered straight from the packet instead, over all reassemblers.
+	static uint64 BytesBuffered()	{ return bytes_buffered; }
+	static uint64 BytesInPlace()	{ return bytes_in_place; }
+
+	// If all reassemblers together use more memory than
+	// reassembly_memory_budget allows, makes those buffering the most
+	// data give it up (see Evict()) until we're down to 90% of the
+	// budget.  Meant to be called between packets, when none of them
+	// is in the middle of delivering data.
+	static void CheckMemoryBudget();
+
+	// Number of times reassemblers gave up their data for the sake of
+	// the budget, and how many bytes they had buffered.
+	static uint64 NumEvictions()	{ return num_evictions; }
+	static uint64 BytesEvicted()	{ return bytes_evicted; }
+
 	void SetMaxOldBlocks(uint32 count)	{ max_old_blocks = count; }
 
+	// Allows merging blocks that wait on a hole with the ones next to
+	// them.  That changes how overlaps get reported, so it's only for
+	// reassemblers that don't look at them closely.
+	void SetCoalesceBlocks(bool arg)	{ coalesce_blocks = arg; }
+
 protected:
-	Reassembler()	{ }
+	Reassembler()	{ buffering = false; }
 
 	DECLARE_ABSTRACT_SERIAL(Reassembler);
 
@@ -65,14 +107,47 @@ protected:
 	virtual void BlockInserted(DataBlock* b) = 0;
 	virtual void Overlap(const u_char* b1, const u_char* b2, uint64 n) = 0;
 
-	DataBlock* AddAndCheck(DataBlock* b, uint64 seq,
-				uint64 upper, const u_char* data);
+	// Gives up all buffered data to stay within the memory budget.
+	// The default skips over the holes as though we'd gotten acks
+	// for the data above them.
+	virtual void Evict();
+
+	// Keeps our entry among the reassemblers holding data up to date;
+	// needs to be called whenever buffered_size changes.
+	void UpdateBuffering();
+
+	DataBlock* AddAndCheck(uint64 seq, uint64 upper, const u_char* data);
+
+	// Returns the first block that doesn't come completely before seq,
+	// or nil if there's none.
+	DataBlock* FindBlock(uint64 seq) const;
+
+	// Creates a block with the given data and links it in between
+	// prev and next.  If we're coalescing blocks and the data directly
+	// follows prev and neither has been delivered yet, it gets added to
+	// prev instead as long as that doesn't make prev too large.  Returns
+	// the block holding the data.
+	DataBlock* InsertBlock(const u_char* data, uint64 size, uint64 seq,
+				DataBlock* prev, DataBlock* next);
 
 	void CheckOverlap(DataBlock *head, DataBlock *tail,
 				uint64 seq, uint64 len, const u_char* data);
 
+	// Records that [seq, seq + len), which must directly follow
+	// the last block, has been delivered without being buffered.
+	// The range is tracked like any other block until it's trimmed,
+	// but it doesn't take part in overlap checks.
+	void AddDeliveredRange(uint64 seq, uint64 len);
+
 	DataBlock* blocks;
 	DataBlock* last_block;
+	DataBlockMap block_map;	// indexes blocks by seq, once there are many
+	uint32 num_blocks;
+	uint64 buffered_size;
+
+	// Our entry in buffering_reassemblers, if buffering is true.
+	BufferingMap::iterator buffering_pos;
+	bool buffering;
 
 	DataBlock* old_blocks;
 	DataBlock* last_old_block;
@@ -81,13 +156,24 @@ protected:
 	uint64 trim_seq;	// how far we've trimmed
 	uint32 max_old_blocks;
 	uint32 total_old_blocks;
+	bool coalesce_blocks;
 
 	static uint64 total_size;
+	static uint64 bytes_buffered;
+	static uint64 bytes_in_place;
+	static uint64 num_evictions;
+	static uint64 bytes_evicted;
+
+	// All reassemblers with buffered data, by how much they buffer.
+	static BufferingMap buffering_reassemblers;
 };
 
 inline DataBlock::~DataBlock()
 	{
-	Reassembler::total_size -= pad_size(upper - seq) + padded_sizeof(DataBlock);
+	if ( block )
+		Reassembler::total_size -= pad_size(capacity);
+
+	Reassembler::total_size -= padded_sizeof(DataBlock);
 	delete [] block;
 	}
 
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <functional>
+#include <errno.h>
 
 #include "bro-config.h"
 
@@ -172,6 +173,9 @@ RuleEndpointState::RuleEndpointState(analyzer::Analyzer* arg_analyzer, bool arg_
 		opposite->opposite = this;
 
 	pia = arg_PIA;
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		prefilter[i] = 0;
 	}
 
 RuleEndpointState::~RuleEndpointState()
@@ -182,6 +186,9 @@ RuleEndpointState::~RuleEndpointState()
 		delete matchers[i];
 		}
 
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		delete prefilter[i];
+
 	loop_over_list(matched_text, j)
 		delete matched_text[j];
 	}
@@ -200,6 +207,17 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	root = new RuleHdrTest(RuleHdrTest::NOPROT, 0, 0, RuleHdrTest::EQ,
 				new maskedvalue_list);
 	RE_level = arg_RE_level;
+
+	// File magic is matched through a separate path; it's mostly
+	// anchored patterns there anyway.
+	use_prefilter = sig_prefilter;
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		prefilters[i] = (use_prefilter && i != Rule::FILE_MAGIC) ?
+					new RulePrefilter() : 0;
+
+	num_prefilter_ids = 0;
+	prefilter_skipped = prefilter_wakeups = 0;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -209,6 +227,9 @@ RuleMatcher::~RuleMatcher()
 #endif
 	Delete(root);
 
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		delete prefilters[i];
+
 	loop_over_list(rules, i)
 		delete rules[i];
 	}
@@ -258,6 +279,20 @@ bool RuleMatcher::ReadFiles(const name_list& files)
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
 
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		{
+		if ( ! prefilters[i] )
+			continue;
+
+		if ( prefilters[i]->Empty() )
+			{
+			delete prefilters[i];
+			prefilters[i] = 0;
+			}
+		else
+			prefilters[i]->Compile();
+		}
+
 	return ! parse_error;
 	}
 
@@ -358,7 +393,8 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+						 (Rule::PatternType) i);
 		}
 
 	// Get the patterns on all of our children.
@@ -385,17 +421,74 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+						 (Rule::PatternType) i);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
+bool RuleMatcher::PatternIsPositional(int id)
+	{
+	Rule* r = Rule::rule_table[id - 1];
+
+	loop_over_list(r->patterns, i)
+		{
+		Rule::Pattern* p = r->patterns[i];
+
+		if ( p->id == id )
+			return p->offset || p->depth != INT_MAX;
+		}
+
+	return false;
+	}
+
 void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids)
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type)
 	{
 	assert(exprs.length() == ids.length());
 
+	if ( ! prefilters[type] )
+		{
+		BuildPatternGroups(dst, exprs, ids, type, false);
+		return;
+		}
+
+	// Keep the patterns the prefilter can guard apart from the others,
+	// so that they end up in groups of their own.
+	string_list plain_exprs, guarded_exprs;
+	int_list plain_ids, guarded_ids;
+
+	loop_over_list(exprs, i)
+		{
+		vector<string> literals;
+		int lookback;
+
+		if ( ! PatternIsPositional(ids[i]) &&
+		     RulePrefilter::AnalyzePattern(exprs[i], &literals, &lookback) )
+			{
+			guarded_exprs.append(exprs[i]);
+			guarded_ids.append(ids[i]);
+			}
+		else
+			{
+			plain_exprs.append(exprs[i]);
+			plain_ids.append(ids[i]);
+			}
+		}
+
+	if ( plain_exprs.length() )
+		BuildPatternGroups(dst, plain_exprs, plain_ids, type, false);
+
+	if ( guarded_exprs.length() )
+		BuildPatternGroups(dst, guarded_exprs, guarded_ids, type, true);
+	}
+
+void RuleMatcher::BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type, bool prefilter)
+	{
 	// We build groups of at most sig_max_group_size regexps.
 
 	string_list group_exprs;
@@ -418,6 +511,27 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 			set->re->CompileSet(group_exprs, group_ids);
 			set->patterns = group_exprs;
 			set->ids = group_ids;
+
+			if ( prefilter )
+				{
+				set->prefilter_id = num_prefilter_ids++;
+
+				loop_over_list(group_exprs, j)
+					{
+					vector<string> literals;
+					int lookback;
+
+					RulePrefilter::AnalyzePattern(group_exprs[j],
+							&literals, &lookback);
+
+					for ( size_t k = 0; k < literals.size(); ++k )
+						prefilters[type]->AddLiteral(literals[k],
+							set->prefilter_id);
+
+					set->lookback = max(set->lookback, lookback);
+					}
+				}
+
 			dst->append(set);
 
 			group_exprs.clear();
@@ -740,12 +854,7 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 						hdr_test->psets[i][j];
 
 					assert(set->re);
-
-					RuleEndpointState::Matcher* m =
-						new RuleEndpointState::Matcher;
-					m->state = new RE_Match_State(set->re);
-					m->type = (Rule::PatternType) i;
-					state->matchers.append(m);
+					AddMatcher(state, set, (Rule::PatternType) i);
 					}
 				}
 			}
@@ -813,6 +922,89 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 	return state;
 	}
 
+void RuleMatcher::AddMatcher(RuleEndpointState* state,
+				RuleHdrTest::PatternSet* set,
+				Rule::PatternType type)
+	{
+	RuleEndpointState::Matcher* m = new RuleEndpointState::Matcher;
+	m->state = new RE_Match_State(set->re);
+	m->type = type;
+	m->prefilter_id = use_prefilter ? set->prefilter_id : -1;
+	m->dormant = m->prefilter_id >= 0;
+	state->matchers.append(m);
+
+	if ( ! m->dormant )
+		return;
+
+	RuleEndpointState::PrefilterState* ps = state->prefilter[type];
+
+	if ( ! ps )
+		{
+		ps = state->prefilter[type] = new RuleEndpointState::PrefilterState;
+		ps->ac_state = 0;
+		ps->num_dormant = 0;
+		ps->lookback = 0;
+		}
+
+	++ps->num_dormant;
+	ps->lookback = max(ps->lookback, set->lookback);
+	}
+
+void RuleMatcher::Prefilter(RuleEndpointState* state, Rule::PatternType type,
+				const u_char* data, int data_len, bool clear)
+	{
+	RuleEndpointState::PrefilterState* ps = state->prefilter[type];
+
+	// Matchers start over with this chunk.
+	if ( clear )
+		ps->tail.clear();
+
+	prefilter_hits.clear();
+	ps->ac_state = prefilters[type]->Scan(ps->ac_state, data, data_len,
+						&prefilter_hits);
+
+	if ( prefilter_hits.size() )
+		{
+		loop_over_list(state->matchers, i)
+			{
+			RuleEndpointState::Matcher* m = state->matchers[i];
+
+			if ( ! m->dormant || m->type != type ||
+			     ! binary_search(prefilter_hits.begin(),
+					     prefilter_hits.end(),
+					     m->prefilter_id) )
+				continue;
+
+			DBG_LOG(DBG_RULES, "Prefilter hit, waking up matcher %d", i);
+
+			// Any match has to start within the tail, so feeding
+			// it brings the DFA into the state it would be in
+			// had it seen all of the input.  Nothing can match
+			// yet as the literal isn't complete without the
+			// current chunk.
+			m->state->Match((const u_char*) ps->tail.data(),
+					ps->tail.size(), false, false, false);
+			m->dormant = false;
+			--ps->num_dormant;
+			++prefilter_wakeups;
+			}
+		}
+
+	if ( ps->num_dormant == 0 )
+		{
+		delete ps;
+		state->prefilter[type] = 0;
+		return;
+		}
+
+	prefilter_skipped += uint64(data_len) * ps->num_dormant;
+
+	ps->tail.append((const char*) data, data_len);
+
+	if ( ps->tail.size() > (size_t) ps->lookback )
+		ps->tail.erase(0, ps->tail.size() - ps->lookback);
+	}
+
 void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 			const u_char* data, int data_len,
 			bool bol, bool eol, bool clear)
@@ -854,11 +1046,15 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 			state->payload_size = 0;
 		}
 
+	// Wake up matchers whose literals show up in this chunk.
+	if ( state->prefilter[type] )
+		Prefilter(state, type, data, data_len, clear);
+
 	// Feed data into all relevant matchers.
 	loop_over_list(state->matchers, x)
 		{
 		RuleEndpointState::Matcher* m = state->matchers[x];
-		if ( m->type == type &&
+		if ( m->type == type && ! m->dormant &&
 		     m->state->Match((const u_char*) data, data_len,
 					bol, eol, clear) )
 			newmatch = true;
@@ -1101,6 +1297,17 @@ void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 
 	loop_over_list(state->matchers, j)
 		state->matchers[j]->state->Clear();
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		{
+		RuleEndpointState::PrefilterState* ps = state->prefilter[i];
+
+		if ( ps )
+			{
+			ps->ac_state = 0;
+			ps->tail.clear();
+			}
+		}
 	}
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
@@ -1175,6 +1382,11 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->hits = 0;
 		stats->misses = 0;
 		stats->avg_nfa_states = 0;
+		stats->prefiltered = 0;
+		stats->prefilter_skipped = prefilter_skipped;
+		stats->prefilter_wakeups = prefilter_wakeups;
+		stats->evictions = 0;
+		stats->recomputes = 0;
 		hdr_test = root;
 		}
 
@@ -1188,6 +1400,10 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			assert(set->re);
 
 			++stats->matchers;
+
+			if ( set->prefilter_id >= 0 )
+				++stats->prefiltered;
+
 			set->re->DFA()->Cache()->GetStats(&cstats);
 
 			stats->dfa_states += cstats.dfa_states;
@@ -1195,6 +1411,8 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			stats->mem += cstats.mem;
 			stats->hits += cstats.hits;
 			stats->misses += cstats.misses;
+			stats->evictions += cstats.evictions;
+			stats->recomputes += cstats.recomputes;
 			stats->avg_nfa_states += cstats.nfa_states;
 			}
 		}
@@ -1253,6 +1471,124 @@ void RuleMatcher::DumpStateStats(BroFile* f, RuleHdrTest* hdr_test)
 		DumpStateStats(f, h);
 	}
 
+void RuleMatcher::AddBenchmarkMatchers(RuleEndpointState* state,
+					RuleHdrTest* hdr_test)
+	{
+	if ( hdr_test->level > RE_level )
+		return;
+
+	loop_over_list(hdr_test->psets[Rule::PAYLOAD], i)
+		AddMatcher(state, hdr_test->psets[Rule::PAYLOAD][i], Rule::PAYLOAD);
+
+	for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling )
+		AddBenchmarkMatchers(state, h);
+	}
+
+bool RuleMatcher::Benchmark(const char* file)
+	{
+	FILE* f = fopen(file, "r");
+
+	if ( ! f )
+		{
+		reporter->Error("can't open %s: %s", file, strerror(errno));
+		return false;
+		}
+
+	string data;
+	char buf[65536];
+	size_t n;
+
+	while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+		data.append(buf, n);
+
+	fclose(f);
+
+	if ( data.empty() )
+		{
+		reporter->Error("%s is empty", file);
+		return false;
+		}
+
+	// We treat the file as a single stream, delivered in chunks of a
+	// typical segment size, and feed it through the matchers of all
+	// payload patterns regardless of header conditions.  As the state
+	// has no header tests, matches don't trigger any rules.
+	const int chunk_size = 1460;
+	bool saved_use_prefilter = use_prefilter;
+
+	for ( int round = 0; round < 2; ++round )
+		{
+		use_prefilter = (round == 1);
+
+		if ( use_prefilter && ! prefilters[Rule::PAYLOAD] )
+			{
+			fprintf(stderr, "  no payload patterns qualify for the prefilter\n");
+			break;
+			}
+
+		int passes = 0;
+		int num_matchers = 0;
+		int num_dormant = 0;
+		unsigned int num_matches = 0;
+		double start = current_time(true);
+		double elapsed;
+
+		// Repeat until we have a meaningful measurement.
+		do
+			{
+			RuleEndpointState* state =
+				new RuleEndpointState(0, true, 0, 0);
+
+			AddBenchmarkMatchers(state, root);
+
+			Match(state, Rule::PAYLOAD, (const u_char*) "", 0,
+				true, false, false);
+
+			for ( string::size_type pos = 0; pos < data.size();
+			      pos += chunk_size )
+				{
+				int len = min(string::size_type(chunk_size),
+						data.size() - pos);
+				Match(state, Rule::PAYLOAD,
+					(const u_char*) data.data() + pos, len,
+					false, false, false);
+				}
+
+			Match(state, Rule::PAYLOAD, (const u_char*) "", 0,
+				false, true, false);
+
+			num_matchers = state->matchers.length();
+			num_dormant = 0;
+			num_matches = 0;
+
+			loop_over_list(state->matchers, i)
+				{
+				RuleEndpointState::Matcher* m = state->matchers[i];
+				num_matches += m->state->AcceptedMatches().size();
+
+				if ( m->dormant )
+					++num_dormant;
+				}
+
+			delete state;
+			++passes;
+			elapsed = current_time(true) - start;
+			}
+		while ( elapsed < 1.0 );
+
+		double bytes = double(data.size()) * passes;
+
+		fprintf(stderr, "%s: %.1f MB/s (%d bytes x %d in %.2fs), "
+			"%d matchers (%d never woken), %u pattern matches\n",
+			use_prefilter ? "with prefilter" : "without prefilter",
+			bytes / elapsed / 1e6, int(data.size()), passes,
+			elapsed, num_matchers, num_dormant, num_matches);
+		}
+
+	use_prefilter = saved_use_prefilter;
+	return true;
+	}
+
 static Val* get_bro_val(const char* label)
 	{
 	ID* id = lookup_ID(label, GLOBAL_MODULE_NAME, false);
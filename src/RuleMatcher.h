@@ -19,6 +19,7 @@
 #include "Rule.h"
 #include "RuleAction.h"
 #include "RuleCondition.h"
+#include "RulePrefilter.h"
 
 //#define MATCHER_PRINT_STATS
 
@@ -105,7 +106,7 @@ private:
 	friend class RuleMatcher;
 
 	struct PatternSet {
-		PatternSet() : re() {}
+		PatternSet() : re(), prefilter_id(-1), lookback(0) {}
 
 		// If we're above the 'RE_level' (see RuleMatcher), this
 		// expr contains all patterns on this node. If we're on
@@ -116,6 +117,12 @@ private:
 		// All the patterns and their rule indices.
 		string_list patterns;
 		int_list ids;	// (only needed for debugging)
+
+		// If all patterns qualify for the literal prefilter, the ID
+		// its hits report for them, and how many bytes need to be
+		// replayed into the DFA on a hit.  Otherwise -1.
+		int prefilter_id;
+		int lookback;
 	};
 
 	declare(PList, PatternSet);
@@ -169,11 +176,24 @@ private:
 	struct Matcher {
 		RE_Match_State* state;
 		Rule::PatternType type;
+		int prefilter_id;
+		bool dormant;	// waiting for a prefilter hit
 	};
 
 	declare(PList, Matcher);
 	typedef PList(Matcher) matcher_list;
 
+	// Per pattern type state of the literal prefilter, as long as
+	// any of our matchers is waiting for a hit.
+	struct PrefilterState {
+		int ac_state;	// state of the prefilter's automaton
+		int num_dormant;	// matchers waiting for a hit
+		int lookback;	// max. bytes any of them needs replayed
+		string tail;	// the last lookback bytes of input
+	};
+
+	PrefilterState* prefilter[Rule::TYPES];
+
 	bool is_orig;
 	analyzer::Analyzer* analyzer;
 	RuleEndpointState* opposite;
@@ -308,6 +328,14 @@ public:
 
 		// Average # NFA states per DFA state.
 		unsigned int avg_nfa_states;
+
+		// # matchers guarded by the literal prefilter
+		unsigned int prefiltered;
+		uint64 prefilter_skipped;	// # bytes not fed into them
+		uint64 prefilter_wakeups;	// # times one was woken up
+
+		unsigned int evictions;	// # DFA states evicted
+		unsigned int recomputes;	// # evicted ones computed again
 	};
 
 	Val* BuildRuleStateValue(const Rule* rule,
@@ -316,6 +344,11 @@ public:
 	void GetStats(Stats* stats, RuleHdrTest* hdr_test = 0);
 	void DumpStats(BroFile* f);
 
+	// Feeds the contents of the given file through all payload
+	// matchers, with and without the literal prefilter, and reports
+	// throughput to stderr.
+	bool Benchmark(const char* file);
+
 private:
 	// Delete node and all children.
 	void Delete(RuleHdrTest* node);
@@ -332,7 +365,34 @@ private:
 
 	// Build groups of regular epxressions.
 	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids);
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type);
+
+	// True if the pattern with the given ID may only match within a
+	// certain range of the input.  Those can't go behind the literal
+	// prefilter, as matchers it wakes up only see the input from
+	// where they're replayed, and so can't tell how far into the
+	// input a match is.
+	static bool PatternIsPositional(int id);
+
+	// Used by the above.  If prefilter is true, the patterns all
+	// qualify for the literal prefilter.
+	void BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				Rule::PatternType type, bool prefilter);
+
+	// Creates the endpoint's matcher for the given set.
+	void AddMatcher(RuleEndpointState* state, RuleHdrTest::PatternSet* set,
+			Rule::PatternType type);
+
+	// Adds matchers for all payload pattern sets to the state.
+	void AddBenchmarkMatchers(RuleEndpointState* state,
+				  RuleHdrTest* hdr_test);
+
+	// Runs the literal prefilter over the data, waking up the
+	// matchers for which it finds a hit.
+	void Prefilter(RuleEndpointState* state, Rule::PatternType type,
+			const u_char* data, int data_len, bool clear);
 
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
@@ -367,6 +427,13 @@ private:
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	bool use_prefilter;
+	RulePrefilter* prefilters[Rule::TYPES];
+	int num_prefilter_ids;
+	vector<int> prefilter_hits;	// scratch space for Prefilter()
+	uint64 prefilter_skipped;
+	uint64 prefilter_wakeups;
 };
 
 // Keeps bi-directional matching-state.
@@ -0,0 +1,825 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <set>
+#include <deque>
+
+#include "RulePrefilter.h"
+
+using std::string;
+using std::set;
+using std::vector;
+
+// Bounds for the literal sets we track during pattern analysis.
+#define MAX_ALTERNATIVES 16
+#define MAX_LITERAL_LEN 32
+
+// Maximum match length standing for "unbounded".
+#define UNBOUNDED_LEN -1
+
+namespace {
+
+// What we know about the strings matched by a regular expression.
+struct LiteralInfo {
+	// If exact, the expression matches exactly the strings in strs.
+	bool exact;
+	set<string> strs;
+
+	// Every match starts with prefix and ends with suffix.
+	string prefix;
+	string suffix;
+
+	// Every match contains at least one of these, ending no more than
+	// must_reach bytes after the start of the match.  Empty if we
+	// don't know of any such set.
+	set<string> must;
+	int must_reach;
+
+	// Maximum length of a match, or UNBOUNDED_LEN.
+	int max_len;
+
+	// True if the expression contains "^".
+	bool bol;
+
+	LiteralInfo()
+		{
+		exact = false;
+		must_reach = 0;
+		max_len = 0;
+		bol = false;
+		}
+};
+
+}
+
+static string common_prefix(const string& a, const string& b)
+	{
+	string::size_type n = 0;
+	while ( n < a.size() && n < b.size() && a[n] == b[n] )
+		++n;
+
+	return a.substr(0, n);
+	}
+
+static string common_suffix(const string& a, const string& b)
+	{
+	string::size_type n = 0;
+	while ( n < a.size() && n < b.size() &&
+		a[a.size() - 1 - n] == b[b.size() - 1 - n] )
+		++n;
+
+	return a.substr(a.size() - n);
+	}
+
+static string common_prefix(const set<string>& s)
+	{
+	set<string>::const_iterator i = s.begin();
+	string p = *i;
+
+	for ( ++i; i != s.end(); ++i )
+		p = common_prefix(p, *i);
+
+	return p;
+	}
+
+static string common_suffix(const set<string>& s)
+	{
+	set<string>::const_iterator i = s.begin();
+	string p = *i;
+
+	for ( ++i; i != s.end(); ++i )
+		p = common_suffix(p, *i);
+
+	return p;
+	}
+
+// A literal set is as good as its shortest member.
+static unsigned int set_strength(const set<string>& s)
+	{
+	if ( s.empty() )
+		return 0;
+
+	unsigned int min_len = UINT_MAX;
+
+	for ( set<string>::const_iterator i = s.begin(); i != s.end(); ++i )
+		min_len = std::min(min_len, (unsigned int) i->size());
+
+	return min_len;
+	}
+
+static int add_len(int a, int b)
+	{
+	if ( a == UNBOUNDED_LEN || b == UNBOUNDED_LEN )
+		return UNBOUNDED_LEN;
+
+	return a + b;
+	}
+
+static int mult_len(int a, int n)
+	{
+	if ( a == 0 )
+		return 0;
+
+	// Anything this long won't be of use anyway.
+	if ( a == UNBOUNDED_LEN || n == UNBOUNDED_LEN ||
+	     n > RulePrefilter::MAX_LOOKBACK )
+		return UNBOUNDED_LEN;
+
+	return a * n;
+	}
+
+// Makes the candidate the info's must-set if it's better.  As we need
+// to feed the DFA everything from the start of a match up to the literal,
+// candidates whose reach is unbounded or too large are of no use.
+static void consider_must(LiteralInfo* info, const set<string>& candidate,
+			  int reach)
+	{
+	if ( candidate.empty() || candidate.size() > MAX_ALTERNATIVES ||
+	     reach == UNBOUNDED_LEN || reach > RulePrefilter::MAX_LOOKBACK )
+		return;
+
+	// Any prefix of a required literal is required, too.
+	set<string> c;
+	for ( set<string>::const_iterator i = candidate.begin();
+	      i != candidate.end(); ++i )
+		c.insert(i->substr(0, MAX_LITERAL_LEN));
+
+	unsigned int sc = set_strength(c);
+	unsigned int sm = set_strength(info->must);
+
+	if ( sc > sm || (sc == sm && c.size() < info->must.size()) ||
+	     (sc == sm && c.size() == info->must.size() &&
+	      reach < info->must_reach) )
+		{
+		info->must = c;
+		info->must_reach = reach;
+		}
+	}
+
+static void truncate_affixes(LiteralInfo* info)
+	{
+	if ( info->prefix.size() > MAX_LITERAL_LEN )
+		info->prefix.resize(MAX_LITERAL_LEN);
+
+	if ( info->suffix.size() > MAX_LITERAL_LEN )
+		info->suffix.erase(0, info->suffix.size() - MAX_LITERAL_LEN);
+	}
+
+// Derives prefix/suffix/must from the set of exact strings, turning the
+// info inexact if the strings got too long to track.
+static void normalize(LiteralInfo* info)
+	{
+	if ( ! info->exact )
+		return;
+
+	info->prefix = common_prefix(info->strs);
+	info->suffix = common_suffix(info->strs);
+
+	if ( ! info->strs.count("") )
+		consider_must(info, info->strs, info->max_len);
+
+	for ( set<string>::const_iterator i = info->strs.begin();
+	      i != info->strs.end(); ++i )
+		if ( i->size() > MAX_LITERAL_LEN )
+			{
+			info->exact = false;
+			info->strs.clear();
+			truncate_affixes(info);
+			break;
+			}
+	}
+
+static LiteralInfo make_exact(const set<string>& strs, int max_len)
+	{
+	LiteralInfo info;
+	info.exact = true;
+	info.strs = strs;
+	info.max_len = max_len;
+	normalize(&info);
+	return info;
+	}
+
+static LiteralInfo make_any(int max_len)
+	{
+	LiteralInfo info;
+	info.max_len = max_len;
+	return info;
+	}
+
+static LiteralInfo concat(const LiteralInfo& a, const LiteralInfo& b)
+	{
+	LiteralInfo r;
+	r.max_len = add_len(a.max_len, b.max_len);
+	r.bol = a.bol || b.bol;
+
+	if ( a.exact && b.exact &&
+	     a.strs.size() * b.strs.size() <= MAX_ALTERNATIVES )
+		{
+		r.exact = true;
+
+		for ( set<string>::const_iterator i = a.strs.begin();
+		      i != a.strs.end(); ++i )
+			for ( set<string>::const_iterator j = b.strs.begin();
+			      j != b.strs.end(); ++j )
+				r.strs.insert(*i + *j);
+
+		normalize(&r);
+		return r;
+		}
+
+	// B's literals start no later than A's maximum length into the match.
+	consider_must(&r, a.must, a.must_reach);
+	consider_must(&r, b.must, add_len(a.max_len, b.must_reach));
+
+	set<string> joined;
+	joined.insert(a.suffix + b.prefix);
+	consider_must(&r, joined, add_len(a.max_len, b.prefix.size()));
+
+	if ( a.exact )
+		{
+		set<string> left;
+		for ( set<string>::const_iterator i = a.strs.begin();
+		      i != a.strs.end(); ++i )
+			left.insert(*i + b.prefix);
+
+		consider_must(&r, left, add_len(a.max_len, b.prefix.size()));
+		r.prefix = common_prefix(left);
+		}
+	else
+		r.prefix = a.prefix;
+
+	if ( b.exact )
+		{
+		set<string> right;
+		for ( set<string>::const_iterator i = b.strs.begin();
+		      i != b.strs.end(); ++i )
+			right.insert(a.suffix + *i);
+
+		consider_must(&r, right, r.max_len);
+		r.suffix = common_suffix(right);
+		}
+	else
+		r.suffix = b.suffix;
+
+	truncate_affixes(&r);
+	return r;
+	}
+
+static LiteralInfo alternate(const LiteralInfo& a, const LiteralInfo& b)
+	{
+	LiteralInfo r;
+	r.bol = a.bol || b.bol;
+
+	if ( a.max_len == UNBOUNDED_LEN || b.max_len == UNBOUNDED_LEN )
+		r.max_len = UNBOUNDED_LEN;
+	else
+		r.max_len = std::max(a.max_len, b.max_len);
+
+	if ( a.exact && b.exact &&
+	     a.strs.size() + b.strs.size() <= MAX_ALTERNATIVES )
+		{
+		r.exact = true;
+		r.strs = a.strs;
+		r.strs.insert(b.strs.begin(), b.strs.end());
+		normalize(&r);
+		return r;
+		}
+
+	r.prefix = common_prefix(a.prefix, b.prefix);
+	r.suffix = common_suffix(a.suffix, b.suffix);
+
+	if ( ! a.must.empty() && ! b.must.empty() )
+		{
+		set<string> both = a.must;
+		both.insert(b.must.begin(), b.must.end());
+		consider_must(&r, both, std::max(a.must_reach, b.must_reach));
+		}
+
+	return r;
+	}
+
+// Zero or more repetitions, at most max_rep (or unbounded).
+static LiteralInfo optional_repeat(const LiteralInfo& a, int max_rep)
+	{
+	if ( max_rep == 1 && a.exact && a.strs.size() < MAX_ALTERNATIVES )
+		{
+		set<string> strs = a.strs;
+		strs.insert("");
+		LiteralInfo r = make_exact(strs, a.max_len);
+		r.bol = a.bol;
+		return r;
+		}
+
+	LiteralInfo r = make_any(mult_len(a.max_len, max_rep));
+	r.bol = a.bol;
+	return r;
+	}
+
+// At least min_rep >= 1 repetitions, at most max_rep (or unbounded).
+static LiteralInfo repeat(const LiteralInfo& a, int min_rep, int max_rep)
+	{
+	if ( min_rep == 1 && max_rep == 1 )
+		return a;
+
+	// Every match starts with a match of a.
+	LiteralInfo r;
+	r.max_len = mult_len(a.max_len, max_rep);
+	r.bol = a.bol;
+	r.prefix = a.prefix;
+	r.suffix = a.suffix;
+
+	consider_must(&r, a.must, a.must_reach);
+
+	if ( a.exact && ! a.strs.count("") )
+		consider_must(&r, a.strs, a.max_len);
+
+	return r;
+	}
+
+namespace {
+
+// A recursive descent parser for the pattern syntax accepted by
+// re-parse.y/re-scan.l, computing LiteralInfo instead of an NFA.
+// Anything we don't understand makes us give up on the pattern.
+class PatternAnalyzer {
+public:
+	PatternAnalyzer(const char* pattern)
+		{ p = pattern; error = false; }
+
+	bool Analyze(vector<string>* literals, int* lookback);
+
+private:
+	LiteralInfo ParseRE();
+	LiteralInfo ParseSeries();
+	LiteralInfo ParseSingleton();
+	LiteralInfo ParseAtom();
+	LiteralInfo ParseCCL();
+
+	bool ParseChar(int* c);
+	bool ParseNumber(int* n);
+
+	bool AtEnd() const	{ return *p == '\0' || *p == '\n'; }
+
+	LiteralInfo Error()
+		{
+		error = true;
+		return make_any(UNBOUNDED_LEN);
+		}
+
+	static string Folded(int c)
+		{ return string(1, char(isascii(c) && isupper(c) ? tolower(c) : c)); }
+
+	const char* p;
+	bool error;
+};
+
+}
+
+bool PatternAnalyzer::Analyze(vector<string>* literals, int* lookback)
+	{
+	// We only handle the ".*R" form, where R is everything else.
+	if ( p[0] != '.' || p[1] != '*' )
+		return false;
+
+	p += 2;
+
+	LiteralInfo info = ParseRE();
+
+	if ( error || ! AtEnd() )
+		return false;
+
+	// We'd need to feed the DFA the start of the stream for "^" to
+	// match.
+	if ( info.bol )
+		return false;
+
+	if ( set_strength(info.must) < RulePrefilter::MIN_LITERAL_LEN )
+		return false;
+
+	literals->assign(info.must.begin(), info.must.end());
+	*lookback = info.must_reach;
+	return true;
+	}
+
+LiteralInfo PatternAnalyzer::ParseRE()
+	{
+	LiteralInfo info = ParseSeries();
+
+	while ( ! error && *p == '|' )
+		{
+		++p;
+		info = alternate(info, ParseSeries());
+		}
+
+	return info;
+	}
+
+LiteralInfo PatternAnalyzer::ParseSeries()
+	{
+	set<string> empty;
+	empty.insert("");
+	LiteralInfo info = make_exact(empty, 0);
+
+	while ( ! error && ! AtEnd() && *p != '|' && *p != ')' )
+		info = concat(info, ParseSingleton());
+
+	return info;
+	}
+
+LiteralInfo PatternAnalyzer::ParseSingleton()
+	{
+	LiteralInfo info = ParseAtom();
+
+	while ( ! error )
+		{
+		if ( *p == '*' )
+			{
+			++p;
+			info = optional_repeat(info, UNBOUNDED_LEN);
+			}
+
+		else if ( *p == '+' )
+			{
+			++p;
+			info = repeat(info, 1, UNBOUNDED_LEN);
+			}
+
+		else if ( *p == '?' )
+			{
+			++p;
+			info = optional_repeat(info, 1);
+			}
+
+		else if ( *p == '{' && isdigit(p[1]) )
+			{
+			++p;
+
+			int min_rep, max_rep;
+			if ( ! ParseNumber(&min_rep) )
+				return Error();
+
+			if ( *p == ',' )
+				{
+				++p;
+
+				if ( *p == '}' )
+					max_rep = UNBOUNDED_LEN;
+				else if ( ! ParseNumber(&max_rep) ||
+					  max_rep < min_rep )
+					return Error();
+				}
+			else
+				max_rep = min_rep;
+
+			if ( *p++ != '}' )
+				return Error();
+
+			if ( max_rep == 0 )
+				{
+				set<string> empty;
+				empty.insert("");
+				info = make_exact(empty, 0);
+				}
+
+			else if ( min_rep == 0 )
+				info = optional_repeat(info, max_rep);
+			else
+				info = repeat(info, min_rep, max_rep);
+			}
+
+		else
+			break;
+		}
+
+	return info;
+	}
+
+LiteralInfo PatternAnalyzer::ParseAtom()
+	{
+	set<string> strs;
+
+	switch ( *p ) {
+	case '(':
+		{
+		++p;
+		LiteralInfo info = ParseRE();
+
+		if ( *p++ != ')' )
+			return Error();
+
+		return info;
+		}
+
+	case '"':
+		{
+		++p;
+		string s;
+
+		while ( *p != '"' )
+			{
+			int c;
+			if ( AtEnd() || ! ParseChar(&c) )
+				return Error();
+
+			s += Folded(c);
+			}
+
+		++p;
+		strs.insert(s);
+		return make_exact(strs, s.size());
+		}
+
+	case '[':
+		++p;
+		return ParseCCL();
+
+	case '.':
+		++p;
+		return make_any(1);
+
+	case '^':
+	case '$':
+		{
+		strs.insert("");
+		LiteralInfo info = make_exact(strs, 0);
+		info.bol = (*p++ == '^');
+		return info;
+		}
+
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+	case '}':
+	case ')':
+	case '|':
+		// Includes "{name}" definitions, which signatures don't have.
+		return Error();
+
+	default:
+		{
+		int c;
+		if ( ! ParseChar(&c) )
+			return Error();
+
+		strs.insert(Folded(c));
+		return make_exact(strs, 1);
+		}
+	}
+	}
+
+LiteralInfo PatternAnalyzer::ParseCCL()
+	{
+	// Both "[^" forms of re-scan.l's SC_FIRST_CCL negate the class.
+	bool negated = false;
+	if ( *p == '^' )
+		{
+		negated = true;
+		++p;
+		}
+
+	set<string> chars;
+	bool large = false;
+
+	for ( bool first = true; ; first = false )
+		{
+		if ( AtEnd() )
+			return Error();
+
+		if ( *p == ']' && ! first )
+			{
+			++p;
+			break;
+			}
+
+		if ( p[0] == '[' && p[1] == ':' )
+			{
+			const char* end = strstr(p, ":]");
+			if ( ! end )
+				return Error();
+
+			p = end + 2;
+			large = true;
+			continue;
+			}
+
+		int lo, hi;
+		if ( ! ParseChar(&lo) )
+			return Error();
+
+		hi = lo;
+
+		if ( p[0] == '-' && p[1] != ']' && p[1] != '\0' && p[1] != '\n' )
+			{
+			++p;
+			if ( ! ParseChar(&hi) || hi < lo )
+				return Error();
+			}
+
+		if ( hi - lo >= MAX_ALTERNATIVES )
+			large = true;
+		else
+			for ( int c = lo; c <= hi; ++c )
+				chars.insert(Folded(c));
+		}
+
+	if ( negated || large || chars.size() > MAX_ALTERNATIVES / 4 )
+		return make_any(1);
+
+	return make_exact(chars, 1);
+	}
+
+bool PatternAnalyzer::ParseChar(int* c)
+	{
+	if ( AtEnd() )
+		return false;
+
+	if ( *p != '\\' )
+		{
+		*c = (u_char) *p++;
+		return true;
+		}
+
+	// Mirror how re-scan.l tokenizes ESCSEQ before handing it to
+	// expand_escape().
+	const char* start = p + 1;
+	const char* end;
+
+	if ( *start >= '0' && *start <= '7' )
+		{
+		end = start;
+		while ( *end >= '0' && *end <= '7' )
+			++end;
+		}
+
+	else if ( *start == 'x' )
+		{
+		if ( ! isxdigit(start[1]) || ! isxdigit(start[2]) )
+			return false;
+
+		end = start + 3;
+		}
+
+	else if ( *start == '\0' || *start == '\n' )
+		return false;
+
+	else
+		end = start + 1;
+
+	string esc(start, end - start);
+	const char* s = esc.c_str();
+	*c = expand_escape(s);
+	p = end;
+	return true;
+	}
+
+bool PatternAnalyzer::ParseNumber(int* n)
+	{
+	if ( ! isdigit(*p) )
+		return false;
+
+	*n = 0;
+
+	while ( isdigit(*p) )
+		{
+		*n = *n * 10 + (*p++ - '0');
+
+		if ( *n > RulePrefilter::MAX_LOOKBACK )
+			*n = RulePrefilter::MAX_LOOKBACK + 1;
+		}
+
+	return true;
+	}
+
+RulePrefilter::RulePrefilter()
+	{
+	goto_fn.resize(1);
+	output.resize(1);
+	num_states = 1;
+	num_classes = 1;
+
+	for ( int i = 0; i < 256; ++i )
+		byte_class[i] = 0;
+	}
+
+RulePrefilter::~RulePrefilter()
+	{
+	}
+
+bool RulePrefilter::AnalyzePattern(const char* pattern,
+				   vector<string>* literals, int* lookback)
+	{
+	PatternAnalyzer pa(pattern);
+	return pa.Analyze(literals, lookback);
+	}
+
+void RulePrefilter::AddLiteral(const string& literal, int id)
+	{
+	int state = 0;
+
+	for ( string::size_type i = 0; i < literal.size(); ++i )
+		{
+		u_char c = literal[i];
+		edge_list& edges = goto_fn[state];
+		int next = -1;
+
+		for ( edge_list::const_iterator e = edges.begin();
+		      e != edges.end(); ++e )
+			if ( e->first == c )
+				{
+				next = e->second;
+				break;
+				}
+
+		if ( next < 0 )
+			{
+			next = goto_fn.size();
+			edges.push_back(std::make_pair(c, next));
+			goto_fn.resize(next + 1);
+			output.resize(next + 1);
+			num_states = next + 1;
+			}
+
+		state = next;
+		}
+
+	output[state].push_back(id);
+	}
+
+void RulePrefilter::Compile()
+	{
+	// Literals are already lower case; map upper case input onto the
+	// same classes.
+	for ( size_t s = 0; s < goto_fn.size(); ++s )
+		for ( edge_list::const_iterator e = goto_fn[s].begin();
+		      e != goto_fn[s].end(); ++e )
+			if ( ! byte_class[e->first] )
+				byte_class[e->first] = num_classes++;
+
+	for ( int c = 'A'; c <= 'Z'; ++c )
+		byte_class[c] = byte_class[tolower(c)];
+
+	delta.assign(num_states * num_classes, 0);
+
+	vector<int> fail(num_states, 0);
+	std::deque<int> queue;
+
+	for ( edge_list::const_iterator e = goto_fn[0].begin();
+	      e != goto_fn[0].end(); ++e )
+		{
+		delta[byte_class[e->first]] = e->second;
+		queue.push_back(e->second);
+		}
+
+	// Breadth-first, so that fail states are complete when we
+	// inherit their transitions and outputs.
+	while ( ! queue.empty() )
+		{
+		int s = queue.front();
+		queue.pop_front();
+
+		int f = fail[s];
+
+		for ( int c = 0; c < num_classes; ++c )
+			delta[s * num_classes + c] = delta[f * num_classes + c];
+
+		output[s].insert(output[s].end(), output[f].begin(),
+				 output[f].end());
+		std::sort(output[s].begin(), output[s].end());
+		output[s].erase(std::unique(output[s].begin(), output[s].end()),
+				output[s].end());
+
+		for ( edge_list::const_iterator e = goto_fn[s].begin();
+		      e != goto_fn[s].end(); ++e )
+			{
+			int c = byte_class[e->first];
+			fail[e->second] = delta[f * num_classes + c];
+			delta[s * num_classes + c] = e->second;
+			queue.push_back(e->second);
+			}
+		}
+
+	has_output.resize(num_states);
+	for ( int s = 0; s < num_states; ++s )
+		has_output[s] = ! output[s].empty();
+
+	vector<edge_list> empty;
+	goto_fn.swap(empty);
+	}
+
+unsigned int RulePrefilter::MemoryAllocation() const
+	{
+	unsigned int size = padded_sizeof(*this);
+
+	size += pad_size(delta.size() * sizeof(int));
+	size += pad_size(has_output.size());
+	size += pad_size(output.size() * sizeof(vector<int>));
+
+	for ( size_t s = 0; s < output.size(); ++s )
+		size += pad_size(output[s].capacity() * sizeof(int));
+
+	return size;
+	}
@@ -0,0 +1,107 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef ruleprefilter_h
+#define ruleprefilter_h
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+// A literal prefilter for the signature engine.
+//
+// Many signature patterns have the form ".*R", where every match of R
+// contains one of a few literal strings ending within a bounded number
+// of bytes from the match's start.  The DFA for a group of such patterns
+// can't accept anything before one of these literals has shown up, and
+// once one does, feeding the DFA just that many preceding bytes gets it
+// into an equivalent state.  So RuleMatcher leaves such DFAs alone until
+// an Aho-Corasick automaton over all their literals reports a hit.
+//
+// Literals are folded to lower case, as is the input we scan, which
+// can only cause additional hits, never miss one.
+class RulePrefilter {
+public:
+	RulePrefilter();
+	~RulePrefilter();
+
+	// Checks whether a signature pattern qualifies for prefiltering.
+	// If so, returns true, fills in a set of literals at least one of
+	// which any match must contain, and sets lookback to the maximum
+	// number of bytes from the start of a match (after the leading
+	// ".*") to the end of that literal.
+	static bool AnalyzePattern(const char* pattern,
+				   std::vector<std::string>* literals,
+				   int* lookback);
+
+	// Adds a literal reported with the given ID.  Must be called
+	// before Compile().
+	void AddLiteral(const std::string& literal, int id);
+
+	// Builds the automaton.
+	void Compile();
+
+	// Returns true if no literals have been added.
+	bool Empty() const	{ return num_states <= 1; }
+
+	// Scans the given data starting from the given state, which is 0
+	// for the beginning of a stream, and returns the state to continue
+	// from for the next chunk.  The IDs of all literals ending inside
+	// the data are added to hits, sorted and without duplicates.
+	int Scan(int state, const u_char* data, int len,
+		 std::vector<int>* hits) const
+		{
+		const int* d = &delta[0];
+		size_t n = hits->size();
+
+		for ( int i = 0; i < len; ++i )
+			{
+			state = d[state * num_classes + byte_class[data[i]]];
+
+			if ( has_output[state] )
+				hits->insert(hits->end(), output[state].begin(),
+						output[state].end());
+			}
+
+		if ( hits->size() != n )
+			{
+			std::sort(hits->begin(), hits->end());
+			hits->erase(std::unique(hits->begin(), hits->end()),
+					hits->end());
+			}
+
+		return state;
+		}
+
+	int NumStates() const	{ return num_states; }
+
+	unsigned int MemoryAllocation() const;
+
+	// Literals shorter than this don't make for a useful filter.
+	static const unsigned int MIN_LITERAL_LEN = 3;
+
+	// Patterns needing a larger lookback are not prefiltered, as we
+	// keep that many bytes around for each stream.
+	static const int MAX_LOOKBACK = 1024;
+
+private:
+	typedef std::vector<std::pair<u_char, int> > edge_list;
+
+	// Trie, only needed until compiled.
+	std::vector<edge_list> goto_fn;
+	int num_states;
+
+	std::vector<std::vector<int> > output;
+	std::vector<char> has_output;
+
+	// Bytes not occurring in any literal share class 0.
+	int byte_class[256];
+	int num_classes;
+
+	// Transitions of the compiled automaton, indexed by
+	// state * num_classes + class.
+	std::vector<int> delta;
+};
+
+#endif
@@ -0,0 +1,295 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "ScriptOpt.h"
+#include "Desc.h"
+#include "Expr.h"
+#include "Func.h"
+#include "Scope.h"
+#include "Stmt.h"
+#include "Traverse.h"
+
+// The largest result expression, in nodes, of functions that get inlined.
+static const int max_inline_size = 20;
+
+namespace {
+
+class NodeCounter : public TraversalCallback {
+public:
+	NodeCounter()	{ num_nodes = 0; }
+
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		return ++num_nodes > max_inline_size ?
+			TC_ABORTALL : TC_CONTINUE;
+		}
+
+	int num_nodes;
+};
+
+}
+
+ScriptOptimizer::ScriptOptimizer()
+	{
+	num_folded = num_pruned = num_inlined = 0;
+	}
+
+void ScriptOptimizer::OptimizeAll()
+	{
+	PDict(ID)* globals = global_scope()->Vars();
+	IterCookie* c = globals->InitForIteration();
+	ID* id;
+
+	while ( (id = globals->NextEntry(c)) )
+		{
+		if ( ! id->HasVal() || id->Type()->Tag() != TYPE_FUNC )
+			continue;
+
+		Func* func = id->ID_Val()->AsFunc();
+
+		if ( func->GetKind() == Func::BRO_FUNC )
+			OptimizeFunc((BroFunc*) func);
+		}
+	}
+
+void ScriptOptimizer::OptimizeFunc(BroFunc* f)
+	{
+	if ( done.find(f) != done.end() )
+		return;
+
+	done.insert(f);
+	active.insert(f);
+	funcs.push_back(f);
+
+	f->Optimize(this);
+
+	active.erase(f);
+	}
+
+Expr* ScriptOptimizer::Reduce(Expr* e)
+	{
+	if ( ! e )
+		return 0;
+
+	Expr* r = e->Optimize(this);
+
+	if ( r != e )
+		{
+		++num_folded;
+		Unref(e);
+		}
+
+	return r;
+	}
+
+Stmt* ScriptOptimizer::Reduce(Stmt* s)
+	{
+	if ( ! s )
+		return 0;
+
+	Stmt* r = s->Optimize(this);
+
+	// The statement we replace isn't deleted, as the coverage
+	// profiler keeps pointers to all statements that were parsed.
+	if ( r != s )
+		++num_pruned;
+
+	return r;
+	}
+
+Expr* ScriptOptimizer::Fold(Expr* e)
+	{
+	if ( e->IsError() || ! is_atomic_type(e->Type()) )
+		return e;
+
+	switch ( e->Tag() ) {
+	case EXPR_NAME:
+		break;
+
+	case EXPR_NOT:
+	case EXPR_POSITIVE:
+	case EXPR_NEGATE:
+	case EXPR_ARITH_COERCE:
+		if ( ! is_atomic_type(((UnaryExpr*) e)->Op()->Type()) )
+			return e;
+		break;
+
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+		{
+		// These can fail at run-time, which is when the
+		// error should get reported.
+		BinaryExpr* be = (BinaryExpr*) e;
+
+		if ( be->Op2()->IsZero() ||
+		     be->Op1()->Type()->InternalType() == TYPE_INTERNAL_ADDR )
+			return e;
+		}
+		// Fall through.
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_AND:
+	case EXPR_OR:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		{
+		BinaryExpr* be = (BinaryExpr*) e;
+
+		if ( ! is_atomic_type(be->Op1()->Type()) ||
+		     ! is_atomic_type(be->Op2()->Type()) )
+			return e;
+		break;
+		}
+
+	default:
+		return e;
+	}
+
+	Val* v = 0;
+
+	try
+		{
+		v = e->Eval(0);
+		}
+
+	catch ( InterpreterException& )
+		{
+		}
+
+	if ( ! v )
+		return e;
+
+	Expr* c = new ConstExpr(v);
+	c->SetLocationInfo(e->GetLocationInfo());
+
+	return c;
+	}
+
+bool ScriptOptimizer::IsFoldable(const ID* id) const
+	{
+	// Globals that other peers or the persistence layer may change
+	// at run-time need to keep being looked up.
+	return id->IsGlobal() && id->IsConst() && id->HasVal() &&
+		is_atomic_type(id->Type()) &&
+		! id->FindAttr(ATTR_SYNCHRONIZED) &&
+		! id->FindAttr(ATTR_PERSISTENT);
+	}
+
+void ScriptOptimizer::Inline(CallExpr* c)
+	{
+	if ( c->IsError() || c->Func()->Tag() != EXPR_NAME )
+		return;
+
+	ID* id = c->Func()->AsNameExpr()->Id();
+
+	if ( ! id->IsGlobal() || ! id->IsConst() || ! id->HasVal() ||
+	     id->Type()->Tag() != TYPE_FUNC )
+		return;
+
+	Func* func = id->ID_Val()->AsFunc();
+
+	if ( func->GetKind() != Func::BRO_FUNC ||
+	     func->Flavor() != FUNC_FLAVOR_FUNCTION )
+		return;
+
+	BroFunc* f = (BroFunc*) func;
+
+	if ( active.find(f) != active.end() )
+		{
+		recursive.insert(f);
+		return;
+		}
+
+	// Arguments left to their defaults get filled in by Func::Call().
+	if ( c->Args()->Exprs().length() != f->FType()->Args()->NumFields() )
+		return;
+
+	// Inline the callee's optimized form.
+	OptimizeFunc(f);
+
+	Expr* body = InlineBody(f);
+
+	if ( body )
+		{
+		c->SetInlineBody(f, body);
+		++num_inlined;
+		}
+	}
+
+Expr* ScriptOptimizer::InlineBody(const BroFunc* f) const
+	{
+	if ( recursive.find(f) != recursive.end() )
+		return 0;
+
+	const vector<Func::Body>& bodies = f->GetBodies();
+
+	if ( bodies.size() != 1 )
+		return 0;
+
+	Stmt* s = bodies[0].stmts;
+
+	while ( s->Tag() == STMT_LIST && s->AsStmtList()->Stmts().length() == 1 )
+		s = s->AsStmtList()->Stmts()[0];
+
+	if ( s->Tag() != STMT_RETURN )
+		return 0;
+
+	Expr* e = ((ReturnStmt*) s)->StmtExpr();
+
+	if ( ! e || e->IsError() )
+		return 0;
+
+	NodeCounter nc;
+	e->Traverse(&nc);
+
+	if ( nc.num_nodes > max_inline_size )
+		return 0;
+
+	return e;
+	}
+
+void ScriptOptimizer::Dump(FILE* f) const
+	{
+	std::vector<const BroFunc*> sorted(funcs);
+
+	std::sort(sorted.begin(), sorted.end(),
+		[](const BroFunc* a, const BroFunc* b)
+			{ return strcmp(a->Name(), b->Name()) < 0; });
+
+	for ( auto func : sorted )
+		{
+		for ( auto& b : func->GetBodies() )
+			{
+			ODesc d;
+			d.Add(func->FType()->FlavorString().c_str());
+			d.SP();
+			d.Add(func->Name());
+			d.NL();
+			b.stmts->Describe(&d);
+			fprintf(f, "%s\n", d.Description());
+			}
+		}
+
+	fprintf(f, "# %d expressions folded, %d statements pruned, %d calls inlined\n",
+		num_folded, num_pruned, num_inlined);
+	}
+
+void optimize_script_functions(bool dump)
+	{
+	ScriptOptimizer opt;
+	opt.OptimizeAll();
+
+	if ( dump )
+		opt.Dump(stdout);
+	}
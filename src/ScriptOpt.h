@@ -0,0 +1,73 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// An optimization pass over the ASTs of script functions, run once all
+// scripts have been parsed: references to constant globals get replaced
+// by their values, operators with constant operands get evaluated ahead
+// of time, branches that can't be taken get pruned, and calls of small
+// non-recursive functions get set up to evaluate the callee's result
+// expression directly rather than going through Func::Call().
+
+#ifndef scriptopt_h
+#define scriptopt_h
+
+#include <stdio.h>
+
+#include <set>
+#include <vector>
+
+class BroFunc;
+class CallExpr;
+class Expr;
+class ID;
+class Stmt;
+
+class ScriptOptimizer {
+public:
+	ScriptOptimizer();
+
+	// Optimizes the bodies of all global functions, events, and hooks.
+	void OptimizeAll();
+
+	// Returns the optimized form of the expression or statement (see
+	// Expr::Optimize() and Stmt::Optimize()), taking ownership of the
+	// argument.  Either may be nil.
+	Expr* Reduce(Expr* e);
+	Stmt* Reduce(Stmt* s);
+
+	// Returns a constant expression with the value of the given
+	// expression, whose operands must be constant, or the expression
+	// itself if it's not safe to evaluate it ahead of time.
+	Expr* Fold(Expr* e);
+
+	// True if references to the global can be replaced by its value.
+	bool IsFoldable(const ID* id) const;
+
+	// Sets up the call for evaluating its callee inline if the callee
+	// qualifies.
+	void Inline(CallExpr* c);
+
+	// Writes the optimized bodies to the file.
+	void Dump(FILE* f) const;
+
+protected:
+	void OptimizeFunc(BroFunc* f);
+
+	// Returns the expression that a function's body consists of the
+	// return of, or nil if the function isn't a candidate for inlining.
+	Expr* InlineBody(const BroFunc* f) const;
+
+	std::set<const BroFunc*> done;
+	std::set<const BroFunc*> active;	// on the current call path
+	std::set<const BroFunc*> recursive;
+	std::vector<const BroFunc*> funcs;
+
+	int num_folded;
+	int num_pruned;
+	int num_inlined;
+};
+
+// Optimizes all script functions, events, and hooks and, if dump is
+// true, prints the result to stdout.
+extern void optimize_script_functions(bool dump);
+
+#endif
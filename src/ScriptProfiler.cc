@@ -0,0 +1,351 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "ScriptProfiler.h"
+#include "EventHandler.h"
+#include "Func.h"
+#include "Reporter.h"
+#include "Stmt.h"
+#include "Val.h"
+
+ScriptProfiler* script_profiler = 0;
+
+volatile sig_atomic_t ScriptProfiler::pending_samples = 0;
+
+// How often to sample the statement being executed, in microseconds of
+// CPU time.
+static const int sample_interval = 10000;
+
+ScriptProfiler::ScriptProfiler(const char* file, double arg_dump_interval)
+	{
+	file_name = file;
+	dump_interval = arg_dump_interval;
+	root = new Node(0, 0);
+	cur_stmt = 0;
+	stmt_allocs = 0;
+
+	Counters now = Now();
+	next_dump = now.wall + dump_interval;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SampleHandler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPROF, &sa, &prev_sigprof);
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = sample_interval;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, 0);
+	}
+
+ScriptProfiler::~ScriptProfiler()
+	{
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, 0);
+	sigaction(SIGPROF, &prev_sigprof, 0);
+
+	delete root;
+
+	for ( auto& f : funcs )
+		delete f.second;
+	}
+
+ScriptProfiler::Node::~Node()
+	{
+	for ( auto& c : children )
+		delete c.second;
+	}
+
+void ScriptProfiler::SampleHandler(int sig)
+	{
+	++pending_samples;
+	}
+
+ScriptProfiler::Counters ScriptProfiler::Now()
+	{
+	Counters c;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	c.wall = ts.tv_sec + ts.tv_nsec / 1e9;
+
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	c.cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	c.cpu = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6 +
+		r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+#endif
+
+	for ( int i = 0; i < NUM_TYPES; ++i )
+		c.allocs += Val::NumAllocations(TypeTag(i));
+
+	return c;
+	}
+
+void ScriptProfiler::EnterFunction(const Func* f)
+	{
+	Enter(f, f->Name(), 0);
+	}
+
+void ScriptProfiler::EnterBody(const Func* f, const Stmt* body)
+	{
+	// Functions have a single body; the bodies of events and hooks
+	// are told apart by their locations.
+	if ( f->Flavor() == FUNC_FLAVOR_FUNCTION )
+		Enter(f, f->Name(), 0);
+	else
+		Enter(body, f->Name(), body->GetLocationInfo());
+	}
+
+void ScriptProfiler::EnterEvent(EventHandler* h)
+	{
+	Enter(h, h->Name(), 0);
+	}
+
+void ScriptProfiler::Enter(const void* key, const char* name,
+				const Location* loc)
+	{
+	Counters now = Now();
+
+	if ( stack.empty() )
+		{
+		// Whatever happened since leaving scripts the last time
+		// doesn't belong to any statement.
+		pending_samples = 0;
+		stmt_allocs = now.allocs;
+		}
+	else
+		ChargeStatement(now.allocs);
+
+	FuncStats*& fs = funcs[key];
+
+	if ( ! fs )
+		{
+		fs = new FuncStats;
+		fs->label = name;
+
+		if ( loc && loc->filename )
+			fs->label += fmt("@%s:%d", loc->filename, loc->first_line);
+
+		// Keep the folded format parseable.
+		std::replace(fs->label.begin(), fs->label.end(), ';', '_');
+		std::replace(fs->label.begin(), fs->label.end(), ' ', '_');
+		}
+
+	Node* parent = stack.empty() ? root : stack.back().node;
+	Node*& node = parent->children[fs];
+
+	if ( ! node )
+		node = new Node(fs, parent);
+
+	++fs->calls;
+	++fs->active;
+
+	Activation a;
+	a.node = node;
+	a.start = now;
+	a.caller_stmt = cur_stmt;
+	stack.push_back(a);
+
+	cur_stmt = 0;
+	}
+
+void ScriptProfiler::Exit()
+	{
+	if ( stack.empty() )
+		return;
+
+	Counters now = Now();
+	ChargeStatement(now.allocs);
+
+	Activation a = stack.back();
+	stack.pop_back();
+
+	Counters total = now;
+	total.Sub(a.start);
+
+	Counters self = total;
+	self.Sub(a.children);
+
+	FuncStats* fs = a.node->func;
+	a.node->self.Add(self);
+	fs->self.Add(self);
+
+	if ( --fs->active == 0 )
+		fs->total.Add(total);
+
+	if ( ! stack.empty() )
+		{
+		stack.back().children.Add(total);
+		cur_stmt = a.caller_stmt;
+		return;
+		}
+
+	cur_stmt = 0;
+
+	if ( dump_interval > 0 && now.wall >= next_dump )
+		{
+		Dump();
+		next_dump = now.wall + dump_interval;
+		}
+	}
+
+void ScriptProfiler::SwitchStatement(const Stmt* s)
+	{
+	// Statements executed outside of any function, such as global
+	// initializations, aren't profiled.
+	if ( stack.empty() )
+		return;
+
+	uint64 allocs = 0;
+
+	for ( int i = 0; i < NUM_TYPES; ++i )
+		allocs += Val::NumAllocations(TypeTag(i));
+
+	ChargeStatement(allocs);
+	cur_stmt = s;
+	}
+
+void ScriptProfiler::ChargeStatement(uint64 allocs)
+	{
+	int samples = pending_samples;
+	pending_samples -= samples;
+
+	if ( cur_stmt && (samples || allocs != stmt_allocs) )
+		{
+		LocationStats& ls = stmts[cur_stmt];
+		ls.samples += samples;
+		ls.allocs += allocs - stmt_allocs;
+		}
+
+	stmt_allocs = allocs;
+	}
+
+void ScriptProfiler::Dump()
+	{
+	WriteFile(file_name, false);
+	WriteFile(file_name + ".stats", true);
+	}
+
+void ScriptProfiler::WriteFile(const std::string& name, bool stats) const
+	{
+	std::string tmp_name = name + ".tmp";
+	FILE* f = fopen(tmp_name.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("can't open script profile %s: %s",
+				tmp_name.c_str(), strerror(errno));
+		return;
+		}
+
+	if ( stats )
+		DumpStats(f);
+	else
+		{
+		for ( auto& c : root->children )
+			DumpNode(f, c.second, "");
+		}
+
+	fclose(f);
+
+	if ( rename(tmp_name.c_str(), name.c_str()) < 0 )
+		reporter->Error("can't rename %s to %s: %s", tmp_name.c_str(),
+				name.c_str(), strerror(errno));
+	}
+
+void ScriptProfiler::DumpNode(FILE* f, const Node* n,
+				const std::string& path) const
+	{
+	std::string p = path.empty() ? n->func->label :
+					path + ";" + n->func->label;
+
+	// Folded stacks count microseconds of CPU time.
+	uint64 usecs = uint64(n->self.cpu * 1e6 + 0.5);
+
+	if ( usecs )
+		fprintf(f, "%s %" PRIu64 "\n", p.c_str(), usecs);
+
+	for ( auto& c : n->children )
+		DumpNode(f, c.second, p);
+	}
+
+void ScriptProfiler::DumpStats(FILE* f) const
+	{
+	std::vector<const FuncStats*> fs;
+
+	for ( auto& i : funcs )
+		fs.push_back(i.second);
+
+	std::sort(fs.begin(), fs.end(),
+		[](const FuncStats* a, const FuncStats* b)
+			{ return a->self.cpu > b->self.cpu; });
+
+	fprintf(f, "# calls total-wall self-wall total-cpu self-cpu total-allocs self-allocs function\n");
+
+	for ( auto s : fs )
+		fprintf(f, "%" PRIu64 " %.6f %.6f %.6f %.6f %" PRIu64 " %" PRIu64 " %s\n",
+			s->calls, s->total.wall, s->self.wall, s->total.cpu,
+			s->self.cpu, s->total.allocs, s->self.allocs,
+			s->label.c_str());
+
+	// Statements on the same line get reported together.
+	struct Line {
+		Line()	{ executions = samples = allocs = 0; }
+		uint64 executions;
+		uint64 samples;
+		uint64 allocs;
+	};
+
+	std::map<std::string, Line> lines;
+
+	for ( auto& i : stmts )
+		{
+		const Location* loc = i.first->GetLocationInfo();
+
+		if ( ! loc || ! loc->filename )
+			continue;
+
+		Line& l = lines[fmt("%s:%d", loc->filename, loc->first_line)];
+		l.executions += i.first->GetAccessCount();
+		l.samples += i.second.samples;
+		l.allocs += i.second.allocs;
+		}
+
+	std::vector<std::pair<std::string, Line> > sorted(lines.begin(),
+								lines.end());
+
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::pair<std::string, Line>& a,
+		   const std::pair<std::string, Line>& b)
+			{
+			if ( a.second.samples != b.second.samples )
+				return a.second.samples > b.second.samples;
+
+			return a.second.allocs > b.second.allocs;
+			});
+
+	fprintf(f, "# executions samples est-cpu allocs location\n");
+
+	for ( auto& l : sorted )
+		fprintf(f, "%" PRIu64 " %" PRIu64 " %.6f %" PRIu64 " %s\n",
+			l.second.executions, l.second.samples,
+			l.second.samples * sample_interval / 1e6,
+			l.second.allocs, l.first.c_str());
+	}
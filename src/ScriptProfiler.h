@@ -0,0 +1,159 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Profiles the execution of scripts: accounts wall-clock time, CPU time,
+// and Val allocations to script functions, event handlers, and built-in
+// functions by instrumenting their calls, and to source locations by
+// sampling the statement being executed.  Results go into a file of
+// "folded" call stacks, which flame graph tools take as input, and a
+// file of per-function and per-location statistics next to it.
+
+#ifndef scriptprofiler_h
+#define scriptprofiler_h
+
+#include <signal.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+class EventHandler;
+class Func;
+class Location;
+class Stmt;
+
+class ScriptProfiler {
+public:
+	// Writes the profile into the given file, and its statistics into
+	// the file's name with ".stats" appended.  If dump_interval is
+	// positive, the files get rewritten after that many seconds of
+	// wall-clock time, otherwise only by Dump().
+	ScriptProfiler(const char* file, double dump_interval);
+	~ScriptProfiler();
+
+	// Bracket the calls of the given kinds of code.  Use Scope
+	// instead of calling these directly.
+	void EnterFunction(const Func* f);
+	void EnterBody(const Func* f, const Stmt* body);
+	void EnterEvent(EventHandler* h);
+	void Exit();
+
+	// Called for every statement that gets executed.
+	void StatementSeen(const Stmt* s)
+		{
+		if ( s != cur_stmt )
+			SwitchStatement(s);
+		}
+
+	// Writes the current state of the profile.
+	void Dump();
+
+	// Enters a function, body, or event for as long as it exists, if
+	// profiling is enabled.
+	class Scope {
+	public:
+		Scope(ScriptProfiler* p, const Func* f) : profiler(p)
+			{ if ( profiler ) profiler->EnterFunction(f); }
+		Scope(ScriptProfiler* p, const Func* f, const Stmt* body)
+		    : profiler(p)
+			{ if ( profiler ) profiler->EnterBody(f, body); }
+		Scope(ScriptProfiler* p, EventHandler* h) : profiler(p)
+			{ if ( profiler ) profiler->EnterEvent(h); }
+
+		~Scope()	{ if ( profiler ) profiler->Exit(); }
+
+	private:
+		ScriptProfiler* profiler;
+	};
+
+protected:
+	struct Counters {
+		Counters()	{ wall = cpu = 0; allocs = 0; }
+
+		void Add(const Counters& c)
+			{ wall += c.wall; cpu += c.cpu; allocs += c.allocs; }
+		void Sub(const Counters& c)
+			{ wall -= c.wall; cpu -= c.cpu; allocs -= c.allocs; }
+
+		double wall;
+		double cpu;
+		uint64 allocs;
+	};
+
+	// Statistics of one function, body, or event.
+	struct FuncStats {
+		FuncStats()	{ calls = 0; active = 0; }
+
+		std::string label;
+		uint64 calls;
+		Counters total;	// not counting recursive calls twice
+		Counters self;
+		int active;	// number of activations on the stack
+	};
+
+	// A node of the call tree, i.e. a distinct call stack.
+	struct Node {
+		Node(FuncStats* arg_func, Node* arg_parent)
+			{ func = arg_func; parent = arg_parent; }
+		~Node();
+
+		FuncStats* func;
+		Node* parent;
+		std::map<FuncStats*, Node*> children;
+		Counters self;
+	};
+
+	struct Activation {
+		Node* node;
+		Counters start;
+		Counters children;
+		const Stmt* caller_stmt;
+	};
+
+	// Statistics of the statements at one source location.
+	struct LocationStats {
+		LocationStats()	{ samples = 0; allocs = 0; }
+
+		uint64 samples;
+		uint64 allocs;
+	};
+
+	void Enter(const void* key, const char* name, const Location* loc);
+	void SwitchStatement(const Stmt* s);
+
+	// Credits what happened since the last statement switch to the
+	// current statement.
+	void ChargeStatement(uint64 allocs);
+
+	// Writes to a temporary file first so that readers never see a
+	// partial profile.
+	void WriteFile(const std::string& name, bool stats) const;
+
+	void DumpNode(FILE* f, const Node* n, const std::string& path) const;
+	void DumpStats(FILE* f) const;
+
+	static Counters Now();
+	static void SampleHandler(int sig);
+
+	std::string file_name;
+	double dump_interval;
+	double next_dump;
+
+	Node* root;
+	std::vector<Activation> stack;
+	std::unordered_map<const void*, FuncStats*> funcs;
+	std::unordered_map<const Stmt*, LocationStats> stmts;
+
+	const Stmt* cur_stmt;
+	uint64 stmt_allocs;	// allocation count at the last switch
+
+	struct sigaction prev_sigprof;
+
+	static volatile sig_atomic_t pending_samples;
+};
+
+extern ScriptProfiler* script_profiler;
+
+#endif
@@ -441,7 +441,7 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 	ConnID id;
 	id.src_addr = ip_hdr->SrcAddr();
 	id.dst_addr = ip_hdr->DstAddr();
-	Dictionary* d = 0;
+	FlatDictionary* d = 0;
 	BifEnum::Tunnel::Type tunnel_type = BifEnum::Tunnel::IP;
 
 	switch ( proto ) {
@@ -807,7 +807,7 @@ int NetSessions::ParseIPPacket(int caplen, const u_char* const pkt, int proto,
 		if ( caplen < (int)sizeof(struct ip6_hdr) )
 			return -1;
 
-		inner = new IP_Hdr((const struct ip6_hdr*) pkt, false, caplen);
+		inner = new (packet_arena) IP_Hdr((const struct ip6_hdr*) pkt, false, caplen);
 		}
 
 	else if ( proto == IPPROTO_IPV4 )
@@ -815,7 +815,7 @@ int NetSessions::ParseIPPacket(int caplen, const u_char* const pkt, int proto,
 		if ( caplen < (int)sizeof(struct ip) )
 			return -1;
 
-		inner = new IP_Hdr((const struct ip*) pkt, false);
+		inner = new (packet_arena) IP_Hdr((const struct ip*) pkt, false);
 		}
 
 	else
@@ -931,7 +931,7 @@ Connection* NetSessions::FindConnection(Val* v)
 		return 0;
 
 	RecordType* vr = vt->AsRecordType();
-	const val_list* vl = v->AsRecord();
+	RecordVal* rv = v->AsRecordVal();
 
 	int orig_h, orig_p;	// indices into record's value list
 	int resp_h, resp_p;
@@ -959,11 +959,11 @@ Connection* NetSessions::FindConnection(Val* v)
 		// types, too.
 		}
 
-	const IPAddr& orig_addr = (*vl)[orig_h]->AsAddr();
-	const IPAddr& resp_addr = (*vl)[resp_h]->AsAddr();
+	const IPAddr& orig_addr = rv->Lookup(orig_h)->AsAddr();
+	const IPAddr& resp_addr = rv->Lookup(resp_h)->AsAddr();
 
-	PortVal* orig_portv = (*vl)[orig_p]->AsPortVal();
-	PortVal* resp_portv = (*vl)[resp_p]->AsPortVal();
+	PortVal* orig_portv = rv->Lookup(orig_p)->AsPortVal();
+	PortVal* resp_portv = rv->Lookup(resp_p)->AsPortVal();
 
 	ConnID id;
 
@@ -979,7 +979,7 @@ Connection* NetSessions::FindConnection(Val* v)
 	if ( ! h )
 		reporter->InternalError("hash computation failed");
 
-	Dictionary* d;
+	FlatDictionary* d;
 
 	if ( orig_portv->IsTCP() )
 		d = &tcp_conns;
@@ -1123,7 +1123,7 @@ void NetSessions::Insert(Connection* c)
 
 void NetSessions::Drain()
 	{
-	IterCookie* cookie = tcp_conns.InitForIteration();
+	FlatIterCookie* cookie = tcp_conns.InitForIteration();
 	Connection* tc;
 
 	while ( (tc = tcp_conns.NextEntry(cookie)) )
@@ -1421,7 +1421,7 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 		// Connections have been flushed already.
 		return 0;
 
-	IterCookie* cookie = tcp_conns.InitForIteration();
+	FlatIterCookie* cookie = tcp_conns.InitForIteration();
 	Connection* tc;
 
 	while ( (tc = tcp_conns.NextEntry(cookie)) )
@@ -1450,7 +1450,7 @@ unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 		// Connections have been flushed already.
 		return 0;
 
-	IterCookie* cookie = tcp_conns.InitForIteration();
+	FlatIterCookie* cookie = tcp_conns.InitForIteration();
 	Connection* tc;
 
 	while ( (tc = tcp_conns.NextEntry(cookie)) )
@@ -1480,15 +1480,11 @@ unsigned int NetSessions::MemoryAllocation()
 	return ConnectionMemoryUsage()
 		+ padded_sizeof(*this)
 		+ ch->MemoryAllocation()
-		// must take care we don't count the HaskKeys twice.
-		+ tcp_conns.MemoryAllocation() - padded_sizeof(tcp_conns) -
-		// 12 is sizeof(Key) from ConnID::BuildConnKey();
-		// it can't be (easily) accessed here. :-(
-			(tcp_conns.Length() * pad_size(12))
-		+ udp_conns.MemoryAllocation() - padded_sizeof(udp_conns) -
-			(udp_conns.Length() * pad_size(12))
-		+ icmp_conns.MemoryAllocation() - padded_sizeof(icmp_conns) -
-			(icmp_conns.Length() * pad_size(12))
+		// The connection tables keep their own (inline) copies of
+		// the keys, so there's nothing counted twice here.
+		+ tcp_conns.MemoryAllocation() - padded_sizeof(tcp_conns)
+		+ udp_conns.MemoryAllocation() - padded_sizeof(udp_conns)
+		+ icmp_conns.MemoryAllocation() - padded_sizeof(icmp_conns)
 		+ fragments.MemoryAllocation() - padded_sizeof(fragments)
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
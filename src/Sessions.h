@@ -4,6 +4,7 @@
 #define sessions_h
 
 #include "Dict.h"
+#include "FlatDict.h"
 #include "CompHash.h"
 #include "IP.h"
 #include "Frag.h"
@@ -21,7 +22,7 @@ class OSFingerprint;
 class ConnCompressor;
 struct ConnID;
 
-declare(PDict,Connection);
+declare(FlatPDict,Connection);
 declare(PDict,FragReassembler);
 
 class Discarder;
@@ -224,9 +225,9 @@ protected:
 			      const Packet *pkt, const EncapsulationStack* encap);
 
 	CompositeHash* ch;
-	PDict(Connection) tcp_conns;
-	PDict(Connection) udp_conns;
-	PDict(Connection) icmp_conns;
+	FlatPDict(Connection) tcp_conns;
+	FlatPDict(Connection) udp_conns;
+	FlatPDict(Connection) icmp_conns;
 	PDict(FragReassembler) fragments;
 
 	typedef pair<IPAddr, IPAddr> IPPair;
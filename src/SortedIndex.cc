@@ -0,0 +1,175 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string.h>
+
+#include "SortedIndex.h"
+#include "Val.h"
+#include "Reporter.h"
+
+namespace {
+
+// Refers to a string's bytes without copying them.
+struct StringRef {
+	const char* bytes;
+	size_t len;
+};
+
+int compare_key(bro_uint_t a, bro_uint_t b)
+	{
+	return a < b ? -1 : (a > b ? 1 : 0);
+	}
+
+int compare_key(const IPAddr& a, const IPAddr& b)
+	{
+	return a < b ? -1 : (b < a ? 1 : 0);
+	}
+
+int compare_key(const IPPrefix& a, const IPPrefix& b)
+	{
+	return a < b ? -1 : (b < a ? 1 : 0);
+	}
+
+int compare_key(const std::string& a, const StringRef& b)
+	{
+	size_t n = a.size() < b.len ? a.size() : b.len;
+	int r = memcmp(a.data(), b.bytes, n);
+
+	if ( r )
+		return r;
+
+	return a.size() < b.len ? -1 : (a.size() > b.len ? 1 : 0);
+	}
+
+// Returns the position of the first entry not less than the key.
+template<typename K, typename Q>
+int lower_bound_index(const std::vector<std::pair<K, int> >& entries,
+			const Q& key)
+	{
+	int lo = 0;
+	int hi = entries.size();
+
+	while ( lo < hi )
+		{
+		int mid = lo + (hi - lo) / 2;
+
+		if ( compare_key(entries[mid].first, key) < 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+		}
+
+	return lo;
+	}
+
+template<typename K, typename Q>
+int lookup_entry(const std::vector<std::pair<K, int> >& entries,
+			const Q& key)
+	{
+	int i = lower_bound_index(entries, key);
+
+	if ( i < int(entries.size()) &&
+	     compare_key(entries[i].first, key) == 0 )
+		return entries[i].second;
+
+	return -1;
+	}
+
+template<typename K, typename Q>
+bool insert_entry(std::vector<std::pair<K, int> >& entries, const Q& key,
+			const K& k, int data)
+	{
+	int i = lower_bound_index(entries, key);
+
+	if ( i < int(entries.size()) &&
+	     compare_key(entries[i].first, key) == 0 )
+		return false;
+
+	entries.insert(entries.begin() + i, std::make_pair(k, data));
+	return true;
+	}
+
+StringRef string_key(const Val* v)
+	{
+	const BroString* s = v->AsString();
+	StringRef r = { (const char*) s->Bytes(), size_t(s->Len()) };
+	return r;
+	}
+
+}
+
+SortedIndex::SortedIndex(const BroType* t)
+	{
+	tag = t->InternalType();
+
+	if ( ! is_atomic_type(t) )
+		reporter->InternalError("non-atomic type in SortedIndex");
+	}
+
+bro_uint_t SortedIndex::NumKey(const Val* v)
+	{
+	switch ( v->Type()->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		return bro_uint_t(v->ForceAsInt());
+
+	case TYPE_INTERNAL_UNSIGNED:
+		return v->ForceAsUInt();
+
+	case TYPE_INTERNAL_DOUBLE:
+		{
+		double d = v->ForceAsDouble();
+		bro_uint_t k;
+		memcpy(&k, &d, sizeof(k));
+		return k;
+		}
+
+	default:
+		reporter->InternalError("bad type in SortedIndex::NumKey");
+		return 0;
+	}
+	}
+
+bool SortedIndex::Insert(const Val* v, int data)
+	{
+	switch ( tag ) {
+	case TYPE_INTERNAL_ADDR:
+		return insert_entry(addrs, v->AsAddr(), v->AsAddr(), data);
+
+	case TYPE_INTERNAL_SUBNET:
+		return insert_entry(subnets, v->AsSubNet(), v->AsSubNet(), data);
+
+	case TYPE_INTERNAL_STRING:
+		{
+		const BroString* s = v->AsString();
+		std::string k((const char*) s->Bytes(), s->Len());
+		return insert_entry(strings, string_key(v), k, data);
+		}
+
+	default:
+		{
+		bro_uint_t k = NumKey(v);
+		return insert_entry(nums, k, k, data);
+		}
+	}
+	}
+
+int SortedIndex::Lookup(const Val* v) const
+	{
+	switch ( tag ) {
+	case TYPE_INTERNAL_ADDR:
+		return lookup_entry(addrs, v->AsAddr());
+
+	case TYPE_INTERNAL_SUBNET:
+		return lookup_entry(subnets, v->AsSubNet());
+
+	case TYPE_INTERNAL_STRING:
+		return lookup_entry(strings, string_key(v));
+
+	default:
+		return lookup_entry(nums, NumKey(v));
+	}
+	}
+
+int SortedIndex::Size() const
+	{
+	return nums.size() + addrs.size() + subnets.size() + strings.size();
+	}
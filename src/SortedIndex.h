@@ -0,0 +1,53 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// A read-only map from values of one atomic type to integers, for lookups
+// against fixed collections of values such as switch case labels and the
+// elements of constant sets.  Entries are kept in sorted arrays and found
+// by binary search, so that looking up a value doesn't need to compute a
+// HashKey for it.
+
+#ifndef sortedindex_h
+#define sortedindex_h
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "IPAddr.h"
+#include "Type.h"
+
+class Val;
+
+class SortedIndex {
+public:
+	// The type must be atomic (see is_atomic_type()).
+	SortedIndex(const BroType* t);
+
+	// Associates data with the value.  Returns false if the value is
+	// already in the index, in which case the index doesn't change.
+	bool Insert(const Val* v, int data);
+
+	// Returns the data associated with the value, or -1 if the value
+	// isn't in the index.
+	int Lookup(const Val* v) const;
+
+	int Size() const;
+
+protected:
+	// Numbers are compared by their bit patterns.
+	typedef std::pair<bro_uint_t, int> NumEntry;
+	typedef std::pair<IPAddr, int> AddrEntry;
+	typedef std::pair<IPPrefix, int> SubNetEntry;
+	typedef std::pair<std::string, int> StringEntry;
+
+	static bro_uint_t NumKey(const Val* v);
+
+	InternalTypeTag tag;
+
+	std::vector<NumEntry> nums;
+	std::vector<AddrEntry> addrs;
+	std::vector<SubNetEntry> subnets;
+	std::vector<StringEntry> strings;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "Conn.h"
 #include "File.h"
 #include "Event.h"
+#include "Arena.h"
 #include "NetVar.h"
 #include "Sessions.h"
 #include "Stats.h"
@@ -164,9 +165,36 @@ void ProfileLogger::Log()
 	file->Write(fmt("%.06f Connections expired due to inactivity: %d\n",
 		network_time, killed_by_inactivity));
 
+	string vals;
+
+	for ( int i = 0; i < NUM_TYPES; ++i )
+		if ( Val::NumAllocations(TypeTag(i)) )
+			vals += fmt(" %s=%" PRIu64, type_name(TypeTag(i)),
+				    Val::NumAllocations(TypeTag(i)));
+
+	file->Write(fmt("%.06f Vals allocated:%s\n", network_time, vals.c_str()));
+
 	file->Write(fmt("%.06f Total reassembler data: %" PRIu64"K\n", network_time,
 		Reassembler::TotalMemoryAllocation() / 1024));
 
+	file->Write(fmt("%.06f Reassembly: buffered=%" PRIu64 "K in_place=%" PRIu64 "K evictions=%" PRIu64 " evicted=%" PRIu64 "K\n",
+		network_time, Reassembler::BytesBuffered() / 1024,
+		Reassembler::BytesInPlace() / 1024,
+		Reassembler::NumEvictions(),
+		Reassembler::BytesEvicted() / 1024));
+
+	Arena::Stats astats;
+	packet_arena.GetStats(&astats);
+	double npkts = astats.releases ? double(astats.releases) : 1.0;
+
+	file->Write(fmt("%.06f Arena: packets=%" PRIu64 " allocs=%" PRIu64 " (%.1f/pkt) bytes=%" PRIu64 "K (%.1f/pkt) heap=%" PRIu64 " (%.2f/pkt) chunks=%u pinned=%u mem=%uK\n",
+		network_time, astats.releases,
+		astats.allocs, astats.allocs / npkts,
+		astats.bytes / 1024, astats.bytes / npkts,
+		astats.heap_allocs, astats.heap_allocs / npkts,
+		astats.chunks, astats.pinned,
+		packet_arena.MemoryAllocation() / 1024));
+
 	// Signature engine.
 	if ( expensive && rule_matcher )
 		{
@@ -174,8 +202,12 @@ void ProfileLogger::Log()
 		rule_matcher->GetStats(&stats);
 
 		file->Write(fmt("%06f RuleMatcher: matchers=%d dfa_states=%d ncomputed=%d "
-			"mem=%dK avg_nfa_states=%d\n", network_time, stats.matchers,
-			stats.dfa_states, stats.computed, stats.mem / 1024, stats.avg_nfa_states));
+			"mem=%dK avg_nfa_states=%d prefiltered=%d skipped=%" PRIu64 "K "
+			"wakeups=%" PRIu64 " evictions=%d recomputes=%d\n",
+			network_time, stats.matchers,
+			stats.dfa_states, stats.computed, stats.mem / 1024, stats.avg_nfa_states,
+			stats.prefiltered, stats.prefilter_skipped / 1024,
+			stats.prefilter_wakeups, stats.evictions, stats.recomputes));
 		}
 
 	file->Write(fmt("%.06f Timers: current=%d max=%d mem=%dK lag=%.2fs\n",
@@ -185,6 +217,18 @@ void ProfileLogger::Log()
 		    (timer_mgr->Size() * padded_sizeof(ConnectionTimer))) / 1024,
 		network_time - timer_mgr->LastTimestamp()));
 
+	Wheel_TimerMgr* wheel = dynamic_cast<Wheel_TimerMgr*>(timer_mgr);
+	if ( wheel )
+		{
+		string levels;
+		for ( int i = 0; i < Wheel_TimerMgr::WHEEL_LEVELS; ++i )
+			levels += fmt(" level%d=%d", i, wheel->LevelSize(i));
+
+		file->Write(fmt("%.06f TimerWheel: buckets=%d ready=%d%s overflow=%d\n",
+			network_time, wheel->BucketsInUse(), wheel->ReadySize(),
+			levels.c_str(), wheel->LevelSize(-1)));
+		}
+
 	DNS_Mgr::Stats dstats;
 	dns_mgr->GetStats(&dstats);
 
@@ -216,13 +260,19 @@ void ProfileLogger::Log()
 		threading::MsgThread::Stats s = i->second;
 		file->Write(fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
 				" (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+				" (max-depth/stalls/wakeups: in=%" PRIu64 "/%" PRIu64 "/%" PRIu64
+				" out=%" PRIu64 "/%" PRIu64 "/%" PRIu64 ")"
 			        "\n",
 			    network_time,
 			    i->first.c_str(),
 			    s.sent_in, s.sent_out,
 			    s.pending_in, s.pending_out,
 			    s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes
+			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes,
+			    s.queue_in_stats.max_depth, s.queue_in_stats.num_stalls,
+			    s.queue_in_stats.num_wakeups,
+			    s.queue_out_stats.max_depth, s.queue_out_stats.num_stalls,
+			    s.queue_out_stats.num_wakeups
 			    ));
 		}
 
@@ -9,6 +9,8 @@
 #include "Reporter.h"
 #include "NetVar.h"
 #include "Stmt.h"
+#include "SortedIndex.h"
+#include "ScriptOpt.h"
 #include "Scope.h"
 #include "Var.h"
 #include "Debug.h"
@@ -84,6 +86,11 @@ int Stmt::IsPure() const
 	return 0;
 	}
 
+Stmt* Stmt::Optimize(ScriptOptimizer* opt)
+	{
+	return this;
+	}
+
 void Stmt::Describe(ODesc* d) const
 	{
 	if ( ! d->IsReadable() || Tag() != STMT_EXPR )
@@ -221,6 +228,12 @@ bool ExprListStmt::DoUnserialize(UnserialInfo* info)
 	return l != 0;
 	}
 
+Stmt* ExprListStmt::Optimize(ScriptOptimizer* opt)
+	{
+	l->Optimize(opt);
+	return this;
+	}
+
 TraversalCode ExprListStmt::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreStmt(this);
@@ -371,6 +384,12 @@ int ExprStmt::IsPure() const
 	return ! e || e->IsPure();
 	}
 
+Stmt* ExprStmt::Optimize(ScriptOptimizer* opt)
+	{
+	e = opt->Reduce(e);
+	return this;
+	}
+
 void ExprStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -467,6 +486,20 @@ int IfStmt::IsPure() const
 	return e->IsPure() && s1->IsPure() && s2->IsPure();
 	}
 
+Stmt* IfStmt::Optimize(ScriptOptimizer* opt)
+	{
+	ExprStmt::Optimize(opt);
+
+	s1 = opt->Reduce(s1);
+	s2 = opt->Reduce(s2);
+
+	if ( ! e->IsConst() )
+		return this;
+
+	// Same test as DoExec().
+	return e->IsZero() ? s2->Ref() : s1->Ref();
+	}
+
 void IfStmt::Describe(ODesc* d) const
 	{
 	ExprStmt::Describe(d);
@@ -603,6 +636,11 @@ void Case::Describe(ODesc* d) const
 	d->PopIndent();
 	}
 
+void Case::Optimize(ScriptOptimizer* opt)
+	{
+	s = opt->Reduce(s);
+	}
+
 TraversalCode Case::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc;
@@ -649,19 +687,10 @@ bool Case::DoUnserialize(UnserialInfo* info)
 	return this->s != 0;
 	}
 
-static void int_del_func(void* v)
-	{
-	delete (int*) v;
-	}
-
 void SwitchStmt::Init()
 	{
-	TypeList* t = new TypeList();
-	t->Append(e->Type()->Ref());
-	comp_hash = new CompositeHash(t);
-	Unref(t);
-
-	case_label_map.SetDeleteFunc(int_del_func);
+	// Non-atomic types get reported by the constructor.
+	case_index = is_atomic_type(e->Type()) ? new SortedIndex(e->Type()) : 0;
 	}
 
 SwitchStmt::SwitchStmt(Expr* index, case_list* arg_cases) :
@@ -758,38 +787,28 @@ SwitchStmt::~SwitchStmt()
 		Unref((*cases)[i]);
 
 	delete cases;
-	delete comp_hash;
+	delete case_index;
 	}
 
 bool SwitchStmt::AddCaseLabelMapping(const Val* v, int idx)
 	{
-	HashKey* hk = comp_hash->ComputeHash(v, 1);
+	if ( ! case_index )
+		return true;
 
-	if ( ! hk )
+	if ( v->Type()->InternalType() != e->Type()->InternalType() )
 		{
 		reporter->PushLocation(e->GetLocationInfo());
 		reporter->InternalError("switch expression type mismatch (%s/%s)",
 		    type_name(v->Type()->Tag()), type_name(e->Type()->Tag()));
 		}
 
-	int* label_idx = case_label_map.Lookup(hk);
-
-	if ( label_idx )
-		{
-		delete hk;
-		return false;
-		}
-
-	case_label_map.Insert(hk, new int(idx));
-	delete hk;
-	return true;
+	return case_index->Insert(v, idx);
 	}
 
 int SwitchStmt::FindCaseLabelMatch(const Val* v) const
 	{
-	HashKey* hk = comp_hash->ComputeHash(v, 1);
-
-	if ( ! hk )
+	if ( ! case_index ||
+	     v->Type()->InternalType() != e->Type()->InternalType() )
 		{
 		reporter->PushLocation(e->GetLocationInfo());
 		reporter->Error("switch expression type mismatch (%s/%s)",
@@ -797,14 +816,12 @@ int SwitchStmt::FindCaseLabelMatch(const Val* v) const
 		return -1;
 		}
 
-	int* label_idx = case_label_map.Lookup(hk);
+	int label_idx = case_index->Lookup(v);
 
-	delete hk;
-
-	if ( ! label_idx )
+	if ( label_idx < 0 )
 		return default_case_idx;
 	else
-		return *label_idx;
+		return label_idx;
 	}
 
 Val* SwitchStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
@@ -833,6 +850,16 @@ Val* SwitchStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 	return rval;
 	}
 
+Stmt* SwitchStmt::Optimize(ScriptOptimizer* opt)
+	{
+	ExprStmt::Optimize(opt);
+
+	loop_over_list(*cases, i)
+		(*cases)[i]->Optimize(opt);
+
+	return this;
+	}
+
 int SwitchStmt::IsPure() const
 	{
 	if ( ! e->IsPure() )
@@ -1059,6 +1086,13 @@ Val* EventStmt::Exec(Frame* f, stmt_flow_type& flow) const
 	return 0;
 	}
 
+Stmt* EventStmt::Optimize(ScriptOptimizer* opt)
+	{
+	// The event expression is also our "e", so it has to stay.
+	event_expr->Optimize(opt);
+	return this;
+	}
+
 TraversalCode EventStmt::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreStmt(this);
@@ -1107,6 +1141,20 @@ int WhileStmt::IsPure() const
 	return loop_condition->IsPure() && body->IsPure();
 	}
 
+Stmt* WhileStmt::Optimize(ScriptOptimizer* opt)
+	{
+	loop_condition = opt->Reduce(loop_condition);
+	body = opt->Reduce(body);
+
+	if ( ! loop_condition->IsConst() || ! loop_condition->IsZero() )
+		return this;
+
+	Stmt* s = new NullStmt;
+	s->SetLocationInfo(GetLocationInfo());
+
+	return s;
+	}
+
 void WhileStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -1371,6 +1419,14 @@ int ForStmt::IsPure() const
 	return e->IsPure() && body->IsPure();
 	}
 
+Stmt* ForStmt::Optimize(ScriptOptimizer* opt)
+	{
+	ExprStmt::Optimize(opt);
+	body = opt->Reduce(body);
+
+	return this;
+	}
+
 void ForStmt::Describe(ODesc* d) const
 	{
 	Stmt::Describe(d);
@@ -1717,6 +1773,14 @@ int StmtList::IsPure() const
 	return 1;
 	}
 
+Stmt* StmtList::Optimize(ScriptOptimizer* opt)
+	{
+	loop_over_list(stmts, i)
+		stmts.replace(i, opt->Reduce(stmts[i]));
+
+	return this;
+	}
+
 void StmtList::Describe(ODesc* d) const
 	{
 	if ( ! d->IsReadable() )
@@ -9,6 +9,7 @@
 #include "Obj.h"
 #include "Expr.h"
 #include "Reporter.h"
+#include "ScriptProfiler.h"
 
 #include "StmtEnums.h"
 
@@ -16,6 +17,8 @@
 
 class StmtList;
 class ForStmt;
+class SortedIndex;
+class ScriptOptimizer;
 
 declare(PDict, int);
 
@@ -36,6 +39,11 @@ public:
 	// True if the statement has no side effects, false otherwise.
 	virtual int IsPure() const;
 
+	// Optimizes the statement's parts in place (see ScriptOpt.h) and
+	// returns the statement to execute instead of this one: either
+	// the statement itself, or a new reference to an equivalent one.
+	virtual Stmt* Optimize(ScriptOptimizer* opt);
+
 	StmtList* AsStmtList()
 		{
 		CHECK_TAG(tag, STMT_LIST, "Stmt::AsStmtList", stmt_name)
@@ -54,7 +62,15 @@ public:
 		return (ForStmt*) this;
 		}
 
-	void RegisterAccess() const	{ last_access = network_time; access_count++; }
+	void RegisterAccess() const
+		{
+		last_access = network_time;
+		access_count++;
+
+		if ( script_profiler )
+			script_profiler->StatementSeen(this);
+		}
+
 	void AccessStats(ODesc* d) const;
 	uint32 GetAccessCount() const { return access_count; }
 
@@ -97,6 +113,8 @@ class ExprListStmt : public Stmt {
 public:
 	const ListExpr* ExprList() const	{ return l; }
 
+	Stmt* Optimize(ScriptOptimizer* opt) override;
+
 	TraversalCode Traverse(TraversalCallback* cb) const;
 
 protected:
@@ -137,6 +155,9 @@ public:
 	Val* Exec(Frame* f, stmt_flow_type& flow) const override;
 
 	const Expr* StmtExpr() const	{ return e; }
+	Expr* StmtExpr()		{ return e; }
+
+	Stmt* Optimize(ScriptOptimizer* opt) override;
 
 	void Describe(ODesc* d) const override;
 
@@ -164,6 +185,8 @@ public:
 	const Stmt* TrueBranch() const	{ return s1; }
 	const Stmt* FalseBranch() const	{ return s2; }
 
+	Stmt* Optimize(ScriptOptimizer* opt) override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -192,6 +215,9 @@ public:
 	const Stmt* Body() const	{ return s; }
 	Stmt* Body()			{ return s; }
 
+	// Optimizes the body.  The labels stay as they are.
+	void Optimize(ScriptOptimizer* opt);
+
 	void Describe(ODesc* d) const override;
 
 	bool Serialize(SerialInfo* info) const;
@@ -216,23 +242,25 @@ public:
 
 	const case_list* Cases() const	{ return cases; }
 
+	Stmt* Optimize(ScriptOptimizer* opt) override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
 protected:
 	friend class Stmt;
-	SwitchStmt()	{ cases = 0; default_case_idx = -1; comp_hash = 0; }
+	SwitchStmt()	{ cases = 0; default_case_idx = -1; case_index = 0; }
 
 	Val* DoExec(Frame* f, Val* v, stmt_flow_type& flow) const override;
 	int IsPure() const override;
 
 	DECLARE_SERIAL(SwitchStmt);
 
-	// Initialize composite hash and case label map.
+	// Initialize the case label index.
 	void Init();
 
-	// Adds an entry in case_label_map for the given value to associate it
+	// Adds an entry in case_index for the given value to associate it
 	// with the given index in the cases list.  If the entry already exists,
 	// returns false, else returns true.
 	bool AddCaseLabelMapping(const Val* v, int idx);
@@ -244,8 +272,7 @@ protected:
 
 	case_list* cases;
 	int default_case_idx;
-	CompositeHash* comp_hash;
-	PDict(int) case_label_map;
+	SortedIndex* case_index;	// nil if the switch type isn't atomic
 };
 
 class AddStmt : public ExprStmt {
@@ -285,6 +312,7 @@ public:
 	EventStmt(EventExpr* e);
 
 	Val* Exec(Frame* f, stmt_flow_type& flow) const override;
+	Stmt* Optimize(ScriptOptimizer* opt) override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
@@ -303,7 +331,11 @@ public:
 	WhileStmt(Expr* loop_condition, Stmt* body);
 	~WhileStmt();
 
+	const Expr* Condition() const	{ return loop_condition; }
+	const Stmt* Body() const	{ return body; }
+
 	int IsPure() const override;
+	Stmt* Optimize(ScriptOptimizer* opt) override;
 
 	void Describe(ODesc* d) const override;
 
@@ -335,6 +367,7 @@ public:
 	const Stmt* LoopBody() const	{ return body; }
 
 	int IsPure() const override;
+	Stmt* Optimize(ScriptOptimizer* opt) override;
 
 	void Describe(ODesc* d) const override;
 
@@ -422,6 +455,8 @@ public:
 	const stmt_list& Stmts() const	{ return stmts; }
 	stmt_list& Stmts()		{ return stmts; }
 
+	Stmt* Optimize(ScriptOptimizer* opt) override;
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
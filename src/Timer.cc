@@ -261,3 +261,431 @@ void CQ_TimerMgr::Remove(Timer* timer)
 		delete timer;
 		}
 	}
+
+double timer_wheel_resolution = 0.0;
+
+// The bucket index marking timers in the ready heap.
+static const int WHEEL_READY = -2;
+
+// Bucket index for timers beyond the wheel's range.
+static const int WHEEL_OVERFLOW =
+	Wheel_TimerMgr::WHEEL_LEVELS * Wheel_TimerMgr::WHEEL_SLOTS;
+
+// Largest tick we compute; keeps far-future times (such as the ones used
+// for expiring everything) from overflowing.
+static const uint64 WHEEL_MAX_TICK = uint64(1) << 62;
+
+Wheel_TimerMgr::Wheel_TimerMgr(const Tag& tag, double arg_resolution)
+	: TimerMgr(tag)
+	{
+	if ( arg_resolution <= 0.0 )
+		reporter->InternalError("bad timer wheel resolution %f",
+					arg_resolution);
+
+	resolution = arg_resolution;
+	now_tick = 0;
+	next_seq = 0;
+	expiring = false;
+
+	for ( int i = 0; i < WHEEL_LEVELS; ++i )
+		level_size[i] = 0;
+
+	overflow_size = 0;
+	buckets_in_use = 0;
+	size = peak_size = 0;
+	}
+
+Wheel_TimerMgr::~Wheel_TimerMgr()
+	{
+	for ( unsigned int i = 0; i < entries.size(); ++i )
+		delete entries[i].timer;
+	}
+
+uint64 Wheel_TimerMgr::Tick(double t) const
+	{
+	if ( t <= 0.0 )
+		return 0;
+
+	double tick = t / resolution;
+
+	if ( tick >= double(WHEEL_MAX_TICK) )
+		return WHEEL_MAX_TICK;
+
+	return uint64(tick);
+	}
+
+void Wheel_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s to TimeMgr %p",
+			timer_type_to_string(timer->Type()), this);
+
+	// As with the other managers, we add the timer even if it's
+	// already expired; Place() puts it into the ready heap then.
+	Place(NewEntry(timer));
+
+	if ( ++size > peak_size )
+		peak_size = size;
+
+	++current_timers[timer->Type()];
+	}
+
+int Wheel_TimerMgr::NewEntry(Timer* timer)
+	{
+	int entry;
+
+	if ( free_entries.empty() )
+		{
+		entry = entries.size();
+		entries.push_back(Entry());
+		}
+	else
+		{
+		entry = free_entries.back();
+		free_entries.pop_back();
+		}
+
+	Entry& e = entries[entry];
+	e.timer = timer;
+	e.time = timer->Time();
+	e.seq = next_seq++;
+	e.bucket = -1;
+	e.pos = -1;
+
+	timer->SetOffset(entry);
+	return entry;
+	}
+
+Timer* Wheel_TimerMgr::ReleaseEntry(int entry)
+	{
+	Entry& e = entries[entry];
+	Timer* timer = e.timer;
+
+	e.timer = 0;
+	e.bucket = -1;
+	e.pos = -1;
+	free_entries.push_back(entry);
+
+	timer->SetOffset(-1);
+	return timer;
+	}
+
+void Wheel_TimerMgr::Place(int entry)
+	{
+	uint64 tick = Tick(entries[entry].time);
+
+	if ( expiring || tick <= now_tick )
+		{
+		PushReady(entry);
+		return;
+		}
+
+	// The level is given by the most significant group of bits in
+	// which the timer's tick differs from the current one: it has to
+	// cascade down once the wheel gets there.
+	uint64 diff = tick ^ now_tick;
+	int level = 0;
+
+	while ( level < WHEEL_LEVELS && (diff >> (WHEEL_BITS * (level + 1))) )
+		++level;
+
+	if ( level >= WHEEL_LEVELS )
+		{
+		AddToBucket(WHEEL_OVERFLOW, entry);
+		return;
+		}
+
+	int slot = (tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+	AddToBucket(level * WHEEL_SLOTS + slot, entry);
+	}
+
+void Wheel_TimerMgr::AddToBucket(int bucket, int entry)
+	{
+	std::vector<int>& b = buckets[bucket];
+
+	if ( b.empty() )
+		++buckets_in_use;
+
+	entries[entry].bucket = bucket;
+	entries[entry].pos = b.size();
+	b.push_back(entry);
+
+	if ( bucket == WHEEL_OVERFLOW )
+		++overflow_size;
+	else
+		++level_size[bucket / WHEEL_SLOTS];
+	}
+
+void Wheel_TimerMgr::RemoveFromBucket(int entry)
+	{
+	int bucket = entries[entry].bucket;
+	std::vector<int>& b = buckets[bucket];
+	int pos = entries[entry].pos;
+
+	if ( pos < 0 || pos >= int(b.size()) || b[pos] != entry )
+		reporter->InternalError("inconsistency in timer wheel bucket %d",
+					bucket);
+
+	// Order within a bucket doesn't matter, so fill the gap with the
+	// last timer.
+	int last = b.back();
+	b[pos] = last;
+	entries[last].pos = pos;
+	b.pop_back();
+
+	if ( b.empty() )
+		--buckets_in_use;
+
+	if ( bucket == WHEEL_OVERFLOW )
+		--overflow_size;
+	else
+		--level_size[bucket / WHEEL_SLOTS];
+
+	entries[entry].bucket = -1;
+	entries[entry].pos = -1;
+	}
+
+void Wheel_TimerMgr::FlushBucket(int bucket, bool to_ready)
+	{
+	if ( buckets[bucket].empty() )
+		return;
+
+	std::vector<int> timers;
+	timers.swap(buckets[bucket]);
+	--buckets_in_use;
+
+	if ( bucket == WHEEL_OVERFLOW )
+		overflow_size -= timers.size();
+	else
+		level_size[bucket / WHEEL_SLOTS] -= timers.size();
+
+	for ( unsigned int i = 0; i < timers.size(); ++i )
+		{
+		if ( to_ready )
+			PushReady(timers[i]);
+		else
+			Place(timers[i]);
+		}
+	}
+
+void Wheel_TimerMgr::ProcessTick()
+	{
+	// Cascade from the top down so that timers due now make it all the
+	// way into the ready heap.
+	if ( (now_tick & ((uint64(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0 )
+		FlushBucket(WHEEL_OVERFLOW, false);
+
+	for ( int level = WHEEL_LEVELS - 1; level > 0; --level )
+		{
+		int shift = WHEEL_BITS * level;
+
+		if ( (now_tick & ((uint64(1) << shift) - 1)) != 0 )
+			continue;
+
+		int slot = (now_tick >> shift) & (WHEEL_SLOTS - 1);
+		FlushBucket(level * WHEEL_SLOTS + slot, false);
+		}
+
+	FlushBucket(now_tick & (WHEEL_SLOTS - 1), true);
+	}
+
+void Wheel_TimerMgr::AdvanceTo(uint64 tick)
+	{
+	while ( now_tick < tick )
+		{
+		// If the lowest levels are empty, nothing can become due
+		// before the next level up cascades, so skip right there.
+		int level = 0;
+		while ( level < WHEEL_LEVELS && level_size[level] == 0 )
+			++level;
+
+		if ( level == WHEEL_LEVELS && overflow_size == 0 )
+			{
+			now_tick = tick;
+			return;
+			}
+
+		if ( level > 0 )
+			{
+			int shift = WHEEL_BITS * level;
+			uint64 next = ((now_tick >> shift) + 1) << shift;
+
+			if ( next > tick )
+				{
+				now_tick = tick;
+				return;
+				}
+
+			now_tick = next - 1;
+			}
+
+		++now_tick;
+		ProcessTick();
+		}
+	}
+
+void Wheel_TimerMgr::PushReady(int entry)
+	{
+	entries[entry].bucket = WHEEL_READY;
+	ready.push_back(0);
+	SetReady(ready.size() - 1, entry);
+	ReadyUp(ready.size() - 1);
+	}
+
+Timer* Wheel_TimerMgr::PopReady()
+	{
+	if ( ready.empty() )
+		return 0;
+
+	int top = ready[0];
+	int last = ready.back();
+	ready.pop_back();
+
+	if ( ! ready.empty() )
+		{
+		SetReady(0, last);
+		ReadyDown(0);
+		}
+
+	return ReleaseEntry(top);
+	}
+
+void Wheel_TimerMgr::RemoveReady(int entry)
+	{
+	int pos = entries[entry].pos;
+
+	if ( pos < 0 || pos >= int(ready.size()) || ready[pos] != entry )
+		reporter->InternalError("inconsistency in timer wheel ready heap");
+
+	int last = ready.back();
+	ready.pop_back();
+
+	if ( last != entry )
+		{
+		SetReady(pos, last);
+		ReadyUp(pos);
+		ReadyDown(entries[last].pos);
+		}
+
+	entries[entry].bucket = -1;
+	entries[entry].pos = -1;
+	}
+
+void Wheel_TimerMgr::ReadyUp(int pos)
+	{
+	int entry = ready[pos];
+
+	while ( pos > 0 )
+		{
+		int parent = (pos - 1) / 2;
+
+		if ( ! ReadyBefore(entry, ready[parent]) )
+			break;
+
+		SetReady(pos, ready[parent]);
+		pos = parent;
+		}
+
+	SetReady(pos, entry);
+	}
+
+void Wheel_TimerMgr::ReadyDown(int pos)
+	{
+	int entry = ready[pos];
+	int n = ready.size();
+
+	for ( ; ; )
+		{
+		int child = 2 * pos + 1;
+
+		if ( child >= n )
+			break;
+
+		if ( child + 1 < n && ReadyBefore(ready[child + 1], ready[child]) )
+			++child;
+
+		if ( ! ReadyBefore(ready[child], entry) )
+			break;
+
+		SetReady(pos, ready[child]);
+		pos = child;
+		}
+
+	SetReady(pos, entry);
+	}
+
+void Wheel_TimerMgr::Expire()
+	{
+	// Everything is due now, including timers added while we dispatch.
+	expiring = true;
+
+	for ( int i = 0; i <= WHEEL_OVERFLOW; ++i )
+		FlushBucket(i, true);
+
+	Timer* timer;
+	while ( (timer = PopReady()) )
+		{
+		--size;
+		DBG_LOG(DBG_TM, "Dispatching timer %s in TimeMgr %p",
+				timer_type_to_string(timer->Type()), this);
+		timer->Dispatch(t, 1);
+		--current_timers[timer->Type()];
+		delete timer;
+		}
+
+	expiring = false;
+	}
+
+int Wheel_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	AdvanceTo(Tick(new_t));
+
+	for ( num_expired = 0; (num_expired < max_expire || max_expire == 0) &&
+	      ! ready.empty() && entries[ready[0]].time <= new_t; ++num_expired )
+		{
+		Timer* timer = PopReady();
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+		--size;
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s in TimeMgr %p",
+				timer_type_to_string(timer->Type()), this);
+		timer->Dispatch(new_t, 0);
+		delete timer;
+		}
+
+	return num_expired;
+	}
+
+void Wheel_TimerMgr::Remove(Timer* timer)
+	{
+	int entry = timer->Offset();
+
+	if ( entry < 0 || entry >= int(entries.size()) ||
+	     entries[entry].timer != timer )
+		reporter->InternalError("asked to remove a missing timer");
+
+	if ( entries[entry].bucket == WHEEL_READY )
+		RemoveReady(entry);
+	else
+		RemoveFromBucket(entry);
+
+	ReleaseEntry(entry);
+
+	--size;
+	--current_timers[timer->Type()];
+	delete timer;
+	}
+
+unsigned int Wheel_TimerMgr::MemoryUsage() const
+	{
+	unsigned int mem = padded_sizeof(*this);
+
+	for ( int i = 0; i <= WHEEL_OVERFLOW; ++i )
+		mem += pad_size(buckets[i].capacity() * sizeof(int));
+
+	mem += pad_size(ready.capacity() * sizeof(int));
+	mem += pad_size(entries.capacity() * sizeof(Entry));
+	mem += pad_size(free_entries.capacity() * sizeof(int));
+
+	return mem;
+	}
@@ -4,8 +4,8 @@
 #define timer_h
 
 #include <string>
+#include <vector>
 
-#include <string>
 #include "SerialObj.h"
 #include "PriorityQueue.h"
 
@@ -179,6 +179,121 @@ protected:
 	struct cq_handle *cq;
 };
 
+// A hierarchical timing wheel: WHEEL_LEVELS levels of WHEEL_SLOTS buckets
+// each, where a bucket at level k spans WHEEL_SLOTS^k ticks of the given
+// resolution.  Adding and canceling timers is O(1).  As time advances,
+// buckets of higher levels get redistributed to lower ones, and level
+// zero buckets move as a whole into a small heap of ready timers from
+// which they're dispatched in order of time.  Timers with equal
+// timestamps are dispatched in the order in which they were added.
+class Wheel_TimerMgr : public TimerMgr {
+public:
+	Wheel_TimerMgr(const Tag& arg_tag, double arg_resolution = 1.0);
+	~Wheel_TimerMgr();
+
+	void Add(Timer* timer);
+	void Expire();
+
+	int Size() const	{ return size; }
+	int PeakSize() const	{ return peak_size; }
+	unsigned int MemoryUsage() const;
+
+	// Returns the number of timers currently stored at the given
+	// level of the wheel; -1 gives the number beyond the wheel's
+	// range.
+	int LevelSize(int level) const
+		{ return level < 0 ? overflow_size : level_size[level]; }
+
+	// Returns the number of non-empty buckets.
+	int BucketsInUse() const	{ return buckets_in_use; }
+
+	// Returns the number of timers due for dispatch.
+	int ReadySize() const	{ return ready.size(); }
+
+	static const int WHEEL_LEVELS = 4;
+	static const int WHEEL_BITS = 8;
+	static const int WHEEL_SLOTS = 1 << WHEEL_BITS;
+
+protected:
+	int DoAdvance(double t, int max_expire);
+	void Remove(Timer* timer);
+
+	uint64 Tick(double t) const;
+
+	// Puts the timer into the bucket corresponding to its time, or
+	// into the ready heap if it's due already.
+	void Place(int entry);
+
+	void AddToBucket(int bucket, int entry);
+	void RemoveFromBucket(int entry);
+
+	// Moves all timers of the given bucket on.  If ready is true, they
+	// all go into the ready heap, otherwise they're placed anew.
+	void FlushBucket(int bucket, bool ready);
+
+	// Advances the wheel to the given tick, cascading buckets as their
+	// time comes.
+	void AdvanceTo(uint64 tick);
+	void ProcessTick();
+
+	// Returns a new entry for the timer, which the timer's
+	// PQ_Element offset then refers to.
+	int NewEntry(Timer* timer);
+
+	// Frees the entry and returns its timer.
+	Timer* ReleaseEntry(int entry);
+
+	// Binary heap of due timers ordered by (time, sequence number).
+	void PushReady(int entry);
+	Timer* PopReady();
+	void RemoveReady(int entry);
+	bool ReadyBefore(int a, int b) const
+		{
+		const Entry& ea = entries[a];
+		const Entry& eb = entries[b];
+		return ea.time < eb.time ||
+			(ea.time == eb.time && ea.seq < eb.seq);
+		}
+	void SetReady(int pos, int entry)
+		{ ready[pos] = entry; entries[entry].pos = pos; }
+	void ReadyUp(int pos);
+	void ReadyDown(int pos);
+
+	// What we need to know about a timer.  We keep it here rather
+	// than in Timer so that timers managed otherwise don't pay for it.
+	struct Entry {
+		Timer* timer;	// nil if the entry is free
+		double time;	// the timer's, to save dereferencing it
+		uint64 seq;	// insertion order, to order equal timestamps
+		int bucket;	// bucket index, or WHEEL_READY for the heap
+		int pos;	// position within the bucket or the heap
+	};
+
+	double resolution;
+	uint64 now_tick;
+	uint64 next_seq;
+	bool expiring;
+
+	std::vector<Entry> entries;
+	std::vector<int> free_entries;
+
+	// Buckets and the ready heap hold entry indices.  Level k, slot i
+	// is at k * WHEEL_SLOTS + i; the final bucket holds timers too far
+	// in the future for the wheel.
+	std::vector<int> buckets[WHEEL_LEVELS * WHEEL_SLOTS + 1];
+	std::vector<int> ready;
+
+	int level_size[WHEEL_LEVELS];
+	int overflow_size;
+	int buckets_in_use;
+	int size;
+	int peak_size;
+};
+
 extern TimerMgr* timer_mgr;
 
+// If non-zero, the resolution (in seconds) of the Wheel_TimerMgr to use
+// for the global timers instead of a PQ_TimerMgr.  Set via --timer-wheel.
+extern double timer_wheel_resolution;
+
 #endif
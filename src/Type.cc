@@ -975,6 +975,7 @@ RecordType::RecordType(type_decl_list* arg_types) : BroType(TYPE_RECORD)
 	{
 	types = arg_types;
 	num_fields = types ? types->length() : 0;
+	slab_size = -1;
 	}
 
 RecordType::~RecordType()
@@ -988,6 +989,49 @@ RecordType::~RecordType()
 		}
 	}
 
+void RecordType::FixSlabLayout()
+	{
+	if ( slab_size >= 0 )
+		return;
+
+	// The flags come first, followed by the values, each aligned to
+	// 8 bytes.
+	int num_slab_fields = 0;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const BroType* t = FieldType(i);
+
+		switch ( t->Tag() ) {
+		case TYPE_BOOL:
+		case TYPE_PORT:
+		case TYPE_ENUM:
+			slab_flags.push_back(num_slab_fields++);
+			break;
+
+		default:
+			slab_flags.push_back(-1);
+			break;
+		}
+		}
+
+	int offset = (num_slab_fields + 7) & ~7;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( slab_flags[i] < 0 )
+			{
+			slab_offsets.push_back(-1);
+			continue;
+			}
+
+		slab_offsets.push_back(offset);
+		offset += sizeof(BroValUnion);
+		}
+
+	slab_size = num_slab_fields ? offset : 0;
+	}
+
 int RecordType::HasField(const char* field) const
 	{
 	return FieldOffset(field) >= 0;
@@ -1431,6 +1475,19 @@ EnumType::~EnumType()
 		delete [] iter->first;
 	}
 
+EnumVal* EnumType::GetVal(bro_int_t i)
+	{
+	EnumVal*& v = vals[i];
+
+	// The values keep a reference to us, so neither goes away; enum
+	// types stay around for good anyway.
+	if ( ! v )
+		v = new EnumVal(i, this);
+
+	v->Ref();
+	return v;
+	}
+
 // Note, we use reporter->Error() here (not Error()) to include the current script
 // location in the error message, rather than the one where the type was
 // originally defined.
@@ -7,6 +7,7 @@
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
 
 #include "Obj.h"
 #include "Attr.h"
@@ -71,6 +72,7 @@ class SubNetType;
 class FuncType;
 class ListExpr;
 class EnumType;
+class EnumVal;
 class Serializer;
 class VectorType;
 class TypeType;
@@ -483,6 +485,31 @@ public:
 
 	int NumFields() const			{ return num_fields; }
 
+	// RecordVals keep fields of bool, port, and enum types unboxed in
+	// a slab of memory.  These are the types for which there's a
+	// shared Val for every value, so that RecordVal::Lookup() can
+	// return one without having to keep it.  Returns the byte offset
+	// of the field's value within the slab, or -1 if the field is
+	// always stored as a Val.  The layout is fixed once the first
+	// value of this type gets created; fields that redefs add after
+	// that are never stored in the slab.
+	int SlabOffset(int field) const
+		{
+		return field < (int) slab_offsets.size() ?
+			slab_offsets[field] : -1;
+		}
+
+	// Each field stored in the slab has a byte at this offset telling
+	// whether it currently holds a value.
+	int SlabFlag(int field) const	{ return slab_flags[field]; }
+
+	// Size of the slab in bytes, 0 if there are no fields to store
+	// in it.
+	int SlabSize() const	{ return slab_size; }
+
+	// Computes the slab layout, if not done already.
+	void FixSlabLayout();
+
 	// Returns 0 if all is ok, otherwise a pointer to an error message.
 	// Takes ownership of list.
 	const char* AddFields(type_decl_list* types, attr_list* attr);
@@ -493,12 +520,16 @@ public:
 	void DescribeFieldsReST(ODesc* d, bool func_args) const;
 
 protected:
-	RecordType() { types = 0; }
+	RecordType() { types = 0; slab_size = -1; }
 
 	DECLARE_SERIAL(RecordType)
 
 	int num_fields;
 	type_decl_list* types;
+
+	std::vector<int> slab_offsets;
+	std::vector<int> slab_flags;
+	int slab_size;	// -1 if the layout isn't fixed yet
 };
 
 class SubNetType : public BroType {
@@ -569,6 +600,10 @@ public:
 	// will be fully qualified with their module name.
 	enum_name_list Names() const;
 
+	// Returns a new reference to a value of this type that all callers
+	// share.
+	EnumVal* GetVal(bro_int_t i);
+
 	void DescribeReST(ODesc* d, bool roles_only = false) const override;
 
 protected:
@@ -593,6 +628,10 @@ protected:
 	// as a flag to prevent mixing of auto-increment and explicit
 	// enumerator specifications.
 	bro_int_t counter;
+
+	// The values handed out by GetVal().
+	typedef std::map<bro_int_t, EnumVal*> ValMap;
+	ValMap vals;
 };
 
 class VectorType : public BroType {
@@ -27,11 +27,14 @@
 #include "Reporter.h"
 #include "IPAddr.h"
 
+uint64 Val::num_allocations[NUM_TYPES];
+
 Val::Val(Func* f)
 	{
 	val.func_val = f;
 	::Ref(val.func_val);
 	type = f->FType()->Ref();
+	++num_allocations[type->Tag()];
 #ifdef DEBUG
 	bound_id = 0;
 #endif
@@ -47,6 +50,7 @@ Val::Val(BroFile* f)
 
 	assert(f->FType()->Tag() == TYPE_STRING);
 	type = string_file_type->Ref();
+	++num_allocations[type->Tag()];
 
 #ifdef DEBUG
 	bound_id = 0;
@@ -72,6 +76,10 @@ Val::~Val()
 
 Val* Val::Clone() const
 	{
+	// Strings are immutable, so their copies can share the bytes.
+	if ( type->Tag() == TYPE_STRING )
+		return new StringVal(new BroString(*AsString()));
+
 	SerializationFormat* form = new BinarySerializationFormat();
 	form->StartWrite();
 
@@ -761,13 +769,18 @@ bool IntervalVal::DoUnserialize(UnserialInfo* info)
 	}
 
 PortVal::PortVal(uint32 p, TransportProto port_type) : Val(TYPE_PORT)
+	{
+	val.uint_val = static_cast<bro_uint_t>(Mask(p, port_type));
+	}
+
+uint32 PortVal::Mask(uint32 p, TransportProto port_type)
 	{
 	// Note, for ICMP one-way connections:
 	// src_port = icmp_type, dst_port = icmp_code.
 
 	if ( p >= 65536 )
 		{
-		InternalWarning("bad port number");
+		reporter->InternalWarning("bad port number");
 		p = 0;
 		}
 
@@ -788,7 +801,7 @@ PortVal::PortVal(uint32 p, TransportProto port_type) : Val(TYPE_PORT)
 		break;	// "other"
 	}
 
-	val.uint_val = static_cast<bro_uint_t>(p);
+	return p;
 	}
 
 PortVal::PortVal(uint32 p) : Val(TYPE_PORT)
@@ -851,6 +864,43 @@ bool PortVal::DoUnserialize(UnserialInfo* info)
 	return true;
 	}
 
+ValManager::ValManager()
+	{
+	b_true = new Val(true, TYPE_BOOL);
+	b_false = new Val(false, TYPE_BOOL);
+
+	for ( bro_uint_t i = 0; i < PREALLOCATED_COUNTS; ++i )
+		counts[i] = new Val(i, TYPE_COUNT);
+
+	memset(ports, 0, sizeof(ports));
+	}
+
+ValManager::~ValManager()
+	{
+	Unref(b_true);
+	Unref(b_false);
+
+	for ( bro_uint_t i = 0; i < PREALLOCATED_COUNTS; ++i )
+		Unref(counts[i]);
+
+	for ( int i = 0; i < 65536 * NUM_PORT_SPACES; ++i )
+		Unref(ports[i]);
+	}
+
+PortVal* ValManager::GetPort(uint32 p)
+	{
+	if ( p >= 65536 * NUM_PORT_SPACES )
+		{
+		reporter->InternalWarning("bad port number");
+		p = 0;
+		}
+
+	if ( ! ports[p] )
+		ports[p] = new PortVal(p);
+
+	return ports[p]->Ref()->AsPortVal();
+	}
+
 AddrVal::AddrVal(const char* text) : Val(TYPE_ADDR)
 	{
 	val.addr_val = new IPAddr(text);
@@ -2556,6 +2606,10 @@ RecordVal::RecordVal(RecordType* t) : MutableVal(t)
 	int n = record_type->NumFields();
 	val_list* vl = val.val_list_val = new val_list(n);
 
+	record_type->FixSlabLayout();
+	int slab_size = record_type->SlabSize();
+	slab = slab_size ? new char[slab_size]() : 0;
+
 	// Initialize to default values from RecordType (which are nil
 	// by default).
 	for ( int i = 0; i < n; ++i )
@@ -2591,15 +2645,150 @@ RecordVal::RecordVal(RecordType* t) : MutableVal(t)
 				def = new VectorVal(type->AsVectorType());
 			}
 
-		vl->append(def ? def->Ref() : 0);
-
-		Unref(def);
+		if ( def && Unbox(i, def) )
+			vl->append(0);
+		else
+			{
+			vl->append(def ? def->Ref() : 0);
+			Unref(def);
+			}
 		}
 	}
 
 RecordVal::~RecordVal()
 	{
 	delete_vals(AsNonConstRecord());
+	delete [] slab;
+	}
+
+// Returns a new reference to a Val for the value of a field of type t
+// stored at p.  For the types that RecordVal keeps in its slab, that's a
+// shared Val.
+static Val* make_slab_val(const BroType* t, const char* p)
+	{
+	const BroValUnion& v = *(const BroValUnion*) p;
+
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+		return val_mgr->GetBool(v.int_val);
+
+	case TYPE_COUNT:
+		return val_mgr->GetCount(v.uint_val);
+
+	case TYPE_PORT:
+		return val_mgr->GetPort(v.uint_val);
+
+	case TYPE_ENUM:
+		return const_cast<BroType*>(t)->AsEnumType()->GetVal(v.int_val);
+
+	case TYPE_INTERVAL:
+		return new IntervalVal(v.double_val, 1.0);
+
+	default:
+		break;
+	}
+
+	switch ( t->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		return new Val(v.int_val, t->Tag());
+
+	case TYPE_INTERNAL_UNSIGNED:
+		return new Val(v.uint_val, t->Tag());
+
+	case TYPE_INTERNAL_DOUBLE:
+		return new Val(v.double_val, t->Tag());
+
+	default:
+		reporter->InternalError("bad type in make_slab_val");
+		return 0;
+	}
+	}
+
+bool RecordVal::Unbox(int field, Val* v)
+	{
+	int offset = record_type->SlabOffset(field);
+
+	if ( offset < 0 )
+		return false;
+
+	const BroType* t = record_type->FieldType(field);
+
+	if ( v->Type()->Tag() != t->Tag() ||
+	     (t->Tag() == TYPE_ENUM && v->Type() != t) )
+		return false;
+
+	char* p = slab + offset;
+
+	switch ( t->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		((BroValUnion*) p)->int_val = v->ForceAsInt();
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		((BroValUnion*) p)->uint_val = v->ForceAsUInt();
+		break;
+
+	default:
+		return false;
+	}
+
+	slab[record_type->SlabFlag(field)] = 1;
+	Unref(v);
+	return true;
+	}
+
+char* RecordVal::SlabAssign(int field)
+	{
+	int offset = record_type->SlabOffset(field);
+
+	// State accesses get logged with Vals.
+	if ( offset < 0 || LoggingAccess() )
+		return 0;
+
+	Unref(AsNonConstRecord()->replace(field, 0));
+	slab[record_type->SlabFlag(field)] = 1;
+	return slab + offset;
+	}
+
+void RecordVal::AssignScalar(int field, const BroValUnion& v)
+	{
+	char* p = SlabAssign(field);
+
+	if ( p )
+		{
+		*(BroValUnion*) p = v;
+		Modified();
+		}
+	else
+		Assign(field, make_slab_val(record_type->FieldType(field),
+						(const char*) &v));
+	}
+
+void RecordVal::AssignInt(int field, bro_int_t i)
+	{
+	BroValUnion v;
+	v.int_val = i;
+	AssignScalar(field, v);
+	}
+
+void RecordVal::AssignUnsigned(int field, bro_uint_t u)
+	{
+	BroValUnion v;
+	v.uint_val = u;
+	AssignScalar(field, v);
+	}
+
+void RecordVal::AssignDouble(int field, double d)
+	{
+	BroValUnion v;
+	v.double_val = d;
+	AssignScalar(field, v);
+	}
+
+void RecordVal::AssignAddr(int field, const IPAddr& addr)
+	{
+	// Addresses always need a Val.
+	Assign(field, new AddrVal(addr));
 	}
 
 void RecordVal::Assign(int field, Val* new_val, Opcode op)
@@ -2625,10 +2814,15 @@ void RecordVal::Assign(int field, Val* new_val, Opcode op)
 			}
 		}
 
-	Val* old_val = AsNonConstRecord()->replace(field, new_val);
+	Val* old_val = AsNonConstRecord()->replace(field, 0);
+	bool in_slab = record_type->SlabOffset(field) >= 0;
 
 	if ( LoggingAccess() && op != OP_NONE )
 		{
+		if ( ! old_val && in_slab && InSlab(field) )
+			old_val = make_slab_val(record_type->FieldType(field),
+					slab + record_type->SlabOffset(field));
+
 		if ( new_val && new_val->IsMutableVal() )
 			new_val->AsMutableVal()->AddProperties(GetProperties());
 
@@ -2640,18 +2834,72 @@ void RecordVal::Assign(int field, Val* new_val, Opcode op)
 		Unref(index); // The logging may keep a cached copy.
 		}
 
+	if ( in_slab )
+		slab[record_type->SlabFlag(field)] = 0;
+
+	if ( new_val && ! Unbox(field, new_val) )
+		AsNonConstRecord()->replace(field, new_val);
+
 	Unref(old_val);
 	Modified();
 	}
 
 Val* RecordVal::Lookup(int field) const
 	{
-	return (*AsRecord())[field];
+	Val* v = (*AsRecord())[field];
+
+	if ( v || ! InSlab(field) )
+		return v;
+
+	// The Val is a shared one, which stays around without our
+	// reference.
+	v = make_slab_val(record_type->FieldType(field),
+				slab + record_type->SlabOffset(field));
+	Unref(v);
+	return v;
+	}
+
+bool RecordVal::LookupScalar(int field, BroValUnion& v) const
+	{
+	Val* box = (*AsRecord())[field];
+
+	if ( ! box )
+		{
+		if ( ! InSlab(field) )
+			return false;
+
+		v = *(const BroValUnion*) (slab + record_type->SlabOffset(field));
+		return true;
+		}
+
+	switch ( box->Type()->InternalType() ) {
+	case TYPE_INTERNAL_INT:
+		v.int_val = box->ForceAsInt();
+		break;
+
+	case TYPE_INTERNAL_UNSIGNED:
+		v.uint_val = box->ForceAsUInt();
+		break;
+
+	case TYPE_INTERNAL_DOUBLE:
+		v.double_val = box->ForceAsDouble();
+		break;
+
+	default:
+		reporter->InternalError("non-scalar field in RecordVal::LookupScalar");
+	}
+
+	return true;
+	}
+
+bool RecordVal::IsSet(int field) const
+	{
+	return (*AsRecord())[field] || InSlab(field);
 	}
 
 Val* RecordVal::LookupWithDefault(int field) const
 	{
-	Val* val = (*AsRecord())[field];
+	Val* val = Lookup(field);
 
 	if ( val )
 		return val->Ref();
@@ -2719,7 +2967,7 @@ RecordVal* RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool allow_orphan
 		}
 
 	for ( i = 0; i < ar_t->NumFields(); ++i )
-		if ( ! ar->Lookup(i) &&
+		if ( ! ar->IsSet(i) &&
 			 ! ar_t->FieldDecl(i)->FindAttr(ATTR_OPTIONAL) )
 			{
 			char buf[512];
@@ -2767,7 +3015,7 @@ void RecordVal::Describe(ODesc* d) const
 		if ( ! d->IsBinary() )
 			d->Add("=");
 
-		Val* v = (*vl)[i];
+		Val* v = Lookup(i);
 		if ( v )
 			v->Describe(d);
 		else
@@ -2794,7 +3042,7 @@ void RecordVal::DescribeReST(ODesc* d) const
 		d->Add(record_type->FieldName(i));
 		d->Add("=");
 
-		Val* v = (*vl)[i];
+		Val* v = Lookup(i);
 
 		if ( v )
 			v->Describe(d);
@@ -2825,7 +3073,7 @@ bool RecordVal::DoSerialize(SerialInfo* info) const
 	loop_over_list(*val.val_list_val, i)
 		{
 		info->s->WriteOpenTag(record_type->FieldName(i));
-		Val* v = (*val.val_list_val)[i];
+		Val* v = Lookup(i);
 		SERIALIZE_OPTIONAL(v);
 		info->s->WriteCloseTag(record_type->FieldName(i));
 		}
@@ -2842,6 +3090,10 @@ bool RecordVal::DoUnserialize(UnserialInfo* info)
 	record_type = (RecordType*) type;
 	origin = 0;
 
+	record_type->FixSlabLayout();
+	int slab_size = record_type->SlabSize();
+	slab = slab_size ? new char[slab_size]() : 0;
+
 	int len;
 	if ( ! UNSERIALIZE(&len) )
 		{
@@ -2855,6 +3107,10 @@ bool RecordVal::DoUnserialize(UnserialInfo* info)
 		{
 		Val* v;
 		UNSERIALIZE_OPTIONAL(v, Val::Unserialize(info));
+
+		if ( v && Unbox(i, v) )
+			v = 0;
+
 		AsNonConstRecord()->append(v);	// correct for v==0, too.
 		}
 
@@ -2909,6 +3165,9 @@ unsigned int RecordVal::MemoryAllocation() const
 		    size += v->MemoryAllocation();
 		}
 
+	if ( slab )
+		size += pad_size(record_type->SlabSize());
+
 	return size + padded_sizeof(*this) + val.val_list_val->MemoryAllocation();
 	}
 
@@ -80,6 +80,7 @@ public:
 		{
 		val.int_val = b;
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -89,6 +90,7 @@ public:
 		{
 		val.int_val = bro_int_t(i);
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -98,6 +100,7 @@ public:
 		{
 		val.uint_val = bro_uint_t(u);
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -107,6 +110,7 @@ public:
 		{
 		val.int_val = i;
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -116,6 +120,7 @@ public:
 		{
 		val.uint_val = u;
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -125,6 +130,7 @@ public:
 		{
 		val.double_val = d;
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -139,6 +145,7 @@ public:
 	Val(BroType* t, bool type_type) // Extra arg to differentiate from protected version.
 		{
 		type = new TypeType(t->Ref());
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -148,6 +155,7 @@ public:
 		{
 		val.int_val = 0;
 		type = base_type(TYPE_ERROR);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -270,6 +278,7 @@ public:
 	// bool, int, count, or counter.
 	bro_int_t ForceAsInt() const		{ return val.int_val; }
 	bro_uint_t ForceAsUInt() const		{ return val.uint_val; }
+	double ForceAsDouble() const		{ return val.double_val; }
 
 #define CONVERTER(tag, ctype, name) \
 	ctype name() \
@@ -336,6 +345,9 @@ public:
 
 	DECLARE_SERIAL(Val);
 
+	// Returns the number of values of the given type created so far.
+	static uint64 NumAllocations(TypeTag t)	{ return num_allocations[t]; }
+
 #ifdef DEBUG
 	// For debugging, we keep a reference to the global ID to which a
 	// value has been bound *last*.
@@ -356,6 +368,7 @@ protected:
 		{
 		val.string_val = s;
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -367,6 +380,7 @@ protected:
 	Val(TypeTag t)
 		{
 		type = base_type(t);
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -375,6 +389,7 @@ protected:
 	Val(BroType* t)
 		{
 		type = t->Ref();
+		++num_allocations[type->Tag()];
 #ifdef DEBUG
 		bound_id = 0;
 #endif
@@ -390,6 +405,8 @@ protected:
 	BroValUnion val;
 	BroType* type;
 
+	static uint64 num_allocations[NUM_TYPES];
+
 #ifdef DEBUG
 	// For debugging, we keep the name of the ID to which a Val is bound.
 	const char* bound_id;
@@ -509,6 +526,9 @@ public:
 	PortVal(uint32 p, TransportProto port_type);
 	PortVal(uint32 p);	// used for already-massaged port value.
 
+	// Returns the massaged value for a port number in host order.
+	static uint32 Mask(uint32 p, TransportProto port_type);
+
 	Val* SizeVal() const override	{ return new Val(val.uint_val, TYPE_INT); }
 
 	// Returns the port number in host order (not including the mask).
@@ -540,6 +560,42 @@ protected:
 	DECLARE_SERIAL(PortVal);
 };
 
+// Hands out shared instances of frequently used immutable values, so that
+// producing them doesn't require an allocation each time.  All methods
+// return a new reference to the value.
+class ValManager {
+public:
+	ValManager();
+	~ValManager();
+
+	Val* GetBool(bool b) const
+		{ return (b ? b_true : b_false)->Ref(); }
+
+	Val* GetCount(bro_uint_t c) const
+		{
+		return c < PREALLOCATED_COUNTS ?
+			counts[c]->Ref() : new Val(c, TYPE_COUNT);
+		}
+
+	// Both take the port number in host order.
+	PortVal* GetPort(uint32 p, TransportProto port_type)
+		{ return GetPort(PortVal::Mask(p, port_type)); }
+
+	PortVal* GetPort(uint32 p);	// already-massaged port value
+
+private:
+	static const bro_uint_t PREALLOCATED_COUNTS = 256;
+
+	Val* b_true;
+	Val* b_false;
+	Val* counts[PREALLOCATED_COUNTS];
+
+	// Created on first use.
+	PortVal* ports[65536 * NUM_PORT_SPACES];
+};
+
+extern ValManager* val_mgr;
+
 class AddrVal : public Val {
 public:
 	AddrVal(const char* text);
@@ -875,9 +931,27 @@ public:
 		{ return new Val(record_type->NumFields(), TYPE_COUNT); }
 
 	void Assign(int field, Val* new_val, Opcode op = OP_ASSIGN);
-	Val* Lookup(int field) const;	// Does not Ref() value.
+
+	// Same as Assign(), but for numeric and address fields: these
+	// don't need to create a Val for the new value if the field is
+	// stored in the record's slab (see RecordType::SlabOffset()).
+	void AssignInt(int field, bro_int_t i);
+	void AssignUnsigned(int field, bro_uint_t u);
+	void AssignDouble(int field, double d);
+	void AssignAddr(int field, const IPAddr& addr);
+
+	// Does not Ref() value.  If the field is stored unboxed, this
+	// returns the shared Val for its value.
+	Val* Lookup(int field) const;
 	Val* LookupWithDefault(int field) const;	// Does Ref() value.
 
+	// Copies the value of a numeric field into v without creating a
+	// Val for it.  Returns false if the field isn't set.
+	bool LookupScalar(int field, BroValUnion& v) const;
+
+	// Returns true if the field has a value, without creating one.
+	bool IsSet(int field) const;
+
 	/**
 	 * Looks up the value of a field by field name.  If the field doesn't
 	 * exist in the record type, it's an internal error: abort.
@@ -915,15 +989,39 @@ public:
 
 protected:
 	friend class Val;
-	RecordVal()	{}
+	RecordVal()	{ slab = 0; }
 
 	bool AddProperties(Properties arg_state) override;
 	bool RemoveProperties(Properties arg_state) override;
 
 	DECLARE_SERIAL(RecordVal);
 
+	// Returns true if the field's value lives in the slab.
+	bool InSlab(int field) const
+		{
+		int offset = record_type->SlabOffset(field);
+		return offset >= 0 && slab[record_type->SlabFlag(field)];
+		}
+
+	// Moves v into the slab if the field is stored there, in which
+	// case it takes ownership of v.  Returns false if v needs to be
+	// kept as a Val.
+	bool Unbox(int field, Val* v);
+
+	// Prepares for storing a new value of the given field in the
+	// slab, returning the value's memory.  Returns nil if the field
+	// isn't stored there or assigning it needs a Val anyway.
+	char* SlabAssign(int field);
+
+	// Backs AssignInt() and friends.
+	void AssignScalar(int field, const BroValUnion& v);
+
 	RecordType* record_type;
 	BroObj* origin;
+
+	// Fields of fixed size, laid out as given by the record type.
+	// A field's entry in the val_list takes precedence over the slab.
+	char* slab;
 };
 
 class EnumVal : public Val {
@@ -158,10 +158,10 @@ void ConnSize_Analyzer::UpdateConnVal(RecordVal *conn_val)
 	if ( bytesidx < 0 )
 		reporter->InternalError("'endpoint' record missing 'num_bytes_ip' field");
 
-	orig_endp->Assign(pktidx, new Val(orig_pkts, TYPE_COUNT));
-	orig_endp->Assign(bytesidx, new Val(orig_bytes, TYPE_COUNT));
-	resp_endp->Assign(pktidx, new Val(resp_pkts, TYPE_COUNT));
-	resp_endp->Assign(bytesidx, new Val(resp_bytes, TYPE_COUNT));
+	orig_endp->AssignUnsigned(pktidx, orig_pkts);
+	orig_endp->AssignUnsigned(bytesidx, orig_bytes);
+	resp_endp->AssignUnsigned(pktidx, resp_pkts);
+	resp_endp->AssignUnsigned(bytesidx, resp_bytes);
 
 	Analyzer::UpdateConnVal(conn_val);
 	}
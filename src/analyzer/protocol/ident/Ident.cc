@@ -211,7 +211,7 @@ const char* Ident_Analyzer::ParsePort(const char* line, const char* end_of_line,
 	int n = 0;
 
 	line = skip_whitespace(line, end_of_line);
-	if ( ! isdigit(*line) )
+	if ( line >= end_of_line || ! isdigit(*line) )
 		return 0;
 
 	const char* l = line;
@@ -221,16 +221,18 @@ const char* Ident_Analyzer::ParsePort(const char* line, const char* end_of_line,
 		n = n * 10 + (*line - '0');
 		++line;
 		}
-	while ( isdigit(*line) );
-
-	line = skip_whitespace(line, end_of_line);
+	while ( line < end_of_line && isdigit(*line) );
 
 	if ( n < 0 || n > 65535 )
 		{
-		Weird("bad_ident_port", l);
+		// The line needn't be NUL-terminated.
+		BroString s((const u_char*) l, end_of_line - l, true);
+		Weird("bad_ident_port", s.CheckString());
 		n = 0;
 		}
 
+	line = skip_whitespace(line, end_of_line);
+
 	pn = n;
 
 	return line;
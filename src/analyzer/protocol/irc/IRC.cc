@@ -55,7 +55,7 @@ void IRC_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		return;
 		}
 
-	string myline = string((const char*) line);
+	string myline = string((const char*) line, length);
 
 	// Check for prefix.
 	string prefix = "";
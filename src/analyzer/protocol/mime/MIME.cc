@@ -452,7 +452,12 @@ BroString* MIME_Multiline::get_concatenated_line()
 		return 0;
 
 	delete line;
-	line = concatenate(buffer);
+
+	// Most headers fit on one line, whose bytes the copy can share.
+	if ( buffer.size() == 1 )
+		line = new BroString(*buffer[0]);
+	else
+		line = concatenate(buffer);
 
 	return line;
 	}
@@ -1498,14 +1503,14 @@ int MIME_Mail::RequestBuffer(int* plen, char** pbuf)
 		// Copy every thing in [data_start, buffer_start) to
 		// [0, overlap).
 		if ( buffer_start > data_start )
-			memcpy(data_buffer->Bytes(),
+			memcpy(data_buffer->MutableBytes(),
 				data_buffer->Bytes() + data_start, overlap);
 		data_start = 0;
 		buffer_start = overlap;
 		}
 
 	*plen = max_chunk_length - overlap;
-	*pbuf = (char*) data_buffer->Bytes() + buffer_start;
+	*pbuf = (char*) data_buffer->MutableBytes() + buffer_start;
 
 	return 1;
 	}
@@ -2,6 +2,7 @@
 
 #include "ContentLine.h"
 #include "analyzer/protocol/tcp/TCP.h"
+#include "LineScan.h"
 
 #include "events.bif.h"
 
@@ -204,6 +205,46 @@ void ContentLine_Analyzer::DoDeliver(int len, const u_char* data)
 		}
 	}
 
+int ContentLine_Analyzer::DeliverInPlace(int len, const u_char* data)
+	{
+	const u_char* end = data + len;
+	const u_char* delim = find_line_delim(data, end, flag_NULs);
+
+	if ( delim == end )
+		return 0;
+
+	int line_len = delim - data;
+	int seq_len;
+	unsigned int c = *delim;
+
+	if ( c == '\r' && delim + 1 < end && delim[1] == '\n' )
+		{
+		seq_len = line_len + 2;
+		c = '\n';
+		}
+
+	else if ( c == '\r' && (CR_LF_as_EOL & CR_as_EOL) )
+		seq_len = line_len + 1;
+
+	else if ( c == '\n' && (CR_LF_as_EOL & LF_as_EOL) &&
+		  (line_len > 0 || last_char != '\r') )
+		seq_len = line_len + 1;
+
+	else
+		// Not a line end, or one that needs DoDeliverOnce()'s care.
+		return 0;
+
+	if ( line_len > 0 && last_char == '\r' )
+		if ( ! suppress_weirds && Conn()->FlagEvent(SINGULAR_CR) )
+			Conn()->Weird("line_terminated_with_single_CR");
+
+	seq_delivered_in_lines = seq + seq_len;
+	last_char = c;
+	ForwardStream(line_len, data, IsOrig());
+
+	return seq_len;
+	}
+
 int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	{
 	const u_char* data_start = data;
@@ -211,8 +252,40 @@ int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	if ( len <= 0 )
 		return 0;
 
+	if ( offset == 0 )
+		{
+		int n = DeliverInPlace(len, data);
+
+		if ( n > 0 )
+			return n;
+		}
+
 	for ( ; len > 0; --len, ++data )
 		{
+		// Bytes up to the next one that may end the line go into
+		// the buffer as they are.
+		int run = find_line_delim(data, data + len, flag_NULs) - data;
+
+		if ( run > 0 )
+			{
+			if ( offset + run > buf_len )
+				InitBuffer(max(buf_len * 2, offset + run));
+
+			memcpy(buf + offset, data, run);
+			offset += run;
+
+			if ( last_char == '\r' )
+				if ( ! suppress_weirds && Conn()->FlagEvent(SINGULAR_CR) )
+					Conn()->Weird("line_terminated_with_single_CR");
+
+			last_char = data[run - 1];
+			data += run;
+			len -= run;
+
+			if ( len == 0 )
+				break;
+			}
+
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
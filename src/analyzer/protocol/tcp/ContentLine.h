@@ -1,4 +1,8 @@
 // Support-analyzer to split a reassembled stream into lines.
+//
+// Lines get passed on without their terminator.  They aren't necessarily
+// followed by a NUL: a line that arrives in one piece is delivered
+// straight out of the segment, so consumers must go by its length.
 
 #ifndef ANALYZER_PROTOCOL_TCP_CONTENTLINE_H
 #define ANALYZER_PROTOCOL_TCP_CONTENTLINE_H
@@ -71,6 +75,11 @@ protected:
 	void InitBuffer(int size);
 	virtual void DoDeliver(int len, const u_char* data);
 	int DoDeliverOnce(int len, const u_char* data);
+
+	// If the data starts with a complete line, passes it on without
+	// copying it into buf first and returns the number of bytes
+	// consumed, including the line terminator.  Returns 0 otherwise.
+	int DeliverInPlace(int len, const u_char* data);
 	void CheckNUL();
 
 	// Returns the sequence number delivered so far.
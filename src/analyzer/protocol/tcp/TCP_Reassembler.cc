@@ -45,6 +45,9 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	if ( tcp_max_old_segments )
 		SetMaxOldBlocks(tcp_max_old_segments);
 
+	// Merged blocks would change what rexmit_inconsistency reports.
+	SetCoalesceBlocks(! rexmit_inconsistency);
+
 	if ( tcp_contents )
 		{
 		// Val dst_port_val(ntohs(Conn()->RespPort()), TYPE_PORT);
@@ -87,6 +90,10 @@ void TCP_Reassembler::SizeBufferedData(uint64& waiting_on_hole,
 	waiting_on_hole = waiting_on_ack = 0;
 	for ( DataBlock* b = blocks; b; b = b->next )
 		{
+		if ( ! b->block )
+			// Delivered in place, nothing buffered.
+			continue;
+
 		if ( b->seq <= last_reassem_seq )
 			// We must have delivered this block, but
 			// haven't yet trimmed it.
@@ -301,8 +308,10 @@ void TCP_Reassembler::MatchUndelivered(uint64 up_to_seq, bool use_last_upper)
 	// block?
 	DataBlock* b;
 	for ( b = blocks; b && b->upper <= last_reassem_seq; b = b->next )
-	      tcp_analyzer->Conn()->Match(Rule::PAYLOAD, b->block, b->Size(),
-						false, false, IsOrig(), false);
+		if ( b->block )
+			tcp_analyzer->Conn()->Match(Rule::PAYLOAD, b->block,
+						b->Size(), false, false,
+						IsOrig(), false);
 
 	ASSERT(b);
 	}
@@ -336,6 +345,14 @@ void TCP_Reassembler::RecordToSeq(uint64 start_seq, uint64 stop_seq, BroFile* f)
 
 void TCP_Reassembler::RecordBlock(DataBlock* b, BroFile* f)
 	{
+	if ( ! b->block )
+		{
+		// The data was delivered in place, so we don't have it
+		// anymore.
+		RecordGap(b->seq, b->upper, f);
+		return;
+		}
+
 	if ( f->Write((const char*) b->block, b->Size()) )
 		return;
 
@@ -397,27 +414,67 @@ void TCP_Reassembler::BlockInserted(DataBlock* start_block)
 			}
 		}
 
-	TCP_Endpoint* e = endp;
+	if ( ! HoldDelivered() )
+		TrimToSeq(last_reassem_seq);
+
+	// Note: don't make an EOF check here, because then we'd miss it
+	// for FIN packets that don't carry any payload (and thus
+	// endpoint->DataSent is not called).  Instead, do the check in
+	// TCP_Connection::NextPacket.
+	}
+
+bool TCP_Reassembler::HoldDelivered() const
+	{
+	const TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
 		// Our endpoint's peer doesn't do reassembly and so
 		// (presumably) isn't processing acks.  So don't hold
 		// the now-delivered data.
-		TrimToSeq(last_reassem_seq);
+		return false;
 
-	else if ( e->NoDataAcked() && tcp_max_initial_window &&
-		  e->Size() > static_cast<uint64>(tcp_max_initial_window) )
+	if ( e->NoDataAcked() && tcp_max_initial_window &&
+	     e->Size() > static_cast<uint64>(tcp_max_initial_window) )
 		// We've sent quite a bit of data, yet none of it has
 		// been acked.  Presume that we're not seeing the peer's
 		// acks (perhaps due to filtering or split routing) and
 		// don't hang onto the data further, as we may wind up
 		// carrying it all the way until this connection ends.
-		TrimToSeq(last_reassem_seq);
+		return false;
 
-	// Note: don't make an EOF check here, because then we'd miss it
-	// for FIN packets that don't carry any payload (and thus
-	// endpoint->DataSent is not called).  Instead, do the check in
-	// TCP_Connection::NextPacket.
+	return true;
+	}
+
+bool TCP_Reassembler::CanDeliverInPlace(uint64 seq, int len) const
+	{
+	// The segment has to be the next one in sequence, with nothing
+	// buffered beyond it.
+	if ( len <= 0 || seq != last_reassem_seq ||
+	     (last_block && last_block->upper > seq) )
+		return false;
+
+	// We need a copy of the data if it's to be written to the
+	// contents file, or compared against retransmissions.
+	return ! record_contents_file && ! max_old_blocks &&
+		! rexmit_inconsistency;
+	}
+
+void TCP_Reassembler::DeliverInPlace(uint64 seq, int len, const u_char* data)
+	{
+	bool hold = HoldDelivered();
+	bytes_in_place += len;
+
+	if ( hold )
+		// Still keep track of the range until it's acked, so
+		// that we account for it the same way as for data we
+		// buffer.
+		AddDeliveredRange(seq, len);
+
+	last_reassem_seq += len;
+	DeliverBlock(seq, len, data);
+
+	if ( ! hold )
+		TrimToSeq(last_reassem_seq);
 	}
 
 void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
@@ -443,6 +500,12 @@ void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 		}
 	}
 
+void TCP_Reassembler::Evict()
+	{
+	tcp_analyzer->Weird("reassembly_buffer_evicted");
+	Reassembler::Evict();
+	}
+
 IMPLEMENT_SERIAL(TCP_Reassembler, SER_TCP_REASSEMBLER);
 
 bool TCP_Reassembler::DoSerialize(SerialInfo* info) const
@@ -498,9 +561,21 @@ int TCP_Reassembler::DataSent(double t, uint64 seq, int len,
 		}
 
 	flags = arg_flags;
-	NewBlock(t, seq, len, data);
+
+	if ( CanDeliverInPlace(seq, len) )
+		DeliverInPlace(seq, len, data);
+	else
+		NewBlock(t, seq, len, data);
+
 	flags = TCP_Flags();
 
+	if ( tcp_max_buffered_bytes &&
+	     TotalSize() > static_cast<uint64>(tcp_max_buffered_bytes) )
+		{
+		tcp_analyzer->Weird("excessive_buffered_data");
+		TrimToSize(tcp_max_buffered_bytes / 2);
+		}
+
 	if ( Endpoint()->NoDataAcked() && tcp_max_above_hole_without_any_acks &&
 	     NumUndeliveredBytes() > static_cast<uint64>(tcp_max_above_hole_without_any_acks) )
 		{
@@ -100,6 +100,16 @@ private:
 
 	void BlockInserted(DataBlock* b) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64 n) override;
+	void Evict() override;
+
+	// Returns true if data we've delivered is to be kept until the
+	// peer acks it.
+	bool HoldDelivered() const;
+
+	// In-sequence data that nothing else needs a copy of gets passed
+	// on straight from the packet rather than going through a block.
+	bool CanDeliverInPlace(uint64 seq, int len) const;
+	void DeliverInPlace(uint64 seq, int len, const u_char* data);
 
 	TCP_Endpoint* endp;
 
@@ -185,14 +185,14 @@ void UDP_Analyzer::UpdateEndpointVal(RecordVal* endp, int is_orig)
 	bro_int_t size = is_orig ? request_len : reply_len;
 	if ( size < 0 )
 		{
-		endp->Assign(0, new Val(0, TYPE_COUNT));
-		endp->Assign(1, new Val(int(UDP_INACTIVE), TYPE_COUNT));
+		endp->AssignUnsigned(0, 0);
+		endp->AssignUnsigned(1, int(UDP_INACTIVE));
 		}
 
 	else
 		{
-		endp->Assign(0, new Val(size, TYPE_COUNT));
-		endp->Assign(1, new Val(int(UDP_ACTIVE), TYPE_COUNT));
+		endp->AssignUnsigned(0, size);
+		endp->AssignUnsigned(1, int(UDP_ACTIVE));
 		}
 	}
 
@@ -127,6 +127,9 @@ bool bro_broker::Manager::Enable(Val* broker_endpoint_flags)
 	int flags = endpoint_flags_to_int(broker_endpoint_flags);
 	endpoint = unique_ptr<broker::endpoint>(new broker::endpoint(name, flags));
 	iosource_mgr->Register(this, true);
+	RegisterFd(endpoint->outgoing_connection_status().fd());
+	RegisterFd(endpoint->incoming_connection_status().fd());
+	RegisterFd(broker::report::default_queue->fd());
 	return true;
 	}
 
@@ -429,6 +432,7 @@ bool bro_broker::Manager::SubscribeToPrints(string topic_prefix)
 		return false;
 
 	q = broker::message_queue(move(topic_prefix), *endpoint);
+	RegisterFd(q.fd());
 	return true;
 	}
 
@@ -437,7 +441,14 @@ bool bro_broker::Manager::UnsubscribeToPrints(const string& topic_prefix)
 	if ( ! Enabled() )
 		return false;
 
-	return print_subscriptions.erase(topic_prefix);
+	auto it = print_subscriptions.find(topic_prefix);
+
+	if ( it == print_subscriptions.end() )
+		return false;
+
+	UnregisterFd(it->second.q.fd());
+	print_subscriptions.erase(it);
+	return true;
 	}
 
 bool bro_broker::Manager::SubscribeToEvents(string topic_prefix)
@@ -451,6 +462,7 @@ bool bro_broker::Manager::SubscribeToEvents(string topic_prefix)
 		return false;
 
 	q = broker::message_queue(move(topic_prefix), *endpoint);
+	RegisterFd(q.fd());
 	return true;
 	}
 
@@ -459,7 +471,14 @@ bool bro_broker::Manager::UnsubscribeToEvents(const string& topic_prefix)
 	if ( ! Enabled() )
 		return false;
 
-	return event_subscriptions.erase(topic_prefix);
+	auto it = event_subscriptions.find(topic_prefix);
+
+	if ( it == event_subscriptions.end() )
+		return false;
+
+	UnregisterFd(it->second.q.fd());
+	event_subscriptions.erase(it);
+	return true;
 	}
 
 bool bro_broker::Manager::SubscribeToLogs(string topic_prefix)
@@ -473,6 +492,7 @@ bool bro_broker::Manager::SubscribeToLogs(string topic_prefix)
 		return false;
 
 	q = broker::message_queue(move(topic_prefix), *endpoint);
+	RegisterFd(q.fd());
 	return true;
 	}
 
@@ -481,7 +501,14 @@ bool bro_broker::Manager::UnsubscribeToLogs(const string& topic_prefix)
 	if ( ! Enabled() )
 		return false;
 
-	return log_subscriptions.erase(topic_prefix);
+	auto it = log_subscriptions.find(topic_prefix);
+
+	if ( it == log_subscriptions.end() )
+		return false;
+
+	UnregisterFd(it->second.q.fd());
+	log_subscriptions.erase(it);
+	return true;
 	}
 
 bool bro_broker::Manager::PublishTopic(broker::topic t)
@@ -994,6 +1021,7 @@ bool bro_broker::Manager::AddStore(StoreHandleVal* handle)
 
 	data_stores[key] = handle;
 	Ref(handle);
+	RegisterFd(handle->store->responses().fd());
 	return true;
 	}
 
@@ -1039,6 +1067,7 @@ bool bro_broker::Manager::CloseStore(const broker::store::identifier& id,
 			++it;
 		}
 
+	UnregisterFd(it->second->store->responses().fd());
 	delete it->second->store;
 	it->second->store = nullptr;
 	Unref(it->second);
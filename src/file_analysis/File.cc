@@ -34,9 +34,9 @@ static RecordVal* get_conn_id_val(const Connection* conn)
 	{
 	RecordVal* v = new RecordVal(conn_id);
 	v->Assign(0, new AddrVal(conn->OrigAddr()));
-	v->Assign(1, new PortVal(ntohs(conn->OrigPort()), conn->ConnTransport()));
+	v->Assign(1, val_mgr->GetPort(ntohs(conn->OrigPort()), conn->ConnTransport()));
 	v->Assign(2, new AddrVal(conn->RespAddr()));
-	v->Assign(3, new PortVal(ntohs(conn->RespPort()), conn->ConnTransport()));
+	v->Assign(3, val_mgr->GetPort(ntohs(conn->RespPort()), conn->ConnTransport()));
 	return v;
 	}
 
@@ -157,6 +157,24 @@ void File::RaiseFileOverNewConnection(Connection* conn, bool is_orig)
 		}
 	}
 
+void File::Weird(const char* name)
+	{
+	Val* conns = val->Lookup(conns_idx);
+	const PDict(TableEntryVal)* tbl = conns ? conns->AsTable() : 0;
+
+	if ( ! tbl || ! tbl->Length() )
+		{
+		reporter->Weird(fmt("%s (fuid %s)", name, id.c_str()));
+		return;
+		}
+
+	IterCookie* c = tbl->InitForIteration();
+	TableEntryVal* conn_val = tbl->NextEntry(c);
+	tbl->StopIteration(c);
+
+	reporter->Weird(conn_val->Value()->Ref(), name, id.c_str());
+	}
+
 uint64 File::LookupFieldDefaultCount(int idx) const
 	{
 	Val* v = val->LookupWithDefault(idx);
@@ -409,6 +427,22 @@ void File::DeliverStream(const u_char* data, uint64 len)
 	IncrementByteCount(len, seen_bytes_idx);
 	}
 
+void File::FlushReassembler()
+	{
+	uint64 current_offset = stream_offset;
+	uint64 gap_bytes = file_reassembler->Flush();
+	IncrementByteCount(gap_bytes, overflow_bytes_idx);
+
+	if ( FileEventAvailable(file_reassembly_overflow) )
+		{
+		val_list* vl = new val_list();
+		vl->append(val->Ref());
+		vl->append(new Val(current_offset, TYPE_COUNT));
+		vl->append(new Val(gap_bytes, TYPE_COUNT));
+		FileEvent(file_reassembly_overflow, vl);
+		}
+	}
+
 void File::DeliverChunk(const u_char* data, uint64 len, uint64 offset)
 	{
 	// Potentially handle reassembly and deliver to the stream analyzers.
@@ -416,20 +450,7 @@ void File::DeliverChunk(const u_char* data, uint64 len, uint64 offset)
 		{
 		if ( reassembly_max_buffer > 0 &&
 		     reassembly_max_buffer < file_reassembler->TotalSize() )
-			{
-			uint64 current_offset = stream_offset;
-			uint64 gap_bytes = file_reassembler->Flush();
-			IncrementByteCount(gap_bytes, overflow_bytes_idx);
-
-			if ( FileEventAvailable(file_reassembly_overflow) )
-				{
-				val_list* vl = new val_list();
-				vl->append(val->Ref());
-				vl->append(new Val(current_offset, TYPE_COUNT));
-				vl->append(new Val(gap_bytes, TYPE_COUNT));
-				FileEvent(file_reassembly_overflow, vl);
-				}
-			}
+			FlushReassembler();
 
 		// Forward data to the reassembler.
 		file_reassembler->NewBlock(network_time, offset, len, data);
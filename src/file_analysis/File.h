@@ -253,6 +253,20 @@ protected:
 	 */
 	void SetReassemblyBuffer(uint64 max);
 
+	/**
+	 * Gives up on the gaps in the reassembly buffer, delivering what's
+	 * buffered, and raises file_reassembly_overflow.
+	 */
+	void FlushReassembler();
+
+	/**
+	 * Reports a weird for the file, as a conn_weird on one of the
+	 * connections it was seen on, with the file's ID as additional
+	 * info.  Files without a connection get a net_weird instead.
+	 * @param name the name of the weird.
+	 */
+	void Weird(const char* name);
+
 	/**
 	 * Perform stream-wise delivery for analyzers that need it.
 	 */
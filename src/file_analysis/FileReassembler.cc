@@ -10,6 +10,7 @@ class File;
 FileReassembler::FileReassembler(File *f, uint64 starting_offset)
 	: Reassembler(starting_offset), the_file(f), flushing(false)
 	{
+	SetCoalesceBlocks(true);
 	}
 
 FileReassembler::FileReassembler()
@@ -111,6 +112,12 @@ void FileReassembler::Overlap(const u_char* b1, const u_char* b2, uint64 n)
 	// Not doing anything here yet.
 	}
 
+void FileReassembler::Evict()
+	{
+	the_file->Weird("reassembly_buffer_evicted");
+	the_file->FlushReassembler();
+	}
+
 IMPLEMENT_SERIAL(FileReassembler, SER_FILE_REASSEMBLER);
 
 bool FileReassembler::DoSerialize(SerialInfo* info) const
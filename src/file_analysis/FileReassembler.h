@@ -55,6 +55,7 @@ protected:
 	void Undelivered(uint64 up_to_seq) override;
 	void BlockInserted(DataBlock* b) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64 n) override;
+	void Evict() override;
 
 	File* the_file;
 	bool flushing;
@@ -7,6 +7,7 @@
 
 #include "events.bif.h"
 #include "types.bif.h"
+#include "const.bif.h"
 
 #include "file_analysis/Manager.h"
 
@@ -14,11 +15,106 @@
 #include <openssl/x509v3.h>
 #include <openssl/asn1.h>
 #include <openssl/opensslconf.h>
+#include <openssl/sha.h>
 
 using namespace file_analysis;
 
 IMPLEMENT_SERIAL(X509Val, SER_X509_VAL);
 
+static X509Cache* cert_cache = 0;
+
+int file_analysis::X509::parse_weirds = 0;
+
+// Returns a copy of a record built by the analyzer, for handing to an
+// event.  The fields' values are immutable except for vectors, which get
+// copied as well.
+static RecordVal* copy_record(RecordVal* r)
+	{
+	RecordType* t = r->Type()->AsRecordType();
+	RecordVal* copy = new RecordVal(t);
+
+	for ( int i = 0; i < t->NumFields(); ++i )
+		{
+		Val* v = r->Lookup(i);
+
+		if ( ! v )
+			continue;
+
+		if ( v->Type()->Tag() == TYPE_VECTOR )
+			{
+			VectorVal* vec = v->AsVectorVal();
+			VectorVal* vec_copy = new VectorVal(vec->Type()->AsVectorType());
+
+			for ( unsigned int j = 0; j < vec->Size(); ++j )
+				{
+				Val* e = vec->Lookup(j);
+				vec_copy->Assign(j, e ? e->Ref() : 0);
+				}
+
+			copy->Assign(i, vec_copy);
+			}
+		else
+			copy->Assign(i, v->Ref());
+		}
+
+	return copy;
+	}
+
+X509Cache::Entry::~Entry()
+	{
+	Unref(cert_val);
+	Unref(cert_record);
+
+	for ( auto& ext : extensions )
+		{
+		Unref(ext.ext);
+		Unref(ext.val);
+		}
+	}
+
+X509Cache::~X509Cache()
+	{
+	for ( auto& e : entries )
+		delete e.second;
+	}
+
+const X509Cache::Entry* X509Cache::Lookup(const std::string& hash)
+	{
+	auto i = index.find(hash);
+
+	if ( i == index.end() )
+		{
+		++misses;
+		return 0;
+		}
+
+	++hits;
+	entries.splice(entries.begin(), entries, i->second);
+
+	return i->second->second;
+	}
+
+void X509Cache::Insert(const std::string& hash, Entry* e,
+			unsigned int max_size)
+	{
+	if ( index.find(hash) != index.end() )
+		{
+		delete e;
+		return;
+		}
+
+	while ( entries.size() >= max_size && ! entries.empty() )
+		{
+		index.erase(entries.back().first);
+		delete entries.back().second;
+		entries.pop_back();
+		++evictions;
+		}
+
+	entries.push_front(std::make_pair(hash, e));
+	index[hash] = entries.begin();
+	}
+
 file_analysis::X509::X509(RecordVal* args, file_analysis::File* file)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag("X509"), args, file)
 	{
@@ -38,6 +134,46 @@ bool file_analysis::X509::Undelivered(uint64 offset, uint64 len)
 	}
 
 bool file_analysis::X509::EndOfFile()
+	{
+	unsigned int cache_size = BifConst::X509::certificate_cache_size;
+	std::string hash;
+
+	if ( cache_size > 0 )
+		{
+		u_char digest[SHA256_DIGEST_LENGTH];
+		SHA256(reinterpret_cast<const u_char*>(cert_data.data()),
+		       cert_data.size(), digest);
+		hash.assign(reinterpret_cast<const char*>(digest), sizeof(digest));
+
+		if ( ! cert_cache )
+			cert_cache = new X509Cache();
+
+		const X509Cache::Entry* e = cert_cache->Lookup(hash);
+
+		if ( e )
+			{
+			RaiseEvents(e);
+			return false;
+			}
+		}
+
+	int weirds = parse_weirds;
+	X509Cache::Entry* e = Parse();
+
+	if ( ! e )
+		return false;
+
+	RaiseEvents(e);
+
+	if ( cache_size > 0 && parse_weirds == weirds )
+		cert_cache->Insert(hash, e, cache_size);
+	else
+		delete e;
+
+	return false;
+	}
+
+X509Cache::Entry* file_analysis::X509::Parse()
 	{
 	// ok, now we can try to parse the certificate with openssl. Should
 	// be rather straightforward...
@@ -47,20 +183,19 @@ bool file_analysis::X509::EndOfFile()
 	if ( ! ssl_cert )
 		{
 		reporter->Weird(fmt("Could not parse X509 certificate (fuid %s)", GetFile()->GetID().c_str()));
-		return false;
+		return 0;
 		}
 
-	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
+	X509Cache::Entry* e = new X509Cache::Entry();
 
-	// parse basic information into record.
-	RecordVal* cert_record = ParseCertificate(cert_val, GetFile()->GetID().c_str());
+	// X509_free(ssl_cert); We do _not_ free the certificate here. It is refcounted
+	// inside the X509Val that is sent on in the cert record to scriptland.
+	//
+	// The certificate will be freed when the last X509Val is Unref'd.
+	e->cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
 
-	// and send the record on to scriptland
-	val_list* vl = new val_list();
-	vl->append(GetFile()->GetVal()->Ref());
-	vl->append(cert_val->Ref());
-	vl->append(cert_record->Ref()); // we Ref it here, because we want to keep a copy around for now...
-	mgr.QueueEvent(x509_certificate, vl);
+	// parse basic information into record.
+	e->cert_record = ParseCertificate(e->cert_val, GetFile()->GetID().c_str());
 
 	// after parsing the certificate - parse the extensions...
 
@@ -71,18 +206,64 @@ bool file_analysis::X509::EndOfFile()
 		if ( ! ex )
 			continue;
 
-		ParseExtension(ex);
+		ParseExtension(ex, e);
 		}
 
-	// X509_free(ssl_cert); We do _not_ free the certificate here. It is refcounted
-	// inside the X509Val that is sent on in the cert record to scriptland.
+	return e;
+	}
+
+void file_analysis::X509::RaiseEvents(const X509Cache::Entry* e)
+	{
+	// send the record on to scriptland
+	val_list* vl = new val_list();
+	vl->append(GetFile()->GetVal()->Ref());
+	vl->append(e->cert_val->Ref());
+	vl->append(copy_record(e->cert_record));
+	mgr.QueueEvent(x509_certificate, vl);
+
+	// send off generic extension event
 	//
-	// The certificate will be freed when the last X509Val is Unref'd.
+	// and then look if we have a specialized event for the extension we just
+	// parsed. And if we have it, we send the specialized event on top of the
+	// generic event that we just had. I know, that is... kind of not nice,
+	// but I am not sure if there is a better way to do it...
+	for ( const auto& ext : e->extensions )
+		{
+		vl = new val_list();
+		vl->append(GetFile()->GetVal()->Ref());
+		vl->append(copy_record(ext.ext));
+		mgr.QueueEvent(x509_extension, vl);
 
-	Unref(cert_record); // Unref the RecordVal that we kept around from ParseCertificate
-	Unref(cert_val); // Same for cert_val
+		if ( ext.val )
+			{
+			vl = new val_list();
+			vl->append(GetFile()->GetVal()->Ref());
+			vl->append(copy_record(ext.val));
+			mgr.QueueEvent(ext.event, vl);
+			}
+		}
+	}
 
-	return false;
+RecordVal* file_analysis::X509::GetCacheStats()
+	{
+	RecordVal* r = new RecordVal(BifType::Record::X509::CacheStats);
+	r->Assign(0, new Val(cert_cache ? cert_cache->Size() : 0, TYPE_COUNT));
+	r->Assign(1, new Val(cert_cache ? cert_cache->Hits() : 0, TYPE_COUNT));
+	r->Assign(2, new Val(cert_cache ? cert_cache->Misses() : 0, TYPE_COUNT));
+	r->Assign(3, new Val(cert_cache ? cert_cache->Evictions() : 0, TYPE_COUNT));
+	return r;
+	}
+
+void file_analysis::X509::ClearCache()
+	{
+	delete cert_cache;
+	cert_cache = 0;
+	}
+
+void file_analysis::X509::ParseWeird(const char* msg)
+	{
+	++parse_weirds;
+	reporter->Weird(msg);
 	}
 
 RecordVal* file_analysis::X509::ParseCertificate(X509Val* cert_val, const char* fid)
@@ -214,7 +395,7 @@ StringVal* file_analysis::X509::GetExtensionFromBIO(BIO* bio)
 		{
 		char tmp[120];
 		ERR_error_string_n(ERR_get_error(), tmp, sizeof(tmp));
-		reporter->Weird(fmt("X509::GetExtensionFromBIO: %s", tmp));
+		ParseWeird(fmt("X509::GetExtensionFromBIO: %s", tmp));
 		BIO_free_all(bio);
 		return 0;
 		}
@@ -245,7 +426,7 @@ StringVal* file_analysis::X509::GetExtensionFromBIO(BIO* bio)
 	return ext_val;
 	}
 
-void file_analysis::X509::ParseExtension(X509_EXTENSION* ex)
+void file_analysis::X509::ParseExtension(X509_EXTENSION* ex, X509Cache::Entry* e)
 	{
 	char name[256];
 	char oid[256];
@@ -279,27 +460,27 @@ void file_analysis::X509::ParseExtension(X509_EXTENSION* ex)
 	pX509Ext->Assign(3, new Val(critical, TYPE_BOOL));
 	pX509Ext->Assign(4, ext_val);
 
-	// send off generic extension event
-	//
-	// and then look if we have a specialized event for the extension we just
-	// parsed. And if we have it, we send the specialized event on top of the
-	// generic event that we just had. I know, that is... kind of not nice,
-	// but I am not sure if there is a better way to do it...
-	val_list* vl = new val_list();
-	vl->append(GetFile()->GetVal()->Ref());
-	vl->append(pX509Ext);
-
-	mgr.QueueEvent(x509_extension, vl);
+	X509Cache::Entry::Extension ext;
+	ext.ext = pX509Ext;
+	ext.val = 0;
 
 	// look if we have a specialized handler for this event...
 	if ( OBJ_obj2nid(ext_asn) == NID_basic_constraints )
-		ParseBasicConstraints(ex);
+		{
+		ext.event = x509_ext_basic_constraints;
+		ext.val = ParseBasicConstraints(ex);
+		}
 
 	else if ( OBJ_obj2nid(ext_asn) == NID_subject_alt_name )
-		ParseSAN(ex);
+		{
+		ext.event = x509_ext_subject_alternative_name;
+		ext.val = ParseSAN(ex);
+		}
+
+	e->extensions.push_back(ext);
 	}
 
-void file_analysis::X509::ParseBasicConstraints(X509_EXTENSION* ex)
+RecordVal* file_analysis::X509::ParseBasicConstraints(X509_EXTENSION* ex)
 	{
 	assert(OBJ_obj2nid(X509_EXTENSION_get_object(ex)) == NID_basic_constraints);
 
@@ -313,27 +494,23 @@ void file_analysis::X509::ParseBasicConstraints(X509_EXTENSION* ex)
 		if ( constr->pathlen )
 			pBasicConstraint->Assign(1, new Val((int32_t) ASN1_INTEGER_get(constr->pathlen), TYPE_COUNT));
 
-		val_list* vl = new val_list();
-		vl->append(GetFile()->GetVal()->Ref());
-		vl->append(pBasicConstraint);
-
-		mgr.QueueEvent(x509_ext_basic_constraints, vl);
 		BASIC_CONSTRAINTS_free(constr);
+		return pBasicConstraint;
 		}
 
-	else
-		reporter->Weird(fmt("Certificate with invalid BasicConstraint. fuid %s", GetFile()->GetID().c_str()));
+	ParseWeird(fmt("Certificate with invalid BasicConstraint. fuid %s", GetFile()->GetID().c_str()));
+	return 0;
 	}
 
-void file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
+RecordVal* file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
 	{
 	assert(OBJ_obj2nid(X509_EXTENSION_get_object(ext)) == NID_subject_alt_name);
 
 	GENERAL_NAMES *altname = (GENERAL_NAMES*)X509V3_EXT_d2i(ext);
 	if ( ! altname )
 		{
-		reporter->Weird(fmt("Could not parse subject alternative names. fuid %s", GetFile()->GetID().c_str()));
-		return;
+		ParseWeird(fmt("Could not parse subject alternative names. fuid %s", GetFile()->GetID().c_str()));
+		return 0;
 		}
 
 	VectorVal* names = 0;
@@ -352,7 +529,7 @@ void file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
 			{
 			if ( ASN1_STRING_type(gen->d.ia5) != V_ASN1_IA5STRING )
 				{
-				reporter->Weird(fmt("DNS-field does not contain an IA5String. fuid %s", GetFile()->GetID().c_str()));
+				ParseWeird(fmt("DNS-field does not contain an IA5String. fuid %s", GetFile()->GetID().c_str()));
 				continue;
 				}
 
@@ -399,7 +576,7 @@ void file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
 
 				else
 					{
-					reporter->Weird(fmt("Weird IP address length %d in subject alternative name. fuid %s", gen->d.ip->length, GetFile()->GetID().c_str()));
+					ParseWeird(fmt("Weird IP address length %d in subject alternative name. fuid %s", gen->d.ip->length, GetFile()->GetID().c_str()));
 					continue;
 					}
 			}
@@ -429,11 +606,8 @@ void file_analysis::X509::ParseSAN(X509_EXTENSION* ext)
 
 		sanExt->Assign(4, new Val(otherfields, TYPE_BOOL));
 
-		val_list* vl = new val_list();
-		vl->append(GetFile()->GetVal()->Ref());
-		vl->append(sanExt);
-		mgr.QueueEvent(x509_ext_subject_alternative_name, vl);
 	GENERAL_NAMES_free(altname);
+	return sanExt;
 	}
 
 StringVal* file_analysis::X509::KeyCurve(EVP_PKEY *key)
@@ -531,14 +705,14 @@ double file_analysis::X509::GetTimeFromAsn1(const ASN1_TIME* atime, const char*
 		{
 		if ( remaining < 11 || remaining > 17 )
 			{
-			reporter->Weird(fmt("Could not parse time in X509 certificate (fuid %s) -- UTCTime has wrong length", fid));
+			ParseWeird(fmt("Could not parse time in X509 certificate (fuid %s) -- UTCTime has wrong length", fid));
 			return 0;
 			}
 
 		if ( pString[remaining-1] != 'Z' )
 			{
 			// not valid according to RFC 2459 4.1.2.5.1
-			reporter->Weird(fmt("Could not parse UTC time in non-YY-format in X509 certificate (x509 %s)", fid));
+			ParseWeird(fmt("Could not parse UTC time in non-YY-format in X509 certificate (x509 %s)", fid));
 			return 0;
 			}
 
@@ -567,7 +741,7 @@ double file_analysis::X509::GetTimeFromAsn1(const ASN1_TIME* atime, const char*
 
 		if ( remaining < 12 || remaining > 23 )
 			{
-			reporter->Weird(fmt("Could not parse time in X509 certificate (fuid %s) -- Generalized time has wrong length", fid));
+			ParseWeird(fmt("Could not parse time in X509 certificate (fuid %s) -- Generalized time has wrong length", fid));
 			return 0;
 			}
 
@@ -578,7 +752,7 @@ double file_analysis::X509::GetTimeFromAsn1(const ASN1_TIME* atime, const char*
 		}
 	else
 		{
-		reporter->Weird(fmt("Invalid time type in X509 certificate (fuid %s)", fid));
+		ParseWeird(fmt("Invalid time type in X509 certificate (fuid %s)", fid));
 		return 0;
 		}
 
@@ -611,7 +785,7 @@ double file_analysis::X509::GetTimeFromAsn1(const ASN1_TIME* atime, const char*
 
 	else
 		{
-		reporter->Weird(fmt("Could not parse time in X509 certificate (fuid %s) -- additional char after time", fid));
+		ParseWeird(fmt("Could not parse time in X509 certificate (fuid %s) -- additional char after time", fid));
 		return 0;
 		}
 
@@ -626,13 +800,13 @@ double file_analysis::X509::GetTimeFromAsn1(const ASN1_TIME* atime, const char*
 		{
 		if ( remaining < 5 )
 			{
-			reporter->Weird(fmt("Could not parse time in X509 certificate (fuid %s) -- not enough bytes remaining for offset", fid));
+			ParseWeird(fmt("Could not parse time in X509 certificate (fuid %s) -- not enough bytes remaining for offset", fid));
 			return 0;
 			}
 
 		if ((*pString != '+') && (*pString != '-'))
 			{
-			reporter->Weird(fmt("Could not parse time in X509 certificate (fuid %s) -- unknown offset type", fid));
+			ParseWeird(fmt("Could not parse time in X509 certificate (fuid %s) -- unknown offset type", fid));
 			return 0;
 			}
 
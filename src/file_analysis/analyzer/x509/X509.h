@@ -3,9 +3,13 @@
 #ifndef FILE_ANALYSIS_X509_H
 #define FILE_ANALYSIS_X509_H
 
+#include <list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "Val.h"
+#include "EventHandler.h"
 #include "../File.h"
 #include "Analyzer.h"
 
@@ -16,6 +20,75 @@ namespace file_analysis {
 
 class X509Val;
 
+/**
+ * A cache of parsed certificates, keyed by the SHA-256 hash of their DER
+ * encoding. When a certificate shows up again, the analyzer reuses the
+ * X509Val and the record values that it built the first time instead of
+ * parsing the certificate again. The cache holds a bounded number of
+ * entries and evicts the least recently used one when full.
+ */
+class X509Cache {
+public:
+	/**
+	 * The values built for one certificate. They are owned by the entry;
+	 * events get copies of the records, as scripts may modify them.
+	 */
+	struct Entry {
+		Entry()	{ cert_val = 0; cert_record = 0; }
+		~Entry();
+
+		struct Extension {
+			RecordVal* ext;	// the X509::Extension record
+			EventHandlerPtr event;	// specialized event, if any
+			RecordVal* val;	// argument of the specialized event
+		};
+
+		X509Val* cert_val;
+		RecordVal* cert_record;
+		std::vector<Extension> extensions;
+	};
+
+	X509Cache()	{ hits = misses = evictions = 0; }
+	~X509Cache();
+
+	/**
+	 * Looks up the entry of a certificate and marks it as the most
+	 * recently used one.
+	 *
+	 * @param hash The SHA-256 hash of the certificate, in binary form.
+	 *
+	 * @return The entry, or null if the certificate isn't cached.
+	 */
+	const Entry* Lookup(const std::string& hash);
+
+	/**
+	 * Adds the entry of a certificate, evicting the least recently used
+	 * ones if the cache would exceed the given size otherwise.
+	 *
+	 * @param hash The SHA-256 hash of the certificate, in binary form.
+	 *
+	 * @param e The entry, which the cache takes ownership of.
+	 *
+	 * @param max_size The maximum number of entries.
+	 */
+	void Insert(const std::string& hash, Entry* e, unsigned int max_size);
+
+	unsigned int Size() const	{ return entries.size(); }
+	uint64 Hits() const	{ return hits; }
+	uint64 Misses() const	{ return misses; }
+	uint64 Evictions() const	{ return evictions; }
+
+private:
+	typedef std::list<std::pair<std::string, Entry*> > entry_list;
+
+	entry_list entries;	// most recently used first
+	std::unordered_map<std::string, entry_list::iterator> index;
+
+	uint64 hits;
+	uint64 misses;
+	uint64 evictions;
+};
+
 class X509 : public file_analysis::Analyzer {
 public:
 	virtual bool DeliverStream(const u_char* data, uint64 len);
@@ -51,16 +124,39 @@ public:
 	 */
 	static StringVal* GetExtensionFromBIO(BIO* bio);
 
+	/**
+	 * Returns statistics about the cache of parsed certificates.
+	 *
+	 * @return A new \c X509::CacheStats record value.
+	 */
+	static RecordVal* GetCacheStats();
+
+	/**
+	 * Empties the cache of parsed certificates.
+	 */
+	static void ClearCache();
+
 protected:
 	X509(RecordVal* args, File* file);
 
 private:
-	void ParseExtension(X509_EXTENSION* ex);
-	void ParseBasicConstraints(X509_EXTENSION* ex);
-	void ParseSAN(X509_EXTENSION* ex);
+	// Parses the certificate into a new cache entry, or returns null
+	// if it can't be parsed.
+	X509Cache::Entry* Parse();
+	void RaiseEvents(const X509Cache::Entry* e);
+
+	void ParseExtension(X509_EXTENSION* ex, X509Cache::Entry* e);
+	RecordVal* ParseBasicConstraints(X509_EXTENSION* ex);
+	RecordVal* ParseSAN(X509_EXTENSION* ex);
 
 	std::string cert_data;
 
+	// Reports a problem with the certificate being parsed. Certificates
+	// that cause these don't get cached, so that the weirds get reported
+	// each time the certificate is seen.
+	static void ParseWeird(const char* msg);
+	static int parse_weirds;
+
 	// Helpers for ParseCertificate.
 	static double GetTimeFromAsn1(const ASN1_TIME * atime, const char* fid);
 	static StringVal* KeyCurve(EVP_PKEY *key);
@@ -0,0 +1,325 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "Columnar.h"
+
+#include "threading/SerialTypes.h"
+
+using namespace input::reader;
+using namespace threading;
+using threading::Value;
+using threading::Field;
+
+// Counters and counts share their encoding.
+static bool same_type(TypeTag a, TypeTag b)
+	{
+	if ( a == TYPE_COUNTER )
+		a = TYPE_COUNT;
+
+	if ( b == TYPE_COUNTER )
+		b = TYPE_COUNT;
+
+	return a == b;
+	}
+
+Columnar::Columnar(ReaderFrontend *frontend) : ReaderBackend(frontend)
+	{
+	fd = -1;
+	mtime = 0;
+	codec = 0;
+	}
+
+Columnar::~Columnar()
+	{
+	DoClose();
+	}
+
+void Columnar::DoClose()
+	{
+	CloseInput();
+	}
+
+bool Columnar::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! info.source || strlen(info.source) == 0 )
+		{
+		Error("No source path provided");
+		return false;
+		}
+
+	if ( ! OpenInput() )
+		return false;
+
+	DoUpdate();
+
+	return true;
+	}
+
+bool Columnar::OpenInput()
+	{
+	fd = open(Info().source, O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s: %s", Info().source, Strerror(errno)));
+		return false;
+		}
+
+	struct stat sb;
+
+	if ( fstat(fd, &sb) == 0 )
+		mtime = sb.st_mtime;
+
+	return true;
+	}
+
+void Columnar::CloseInput()
+	{
+	if ( fd >= 0 )
+		{
+		safe_close(fd);
+		fd = -1;
+		}
+
+	buffer.clear();
+	columns.clear();
+
+	delete codec;
+	codec = 0;
+
+	for ( size_t i = 0; i < file_fields.size(); ++i )
+		delete file_fields[i];
+
+	file_fields.clear();
+	}
+
+bool Columnar::ReadInput()
+	{
+	char buf[65536];
+
+	for ( ;; )
+		{
+		ssize_t n = read(fd, buf, sizeof(buf));
+
+		if ( n == 0 )
+			return true;
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			Error(Fmt("error reading %s: %s", Info().source, Strerror(errno)));
+			return false;
+			}
+
+		buffer.append(buf, n);
+		}
+	}
+
+bool Columnar::ParseHeader()
+	{
+	int n = formatter::Columnar::DecodeHeader(buffer.data(), buffer.size(),
+						  &file_fields);
+
+	if ( n == 0 )
+		// Wait for the rest.
+		return true;
+
+	if ( n < 0 )
+		{
+		Error(Fmt("%s is not a columnar log file or its header is corrupt",
+			  Info().source));
+		return false;
+		}
+
+	buffer.erase(0, n);
+
+	for ( int i = 0; i < NumFields(); i++ )
+		{
+		const Field* field = Fields()[i];
+		int column = -1;
+
+		for ( size_t j = 0; j < file_fields.size(); ++j )
+			{
+			if ( strcmp(file_fields[j]->name, field->name) == 0 )
+				{
+				column = j;
+				break;
+				}
+			}
+
+		if ( column < 0 )
+			{
+			if ( field->optional )
+				{
+				// Always send an unset value back.
+				columns.push_back(-1);
+				continue;
+				}
+
+			Error(Fmt("Did not find requested field %s in input data file %s.",
+				  field->name, Info().source));
+			return false;
+			}
+
+		const Field* ffield = file_fields[column];
+
+		if ( ! same_type(ffield->type, field->type) ||
+		     ((field->type == TYPE_TABLE || field->type == TYPE_VECTOR) &&
+		      ! same_type(ffield->subtype, field->subtype)) )
+			{
+			Error(Fmt("Field %s in input data file %s has type %s, expected %s.",
+				  field->name, Info().source,
+				  ffield->TypeName().c_str(), field->TypeName().c_str()));
+			return false;
+			}
+
+		// A port's protocol travels with its number, so there's
+		// no need to look at a secondary field.
+		columns.push_back(column);
+		}
+
+	codec = new formatter::Columnar(this, file_fields.size(),
+					file_fields.empty() ? 0 : &file_fields[0]);
+	return true;
+	}
+
+bool Columnar::SendRowGroups()
+	{
+	size_t consumed = 0;
+	bool ok = true;
+
+	for ( ;; )
+		{
+		const char* data = buffer.data() + consumed;
+		int len = buffer.size() - consumed;
+		int size = formatter::Columnar::RowGroupSize(data, len);
+
+		// Wait for an incomplete row group to be finished.
+		if ( size == 0 || size > len )
+			break;
+
+		vector<Value**> records;
+
+		if ( ! codec->DecodeRowGroup(data, size, columns, &records) )
+			{
+			Error(Fmt("corrupt row group in %s", Info().source));
+			ok = false;
+			break;
+			}
+
+		consumed += size;
+
+		for ( size_t i = 0; i < records.size(); ++i )
+			{
+			Value** vals = records[i];
+
+			for ( int j = 0; j < NumFields(); ++j )
+				{
+				if ( ! vals[j] )
+					vals[j] = new Value(Fields()[j]->type, false);
+				}
+
+			if ( Info().mode == MODE_STREAM )
+				Put(vals);
+			else
+				SendEntry(vals);
+			}
+		}
+
+	buffer.erase(0, consumed);
+	return ok;
+	}
+
+// read the entire file and send appropriate thingies back to InputMgr
+bool Columnar::DoUpdate()
+	{
+	switch ( Info().mode ) {
+		case MODE_REREAD:
+			{
+			// check if the file has changed
+			struct stat sb;
+			if ( stat(Info().source, &sb) == -1 )
+				{
+				Error(Fmt("Could not get stat for %s", Info().source));
+				return false;
+				}
+
+			if ( sb.st_mtime <= mtime ) // no change
+				return true;
+
+			// file changed. reread.
+
+			// fallthrough
+			}
+
+		case MODE_MANUAL:
+		case MODE_STREAM:
+			{
+			// Streaming picks up where the previous update
+			// stopped; otherwise, start over.
+			if ( Info().mode == MODE_STREAM && fd >= 0 )
+				break;
+
+			CloseInput();
+
+			if ( ! OpenInput() )
+				return false;
+
+			break;
+			}
+
+		default:
+			assert(false);
+
+		}
+
+	if ( ! ReadInput() )
+		return false;
+
+	if ( ! codec && ! ParseHeader() )
+		return false;
+
+	if ( codec && ! SendRowGroups() )
+		return false;
+
+	if ( Info().mode != MODE_STREAM )
+		{
+		if ( ! codec )
+			{
+			Error(Fmt("%s is truncated", Info().source));
+			return false;
+			}
+
+		EndCurrentSend();
+		}
+
+	return true;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode )
+		{
+		case MODE_MANUAL:
+			// yay, we do nothing :)
+			break;
+
+		case MODE_REREAD:
+		case MODE_STREAM:
+			Update(); // call update and not DoUpdate, because update
+				  // checks disabled.
+			break;
+
+		default:
+			assert(false);
+		}
+
+	return true;
+	}
@@ -0,0 +1,58 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef INPUT_READERS_COLUMNAR_H
+#define INPUT_READERS_COLUMNAR_H
+
+#include <string>
+#include <vector>
+
+#include "input/ReaderBackend.h"
+#include "threading/formatters/Columnar.h"
+
+namespace input { namespace reader {
+
+/**
+ * Reader for the files the columnar log writer produces.
+ */
+class Columnar : public ReaderBackend {
+public:
+	Columnar(ReaderFrontend* frontend);
+	~Columnar();
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	virtual bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	                    const threading::Field* const* fields);
+	virtual void DoClose();
+	virtual bool DoUpdate();
+	virtual bool DoHeartbeat(double network_time, double current_time);
+
+private:
+	bool OpenInput();
+	void CloseInput();
+	bool ReadInput();
+	bool ParseHeader();
+	bool SendRowGroups();
+
+	int fd;
+	time_t mtime;
+
+	// Data read but not yet processed.
+	string buffer;
+
+	// The fields the file's header lists, and the codec set up for them
+	// once the header has been read.
+	vector<threading::Field*> file_fields;
+	threading::formatter::Columnar* codec;
+
+	// For each field we deliver, the column of the file holding it, or
+	// -1 for an optional field the file doesn't have.
+	vector<int> columns;
+};
+
+}
+}
+
+#endif /* INPUT_READERS_COLUMNAR_H */
@@ -0,0 +1,17 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "IOSource.h"
+#include "Manager.h"
+
+using namespace iosource;
+
+void IOSource::RegisterFd(int fd)
+	{
+	registered_fds = true;
+	iosource_mgr->RegisterFd(fd, this);
+	}
+
+void IOSource::UnregisterFd(int fd)
+	{
+	iosource_mgr->UnregisterFd(fd);
+	}
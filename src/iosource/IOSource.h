@@ -22,7 +22,7 @@ public:
 	/**
 	 * Constructor.
 	 */
-	IOSource()	{ idle = false; closed = false; }
+	IOSource()	{ idle = false; closed = false; registered_fds = false; }
 
 	/**
 	 * Destructor.
@@ -51,10 +51,21 @@ public:
 	 */
 	virtual void Done()	{ }
 
+	/**
+	 * Returns true if the source has announced its file descriptors
+	 * through RegisterFd(). The manager then watches these itself and
+	 * no longer calls GetFds().
+	 */
+	bool HasRegisteredFds() const	{ return registered_fds; }
+
 	/**
 	 * Returns select'able file descriptors for this source. Leaves the
 	 * passed values untouched if not available.
 	 *
+	 * This is called only for sources that don't use RegisterFd(), and
+	 * on platforms where the manager can't watch registered descriptors
+	 * on its own.
+	 *
 	 * @param read Pointer to container where to insert a read descriptor.
 	 *
 	 * @param write Pointer to container where to insert a write descriptor.
@@ -130,9 +141,30 @@ protected:
 	 */
 	void SetClosed(bool is_closed)	{ closed = is_closed; }
 
+	/**
+	 * Registers a file descriptor with the IOSource manager, which
+	 * from then on considers the source for processing whenever the
+	 * descriptor becomes readable. This is preferable to GetFds(), as
+	 * the manager doesn't need to ask for the descriptors over and over
+	 * again. Once a source has registered a descriptor, it must use
+	 * this method for all of them.
+	 *
+	 * @param fd The file descriptor to watch.
+	 */
+	void RegisterFd(int fd);
+
+	/**
+	 * Stops watching a file descriptor previously passed to
+	 * RegisterFd().
+	 *
+	 * @param fd The file descriptor to stop watching.
+	 */
+	void UnregisterFd(int fd);
+
 private:
 	bool idle;
 	bool closed;
+	bool registered_fds;
 };
 
 }
@@ -4,9 +4,17 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
 
 #include <algorithm>
 
+#include "bro-config.h"
+
+#ifdef HAVE_LINUX
+#include <sys/epoll.h>
+#endif
+
 #include "Manager.h"
 #include "IOSource.h"
 #include "PktSrc.h"
@@ -19,6 +27,24 @@
 
 using namespace iosource;
 
+Manager::Manager()
+	{
+	call_count = 0;
+	dont_counts = 0;
+	soonest_src = 0;
+	soonest_ts = soonest_local_network_time = 0;
+
+#ifdef HAVE_LINUX
+	poll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if ( poll_fd < 0 )
+		reporter->Warning("epoll_create1 failed, falling back to select(): %s",
+				  strerror(errno));
+#else
+	poll_fd = -1;
+#endif
+	}
+
 Manager::~Manager()
 	{
 	for ( SourceList::iterator i = sources.begin(); i != sources.end(); ++i )
@@ -37,6 +63,9 @@ Manager::~Manager()
 		}
 
 	pkt_dumpers.clear();
+
+	if ( poll_fd >= 0 )
+		close(poll_fd);
 	}
 
 void Manager::RemoveAll()
@@ -54,6 +83,7 @@ IOSource* Manager::FindSoonest(double* ts)
 		if ( ! (*i)->src->IsOpen() )
 			{
 			(*i)->src->Done();
+			UnregisterFds((*i)->src);
 			delete *i;
 			sources.erase(i);
 			break;
@@ -63,13 +93,17 @@ IOSource* Manager::FindSoonest(double* ts)
 	// are ready, and return the soonest. Unfortunately, that'd mean
 	// one select-call per packet, which we can't afford in high-volume
 	// environments.  Thus, we call select only every SELECT_FREQUENCY
-	// call (or if all sources report that they are dry).
+	// call (or if all sources report that they are dry). Sources that
+	// register their fds don't have that problem: the kernel keeps
+	// track of them for us, and we can check them every time at the
+	// cost of a single system call.
 
 	++call_count;
 
-	IOSource* soonest_src = 0;
-	double soonest_ts = 1e20;
-	double soonest_local_network_time = 1e20;
+	soonest_src = 0;
+	soonest_ts = 1e20;
+	soonest_local_network_time = 1e20;
+	considered.clear();
 	bool all_idle = true;
 
 	// Find soonest source of those which tell us they have something to
@@ -79,19 +113,24 @@ IOSource* Manager::FindSoonest(double* ts)
 		if ( ! (*i)->src->IsIdle() )
 			{
 			all_idle = false;
-			double local_network_time = 0;
-			double ts = (*i)->src->NextTimestamp(&local_network_time);
-			if ( ts > 0 && ts < soonest_ts )
-				{
-				soonest_ts = ts;
-				soonest_src = (*i)->src;
-				soonest_local_network_time =
-					local_network_time ?
-						local_network_time : ts;
-				}
+			ConsiderSource((*i)->src);
 			}
 		}
 
+	if ( all_idle )
+		{
+		// Interesting: when all sources are dry, simply sleeping a
+		// bit *without* watching for any fd becoming ready may
+		// decrease CPU load. I guess that's because it allows
+		// the kernel's packet buffers to fill. - Robin
+		struct timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 20; // SELECT_TIMEOUT;
+		select(0, 0, 0, 0, &timeout);
+		}
+
+	PollRegisteredFds();
+
 	// If we found one and aren't going to select this time,
 	// return it.
 	int maxx = 0;
@@ -116,8 +155,22 @@ IOSource* Manager::FindSoonest(double* ts)
 			// be ready.
 			continue;
 
+		if ( src->src->HasRegisteredFds() && poll_fd >= 0 )
+			// Already checked.
+			continue;
+
 		src->Clear();
-		src->src->GetFds(&src->fd_read, &src->fd_write, &src->fd_except);
+
+		if ( src->src->HasRegisteredFds() )
+			{
+			for ( FdMap::const_iterator j = registered_fds.begin();
+			      j != registered_fds.end(); ++j )
+				if ( j->second.src == src->src )
+					src->fd_read.Insert(j->first);
+			}
+		else
+			src->src->GetFds(&src->fd_read, &src->fd_write, &src->fd_except);
+
 		src->SetFds(&fd_read, &fd_write, &fd_except, &maxx);
 		}
 
@@ -128,23 +181,11 @@ IOSource* Manager::FindSoonest(double* ts)
 	// BPF buffer switch on the next read when the hold buffer is empty
 	// while the store buffer isn't filled yet.
 
-	struct timeval timeout;
-
-	if ( all_idle )
-		{
-		// Interesting: when all sources are dry, simply sleeping a
-		// bit *without* watching for any fd becoming ready may
-		// decrease CPU load. I guess that's because it allows
-		// the kernel's packet buffers to fill. - Robin
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 20; // SELECT_TIMEOUT;
-		select(0, 0, 0, 0, &timeout);
-		}
-
 	if ( ! maxx )
 		// No selectable fd at all.
 		goto finished;
 
+	struct timeval timeout;
 	timeout.tv_sec = 0;
 	timeout.tv_usec = 0;
 
@@ -158,19 +199,11 @@ IOSource* Manager::FindSoonest(double* ts)
 			if ( ! src->src->IsIdle() )
 				continue;
 
+			if ( src->src->HasRegisteredFds() && poll_fd >= 0 )
+				continue;
+
 			if ( src->Ready(&fd_read, &fd_write, &fd_except) )
-				{
-				double local_network_time = 0;
-				double ts = src->src->NextTimestamp(&local_network_time);
-				if ( ts > 0.0 && ts < soonest_ts )
-					{
-					soonest_ts = ts;
-					soonest_src = src->src;
-					soonest_local_network_time =
-						local_network_time ?
-							local_network_time : ts;
-					}
-				}
+				ConsiderSource(src->src);
 			}
 		}
 
@@ -179,6 +212,124 @@ finished:
 	return soonest_src;
 	}
 
+void Manager::ConsiderSource(IOSource* src)
+	{
+	if ( std::find(considered.begin(), considered.end(), src) != considered.end() )
+		// Already asked during this round.
+		return;
+
+	considered.push_back(src);
+
+	double local_network_time = 0;
+	double ts = src->NextTimestamp(&local_network_time);
+
+	if ( ts > 0.0 && ts < soonest_ts )
+		{
+		soonest_ts = ts;
+		soonest_src = src;
+		soonest_local_network_time =
+			local_network_time ? local_network_time : ts;
+		}
+	}
+
+void Manager::PollRegisteredFds()
+	{
+	if ( registered_fds.empty() || poll_fd < 0 )
+		return;
+
+	for ( FdMap::const_iterator i = registered_fds.begin();
+	      i != registered_fds.end(); ++i )
+		{
+		if ( i->second.always_ready && i->second.src->IsIdle() &&
+		     i->second.src->IsOpen() )
+			ConsiderSource(i->second.src);
+		}
+
+#ifdef HAVE_LINUX
+	struct epoll_event events[MAX_READY_FDS];
+	int n = epoll_wait(poll_fd, events, MAX_READY_FDS, 0);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		FdMap::const_iterator j = registered_fds.find(events[i].data.fd);
+
+		if ( j == registered_fds.end() )
+			continue;
+
+		IOSource* src = j->second.src;
+
+		if ( src->IsIdle() && src->IsOpen() )
+			ConsiderSource(src);
+		}
+#endif
+	}
+
+void Manager::RegisterFd(int fd, IOSource* src)
+	{
+	if ( fd < 0 )
+		return;
+
+	RegisteredFd r;
+	r.src = src;
+	r.always_ready = false;
+
+#ifdef HAVE_LINUX
+	if ( poll_fd >= 0 )
+		{
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+
+		if ( epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &event) < 0 )
+			{
+			if ( errno == EPERM )
+				// Not pollable, like a regular file, which
+				// select() would always report as ready.
+				r.always_ready = true;
+
+			else if ( errno != EEXIST )
+				reporter->InternalWarning("cannot watch fd %d: %s",
+							  fd, strerror(errno));
+			}
+		}
+#endif
+
+	registered_fds[fd] = r;
+	DBG_LOG(DBG_MAINLOOP, "registered fd %d for %s", fd, src->Tag());
+	}
+
+void Manager::UnregisterFd(int fd)
+	{
+	FdMap::iterator i = registered_fds.find(fd);
+
+	if ( i == registered_fds.end() )
+		return;
+
+#ifdef HAVE_LINUX
+	// This fails harmlessly if the fd has already been closed, as
+	// that removes it from the epoll set anyways.
+	if ( poll_fd >= 0 && ! i->second.always_ready )
+		epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, 0);
+#endif
+
+	registered_fds.erase(i);
+	DBG_LOG(DBG_MAINLOOP, "unregistered fd %d", fd);
+	}
+
+void Manager::UnregisterFds(IOSource* src)
+	{
+	FdMap::iterator i = registered_fds.begin();
+
+	while ( i != registered_fds.end() )
+		{
+		FdMap::iterator j = i++;
+
+		if ( j->second.src == src )
+			UnregisterFd(j->first);
+		}
+	}
+
 void Manager::Register(IOSource* src, bool dont_count)
 	{
 	// First see if we already have registered that source. If so, just
@@ -5,6 +5,8 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 #include "iosource/FD_Set.h"
 
 namespace iosource {
@@ -21,7 +23,7 @@ public:
 	/**
 	 * Constructor.
 	 */
-	Manager()	{ call_count = 0; dont_counts = 0; }
+	Manager();
 
 	/**
 	 * Destructor.
@@ -42,6 +44,25 @@ public:
 	 */
 	void Register(IOSource* src, bool dont_count = false);
 
+	/**
+	 * Starts watching a file descriptor on behalf of a source. Sources
+	 * call this through IOSource::RegisterFd().
+	 *
+	 * @param fd The file descriptor to watch for input.
+	 *
+	 * @param src The source to consider for processing once the
+	 * descriptor becomes readable.
+	 */
+	void RegisterFd(int fd, IOSource* src);
+
+	/**
+	 * Stops watching a file descriptor. Sources call this through
+	 * IOSource::UnregisterFd().
+	 *
+	 * @param fd The file descriptor to stop watching.
+	 */
+	void UnregisterFd(int fd);
+
 	/**
 	 * Returns the packet source with the soonest available input. This
 	 * may block for a little while if all are dry.
@@ -99,10 +120,17 @@ public:
 private:
 	/**
 	 * When looking for a source with something to process, every
-	 * SELECT_FREQUENCY calls we will go ahead and block on a select().
+	 * SELECT_FREQUENCY calls we will go ahead and block on a select()
+	 * for sources that don't register their file descriptors.
 	 */
 	static const int SELECT_FREQUENCY = 25;
 
+	/**
+	 * Maximum number of ready file descriptors to fetch from the kernel
+	 * at once.
+	 */
+	static const int MAX_READY_FDS = 64;
+
 	/**
 	 * Microseconds to wait in an empty select if no source is ready.
 	 */
@@ -111,6 +139,17 @@ private:
 	void Register(PktSrc* src);
 	void RemoveAll();
 
+	// Asks a source for the time of its next input, and makes it the
+	// soonest one if that's earlier than what we have so far.
+	void ConsiderSource(IOSource* src);
+
+	// Checks the registered file descriptors, considering the sources
+	// of all that are ready.
+	void PollRegisteredFds();
+
+	// Stops watching all descriptors registered by a source.
+	void UnregisterFds(IOSource* src);
+
 	unsigned int call_count;
 	int dont_counts;
 
@@ -135,6 +174,26 @@ private:
 	typedef std::list<Source*> SourceList;
 	SourceList sources;
 
+	struct RegisteredFd {
+		IOSource* src;
+		// True if the descriptor can't be watched by the kernel
+		// (e.g., a regular file) and is hence always ready.
+		bool always_ready;
+	};
+
+	typedef std::map<int, RegisteredFd> FdMap;
+	FdMap registered_fds;
+
+	// Descriptor for watching the registered fds, or -1 if the
+	// platform doesn't support that and we have to select() them.
+	int poll_fd;
+
+	// State of the current FindSoonest() run.
+	IOSource* soonest_src;
+	double soonest_ts;
+	double soonest_local_network_time;
+	std::vector<IOSource*> considered;
+
 	typedef std::list<PktDumper *> PktDumperList;
 
 	PktSrcList pkt_srcs;
@@ -426,6 +426,64 @@ void Packet::ProcessLayer2()
 	hdr_size = (pdata - data);
 }
 
+// Transport protocols whose first four bytes are the two ports.
+static inline bool has_ports(int proto)
+	{
+	return proto == IPPROTO_TCP || proto == IPPROTO_UDP ||
+		proto == IPPROTO_SCTP;
+	}
+
+uint32 Packet::FlowHash(bool use_ports) const
+	{
+	if ( ! l2_valid || (l3_proto != L3_IPV4 && l3_proto != L3_IPV6) )
+		return 0;
+
+	// This needs to compute exactly what PktSrc::ShardFilter()'s BPF
+	// expression does, so it sticks to what a filter can express:
+	// XORing the addresses and ports together makes it symmetric.
+	const u_char* l3 = data + hdr_size;
+	const u_char* end_of_data = data + cap_len;
+	const u_char* l4 = 0;
+	uint32 h = 0;
+
+	if ( l3_proto == L3_IPV4 )
+		{
+		if ( l3 + sizeof(struct ip) > end_of_data )
+			return 0;
+
+		const struct ip* ip4 = (const struct ip*) l3;
+		h = ntohl(ip4->ip_src.s_addr) ^ ntohl(ip4->ip_dst.s_addr);
+
+		// Fragments other than the first don't carry ports, so we
+		// hash all fragments on addresses only to keep them together.
+		if ( has_ports(ip4->ip_p) && (ntohs(ip4->ip_off) & 0x3fff) == 0 )
+			l4 = l3 + ip4->ip_hl * 4;
+		}
+
+	else
+		{
+		if ( l3 + sizeof(struct ip6_hdr) > end_of_data )
+			return 0;
+
+		const struct ip6_hdr* ip6 = (const struct ip6_hdr*) l3;
+		const uint32* src = (const uint32*) &ip6->ip6_src;
+		const uint32* dst = (const uint32*) &ip6->ip6_dst;
+
+		for ( int i = 0; i < 4; ++i )
+			h ^= ntohl(src[i]) ^ ntohl(dst[i]);
+
+		// A filter can't walk extension headers, so packets with
+		// any (including fragments) get hashed without ports.
+		if ( has_ports(ip6->ip6_nxt) )
+			l4 = l3 + sizeof(struct ip6_hdr);
+		}
+
+	if ( use_ports && l4 && l4 + 4 <= end_of_data )
+		h ^= ((l4[0] << 8) | l4[1]) ^ ((l4[2] << 8) | l4[3]);
+
+	return h ^ (h >> 16);
+	}
+
 RecordVal* Packet::BuildPktHdrVal() const
 	{
 	static RecordType* l2_hdr_type = 0;
@@ -115,6 +115,21 @@ public:
 	const IP_Hdr IP() const
 		{ return IP_Hdr((struct ip *) (data + hdr_size), false); }
 
+	/**
+	 * Returns a hash over the packet's IP addresses and, where present,
+	 * its transport-layer ports. The hash is symmetric: both directions
+	 * of a flow map to the same value. IP fragments, as well as IPv6
+	 * packets with extension headers, are hashed on their addresses
+	 * only. The hash is simple enough to compute in a BPF filter as
+	 * well; see PktSrc::ShardFilter().
+	 *
+	 * @param use_ports If false, ports are left out for all packets, so
+	 * that all traffic between a pair of hosts hashes the same.
+	 *
+	 * @return The hash, or zero if the packet isn't IP.
+	 */
+	uint32 FlowHash(bool use_ports = true) const;
+
 	/**
 	 * Returns a \c raw_pkt_hdr RecordVal, which includes layer 2 and
 	 * also everything in IP_Hdr (i.e., IP4/6 + TCP/UDP/ICMP).
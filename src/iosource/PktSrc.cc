@@ -1,8 +1,11 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <errno.h>
+#include <signal.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+
 #include "bro-config.h"
 
 #include "util.h"
@@ -10,6 +13,8 @@
 #include "Hash.h"
 #include "Net.h"
 #include "Sessions.h"
+#include "Var.h"
+#include "Manager.h"
 
 #include "pcap/const.bif.h"
 
@@ -26,6 +31,10 @@ PktSrc::Properties::Properties()
 PktSrc::PktSrc()
 	{
 	have_packet = false;
+	current_packet = 0;
+	batch_len = 0;
+	batch_idx = 0;
+	shard_filtered = false;
 	errbuf = "";
 	SetClosed(true);
 
@@ -106,6 +115,10 @@ void PktSrc::Opened(const Properties& arg_props)
 		return;
 		}
 
+	if ( props.selectable_fd >= 0 && ! pseudo_realtime )
+		// In pseudo-realtime mode, GetFds() decides when we're ready.
+		RegisterFd(props.selectable_fd);
+
 	if ( props.is_live )
 		Info(fmt("listening on %s\n", props.path.c_str()));
 
@@ -114,6 +127,9 @@ void PktSrc::Opened(const Properties& arg_props)
 
 void PktSrc::Closed()
 	{
+	if ( props.selectable_fd >= 0 )
+		UnregisterFd(props.selectable_fd);
+
 	SetClosed(true);
 
 	DBG_LOG(DBG_PKTIO, "Closed source %s", props.path.c_str());
@@ -159,20 +175,20 @@ double PktSrc::CheckPseudoTime()
 
 	if ( remote_trace_sync_interval )
 		{
-		if ( next_sync_point == 0 || current_packet.time >= next_sync_point )
+		if ( next_sync_point == 0 || current_packet->time >= next_sync_point )
 			{
 			int n = remote_serializer->SendSyncPoint();
 			next_sync_point = first_timestamp +
 						n * remote_trace_sync_interval;
 			remote_serializer->Log(RemoteSerializer::LogInfo,
 				fmt("stopping at packet %.6f, next sync-point at %.6f",
-					current_packet.time, next_sync_point));
+					current_packet->time, next_sync_point));
 
 			return 0;
 			}
 		}
 
-	double pseudo_time = current_packet.time - first_timestamp;
+	double pseudo_time = current_packet->time - first_timestamp;
 	double ct = (current_time(true) - first_wallclock) * pseudo_realtime;
 
 	return pseudo_time <= ct ? bro_start_time + pseudo_time : 0;
@@ -235,33 +251,56 @@ double PktSrc::NextTimestamp(double* local_network_time)
 		return -1.0;
 		}
 
-	return current_packet.time;
+	return current_packet->time;
 	}
 
 void PktSrc::Process()
 	{
-	if ( ! IsOpen() )
-		return;
+	int processed = 0;
 
-	if ( ! ExtractNextPacketInternal() )
-		return;
-
-	if ( current_packet.Layer2Valid() )
+	do
 		{
-		if ( pseudo_realtime )
+		if ( ! IsOpen() )
+			return;
+
+		if ( ! ExtractNextPacketInternal() )
+			return;
+
+		if ( current_packet->Layer2Valid() )
 			{
-			current_pseudo = CheckPseudoTime();
-			net_packet_dispatch(current_pseudo, &current_packet, this);
-			if ( ! first_wallclock )
-				first_wallclock = current_time(true);
+			if ( pseudo_realtime )
+				{
+				current_pseudo = CheckPseudoTime();
+				net_packet_dispatch(current_pseudo, current_packet, this);
+				if ( ! first_wallclock )
+					first_wallclock = current_time(true);
+				}
+
+			else
+				net_packet_dispatch(current_packet->time, current_packet, this);
 			}
 
-		else
-			net_packet_dispatch(current_packet.time, &current_packet, this);
+		// The packet's data stays around until the batch is done.
+		have_packet = 0;
 		}
+	while ( ++processed < int(BifConst::packet_batch_size) &&
+		CanProcessBatch() );
+	}
 
-	have_packet = 0;
-	DoneWithPacket();
+bool PktSrc::CanProcessBatch() const
+	{
+	if ( pseudo_realtime || net_is_processing_suspended() )
+		return false;
+
+	if ( signal_val == SIGTERM || signal_val == SIGINT )
+		return false;
+
+	// With more than one trace, the main loop needs to pick the source
+	// with the soonest packet each time to keep them in order.
+	if ( ! props.is_live && iosource_mgr->GetPktSrcs().size() > 1 )
+		return false;
+
+	return true;
 	}
 
 const char* PktSrc::Tag()
@@ -287,10 +326,16 @@ bool PktSrc::ExtractNextPacketInternal()
 	if ( pseudo_realtime )
 		current_wallclock = current_time(true);
 
-	if ( ExtractNextPacket(&current_packet) )
+	while ( NextPacketFromBatch() )
 		{
 		if ( ! first_timestamp )
-			first_timestamp = current_packet.time;
+			first_timestamp = current_packet->time;
+
+		if ( ! InShard(*current_packet) )
+			{
+			// Belongs to another process' share.
+			continue;
+			}
 
 		SetIdle(false);
 		have_packet = true;
@@ -310,6 +355,109 @@ bool PktSrc::ExtractNextPacketInternal()
 	return 0;
 	}
 
+bool PktSrc::NextPacketFromBatch()
+	{
+	if ( ++batch_idx < batch_len )
+		{
+		current_packet = &batch[batch_idx];
+		return true;
+		}
+
+	if ( batch_len )
+		{
+		batch_len = 0;
+		DoneWithBatch();
+		}
+
+	int max = std::max(int(BifConst::packet_batch_size), 1);
+
+	if ( int(batch.size()) < max )
+		batch.resize(max);
+
+	batch_len = ExtractNextBatch(&batch, max);
+	batch_idx = 0;
+
+	if ( ! batch_len )
+		return false;
+
+	current_packet = &batch[0];
+	return true;
+	}
+
+int PktSrc::ExtractNextBatch(std::vector<Packet>* pkts, int max)
+	{
+	return ExtractNextPacket(&(*pkts)[0]) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithBatch()
+	{
+	DoneWithPacket();
+	}
+
+bool PktSrc::InShard(const Packet& pkt) const
+	{
+	if ( BifConst::packet_shards <= 1 || shard_filtered )
+		return true;
+
+	uint32 h = pkt.FlowHash(BifConst::packet_shard_by_ports);
+	return h % BifConst::packet_shards == BifConst::packet_shard_id;
+	}
+
+std::string PktSrc::ShardFilter()
+	{
+	if ( BifConst::packet_shards <= 1 )
+		return "";
+
+	bool use_ports = BifConst::packet_shard_by_ports;
+	const char* l4 = "ip[((ip[0] & 0xf) << 2):2] ^ ip[((ip[0] & 0xf) << 2) + 2:2]";
+	const char* l4_6 = "ip6[40:2] ^ ip6[42:2]";
+
+	// The conditions under which Packet::FlowHash() includes ports.
+	const char* with_ports = "(ip[9] = 6 or ip[9] = 17 or ip[9] = 132) and ip[6:2] & 0x3fff = 0";
+	const char* with_ports_6 = "(ip6[6] = 6 or ip6[6] = 17 or ip6[6] = 132)";
+
+	string addrs = "ip[12:4] ^ ip[16:4]";
+	string addrs_6 = "ip6[8:4]";
+
+	for ( int i = 12; i < 40; i += 4 )
+		addrs_6 += fmt(" ^ ip6[%d:4]", i);
+
+	// Folds the hash's upper half into the lower one and picks the
+	// share, the way Packet::FlowHash() and InShard() do.
+	auto share = [](const string& h) -> string
+		{
+		return fmt("((%s) ^ ((%s) >> 16)) %% %" PRIu64 " = %" PRIu64,
+			   h.c_str(), h.c_str(),
+			   uint64(BifConst::packet_shards),
+			   uint64(BifConst::packet_shard_id));
+		};
+
+	string f;
+
+	if ( use_ports )
+		{
+		f = fmt("(ip and %s and %s)", with_ports,
+			share(addrs + " ^ " + l4).c_str());
+		f += fmt(" or (ip and not (%s) and %s)", with_ports,
+			 share(addrs).c_str());
+		f += fmt(" or (ip6 and %s and %s)", with_ports_6,
+			 share(addrs_6 + " ^ " + l4_6).c_str());
+		f += fmt(" or (ip6 and not %s and %s)", with_ports_6,
+			 share(addrs_6).c_str());
+		}
+
+	else
+		{
+		f = fmt("(ip and %s)", share(addrs).c_str());
+		f += fmt(" or (ip6 and %s)", share(addrs_6).c_str());
+		}
+
+	if ( BifConst::packet_shard_id == 0 )
+		f += " or not (ip or ip6)";
+
+	return f;
+	}
+
 bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 	{
 	if ( index < 0 )
@@ -317,10 +465,17 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 
 	char errbuf[PCAP_ERRBUF_SIZE];
 
+	string full_filter = filter;
+	string shard_filter = ShardFilter();
+
+	if ( ! shard_filter.empty() )
+		full_filter = filter.empty() ? shard_filter :
+			"(" + filter + ") and (" + shard_filter + ")";
+
 	// Compile filter.
 	BPF_Program* code = new BPF_Program();
 
-	if ( ! code->Compile(BifConst::Pcap::snaplen, LinkType(), filter.c_str(), Netmask(), errbuf, sizeof(errbuf)) )
+	if ( ! code->Compile(BifConst::Pcap::snaplen, LinkType(), full_filter.c_str(), Netmask(), errbuf, sizeof(errbuf)) )
 		{
 		string msg = fmt("cannot compile BPF filter \"%s\"", filter.c_str());
 
@@ -342,6 +497,9 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 
 	filters[index] = code;
 
+	if ( ! shard_filter.empty() )
+		shard_filtered = true;
+
 	return true;
 	}
 
@@ -375,6 +533,6 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	if ( ! have_packet )
 		return false;
 
-	*pkt = &current_packet;
+	*pkt = current_packet;
 	return true;
 	}
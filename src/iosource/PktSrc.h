@@ -123,6 +123,10 @@ public:
 	 * This is primarily a helper for packet source implementation that
 	 * want to apply BPF filtering to their packets.
 	 *
+	 * If packet_shards is set, the filter also selects this process'
+	 * share of the input (see \a ShardFilter()), so that packets of
+	 * other shares get dropped before they reach Bro.
+	 *
 	 * @param index The index to associate with the filter.
 	 *
 	 * @param BPF filter The filter string to precompile.
@@ -143,6 +147,16 @@ public:
 	 */
 	BPF_Program* GetBPFFilter(int index);
 
+	/**
+	 * Returns a BPF filter expression matching the packets of the share
+	 * of input selected by packet_shards and packet_shard_id, computing
+	 * the same hash as \a Packet::FlowHash(). Non-IP packets belong
+	 * to shard zero.
+	 *
+	 * @return The expression, or an empty string if sharding is off.
+	 */
+	static std::string ShardFilter();
+
 	/**
 	 * Applies a precompiled BPF filter to a packet. This will close the
 	 * source with an error message if no filter with that index has been
@@ -341,6 +355,35 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides a batch of packets from the source. The default
+	 * implementation wraps \a ExtractNextPacket() and hence returns at
+	 * most one packet per call. Sources that can hand out several
+	 * packets at once should override this together with \a
+	 * DoneWithBatch().
+	 *
+	 * @param pkts The packets to fill in, starting at index zero. The
+	 * vector comes sized to at least *max* entries. The callee keeps
+	 * ownership of the packets' data but must guarantee that it stays
+	 * available at least until \a DoneWithBatch() is called. It is
+	 * guaranteed that no two calls to this method will happen without
+	 * \a DoneWithBatch() in between.
+	 *
+	 * @param max The maximum number of packets to provide.
+	 *
+	 * @return The number of packets filled in. Zero if no packet is
+	 * available or an error occured (which must be flagged via
+	 * Error()).
+	 */
+	virtual int ExtractNextBatch(std::vector<Packet>* pkts, int max);
+
+	/**
+	 * Signals that the data of all packets of the previously extracted
+	 * batch will no longer be needed. The default implementation calls
+	 * \a DoneWithPacket().
+	 */
+	virtual void DoneWithBatch();
+
 private:
 	// Checks if the current packet has a pseudo-time <= current_time. If
 	// yes, returns pseudo-time, otherwise 0.
@@ -349,6 +392,18 @@ private:
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Advances current_packet to the next packet of the current batch,
+	// extracting a new batch once the current one is used up.
+	bool NextPacketFromBatch();
+
+	// Returns true if Process() may go on with the next packet without
+	// returning to the main loop first.
+	bool CanProcessBatch() const;
+
+	// Returns true if the packet falls into the share of input this
+	// process analyzes, as configured through packet_shards.
+	bool InShard(const Packet& pkt) const;
+
 	// IOSource interface implementation.
 	virtual void Init();
 	virtual void Done();
@@ -361,11 +416,20 @@ private:
 	Properties props;
 
 	bool have_packet;
-	Packet current_packet;
+	Packet* current_packet;
+
+	// The packets extracted by the most recent ExtractNextBatch().
+	std::vector<Packet> batch;
+	int batch_len;
+	int batch_idx;
 
 	// For BPF filtering support.
 	std::vector<BPF_Program *> filters;
 
+	// True once the source's filters pick our shard, so that we don't
+	// need to check packets ourselves.
+	bool shard_filtered;
+
 	// Only set in pseudo-realtime mode.
 	double first_timestamp;
 	double first_wallclock;
@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "plugin/Plugin.h"
+
+#include "Source.h"
+
+namespace plugin {
+namespace Bro_TPacket {
+
+class Plugin : public plugin::Plugin {
+public:
+	plugin::Configuration Configure()
+		{
+		AddComponent(new ::iosource::PktSrcComponent("TPacketReader", "tpacket", ::iosource::PktSrcComponent::LIVE, ::iosource::af_packet::AF_PacketSource::Instantiate));
+
+		plugin::Configuration config;
+		config.name = "Bro::TPacket";
+		config.description = "Packet acquisition via Linux AF_PACKET (TPACKET_V3)";
+		return config;
+		}
+} plugin;
+
+}
+}
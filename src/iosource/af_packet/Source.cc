@@ -0,0 +1,455 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+
+#include "bro-config.h"
+
+#include "Source.h"
+#include "iosource/Packet.h"
+
+#include "af_packet.bif.h"
+
+using namespace iosource::af_packet;
+
+// Room the kernel leaves in front of each frame so that we can put a
+// stripped VLAN tag back in place.
+static const unsigned int VLAN_TAG_LEN = 4;
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	fd = -1;
+	ifindex = 0;
+	ring = 0;
+	block_size = num_blocks = 0;
+	current_block = 0;
+	block_open = false;
+	frames_left = 0;
+	next_frame = 0;
+	}
+
+void AF_PacketSource::Open()
+	{
+	// Check the options first, so that bad ones get reported even
+	// without the privileges to open the socket.
+	if ( ! CheckOptions() )
+		return;
+
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( fd < 0 )
+		{
+		SocketError("socket");
+		return;
+		}
+
+	ifindex = if_nametoindex(props.path.c_str());
+
+	if ( ! ifindex )
+		{
+		Error(fmt("unknown interface %s", props.path.c_str()));
+		Close();
+		return;
+		}
+
+	if ( ! ConfigureSocket() || ! SetupRing() )
+		return;
+
+	struct sockaddr_ll addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = ifindex;
+
+	if ( bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 )
+		{
+		SocketError("bind");
+		return;
+		}
+
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SocketError("enabling promiscuous mode");
+		return;
+		}
+
+	// The fanout group can only be joined once the socket is bound.
+	if ( BifConst::TPacket::enable_fanout && ! JoinFanoutGroup() )
+		return;
+
+	props.selectable_fd = fd;
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+bool AF_PacketSource::CheckOptions()
+	{
+	unsigned int page_size = getpagesize();
+
+	block_size = BifConst::TPacket::block_size;
+
+	if ( block_size < page_size || block_size % page_size )
+		{
+		Error(fmt("TPacket::block_size must be a multiple of the page size (%u)",
+			  page_size));
+		return false;
+		}
+
+	num_blocks = BifConst::TPacket::buffer_size / block_size;
+
+	if ( ! num_blocks )
+		{
+		Error("TPacket::buffer_size must be at least TPacket::block_size");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::ConfigureSocket()
+	{
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	safe_strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name));
+
+	if ( ioctl(fd, SIOCGIFHWADDR, &ifr) < 0 )
+		{
+		SocketError("SIOCGIFHWADDR");
+		return false;
+		}
+
+	switch ( ifr.ifr_hwaddr.sa_family ) {
+	case ARPHRD_ETHER:
+	case ARPHRD_LOOPBACK:
+		props.link_type = DLT_EN10MB;
+		break;
+
+	default:
+		Error(fmt("unsupported link type %d on interface %s",
+			  ifr.ifr_hwaddr.sa_family, props.path.c_str()));
+		Close();
+		return false;
+	}
+
+	int version = TPACKET_V3;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		SocketError("TPACKET_V3 not supported");
+		return false;
+		}
+
+	// Must be set before the ring gets created.
+	unsigned int reserve = VLAN_TAG_LEN;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(reserve)) < 0 )
+		{
+		SocketError("PACKET_RESERVE");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::SetupRing()
+	{
+	// With TPACKET_V3, frames are packed into the blocks with their
+	// actual size, so the frame size only matters for the kernel's
+	// consistency checks.
+	unsigned int frame_size = TPACKET_ALIGNMENT << 7;
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size;
+	req.tp_block_nr = num_blocks;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (block_size / frame_size) * num_blocks;
+	req.tp_retire_blk_tov = uint32(BifConst::TPacket::block_timeout * 1000);
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		SocketError("PACKET_RX_RING");
+		return false;
+		}
+
+	void* m = mmap(0, size_t(block_size) * num_blocks, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, 0);
+
+	if ( m == MAP_FAILED )
+		{
+		SocketError("mmap");
+		return false;
+		}
+
+	ring = (u_char*) m;
+	current_block = 0;
+	block_open = false;
+	frames_left = 0;
+	next_frame = 0;
+
+	return true;
+	}
+
+bool AF_PacketSource::JoinFanoutGroup()
+	{
+	ODesc d;
+	BifConst::TPacket::fanout_mode->Describe(&d);
+	const char* mode_name = d.Description();
+
+	int mode;
+
+	if ( strcmp(mode_name, "TPacket::FANOUT_HASH") == 0 )
+		mode = PACKET_FANOUT_HASH;
+	else if ( strcmp(mode_name, "TPacket::FANOUT_CPU") == 0 )
+		mode = PACKET_FANOUT_CPU;
+#ifdef PACKET_FANOUT_QM
+	else if ( strcmp(mode_name, "TPacket::FANOUT_QM") == 0 )
+		mode = PACKET_FANOUT_QM;
+#endif
+	else
+		{
+		Error(fmt("unsupported fanout mode %s", mode_name));
+		Close();
+		return false;
+		}
+
+	// Have the kernel reassemble IP fragments before hashing so that
+	// they end up with the rest of their flow.
+	int flags = (mode == PACKET_FANOUT_HASH ? PACKET_FANOUT_FLAG_DEFRAG : 0);
+	int arg = (BifConst::TPacket::fanout_id & 0xffff) | ((mode | flags) << 16);
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0 )
+		{
+		SocketError("joining fanout group");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( fd < 0 )
+		return;
+
+	if ( ring )
+		munmap(ring, size_t(block_size) * num_blocks);
+
+	close(fd);
+	fd = -1;
+	ring = 0;
+	block_open = false;
+	frames_left = 0;
+	next_frame = 0;
+
+	Closed();
+	}
+
+bool AF_PacketSource::NextFrame(Packet* pkt)
+	{
+	if ( ! ring )
+		return false;
+
+	while ( ! block_open )
+		{
+		struct tpacket_block_desc* bd = BlockDesc(current_block);
+
+		if ( ! (bd->hdr.bh1.block_status & TP_STATUS_USER) )
+			// Kernel hasn't handed over the block yet.
+			return false;
+
+		// Make sure we don't read the block's content before
+		// seeing its status.
+		__sync_synchronize();
+
+		block_open = true;
+		frames_left = bd->hdr.bh1.num_pkts;
+		next_frame = (struct tpacket3_hdr*) ((u_char*) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+		if ( ! frames_left )
+			ReleaseBlock();
+		}
+
+	if ( ! frames_left )
+		// All handed out, the block goes back once we're done with it.
+		return false;
+
+	struct tpacket3_hdr* hdr = next_frame;
+	u_char* data = (u_char*) hdr + hdr->tp_mac;
+	uint32 caplen = hdr->tp_snaplen;
+	uint32 len = hdr->tp_len;
+
+	if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+		{
+		// The kernel has stripped the VLAN tag; we put it back right
+		// in the ring, using the space reserved in front of the frame.
+		uint16 tpid = ETH_P_8021Q;
+
+#ifdef TP_STATUS_VLAN_TPID_VALID
+		if ( hdr->tp_status & TP_STATUS_VLAN_TPID_VALID )
+			tpid = hdr->hv1.tp_vlan_tpid;
+#endif
+
+		u_char* mac = data;
+		data -= VLAN_TAG_LEN;
+		memmove(data, mac, 2 * ETH_ALEN);
+
+		uint16 tag[2];
+		tag[0] = htons(tpid);
+		tag[1] = htons(hdr->hv1.tp_vlan_tci);
+		memcpy(data + 2 * ETH_ALEN, tag, sizeof(tag));
+
+		caplen += VLAN_TAG_LEN;
+		len += VLAN_TAG_LEN;
+		}
+
+	struct timeval ts;
+	ts.tv_sec = hdr->tp_sec;
+	ts.tv_usec = hdr->tp_nsec / 1000;
+
+	pkt->Init(props.link_type, &ts, caplen, len, data);
+
+	next_frame = (struct tpacket3_hdr*) ((u_char*) hdr + hdr->tp_next_offset);
+	--frames_left;
+
+	++stats.received;
+	stats.bytes_received += len;
+
+	return true;
+	}
+
+void AF_PacketSource::ReleaseBlock()
+	{
+	if ( ! block_open || frames_left )
+		return;
+
+	// Make sure we're done reading before handing the block back.
+	__sync_synchronize();
+	BlockDesc(current_block)->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+	current_block = (current_block + 1) % num_blocks;
+	block_open = false;
+	next_frame = 0;
+	}
+
+int AF_PacketSource::ExtractNextBatch(std::vector<Packet>* pkts, int max)
+	{
+	// A batch never extends beyond the current block, so that we can
+	// hand the block back to the kernel once the batch is done.
+	int n = 0;
+
+	while ( n < max && NextFrame(&(*pkts)[n]) )
+		++n;
+
+	return n;
+	}
+
+void AF_PacketSource::DoneWithBatch()
+	{
+	ReleaseBlock();
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	return NextFrame(pkt);
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	ReleaseBlock();
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( fd < 0 )
+		return true; // Prevent error message
+
+	BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	if ( code->MatchesAnything() )
+		{
+		// Fails harmlessly if no filter is attached.
+		int dummy = 0;
+		setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+		return true;
+		}
+
+	// Filter in the kernel so that packets we don't want never take
+	// up ring space. Note that the kernel runs the filter before we
+	// put stripped VLAN tags back.
+	struct bpf_program* prog = code->GetProgram();
+
+	struct sock_fprog fprog;
+	fprog.len = prog->bf_len;
+	fprog.filter = (struct sock_filter*) prog->bf_insns;
+
+	if ( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SocketError("attaching filter");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( fd >= 0 )
+		{
+		// The kernel resets its counters with every query.
+		struct tpacket_stats_v3 kstats;
+		socklen_t len = sizeof(kstats);
+
+		if ( getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) == 0 )
+			{
+			stats.link += kstats.tp_packets;
+			stats.dropped += kstats.tp_drops;
+			}
+		}
+
+	*s = stats;
+	}
+
+void AF_PacketSource::SocketError(const char* where)
+	{
+	Error(fmt("%s: %s", where, strerror(errno)));
+	Close();
+	}
+
+iosource::PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
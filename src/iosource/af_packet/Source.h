@@ -0,0 +1,79 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef IOSOURCE_PKTSRC_AF_PACKET_SOURCE_H
+#define IOSOURCE_PKTSRC_AF_PACKET_SOURCE_H
+
+extern "C" {
+#include <linux/if_packet.h>
+}
+
+#include "../PktSrc.h"
+
+namespace iosource {
+namespace af_packet {
+
+/**
+ * A live packet source reading from a memory-mapped TPACKET_V3 ring. The
+ * kernel fills the ring block by block; packets handed out point directly
+ * into the ring, and each block goes back to the kernel only once all its
+ * packets are done with.
+ */
+class AF_PacketSource : public iosource::PktSrc {
+public:
+	AF_PacketSource(const std::string& path, bool is_live);
+	virtual ~AF_PacketSource();
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	virtual void Open();
+	virtual void Close();
+	virtual bool ExtractNextPacket(Packet* pkt);
+	virtual void DoneWithPacket();
+	virtual int ExtractNextBatch(std::vector<Packet>* pkts, int max);
+	virtual void DoneWithBatch();
+	virtual bool PrecompileFilter(int index, const std::string& filter);
+	virtual bool SetFilter(int index);
+	virtual void Statistics(Stats* stats);
+
+private:
+	bool CheckOptions();
+	bool ConfigureSocket();
+	bool SetupRing();
+	bool JoinFanoutGroup();
+	void SocketError(const char* where);
+
+	// Fills in the packet from the next frame of the current block,
+	// moving on to the next block first if the current one has been
+	// released. Returns false if the current block is used up, or if
+	// the kernel has not handed over the next one yet.
+	bool NextFrame(Packet* pkt);
+
+	// Returns the current block to the kernel if all its frames have
+	// been handed out.
+	void ReleaseBlock();
+
+	struct tpacket_block_desc* BlockDesc(unsigned int idx) const
+		{ return (struct tpacket_block_desc*) (ring + idx * block_size); }
+
+	Properties props;
+	Stats stats;
+
+	int fd;
+	int ifindex;
+
+	u_char* ring;
+	unsigned int block_size;
+	unsigned int num_blocks;
+
+	unsigned int current_block;	// Block we're reading from.
+	bool block_open;	// True if we own current_block.
+	unsigned int frames_left;	// Frames not yet handed out.
+	struct tpacket3_hdr* next_frame;	// Next frame to hand out.
+};
+
+}
+}
+
+#endif
@@ -224,6 +224,84 @@ void PcapSource::DoneWithPacket()
 	// Nothing to do.
 	}
 
+int PcapSource::ExtractNextBatch(std::vector<Packet>* pkts, int max)
+	{
+	if ( ! pd )
+		return 0;
+
+	// Without batching, there's nothing to gain from the copies below.
+	if ( max <= 1 )
+		return PktSrc::ExtractNextBatch(pkts, max);
+
+	// A packet's data is only valid until the callback returns: libpcap
+	// reads trace files into a single buffer that the next packet
+	// overwrites, and with a memory-mapped ring it may hand the slot
+	// back to the kernel. Since the packets get processed after
+	// pcap_dispatch() returns, we copy them over.
+	// testing/scripts/packet-batch-benchmark compares the cost of this
+	// with going through the main loop once per packet.
+	batch_hdrs.clear();
+	batch_data.clear();
+
+	int rc = pcap_dispatch(pd, max, BatchCallback, (u_char*) this);
+
+	if ( rc == -1 )
+		{
+		PcapError("pcap_dispatch");
+		return 0;
+		}
+
+	// -2 means someone called pcap_breakloop() before we got any
+	// packets, which isn't an error.
+	if ( batch_hdrs.empty() )
+		{
+		// Source has gone dry.  If it's a network interface, this just means
+		// it's timed out. If it's a file, though, then the file has been
+		// exhausted.
+		if ( ! props.is_live )
+			Close();
+
+		return 0;
+		}
+
+	const u_char* data = batch_data.empty() ? 0 : &batch_data[0];
+	int n = 0;
+
+	for ( size_t i = 0; i < batch_hdrs.size(); ++i )
+		{
+		struct pcap_pkthdr* hdr = &batch_hdrs[i];
+		Packet* pkt = &(*pkts)[n];
+
+		pkt->Init(props.link_type, &hdr->ts, hdr->caplen, hdr->len, data);
+		data += hdr->caplen;
+
+		if ( hdr->len == 0 || hdr->caplen == 0 )
+			{
+			Weird("empty_pcap_header", pkt);
+			continue;
+			}
+
+		++stats.received;
+		stats.bytes_received += hdr->len;
+		++n;
+		}
+
+	return n;
+	}
+
+void PcapSource::DoneWithBatch()
+	{
+	// Nothing to do, the buffers get reused by the next batch.
+	}
+
+void PcapSource::BatchCallback(u_char* arg, const struct pcap_pkthdr* hdr,
+			       const u_char* data)
+	{
+	PcapSource* src = (PcapSource*) arg;
+	src->batch_hdrs.push_back(*hdr);
+	src->batch_data.insert(src->batch_data.end(), data, data + hdr->caplen);
+	}
+
 bool PcapSource::PrecompileFilter(int index, const std::string& filter)
 	{
 	return PktSrc::PrecompileBPFFilter(index, filter);
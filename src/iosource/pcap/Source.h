@@ -21,6 +21,8 @@ protected:
 	virtual void Close();
 	virtual bool ExtractNextPacket(Packet* pkt);
 	virtual void DoneWithPacket();
+	virtual int ExtractNextBatch(std::vector<Packet>* pkts, int max);
+	virtual void DoneWithBatch();
 	virtual bool PrecompileFilter(int index, const std::string& filter);
 	virtual bool SetFilter(int index);
 	virtual void Statistics(Stats* stats);
@@ -31,6 +33,11 @@ private:
 	void PcapError(const char* where = 0);
 	void SetHdrSize();
 
+	// Callback for pcap_dispatch() that copies a packet into the
+	// current batch.
+	static void BatchCallback(u_char* arg, const struct pcap_pkthdr* hdr,
+				  const u_char* data);
+
 	Properties props;
 	Stats stats;
 
@@ -39,6 +46,11 @@ private:
 	struct pcap_pkthdr current_hdr;
 	struct pcap_pkthdr last_hdr;
 	const u_char* last_data;
+
+	// Headers and data of the packets in the current batch. The data
+	// of all packets is stored back to back.
+	std::vector<struct pcap_pkthdr> batch_hdrs;
+	std::vector<u_char> batch_data;
 };
 
 }
@@ -830,11 +830,15 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 
 		// Alright, can do the write now.
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns);
-
-		// Write takes ownership of vals.
+		// The values go straight into the writer's current batch.
 		assert(writer);
-		writer->Write(filter->num_fields, vals);
+		RecordBatch* batch = writer->StartWrite();
+
+		if ( batch )
+			{
+			RecordToFilterVals(stream, filter, columns, batch);
+			writer->FinishWrite();
+			}
 
 #ifdef DEBUG
 		DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'",
@@ -856,15 +860,15 @@ bool Manager::Write(EnumVal* id, RecordVal* columns)
 	return true;
 	}
 
-threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
+threading::Value* Manager::ValToLogVal(RecordBatch* batch, Val* val, BroType* ty)
 	{
 	if ( ! ty )
 		ty = val->Type();
 
 	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+		return batch->NewValue(ty->Tag(), false);
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	threading::Value* lval = batch->NewValue(ty->Tag());
 
 	switch ( lval->type ) {
 	case TYPE_BOOL:
@@ -877,18 +881,14 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 		const char* s =
 			val->Type()->AsEnumType()->Lookup(val->InternalInt());
 
-		if ( s )
-			{
-			lval->val.string_val.data = copy_string(s);
-			lval->val.string_val.length = strlen(s);
-			}
-
-		else
+		if ( ! s )
 			{
 			val->Type()->Error("enum type does not contain value", val);
-			lval->val.string_val.data = copy_string("");
-			lval->val.string_val.length = 0;
+			s = "";
 			}
+
+		lval->val.string_val.data = batch->NewString(s, strlen(s));
+		lval->val.string_val.length = strlen(s);
 		break;
 		}
 
@@ -919,10 +919,8 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 	case TYPE_STRING:
 		{
 		const BroString* s = val->AsString();
-		char* buf = new char[s->Len()];
-		memcpy(buf, s->Bytes(), s->Len());
-
-		lval->val.string_val.data = buf;
+		lval->val.string_val.data =
+			batch->NewString((const char*) s->Bytes(), s->Len());
 		lval->val.string_val.length = s->Len();
 		break;
 		}
@@ -931,7 +929,7 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 		{
 		const BroFile* f = val->AsFile();
 		string s = f->Name();
-		lval->val.string_val.data = copy_string(s.c_str());
+		lval->val.string_val.data = batch->NewString(s.data(), s.size());
 		lval->val.string_val.length = s.size();
 		break;
 		}
@@ -942,7 +940,7 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 		const Func* f = val->AsFunc();
 		f->Describe(&d);
 		const char* s = d.Description();
-		lval->val.string_val.data = copy_string(s);
+		lval->val.string_val.data = batch->NewString(s, strlen(s));
 		lval->val.string_val.length = strlen(s);
 		break;
 		}
@@ -956,10 +954,10 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 			set = new ListVal(TYPE_INT);
 
 		lval->val.set_val.size = set->Length();
-		lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+		lval->val.set_val.vals = batch->NewValueArray(lval->val.set_val.size);
 
 		for ( int i = 0; i < lval->val.set_val.size; i++ )
-			lval->val.set_val.vals[i] = ValToLogVal(set->Index(i));
+			lval->val.set_val.vals[i] = ValToLogVal(batch, set->Index(i));
 
 		Unref(set);
 		break;
@@ -970,12 +968,12 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 		VectorVal* vec = val->AsVectorVal();
 		lval->val.vector_val.size = vec->Size();
 		lval->val.vector_val.vals =
-			new threading::Value* [lval->val.vector_val.size];
+			batch->NewValueArray(lval->val.vector_val.size);
 
 		for ( int i = 0; i < lval->val.vector_val.size; i++ )
 			{
 			lval->val.vector_val.vals[i] =
-				ValToLogVal(vec->Lookup(i),
+				ValToLogVal(batch, vec->Lookup(i),
 					    vec->Type()->YieldType());
 			}
 
@@ -990,9 +988,9 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 	}
 
 threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
-				    RecordVal* columns)
+				    RecordVal* columns, RecordBatch* batch)
 	{
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	threading::Value** vals = batch->AddRecord();
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
@@ -1011,13 +1009,13 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! val )
 				{
 				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				vals[i] = batch->NewValue(filter->fields[i]->type, false);
 				break;
 				}
 			}
 
 		if ( val )
-			vals[i] = ValToLogVal(val);
+			vals[i] = ValToLogVal(batch, val);
 		}
 
 	return vals;
@@ -1100,7 +1098,7 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
 
 void Manager::DeleteVals(int num_fields, threading::Value** vals)
 	{
-	// Note this code is duplicated in WriterBackend::DeleteVals().
+	// Note this code is duplicated in RecordBatch::Clear().
 	for ( int i = 0; i < num_fields; i++ )
 		delete vals[i];
 
@@ -225,10 +225,11 @@ private:
 	bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt,
 			    TableVal* include, TableVal* exclude, string path, list<int> indices);
 
+	// Adds the record to the batch, allocating all values from it.
 	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
-				    RecordVal* columns);
+				    RecordVal* columns, RecordBatch* batch);
 
-	threading::Value* ValToLogVal(Val* val, BroType* ty = 0);
+	threading::Value* ValToLogVal(RecordBatch* batch, Val* val, BroType* ty = 0);
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -0,0 +1,96 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#include "RecordBatch.h"
+
+using namespace logging;
+using threading::Value;
+
+RecordBatch::RecordBatch(int arg_num_fields)
+	{
+	num_fields = arg_num_fields;
+	next = 0;
+	avail = 0;
+	block_size = MIN_BLOCK_SIZE;
+	allocated = 0;
+	}
+
+RecordBatch::~RecordBatch()
+	{
+	Clear();
+	}
+
+Value** RecordBatch::AddRecord()
+	{
+	Value** vals = (Value**) Allocate(num_fields * sizeof(Value*));
+	records.push_back(vals);
+	return vals;
+	}
+
+void RecordBatch::AdoptRecord(Value** vals)
+	{
+	records.push_back(vals);
+	adopted.push_back(vals);
+	}
+
+char* RecordBatch::NewString(const char* data, int len)
+	{
+	// Empty strings get a valid pointer as well.
+	char* s = (char*) Allocate(len > 0 ? len : 1);
+	memcpy(s, data, len);
+	return s;
+	}
+
+void RecordBatch::Clear()
+	{
+	// Values allocated from our blocks don't need their destructors
+	// run, as everything they point to lives in the blocks as well.
+	for ( size_t i = 0; i < adopted.size(); ++i )
+		{
+		for ( int j = 0; j < num_fields; ++j )
+			delete adopted[i][j];
+
+		delete [] adopted[i];
+		}
+
+	adopted.clear();
+	records.clear();
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+		free(blocks[i]);
+
+	blocks.clear();
+	next = 0;
+	avail = 0;
+	block_size = MIN_BLOCK_SIZE;
+	allocated = 0;
+	}
+
+void* RecordBatch::AllocateBlock(size_t size)
+	{
+	if ( size > block_size / 2 )
+		{
+		// Give large requests a block of their own so that we can
+		// keep using the current one.
+		char* b = (char*) safe_malloc(size);
+		blocks.push_back(b);
+		allocated += size;
+		return b;
+		}
+
+	char* b = (char*) safe_malloc(block_size);
+	blocks.push_back(b);
+	allocated += block_size;
+
+	next = b + size;
+	avail = block_size - size;
+
+	if ( block_size < MAX_BLOCK_SIZE )
+		block_size *= 2;
+
+	return b;
+	}
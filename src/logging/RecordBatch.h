@@ -0,0 +1,139 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef LOGGING_RECORDBATCH_H
+#define LOGGING_RECORDBATCH_H
+
+#include <new>
+#include <vector>
+
+#include "threading/SerialTypes.h"
+
+namespace logging  {
+
+/**
+ * A batch of log records on their way from the main thread to a writer
+ * thread.
+ *
+ * The logging::Manager converts records directly into the batch: the
+ * threading::Value instances, the strings they point to, and the element
+ * arrays of sets and vectors all come out of a few large memory blocks
+ * that the batch owns. Once the writer thread is done with the batch,
+ * deleting it releases everything at once, rather than tearing down each
+ * value individually.
+ *
+ * For compatibility with code producing individually allocated values
+ * (such as records received from remote peers), a batch can also adopt
+ * such records, and then deletes them the traditional way.
+ *
+ * A batch is filled by one thread and then handed over to another, which
+ * may read and delete it; it's never used by two threads at a time.
+ */
+class RecordBatch {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of values per record.
+	 */
+	RecordBatch(int num_fields);
+
+	/**
+	 * Destructor. Releases all records.
+	 */
+	~RecordBatch();
+
+	/**
+	 * Returns the number of values per record.
+	 */
+	int NumFields() const	{ return num_fields; }
+
+	/**
+	 * Returns the number of records in the batch.
+	 */
+	int NumRecords() const	{ return records.size(); }
+
+	/**
+	 * Returns the values of a record.
+	 *
+	 * @param i The index of the record, between zero and NumRecords() - 1.
+	 */
+	threading::Value** Record(int i) const	{ return records[i]; }
+
+	/**
+	 * Appends a record to the batch and returns its array of values,
+	 * which the caller must fill with values obtained from NewValue().
+	 */
+	threading::Value** AddRecord();
+
+	/**
+	 * Appends a record whose values have been allocated individually
+	 * with \c new. The batch takes ownership of \a vals.
+	 */
+	void AdoptRecord(threading::Value** vals);
+
+	/**
+	 * Returns a new value allocated from the batch. The batch retains
+	 * ownership; the value must not be deleted.
+	 */
+	threading::Value* NewValue(TypeTag type, bool present = true)
+		{ return new (Allocate(sizeof(threading::Value))) threading::Value(type, present); }
+
+	/**
+	 * Returns an array of value pointers allocated from the batch, for
+	 * the elements of a set or vector.
+	 */
+	threading::Value** NewValueArray(int n)
+		{ return (threading::Value**) Allocate(n * sizeof(threading::Value*)); }
+
+	/**
+	 * Returns a copy of a string, allocated from the batch.
+	 */
+	char* NewString(const char* data, int len);
+
+	/**
+	 * Removes all records and releases the memory.
+	 */
+	void Clear();
+
+	/**
+	 * Returns the number of bytes allocated for the batch's memory
+	 * blocks.
+	 */
+	unsigned int MemoryAllocation() const	{ return allocated; }
+
+private:
+	void* Allocate(size_t size)
+		{
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+
+		if ( size > avail )
+			return AllocateBlock(size);
+
+		char* p = next;
+		next += size;
+		avail -= size;
+		return p;
+		}
+
+	void* AllocateBlock(size_t size);
+
+	// Blocks start small so that unbuffered writers, which send single
+	// records, don't pay for a large one, and double up to the maximum.
+	static const size_t MIN_BLOCK_SIZE = 4 * 1024;
+	static const size_t MAX_BLOCK_SIZE = 64 * 1024;
+	static const size_t ALIGN = 16;
+
+	int num_fields;
+	std::vector<threading::Value**> records;
+	std::vector<threading::Value**> adopted;
+
+	std::vector<char*> blocks;
+	char* next;	// next free byte in the current block
+	size_t avail;	// bytes left in the current block
+	size_t block_size;	// size of the next block to allocate
+	unsigned int allocated;
+};
+
+}
+
+#endif
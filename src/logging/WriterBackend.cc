@@ -144,20 +144,6 @@ WriterBackend::~WriterBackend()
 	delete info;
 	}
 
-void WriterBackend::DeleteVals(int num_writes, Value*** vals)
-	{
-	for ( int j = 0; j < num_writes; ++j )
-		{
-		// Note this code is duplicated in Manager::DeleteVals().
-		for ( int i = 0; i < num_fields; i++ )
-			delete vals[j][i];
-
-		delete [] vals[j];
-		}
-
-	delete [] vals;
-	}
-
 bool WriterBackend::FinishedRotation(const char* new_name, const char* old_name,
 				     double open, double close, bool terminating)
 	{
@@ -197,6 +183,18 @@ bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	}
 
 bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
+	{
+	RecordBatch* batch = new RecordBatch(arg_num_fields);
+
+	for ( int j = 0; j < num_writes; j++ )
+		batch->AdoptRecord(vals[j]);
+
+	delete [] vals;
+
+	return Write(arg_num_fields, batch);
+	}
+
+bool WriterBackend::Write(int arg_num_fields, RecordBatch* batch)
 	{
 	// Double-check that the arguments match. If we get this from remote,
 	// something might be mixed up.
@@ -209,25 +207,27 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 		Debug(DBG_LOGGING, msg);
 #endif
 
-		DeleteVals(num_writes, vals);
+		delete batch;
 		DisableFrontend();
 		return false;
 		}
 
 	// Double-check all the types match.
-	for ( int j = 0; j < num_writes; j++ )
+	for ( int j = 0; j < batch->NumRecords(); j++ )
 		{
+		Value** vals = batch->Record(j);
+
 		for ( int i = 0; i < num_fields; ++i )
 			{
-			if ( vals[j][i]->type != fields[i]->type )
+			if ( vals[i]->type != fields[i]->type )
 				{
 #ifdef DEBUG
 				const char* msg = Fmt("Field type doesn't match in WriterBackend::Write() (%d vs. %d)",
-						      vals[j][i]->type, fields[i]->type);
+						      vals[i]->type, fields[i]->type);
 				Debug(DBG_LOGGING, msg);
 #endif
 				DisableFrontend();
-				DeleteVals(num_writes, vals);
+				delete batch;
 				return false;
 				}
 			}
@@ -236,17 +236,9 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	bool success = true;
 
 	if ( ! Failed() )
-		{
-		for ( int j = 0; j < num_writes; j++ )
-			{
-			success = DoWrite(num_fields, fields, vals[j]);
+		success = DoWriteBatch(num_fields, fields, *batch);
 
-			if ( ! success )
-				break;
-			}
-		}
-
-	DeleteVals(num_writes, vals);
+	delete batch;
 
 	if ( ! success )
 		DisableFrontend();
@@ -254,6 +246,18 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::DoWriteBatch(int num_fields, const Field* const* fields,
+				 const RecordBatch& batch)
+	{
+	for ( int j = 0; j < batch.NumRecords(); j++ )
+		{
+		if ( ! DoWrite(num_fields, fields, batch.Record(j)) )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
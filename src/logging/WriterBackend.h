@@ -8,6 +8,7 @@
 #include "threading/MsgThread.h"
 
 #include "Component.h"
+#include "RecordBatch.h"
 
 class RemoteSerializer;
 
@@ -152,6 +153,20 @@ public:
 	 */
 	bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+	/**
+	 * Writes a batch of log entries.
+	 *
+	 * @param num_fields: The number of log fields for this stream. The
+	 * value must match what was passed to Init().
+	 *
+	 * @param batch The log entries. Their types must match with the
+	 * fields passed to Init(). The method takes ownership of \a batch.
+	 *
+	 * @return False if an error occured, in which case the writer must
+	 * not be used any further.
+	 */
+	bool Write(int num_fields, RecordBatch* batch);
+
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
 	 * supports that. (If not, it will be ignored).
@@ -279,6 +294,19 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method implementing recording of a batch
+	 * of log entries.
+	 *
+	 * The default implementation calls DoWrite() for each entry. A
+	 * writer may override this method to process the batch as a whole.
+	 * The batch remains owned by the caller and must not be accessed
+	 * anymore after the method returns. The same failure semantics as
+	 * with DoWrite() apply.
+	 */
+	virtual bool DoWriteBatch(int num_fields, const threading::Field* const*  fields,
+				  const RecordBatch& batch);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -369,11 +397,6 @@ protected:
 	virtual bool DoHeartbeat(double network_time, double current_time) = 0;
 
 private:
-	/**
-	 * Deletes the values as passed into Write().
-	 */
-	void DeleteVals(int num_writes, threading::Value*** vals);
-
 	// Frontend that instantiated us. This object must not be access from
 	// this class, it's running in a different thread!
 	WriterFrontend* frontend;
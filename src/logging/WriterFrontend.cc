@@ -54,16 +54,15 @@ private:
 class WriteMessage : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, int num_fields, RecordBatch* batch)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		num_fields(num_fields), batch(batch)	{}
 
-	virtual bool Process() { return Object()->Write(num_fields, num_writes, vals); }
+	virtual bool Process() { return Object()->Write(num_fields, batch); }
 
 private:
 	int num_fields;
-	int num_writes;
-	Value ***vals;
+	RecordBatch* batch;
 };
 
 class SetBufMessage : public threading::InputMessage<WriterBackend>
@@ -108,8 +107,7 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	buf = true;
 	local = arg_local;
 	remote = arg_remote;
-	write_buffer = 0;
-	write_buffer_pos = 0;
+	write_batch = 0;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -134,6 +132,7 @@ WriterFrontend::~WriterFrontend()
 	{
 	Unref(stream);
 	Unref(writer);
+	delete write_batch;
 	delete info;
 	delete [] name;
 	}
@@ -177,49 +176,65 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const * arg_fields)
 
 void WriterFrontend::Write(int num_fields, Value** vals)
 	{
-	if ( disabled )
+	RecordBatch* batch = StartWrite();
+
+	if ( ! batch )
+		{
+		DeleteVals(vals);
 		return;
+		}
+
+	batch->AdoptRecord(vals);
+	FinishWrite();
+	}
+
+RecordBatch* WriterFrontend::StartWrite()
+	{
+	if ( disabled )
+		return 0;
+
+	if ( ! write_batch )
+		// Need new batch.
+		write_batch = new RecordBatch(num_fields);
+
+	return write_batch;
+	}
+
+void WriterFrontend::FinishWrite()
+	{
+	assert(write_batch && write_batch->NumRecords() > 0);
 
 	if ( remote )
 		remote_serializer->SendLogWrite(stream,
 						writer,
 						info->path,
 						num_fields,
-						vals);
+						write_batch->Record(write_batch->NumRecords() - 1));
 
 	if ( ! backend )
 		{
-		DeleteVals(vals);
+		write_batch->Clear();
 		return;
 		}
 
-	if ( ! write_buffer )
-		{
-		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
-		}
-
-	write_buffer[write_buffer_pos++] = vals;
-
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || terminating )
+	if ( write_batch->NumRecords() >= WRITER_BUFFER_SIZE || ! buf || terminating )
 		// Buffer full (or no bufferin desired or termiating).
 		FlushWriteBuffer();
-
 	}
 
 void WriterFrontend::FlushWriteBuffer()
 	{
-	if ( ! write_buffer_pos )
+	if ( ! write_batch || ! write_batch->NumRecords() )
 		// Nothing to do.
 		return;
 
-	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+	if ( ! backend )
+		return;
+
+	backend->SendIn(new WriteMessage(backend, num_fields, write_batch));
 
-	// Clear buffer (no delete, we pass ownership to child thread.)
-	write_buffer = 0;
-	write_buffer_pos = 0;
+	// No delete, we pass ownership to child thread.
+	write_batch = 0;
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
@@ -4,6 +4,7 @@
 #define LOGGING_WRITERFRONTEND_H
 
 #include "WriterBackend.h"
+#include "RecordBatch.h"
 
 #include "threading/MsgThread.h"
 
@@ -93,10 +94,35 @@ public:
 	 * takes only a single record, not an array). The method takes
 	 * ownership of \a vals.
 	 *
+	 * This method is the compatibility path for values allocated
+	 * individually; StartWrite() and FinishWrite() avoid that.
+	 *
 	 * This method must only be called from the main thread.
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Begins writing out a record by returning the batch to add it to.
+	 * The caller must append exactly one record to the batch, with
+	 * values allocated from it, and then call FinishWrite(). The
+	 * batch is later sent to the backend as a whole, like the records
+	 * buffered by Write().
+	 *
+	 * This method must only be called from the main thread.
+	 *
+	 * @return The batch, or null if the writer is disabled, in which
+	 * case FinishWrite() must not be called.
+	 */
+	RecordBatch* StartWrite();
+
+	/**
+	 * Completes writing out the record most recently added to the batch
+	 * returned by StartWrite().
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void FinishWrite();
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -220,10 +246,9 @@ protected:
 	int num_fields;	// The number of log fields.
 	const threading::Field* const*  fields;	// The log fields.
 
-	// Buffer for bulk writes.
+	// Batch for bulk writes.
 	static const int WRITER_BUFFER_SIZE = 1000;
-	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	RecordBatch* write_batch;	// Up to WRITER_BUFFER_SIZE records.
 };
 
 }
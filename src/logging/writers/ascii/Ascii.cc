@@ -18,11 +18,15 @@ using threading::Field;
 Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	{
 	fd = 0;
+	gzfile = 0;
+	write_buffer = 0;
+	write_buffer_len = 0;
 	ascii_done = false;
 	output_to_stdout = false;
 	include_meta = false;
 	tsv = false;
 	use_json = false;
+	gzip_level = 0;
 	formatter = 0;
 
 	InitConfigOptions();
@@ -34,6 +38,7 @@ void Ascii::InitConfigOptions()
 	output_to_stdout = BifConst::LogAscii::output_to_stdout;
 	include_meta = BifConst::LogAscii::include_meta;
 	use_json = BifConst::LogAscii::use_json;
+	gzip_level = BifConst::LogAscii::gzip_level;
 
 	separator.assign(
 			(const char*) BifConst::LogAscii::separator->Bytes(),
@@ -132,8 +137,25 @@ bool Ascii::InitFilterOptions()
 
 		else if ( strcmp(i->first, "json_timestamps") == 0 )
 			json_timestamps.assign(i->second);
+
+		else if ( strcmp(i->first, "gzip_level") == 0 )
+			{
+			char* end;
+			long l = strtol(i->second, &end, 10);
+
+			if ( *end || l < 0 || l > 9 )
+				{
+				Error("invalid value for 'gzip_level', must be a string holding a number between 0 and 9");
+				return false;
+				}
+
+			gzip_level = l;
+			}
 		}
 
+	if ( gzip_level > 9 )
+		gzip_level = 9;
+
 	if ( ! InitFormatter() )
 		return false;
 
@@ -186,13 +208,61 @@ Ascii::~Ascii()
 		CloseFile(network_time);
 
 	delete formatter;
+	free(write_buffer);
 	}
 
 bool Ascii::WriteHeaderField(const string& key, const string& val)
 	{
 	string str = meta_prefix + key + separator + val + "\n";
 
-	return safe_write(fd, str.c_str(), str.length());
+	return WriteBytes(str.c_str(), str.length());
+	}
+
+bool Ascii::WriteBytes(const char* data, size_t len)
+	{
+	if ( write_buffer_len + len > WRITE_BUFFER_SIZE && ! FlushBuffer() )
+		return false;
+
+	if ( ! write_buffer || len >= WRITE_BUFFER_SIZE )
+		{
+		// Unbuffered, or doesn't fit anyway.
+		if ( gzfile )
+			return gzwrite(gzfile, data, len) == int(len);
+
+		return safe_write(fd, data, len);
+		}
+
+	memcpy(write_buffer + write_buffer_len, data, len);
+	write_buffer_len += len;
+	return true;
+	}
+
+bool Ascii::FlushBuffer()
+	{
+	if ( ! write_buffer_len )
+		return true;
+
+	size_t len = write_buffer_len;
+	write_buffer_len = 0;
+
+	if ( gzfile )
+		return gzwrite(gzfile, write_buffer, len) == int(len);
+
+	return safe_write(fd, write_buffer, len);
+	}
+
+bool Ascii::SyncFile()
+	{
+	if ( ! FlushBuffer() )
+		return false;
+
+	// Push out what zlib has buffered, so that a reader sees complete
+	// lines; this costs some compression.
+	if ( gzfile && gzflush(gzfile, Z_SYNC_FLUSH) != Z_OK )
+		return false;
+
+	fsync(fd);
+	return true;
 	}
 
 void Ascii::CloseFile(double t)
@@ -203,7 +273,22 @@ void Ascii::CloseFile(double t)
 	if ( include_meta && ! tsv )
 		WriteHeaderField("close", Timestamp(0));
 
-	safe_close(fd);
+	FlushBuffer();
+
+	if ( gzfile )
+		{
+		// Also closes fd.
+		int rc = gzclose(gzfile);
+
+		if ( rc != Z_OK )
+			Error(Fmt("error closing %s: %s", fname.c_str(),
+				  rc == Z_ERRNO ? Strerror(errno) : zError(rc)));
+
+		gzfile = 0;
+		}
+	else
+		safe_close(fd);
+
 	fd = 0;
 	}
 
@@ -221,6 +306,9 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 
 	fname = IsSpecial(path) ? path : path + "." + LogExt();
 
+	if ( gzip_level > 0 && ! IsSpecial(path) )
+		fname += ".gz";
+
 	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
 
 	if ( fd < 0 )
@@ -231,6 +319,33 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 		return false;
 		}
 
+	// Special files, such as stdout, see output right away.
+	if ( ! write_buffer && ! IsSpecial(path) &&
+	     posix_memalign((void**) &write_buffer, 4096, WRITE_BUFFER_SIZE) != 0 )
+		{
+		Error("cannot allocate write buffer");
+		write_buffer = 0;
+		return false;
+		}
+
+	if ( gzip_level > 0 && ! IsSpecial(path) )
+		{
+		char mode[8];
+		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+
+		gzfile = gzdopen(fd, mode);
+
+		if ( ! gzfile )
+			{
+			Error(Fmt("cannot open %s for compression", fname.c_str()));
+			safe_close(fd);
+			fd = 0;
+			return false;
+			}
+
+		gzbuffer(gzfile, WRITE_BUFFER_SIZE);
+		}
+
 	if ( ! WriteHeader(path) )
 		{
 		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
@@ -264,7 +379,7 @@ bool Ascii::WriteHeader(const string& path)
 		{
 		// A single TSV-style line is all we need.
 		string str = names + "\n";
-		if ( ! safe_write(fd, str.c_str(), str.length()) )
+		if ( ! WriteBytes(str.c_str(), str.length()) )
 			return false;
 
 		return true;
@@ -275,7 +390,7 @@ bool Ascii::WriteHeader(const string& path)
 		+ get_escaped_string(separator, false)
 		+ "\n";
 
-	if ( ! safe_write(fd, str.c_str(), str.length()) )
+	if ( ! WriteBytes(str.c_str(), str.length()) )
 		return false;
 
 	if ( ! (WriteHeaderField("set_separator", get_escaped_string(set_separator, false)) &&
@@ -294,7 +409,12 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
-	fsync(fd);
+	if ( fd && ! SyncFile() )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
 	return true;
 	}
 
@@ -337,18 +457,18 @@ bool Ascii::DoWrite(int num_fields, const Field* const * fields,
 		char hex[4] = {'\\', 'x', '0', '0'};
 		bytetohex(bytes[0], hex + 2);
 
-		if ( ! safe_write(fd, hex, 4) )
+		if ( ! WriteBytes(hex, 4) )
 			goto write_error;
 
 		++bytes;
 		--len;
 		}
 
-	if ( ! safe_write(fd, bytes, len) )
+	if ( ! WriteBytes(bytes, len) )
 		goto write_error;
 
-        if ( ! IsBuf() )
-		fsync(fd);
+	if ( ! IsBuf() && ! SyncFile() )
+		goto write_error;
 
 	return true;
 
@@ -366,10 +486,15 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		return true;
 		}
 
+	// Closing finishes the compressed stream, so the rotated file is
+	// complete without a further pass over it.
 	CloseFile(close);
 
 	string nname = string(rotated_path) + "." + LogExt();
 
+	if ( gzip_level > 0 )
+		nname += ".gz";
+
 	if ( rename(fname.c_str(), nname.c_str()) != 0 )
 		{
 		char buf[256];
@@ -391,13 +516,24 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
 bool Ascii::DoSetBuf(bool enabled)
 	{
-	// Nothing to do.
+	if ( ! enabled && fd && ! SyncFile() )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
 	return true;
 	}
 
 bool Ascii::DoHeartbeat(double network_time, double current_time)
 	{
-	// Nothing to do.
+	// Don't keep buffered output around for long.
+	if ( fd && ! FlushBuffer() )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
 	return true;
 	}
 
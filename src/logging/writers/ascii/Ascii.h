@@ -5,6 +5,8 @@
 #ifndef LOGGING_WRITER_ASCII_H
 #define LOGGING_WRITER_ASCII_H
 
+#include <zlib.h>
+
 #include "logging/WriterBackend.h"
 #include "threading/formatters/Ascii.h"
 #include "threading/formatters/JSON.h"
@@ -37,6 +39,9 @@ private:
 	bool IsSpecial(string path) 	{ return path.find("/dev/") == 0; }
 	bool WriteHeader(const string& path);
 	bool WriteHeaderField(const string& key, const string& value);
+	bool WriteBytes(const char* data, size_t len);
+	bool FlushBuffer();
+	bool SyncFile();
 	void CloseFile(double t);
 	string Timestamp(double t); // Uses current time if t is zero.
 	void InitConfigOptions();
@@ -44,10 +49,17 @@ private:
 	bool InitFormatter();
 
 	int fd;
+	gzFile gzfile;	// Wraps fd if compressing.
 	string fname;
 	ODesc desc;
 	bool ascii_done;
 
+	// Output collects here until there's a full buffer to write,
+	// a flush, or a heartbeat.
+	static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+	char* write_buffer;
+	size_t write_buffer_len;
+
 	// Options set from the script-level.
 	bool output_to_stdout;
 	bool include_meta;
@@ -62,6 +74,8 @@ private:
 	bool use_json;
 	string json_timestamps;
 
+	int gzip_level;
+
 	threading::formatter::Formatter* formatter;
 	bool init_options;
 };
@@ -0,0 +1,241 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "threading/SerialTypes.h"
+
+#include "Columnar.h"
+#include "columnar.bif.h"
+
+using namespace logging::writer;
+using namespace threading;
+using threading::Value;
+using threading::Field;
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	fd = 0;
+	columnar_done = false;
+	codec = 0;
+
+	compression_level = BifConst::LogColumnar::compression_level;
+	row_group_size = BifConst::LogColumnar::row_group_size;
+	init_options = InitFilterOptions();
+	}
+
+Columnar::~Columnar()
+	{
+	if ( ! columnar_done )
+		// In case of errors aborting the logging altogether,
+		// DoFinish() may not have been called.
+		CloseFile();
+
+	delete codec;
+	}
+
+bool Columnar::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "compression_level") == 0 )
+			{
+			char* end;
+			long l = strtol(i->second, &end, 10);
+
+			if ( *end || l < 0 || l > 9 )
+				{
+				Error("invalid value for 'compression_level', must be a string holding a number between 0 and 9");
+				return false;
+				}
+
+			compression_level = l;
+			}
+
+		else if ( strcmp(i->first, "row_group_size") == 0 )
+			{
+			char* end;
+			long l = strtol(i->second, &end, 10);
+
+			if ( *end || l <= 0 || l > INT_MAX )
+				{
+				Error("invalid value for 'row_group_size', must be a string holding a positive number");
+				return false;
+				}
+
+			row_group_size = l;
+			}
+		}
+
+	if ( compression_level > 9 )
+		compression_level = 9;
+
+	if ( row_group_size <= 0 )
+		row_group_size = 1;
+
+	return true;
+	}
+
+bool Columnar::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
+	{
+	if ( ! init_options )
+		return false;
+
+	if ( ! codec )
+		codec = new formatter::Columnar(this, num_fields, fields);
+
+	return OpenFile();
+	}
+
+bool Columnar::OpenFile()
+	{
+	assert(! fd);
+
+	fname = string(Info().path) + "." + LogExt();
+
+	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s: %s", fname.c_str(),
+			  Strerror(errno)));
+		fd = 0;
+		return false;
+		}
+
+	buffer.clear();
+	formatter::Columnar::EncodeHeader(&buffer, NumFields(), Fields());
+
+	if ( ! safe_write(fd, buffer.data(), buffer.size()) )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::WriteRowGroup()
+	{
+	if ( ! codec->NumRecords() )
+		return true;
+
+	buffer.clear();
+
+	if ( ! codec->EncodeRowGroup(&buffer, compression_level) )
+		return false;
+
+	if ( ! safe_write(fd, buffer.data(), buffer.size()) )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
+	return true;
+	}
+
+void Columnar::CloseFile()
+	{
+	if ( ! fd )
+		return;
+
+	WriteRowGroup();
+	safe_close(fd);
+	fd = 0;
+	}
+
+bool Columnar::DoWrite(int num_fields, const Field* const * fields,
+			     Value** vals)
+	{
+	if ( ! fd && ! OpenFile() )
+		return false;
+
+	codec->AddRecord(vals);
+
+	// Without buffering, each record goes out right away as a row
+	// group of its own.
+	if ( codec->NumRecords() >= row_group_size || ! IsBuf() )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Columnar::DoFlush(double network_time)
+	{
+	if ( ! fd )
+		return true;
+
+	if ( ! WriteRowGroup() )
+		return false;
+
+	fsync(fd);
+	return true;
+	}
+
+bool Columnar::DoFinish(double network_time)
+	{
+	if ( columnar_done )
+		{
+		fprintf(stderr, "internal error: duplicate finish\n");
+		abort();
+		}
+
+	columnar_done = true;
+
+	CloseFile();
+
+	return true;
+	}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( ! fd )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	CloseFile();
+
+	string nname = string(rotated_path) + "." + LogExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::DoSetBuf(bool enabled)
+	{
+	if ( ! enabled && fd )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	// Nothing to do.
+	return true;
+	}
@@ -0,0 +1,58 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for column-oriented binary logs.
+
+#ifndef LOGGING_WRITER_COLUMNAR_H
+#define LOGGING_WRITER_COLUMNAR_H
+
+#include "logging/WriterBackend.h"
+#include "threading/formatters/Columnar.h"
+
+namespace logging { namespace writer {
+
+class Columnar : public WriterBackend {
+public:
+	Columnar(WriterFrontend* frontend);
+	~Columnar();
+
+	static string LogExt()	{ return "columnar"; }
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	virtual bool DoInit(const WriterInfo& info, int num_fields,
+			    const threading::Field* const* fields);
+	virtual bool DoWrite(int num_fields, const threading::Field* const* fields,
+			     threading::Value** vals);
+	virtual bool DoSetBuf(bool enabled);
+	virtual bool DoRotate(const char* rotated_path, double open,
+			      double close, bool terminating);
+	virtual bool DoFlush(double network_time);
+	virtual bool DoFinish(double network_time);
+	virtual bool DoHeartbeat(double network_time, double current_time);
+
+private:
+	bool InitFilterOptions();
+	bool OpenFile();
+	bool WriteRowGroup();
+	void CloseFile();
+
+	int fd;
+	string fname;
+	string buffer;
+	bool columnar_done;
+
+	threading::formatter::Columnar* codec;
+
+	// Options set from the script-level.
+	int compression_level;
+	int row_group_size;
+	bool init_options;
+};
+
+}
+}
+
+
+#endif
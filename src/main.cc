@@ -46,6 +46,9 @@ extern "C" void OPENSSL_add_all_algorithms_conf(void);
 #include "EventRegistry.h"
 #include "Stats.h"
 #include "Brofiler.h"
+#include "ScriptProfiler.h"
+#include "Bytecode.h"
+#include "ScriptOpt.h"
 
 #include "threading/Manager.h"
 #include "input/Manager.h"
@@ -95,6 +98,7 @@ analyzer::Manager* analyzer_mgr = 0;
 file_analysis::Manager* file_mgr = 0;
 broxygen::Manager* broxygen_mgr = 0;
 iosource::Manager* iosource_mgr = 0;
+ValManager* val_mgr = 0;
 #ifdef ENABLE_BROKER
 bro_broker::Manager* broker_mgr = 0;
 #endif
@@ -210,6 +214,12 @@ void usage()
 	fprintf(stderr, "    -X <file.bst>                  | print contents of state file as XML\n");
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
+	fprintf(stderr, "    --timer-wheel[=<resolution>]   | use a timing wheel with given resolution in seconds for timers (default 1)\n");
+	fprintf(stderr, "    --compile-scripts              | execute script functions as bytecode\n");
+	fprintf(stderr, "    --optimize-scripts             | fold constants, prune dead branches, and inline small functions\n");
+	fprintf(stderr, "    --dump-optimized-scripts       | same, and print the optimized function bodies\n");
+	fprintf(stderr, "    --profile-scripts <file>       | write a profile of script execution to file\n");
+	fprintf(stderr, "    --profile-scripts-interval <s> | rewrite the script profile every s seconds (default at exit only)\n");
 
 #ifdef USE_IDMEF
 	fprintf(stderr, "    -n|--idmef-dtd <idmef-msg.dtd> | specify path to IDMEF DTD file\n");
@@ -223,6 +233,8 @@ void usage()
 	fprintf(stderr, "    $BRO_SEED_FILE                 | file to load seeds from (not set)\n");
 	fprintf(stderr, "    $BRO_LOG_SUFFIX                | ASCII log file extension (.%s)\n", logging::writer::Ascii::LogExt().c_str());
 	fprintf(stderr, "    $BRO_PROFILER_FILE             | Output file for script execution statistics (not set)\n");
+	fprintf(stderr, "    $BRO_COMPILE_SCRIPTS           | same as --compile-scripts (%s)\n", getenv("BRO_COMPILE_SCRIPTS") ? "set" : "not set");
+	fprintf(stderr, "    $BRO_OPTIMIZE_SCRIPTS          | same as --optimize-scripts (%s)\n", getenv("BRO_OPTIMIZE_SCRIPTS") ? "set" : "not set");
 	fprintf(stderr, "    $BRO_DISABLE_BROXYGEN          | Disable Broxygen documentation support (%s)\n", getenv("BRO_DISABLE_BROXYGEN") ? "set" : "not set");
 
 	fprintf(stderr, "\n");
@@ -376,6 +388,13 @@ void terminate_bro()
 
 	mgr.Drain();
 
+	if ( script_profiler )
+		{
+		script_profiler->Dump();
+		delete script_profiler;
+		script_profiler = 0;
+		}
+
 	plugin_mgr->FinishPlugins();
 
 	delete broxygen_mgr;
@@ -465,6 +484,11 @@ int main(int argc, char** argv)
 	int do_watchdog = 0;
 	int override_ignore_checksums = 0;
 	int rule_debug = 0;
+	int compile_scripts = getenv("BRO_COMPILE_SCRIPTS") ? 1 : 0;
+	int optimize_scripts = getenv("BRO_OPTIMIZE_SCRIPTS") ? 1 : 0;
+	int dump_optimized = 0;
+	const char* script_profile_file = 0;
+	double script_profile_interval = 0;
 	int RE_level = 4;
 	int print_plugins = 0;
 	int time_bro = 0;
@@ -515,6 +539,12 @@ int main(int argc, char** argv)
 #endif
 
 		{"pseudo-realtime",	optional_argument, 0,	'E'},
+		{"timer-wheel",		optional_argument, 0,	'k'},
+		{"compile-scripts",	no_argument,		0,	'c'},
+		{"optimize-scripts",	no_argument,		0,	'j'},
+		{"dump-optimized-scripts",	no_argument,		0,	'Y'},
+		{"profile-scripts",	required_argument, 0,	'o'},
+		{"profile-scripts-interval",	required_argument, 0,	'O'},
 
 		{0,			0,			0,	0},
 	};
@@ -643,6 +673,36 @@ int main(int argc, char** argv)
 				pseudo_realtime = atof(optarg);
 			break;
 
+		case 'k':
+			timer_wheel_resolution = 1.0;
+			if ( optarg )
+				timer_wheel_resolution = atof(optarg);
+
+			if ( timer_wheel_resolution <= 0.0 )
+				usage();
+			break;
+
+		case 'c':
+			compile_scripts = 1;
+			break;
+
+		case 'j':
+			optimize_scripts = 1;
+			break;
+
+		case 'Y':
+			optimize_scripts = 1;
+			dump_optimized = 1;
+			break;
+
+		case 'o':
+			script_profile_file = optarg;
+			break;
+
+		case 'O':
+			script_profile_interval = atof(optarg);
+			break;
+
 		case 'F':
 			if ( dns_type != DNS_DEFAULT )
 				usage();
@@ -749,6 +809,7 @@ int main(int argc, char** argv)
 	bro_start_time = current_time(true);
 
 	reporter = new Reporter();
+	val_mgr = new ValManager();
 	thread_mgr = new threading::Manager();
 	plugin_mgr = new plugin::Manager();
 
@@ -786,7 +847,10 @@ int main(int argc, char** argv)
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr("<GLOBAL>");
+	if ( timer_wheel_resolution > 0.0 )
+		timer_mgr = new Wheel_TimerMgr("<GLOBAL>", timer_wheel_resolution);
+	else
+		timer_mgr = new PQ_TimerMgr("<GLOBAL>");
 	// timer_mgr = new CQ_TimerMgr();
 
 	broxygen_mgr = new broxygen::Manager(broxygen_config, bro_argv[0]);
@@ -970,6 +1034,14 @@ int main(int argc, char** argv)
 
 	delete [] script_rule_files;
 
+	// The debugger steps through statements as written, so it needs
+	// the AST unchanged.
+	if ( optimize_scripts && ! g_policy_debug )
+		optimize_script_functions(dump_optimized);
+
+	if ( compile_scripts && ! g_policy_debug )
+		compile_script_functions();
+
 	if ( g_policy_debug )
 		// ### Add support for debug command file.
 		dbg_init_debugger(0);
@@ -1081,6 +1153,10 @@ int main(int argc, char** argv)
 			segment_logger = profiling_logger;
 		}
 
+	if ( script_profile_file )
+		script_profiler = new ScriptProfiler(script_profile_file,
+						script_profile_interval);
+
 	if ( ! reading_live && ! reading_traces )
 		// Set up network_time to track real-time, since
 		// we don't have any other source for it.
@@ -1205,6 +1281,15 @@ int main(int argc, char** argv)
 				mem_net_done_malloced / 1024 / 1024,
 				(mem_net_done_total - mem_net_start_total) / 1024 / 1024,
 				(mem_net_done_malloced - mem_net_start_malloced) / 1024 / 1024);
+
+			fprintf(stderr, "# allocated vals");
+
+			for ( int i = 0; i < NUM_TYPES; ++i )
+				if ( Val::NumAllocations(TypeTag(i)) )
+					fprintf(stderr, " %s=%" PRIu64, type_name(TypeTag(i)),
+						Val::NumAllocations(TypeTag(i)));
+
+			fprintf(stderr, "\n");
 			}
 
 		done_with_network();
@@ -2,11 +2,19 @@
 #define THREADING_QUEUE_H
 
 #include <pthread.h>
-#include <queue>
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 #include <sys/time.h>
 
+#include "bro-config.h"
+
+#ifdef HAVE_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "Reporter.h"
 #include "BasicThread.h"
 
@@ -17,13 +25,16 @@ namespace threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * Elements pass through a fixed-size lock-free ring buffer. If the writer
+ * finds the ring full, it spills into a mutex-protected overflow list
+ * rather than blocking (the main thread is writer for one queue and
+ * reader for another, so blocking could deadlock); the reader drains the
+ * overflow once the ring is empty, which keeps elements in order.
  *
- * All Queue instances must be instantiated by Bro's main thread.
+ * An idle reader sleeps (on a futex where available) after announcing
+ * so; the writer only makes a system call to wake it up if it does.
  *
- * TODO: Unclear how critical performance is for this qeueue. We could like;y
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Bro's main thread.
  */
 template<typename T>
 class Queue
@@ -69,7 +80,11 @@ public:
 	 * it is empty. In other words, this method helps to avoid locking the queue
 	 * frequently, but doesn't allow you to forgo it completely.
 	 */
-	bool MaybeReady() { return (num_reads != num_writes); }
+	bool MaybeReady()
+		{
+		return num_reads.load(std::memory_order_relaxed) !=
+			num_writes.load(std::memory_order_relaxed);
+		}
 
 	/** Wake up the reader if it's currently blocked for input. This is
 	 primarily to give it a chance to check termination quickly.
@@ -88,6 +103,9 @@ public:
 		{
 		uint64_t num_reads;	//! Number of messages read from the queue.
 		uint64_t num_writes;	//! Number of messages written to the queue.
+		uint64_t max_depth;	//! Largest number of messages queued at a time.
+		uint64_t num_stalls;	//! Number of writes finding the ring full.
+		uint64_t num_wakeups;	//! Number of writes waking up an idle reader.
 		};
 
 	/**
@@ -98,21 +116,67 @@ public:
 	void GetStats(Stats* stats);
 
 private:
-	static const int NUM_QUEUES = 8;
+	static const uint64_t RING_SIZE = 1024;	// Must be a power of two.
+	static const int CACHE_LINE = 64;
+	static const int SPIN_COUNT = 64;
 
-	pthread_mutex_t mutex[NUM_QUEUES];	// Mutex protected shared accesses.
-	pthread_cond_t has_data[NUM_QUEUES];	// Signals when data becomes available
-	std::queue<T> messages[NUM_QUEUES];	// Actually holds the queued messages
+	// Removes the next element, if any, without blocking.
+	bool Pop(T* data);
 
-	int read_ptr;	// Where the next operation will read from
-	int write_ptr;	// Where the next operation will write to
+	// Blocks until a writer signals a change of the wake-up counter
+	// from the given value, or until a timeout.
+	void Sleep(uint32_t seq);
+
+	// Wakes up a sleeping reader.
+	void Wake();
+
+	// Bumps a counter that only one side ever modifies; that doesn't
+	// need an atomic read-modify-write.
+	static void Increment(std::atomic<uint64_t>* counter)
+		{
+		counter->store(counter->load(std::memory_order_relaxed) + 1,
+			       std::memory_order_relaxed);
+		}
+
+	// Records the given number of queued elements if it's a new maximum.
+	void UpdateMaxDepth(uint64_t depth);
+
+	T ring[RING_SIZE];
+
+	// The padding keeps what the reader and the writer modify on
+	// separate cache lines.
+	char pad0[CACHE_LINE];
+
+	// Reader side.
+	std::atomic<uint64_t> head;	// Next slot to read.
+	uint64_t cached_tail;	// Reader's view of tail.
+	std::atomic<uint64_t> num_reads;
+	char pad1[CACHE_LINE];
+
+	// Writer side.
+	std::atomic<uint64_t> tail;	// Next slot to write.
+	uint64_t cached_head;	// Writer's view of head.
+	std::atomic<uint64_t> num_writes;
+	std::atomic<uint64_t> num_stalls;
+	std::atomic<uint64_t> num_wakeups;
+	char pad2[CACHE_LINE];
+
+	// Shared between both.
+	std::atomic<uint32_t> waiting;	// Reader is (about to go) asleep.
+	std::atomic<uint32_t> wake_seq;	// Bumped for each wake-up.
+	std::atomic<uint64_t> max_depth;
+
+	pthread_mutex_t overflow_mutex;	// Protects overflow.
+	std::deque<T> overflow;	// Elements not fitting into the ring.
+	std::atomic<uint64_t> overflow_size;
+
+#ifndef HAVE_LINUX
+	pthread_mutex_t wake_mutex;
+	pthread_cond_t wake_cond;
+#endif
 
 	BasicThread* reader;
 	BasicThread* writer;
-
-	// Statistics.
-	uint64_t num_reads;
-	uint64_t num_writes;
 };
 
 inline static void safe_lock(pthread_mutex_t* mutex)
@@ -130,147 +194,249 @@ inline static void safe_unlock(pthread_mutex_t* mutex)
 
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+	: head(0), num_reads(0), tail(0), num_writes(0), num_stalls(0),
+	  num_wakeups(0), waiting(0), wake_seq(0), max_depth(0),
+	  overflow_size(0)
 	{
-	read_ptr = 0;
-	write_ptr = 0;
-	num_reads = num_writes = 0;
+	cached_tail = cached_head = 0;
 	reader = arg_reader;
 	writer = arg_writer;
 
-	for( int i = 0; i < NUM_QUEUES; ++i )
-		{
-		if ( pthread_cond_init(&has_data[i], 0) != 0 )
-			reporter->FatalError("cannot init queue condition variable");
+	if ( pthread_mutex_init(&overflow_mutex, 0) != 0 )
+		reporter->FatalError("cannot init queue mutex");
 
-		if ( pthread_mutex_init(&mutex[i], 0) != 0 )
-			reporter->FatalError("cannot init queue mutex");
-		}
+#ifndef HAVE_LINUX
+	if ( pthread_cond_init(&wake_cond, 0) != 0 )
+		reporter->FatalError("cannot init queue condition variable");
+
+	if ( pthread_mutex_init(&wake_mutex, 0) != 0 )
+		reporter->FatalError("cannot init queue mutex");
+#endif
 	}
 
 template<typename T>
 inline Queue<T>::~Queue()
 	{
-	for( int i = 0; i < NUM_QUEUES; ++i )
+	pthread_mutex_destroy(&overflow_mutex);
+
+#ifndef HAVE_LINUX
+	pthread_cond_destroy(&wake_cond);
+	pthread_mutex_destroy(&wake_mutex);
+#endif
+	}
+
+template<typename T>
+inline bool Queue<T>::Pop(T* data)
+	{
+	uint64_t h = head.load(std::memory_order_relaxed);
+
+	if ( h == cached_tail )
 		{
-		pthread_cond_destroy(&has_data[i]);
-		pthread_mutex_destroy(&mutex[i]);
+		// Look at the overflow before refreshing our view of the
+		// ring: anything that went into the ring before the
+		// overflow's current content is then visible, too.
+		uint64_t ov = overflow_size.load(std::memory_order_acquire);
+		cached_tail = tail.load(std::memory_order_acquire);
+
+		// This is when we catch up with the writer, so the backlog
+		// is a good sample of the queue's depth.
+		UpdateMaxDepth(cached_tail - h + ov);
+
+		if ( h == cached_tail )
+			{
+			if ( ov == 0 )
+				return false;
+
+			safe_lock(&overflow_mutex);
+			*data = overflow.front();
+			overflow.pop_front();
+			overflow_size.fetch_sub(1, std::memory_order_release);
+			safe_unlock(&overflow_mutex);
+
+			Increment(&num_reads);
+			return true;
+			}
 		}
+
+	*data = ring[h & (RING_SIZE - 1)];
+	head.store(h + 1, std::memory_order_release);
+	Increment(&num_reads);
+	return true;
 	}
 
 template<typename T>
 inline T Queue<T>::Get()
 	{
-	safe_lock(&mutex[read_ptr]);
-
-	int old_read_ptr = read_ptr;
+	T data;
 
-	if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+	// Spin briefly before going to sleep, the writer is often just
+	// about to put the next element.
+	for ( int i = 0; i < SPIN_COUNT; ++i )
 		{
-		struct timespec ts;
-		ts.tv_sec = time(0) + 5;
-		ts.tv_nsec = 0;
-
-		pthread_cond_timedwait(&has_data[read_ptr], &mutex[read_ptr], &ts);
-		safe_unlock(&mutex[read_ptr]);
-		return 0;
+		if ( Pop(&data) )
+			return data;
 		}
 
-	else if ( messages[read_ptr].empty() )
-		{
-		safe_unlock(&mutex[read_ptr]);
+	if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
 		return 0;
-		}
 
-	T data = messages[read_ptr].front();
-	messages[read_ptr].pop();
+	// Tell the writer we're going to sleep, then check once more so
+	// that we can't miss an element put in the meantime.
+	uint32_t seq = wake_seq.load(std::memory_order_acquire);
+	waiting.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
 
-	read_ptr = (read_ptr + 1) % NUM_QUEUES;
-	++num_reads;
+	if ( Pop(&data) )
+		{
+		waiting.store(0, std::memory_order_relaxed);
+		return data;
+		}
 
-	safe_unlock(&mutex[old_read_ptr]);
+	Sleep(seq);
+	waiting.store(0, std::memory_order_relaxed);
 
-	return data;
+	return 0;
 	}
 
 template<typename T>
 inline void Queue<T>::Put(T data)
 	{
-	safe_lock(&mutex[write_ptr]);
+	uint64_t t = tail.load(std::memory_order_relaxed);
 
-	int old_write_ptr = write_ptr;
+	// Only we ever add to the overflow, so if it's empty now it stays
+	// so until we put something there.
+	bool use_ring = (overflow_size.load(std::memory_order_acquire) == 0);
 
-	bool need_signal = messages[write_ptr].empty();
+	if ( use_ring && t - cached_head >= RING_SIZE )
+		{
+		cached_head = head.load(std::memory_order_acquire);
 
-	messages[write_ptr].push(data);
+		if ( t - cached_head >= RING_SIZE )
+			{
+			Increment(&num_stalls);
+			use_ring = false;
+			}
+		}
 
-	if ( need_signal )
-		pthread_cond_signal(&has_data[write_ptr]);
+	if ( use_ring )
+		{
+		ring[t & (RING_SIZE - 1)] = data;
+		tail.store(t + 1, std::memory_order_release);
+		}
 
-	write_ptr = (write_ptr + 1) % NUM_QUEUES;
-	++num_writes;
+	else
+		{
+		safe_lock(&overflow_mutex);
+		overflow.push_back(data);
+		uint64_t ov = overflow_size.fetch_add(1, std::memory_order_release) + 1;
+		safe_unlock(&overflow_mutex);
+
+		// The ring needn't be full anymore: the reader may have
+		// made room in it while we keep queuing up behind the
+		// overflow.
+		UpdateMaxDepth(t - head.load(std::memory_order_acquire) + ov);
+		}
 
-	safe_unlock(&mutex[old_write_ptr]);
-	}
+	Increment(&num_writes);
 
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// Only the first write after the reader went idle wakes it up.
+	if ( waiting.load(std::memory_order_relaxed) &&
+	     waiting.exchange(0, std::memory_order_relaxed) )
+		{
+		Increment(&num_wakeups);
+		Wake();
+		}
+	}
 
 template<typename T>
-inline bool Queue<T>::Ready()
+inline void Queue<T>::Sleep(uint32_t seq)
 	{
-	safe_lock(&mutex[read_ptr]);
+#ifdef HAVE_LINUX
+	struct timespec ts;
+	ts.tv_sec = 5;
+	ts.tv_nsec = 0;
+
+	// Returns right away if wake_seq isn't seq anymore.
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_seq),
+		FUTEX_WAIT_PRIVATE, seq, &ts, 0, 0);
+#else
+	struct timespec ts;
+	ts.tv_sec = time(0) + 5;
+	ts.tv_nsec = 0;
 
-	bool ret = (messages[read_ptr].size());
+	safe_lock(&wake_mutex);
 
-	safe_unlock(&mutex[read_ptr]);
+	if ( wake_seq.load(std::memory_order_acquire) == seq )
+		pthread_cond_timedwait(&wake_cond, &wake_mutex, &ts);
 
-	return ret;
+	safe_unlock(&wake_mutex);
+#endif
 	}
 
 template<typename T>
-inline uint64_t Queue<T>::Size()
+inline void Queue<T>::Wake()
 	{
-	// Need to lock all queues.
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		safe_lock(&mutex[i]);
-
-	uint64_t size = 0;
+#ifdef HAVE_LINUX
+	wake_seq.fetch_add(1, std::memory_order_release);
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&wake_seq),
+		FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+#else
+	safe_lock(&wake_mutex);
+	wake_seq.fetch_add(1, std::memory_order_release);
+	pthread_cond_signal(&wake_cond);
+	safe_unlock(&wake_mutex);
+#endif
+	}
 
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		size += messages[i].size();
+template<typename T>
+inline void Queue<T>::UpdateMaxDepth(uint64_t depth)
+	{
+	uint64_t max = max_depth.load(std::memory_order_relaxed);
 
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		safe_unlock(&mutex[i]);
+	while ( depth > max &&
+		! max_depth.compare_exchange_weak(max, depth,
+						  std::memory_order_relaxed) )
+		;
+	}
 
-	return size;
+template<typename T>
+inline bool Queue<T>::Ready()
+	{
+	return head.load(std::memory_order_relaxed) !=
+			tail.load(std::memory_order_acquire) ||
+		overflow_size.load(std::memory_order_acquire) > 0;
 	}
 
 template<typename T>
-inline void Queue<T>::GetStats(Stats* stats)
+inline uint64_t Queue<T>::Size()
 	{
-	// To be safe, we look all queues. That's probably unneccessary, but
-	// doesn't really hurt.
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		safe_lock(&mutex[i]);
+	// Load head first so that a concurrent read can't make us
+	// underflow.
+	uint64_t h = head.load(std::memory_order_acquire);
+	uint64_t t = tail.load(std::memory_order_acquire);
 
-	stats->num_reads = num_reads;
-	stats->num_writes = num_writes;
+	return (t - h) + overflow_size.load(std::memory_order_acquire);
+	}
 
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		safe_unlock(&mutex[i]);
+template<typename T>
+inline void Queue<T>::GetStats(Stats* stats)
+	{
+	stats->num_reads = num_reads.load(std::memory_order_relaxed);
+	stats->num_writes = num_writes.load(std::memory_order_relaxed);
+	stats->max_depth = max_depth.load(std::memory_order_relaxed);
+	stats->num_stalls = num_stalls.load(std::memory_order_relaxed);
+	stats->num_wakeups = num_wakeups.load(std::memory_order_relaxed);
 	}
 
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		{
-		safe_lock(&mutex[i]);
-		pthread_cond_signal(&has_data[i]);
-		safe_unlock(&mutex[i]);
-		}
+	Wake();
 	}
 
 }
 
 
 #endif
-
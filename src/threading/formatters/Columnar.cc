@@ -0,0 +1,715 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "bro-config.h"
+
+#include <zlib.h>
+
+#include "./Columnar.h"
+#include "../MsgThread.h"
+
+using namespace threading::formatter;
+using threading::Value;
+using threading::Field;
+
+const char Columnar::MAGIC[8] = { 'B', 'R', 'O', 'C', 'O', 'L', '\0', '\1' };
+
+// Version of the header layout.
+static const uint8 HEADER_VERSION = 1;
+
+enum RowGroupCodec { CODEC_NONE = 0, CODEC_ZLIB = 1 };
+
+// Bytes in front of a row group's payload: total length, number of
+// records, codec, uncompressed length.
+static const int ROW_GROUP_PREFIX = 4 + 4 + 1 + 4;
+
+static inline void put_u8(string* s, uint8 v)
+	{
+	s->push_back(char(v));
+	}
+
+static inline void put_u32(string* s, uint32 v)
+	{
+	char b[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+	s->append(b, 4);
+	}
+
+static inline void put_u64(string* s, uint64 v)
+	{
+	put_u32(s, uint32(v));
+	put_u32(s, uint32(v >> 32));
+	}
+
+static inline void put_double(string* s, double d)
+	{
+	uint64 v;
+	memcpy(&v, &d, sizeof(v));
+	put_u64(s, v);
+	}
+
+static inline uint32 get_u32(const char* p)
+	{
+	const u_char* u = (const u_char*) p;
+	return uint32(u[0]) | (uint32(u[1]) << 8) |
+	       (uint32(u[2]) << 16) | (uint32(u[3]) << 24);
+	}
+
+static inline uint64 get_u64(const char* p)
+	{
+	return uint64(get_u32(p)) | (uint64(get_u32(p + 4)) << 32);
+	}
+
+static inline double get_double(const char* p)
+	{
+	uint64 v = get_u64(p);
+	double d;
+	memcpy(&d, &v, sizeof(d));
+	return d;
+	}
+
+static const u_char v4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+static void put_addr(string* s, const Value::addr_t& a)
+	{
+	if ( a.family == IPv4 )
+		{
+		s->append((const char*) v4_mapped_prefix, sizeof(v4_mapped_prefix));
+		s->append((const char*) &a.in.in4, 4);
+		}
+	else
+		s->append((const char*) &a.in.in6, 16);
+	}
+
+static void get_addr(const char* p, Value::addr_t* a)
+	{
+	if ( memcmp(p, v4_mapped_prefix, sizeof(v4_mapped_prefix)) == 0 )
+		{
+		a->family = IPv4;
+		memcpy(&a->in.in4, p + sizeof(v4_mapped_prefix), 4);
+		}
+	else
+		{
+		a->family = IPv6;
+		memcpy(&a->in.in6, p, 16);
+		}
+	}
+
+// Returns the number of bytes a value of the given type occupies in a
+// column's data array, or zero if the type isn't stored at fixed width.
+static int fixed_width(TypeTag type)
+	{
+	switch ( type ) {
+	case TYPE_BOOL:
+		return 1;
+
+	case TYPE_PORT:
+		return 4;
+
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return 8;
+
+	case TYPE_ADDR:
+		return 16;
+
+	case TYPE_SUBNET:
+		return 17;
+
+	default:
+		return 0;
+	}
+	}
+
+static bool is_string_type(TypeTag type)
+	{
+	return type == TYPE_STRING || type == TYPE_ENUM ||
+	       type == TYPE_FILE || type == TYPE_FUNC;
+	}
+
+static bool is_container_type(TypeTag type)
+	{
+	return type == TYPE_TABLE || type == TYPE_VECTOR;
+	}
+
+// Buffers the values of one field while a row group is being built.
+class Columnar::Column {
+public:
+	Column(TypeTag arg_type, TypeTag arg_subtype)
+		: type(arg_type), rows(0), elements(0)
+		{
+		if ( is_container_type(type) )
+			elements = new Column(arg_subtype, TYPE_ERROR);
+		}
+
+	~Column()	{ delete elements; }
+
+	void Add(const Value* v);
+
+	// Appends the column to the buffer and clears it.
+	void Encode(string* out);
+
+private:
+	TypeTag type;
+	int rows;
+
+	string present;	// bitmap of rows with a value
+	string data;	// fixed-width values, string end offsets, or
+			// container sizes
+	string blob;	// string contents
+	Column* elements;	// container elements
+};
+
+void Columnar::Column::Add(const Value* v)
+	{
+	if ( rows % 8 == 0 )
+		present.push_back(0);
+
+	int row = rows++;
+
+	if ( ! v->present )
+		return;
+
+	present[row / 8] |= (1 << (row % 8));
+
+	switch ( type ) {
+	case TYPE_BOOL:
+		put_u8(&data, v->val.int_val ? 1 : 0);
+		break;
+
+	case TYPE_INT:
+		put_u64(&data, uint64(v->val.int_val));
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		put_u64(&data, v->val.uint_val);
+		break;
+
+	case TYPE_PORT:
+		put_u32(&data, (uint32(v->val.port_val.proto) << 16) |
+				(v->val.port_val.port & 0xffff));
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		put_double(&data, v->val.double_val);
+		break;
+
+	case TYPE_ADDR:
+		put_addr(&data, v->val.addr_val);
+		break;
+
+	case TYPE_SUBNET:
+		put_addr(&data, v->val.subnet_val.prefix);
+		put_u8(&data, v->val.subnet_val.length);
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		blob.append(v->val.string_val.data, v->val.string_val.length);
+		put_u32(&data, blob.size());
+		break;
+
+	case TYPE_TABLE:
+		put_u32(&data, v->val.set_val.size);
+
+		for ( int i = 0; i < v->val.set_val.size; ++i )
+			elements->Add(v->val.set_val.vals[i]);
+		break;
+
+	case TYPE_VECTOR:
+		put_u32(&data, v->val.vector_val.size);
+
+		for ( int i = 0; i < v->val.vector_val.size; ++i )
+			elements->Add(v->val.vector_val.vals[i]);
+		break;
+
+	default:
+		// Logging doesn't allow other types, and the header
+		// tells a reader what's there.
+		break;
+	}
+	}
+
+void Columnar::Column::Encode(string* out)
+	{
+	size_t start = out->size();
+	put_u32(out, 0);	// length, filled in below
+
+	out->append(present);
+	out->append(data);
+	out->append(blob);
+
+	if ( elements )
+		elements->Encode(out);
+
+	uint32 len = out->size() - start - 4;
+	string l;
+	put_u32(&l, len);
+	out->replace(start, 4, l);
+
+	rows = 0;
+	present.clear();
+	data.clear();
+	blob.clear();
+	}
+
+static void delete_values(vector<Value*>* vals, size_t from)
+	{
+	for ( size_t i = from; i < vals->size(); ++i )
+		delete (*vals)[i];
+
+	vals->resize(from);
+	}
+
+static int count_present(const char* bitmap, int rows)
+	{
+	int n = 0;
+
+	for ( int i = 0; i < rows; ++i )
+		if ( bitmap[i / 8] & (1 << (i % 8)) )
+			++n;
+
+	return n;
+	}
+
+// Decodes a column of the given number of rows starting at p, which
+// must point to its length.  Advances p past the column.  Returns false
+// if the data is inconsistent, in which case vals remains unchanged.
+static bool decode_column(const char*& p, const char* end, TypeTag type,
+			  TypeTag subtype, int rows, vector<Value*>* vals)
+	{
+	size_t first = vals->size();
+
+	if ( end - p < 4 )
+		return false;
+
+	uint32 len = get_u32(p);
+	p += 4;
+
+	if ( uint32(end - p) < len )
+		return false;
+
+	const char* cend = p + len;
+	const char* bitmap = p;
+	int bitmap_len = (rows + 7) / 8;
+
+	if ( cend - p < bitmap_len )
+		return false;
+
+	p += bitmap_len;
+
+	int num_present = count_present(bitmap, rows);
+	int width = fixed_width(type);
+
+	if ( is_string_type(type) || is_container_type(type) )
+		width = 4;
+
+	if ( width == 0 || (cend - p) / width < num_present )
+		return false;
+
+	const char* d = p;
+	p += num_present * width;
+
+	const char* blob = p;
+	uint32 blob_len = 0;
+
+	if ( is_string_type(type) && num_present > 0 )
+		{
+		blob_len = get_u32(d + (num_present - 1) * 4);
+
+		if ( uint32(cend - p) < blob_len )
+			return false;
+
+		p += blob_len;
+		}
+
+	vector<Value*> elements;
+
+	if ( is_container_type(type) )
+		{
+		uint64 total = 0;
+
+		for ( int i = 0; i < num_present; ++i )
+			total += get_u32(d + i * 4);
+
+		// Every element takes at least a bit in the bitmap.
+		if ( total > uint64(cend - p) * 8 )
+			return false;
+
+		if ( ! decode_column(p, cend, subtype, TYPE_ERROR, total,
+				     &elements) )
+			return false;
+		}
+
+	if ( p != cend )
+		{
+		delete_values(&elements, 0);
+		return false;
+		}
+
+	uint32 offset = 0;
+	size_t next_element = 0;
+
+	for ( int i = 0; i < rows; ++i )
+		{
+		if ( ! (bitmap[i / 8] & (1 << (i % 8))) )
+			{
+			vals->push_back(new Value(type, false));
+			continue;
+			}
+
+		Value* v = new Value(type, true);
+
+		switch ( type ) {
+		case TYPE_BOOL:
+			v->val.int_val = *d ? 1 : 0;
+			break;
+
+		case TYPE_INT:
+			v->val.int_val = bro_int_t(get_u64(d));
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_COUNTER:
+			v->val.uint_val = get_u64(d);
+			break;
+
+		case TYPE_PORT:
+			{
+			uint32 pp = get_u32(d);
+			v->val.port_val.port = pp & 0xffff;
+			v->val.port_val.proto = TransportProto(pp >> 16);
+			break;
+			}
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			v->val.double_val = get_double(d);
+			break;
+
+		case TYPE_ADDR:
+			get_addr(d, &v->val.addr_val);
+			break;
+
+		case TYPE_SUBNET:
+			get_addr(d, &v->val.subnet_val.prefix);
+			v->val.subnet_val.length = uint8(d[16]);
+			break;
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			{
+			uint32 end_offset = get_u32(d);
+
+			if ( end_offset < offset || end_offset > blob_len )
+				{
+				v->present = false;
+				delete v;
+				delete_values(vals, first);
+				return false;
+				}
+
+			int n = end_offset - offset;
+			v->val.string_val.data = new char[n];
+			v->val.string_val.length = n;
+			memcpy(v->val.string_val.data, blob + offset, n);
+			offset = end_offset;
+			break;
+			}
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			int n = get_u32(d);
+			Value** e = new Value*[n];
+
+			for ( int j = 0; j < n; ++j )
+				e[j] = elements[next_element++];
+
+			// set_t and vec_t are the same.
+			v->val.set_val.size = n;
+			v->val.set_val.vals = e;
+			break;
+			}
+
+		default:
+			break;
+		}
+
+		d += width;
+		vals->push_back(v);
+		}
+
+	return true;
+	}
+
+Columnar::Columnar(threading::MsgThread* t, int arg_num_fields,
+		   const threading::Field* const* arg_fields)
+	{
+	thread = t;
+	num_fields = arg_num_fields;
+	fields = arg_fields;
+	num_records = 0;
+
+	for ( int i = 0; i < num_fields; ++i )
+		columns.push_back(new Column(fields[i]->type, fields[i]->subtype));
+	}
+
+Columnar::~Columnar()
+	{
+	for ( size_t i = 0; i < columns.size(); ++i )
+		delete columns[i];
+	}
+
+void Columnar::AddRecord(threading::Value** vals)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		columns[i]->Add(vals[i]);
+
+	++num_records;
+	}
+
+bool Columnar::EncodeRowGroup(string* out, int compression_level)
+	{
+	string raw;
+
+	for ( int i = 0; i < num_fields; ++i )
+		columns[i]->Encode(&raw);
+
+	string payload;
+	uint8 codec = CODEC_NONE;
+
+	if ( compression_level > 0 )
+		{
+		uLongf n = compressBound(raw.size());
+		payload.resize(n);
+
+		int rc = compress2((Bytef*) &payload[0], &n,
+				   (const Bytef*) raw.data(), raw.size(),
+				   compression_level > 9 ? 9 : compression_level);
+
+		if ( rc != Z_OK )
+			{
+			thread->Error(thread->Fmt("zlib compression failed: %s",
+						  zError(rc)));
+			num_records = 0;
+			return false;
+			}
+
+		payload.resize(n);
+		codec = CODEC_ZLIB;
+		}
+	else
+		payload.swap(raw);
+
+	put_u32(out, ROW_GROUP_PREFIX - 4 + payload.size());
+	put_u32(out, num_records);
+	put_u8(out, codec);
+	put_u32(out, codec == CODEC_NONE ? payload.size() : raw.size());
+	out->append(payload);
+
+	num_records = 0;
+	return true;
+	}
+
+void Columnar::EncodeHeader(string* out, int num_fields,
+			    const threading::Field* const* fields)
+	{
+	string h;
+	put_u8(&h, HEADER_VERSION);
+	put_u32(&h, num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const Field* f = fields[i];
+		put_u32(&h, strlen(f->name));
+		h.append(f->name);
+		put_u8(&h, f->type);
+		put_u8(&h, f->subtype);
+		put_u8(&h, f->optional ? 1 : 0);
+		}
+
+	out->append(MAGIC, sizeof(MAGIC));
+	put_u32(out, h.size());
+	out->append(h);
+	}
+
+int Columnar::DecodeHeader(const char* data, int len,
+			   vector<threading::Field*>* fields)
+	{
+	int prefix = sizeof(MAGIC) + 4;
+
+	if ( len < prefix )
+		{
+		int n = len < int(sizeof(MAGIC)) ? len : sizeof(MAGIC);
+		return memcmp(data, MAGIC, n) == 0 ? 0 : -1;
+		}
+
+	if ( memcmp(data, MAGIC, sizeof(MAGIC)) != 0 )
+		return -1;
+
+	uint32 hlen = get_u32(data + sizeof(MAGIC));
+
+	if ( hlen > uint32(len - prefix) )
+		return 0;
+
+	const char* p = data + prefix;
+	const char* end = p + hlen;
+
+	if ( end - p < 5 || uint8(*p) != HEADER_VERSION )
+		return -1;
+
+	uint32 n = get_u32(p + 1);
+	p += 5;
+
+	vector<Field*> f;
+
+	for ( uint32 i = 0; i < n; ++i )
+		{
+		if ( end - p < 4 )
+			break;
+
+		uint32 name_len = get_u32(p);
+		p += 4;
+
+		if ( uint32(end - p) < name_len + 3 )
+			break;
+
+		string name(p, name_len);
+		p += name_len;
+
+		TypeTag type = TypeTag(uint8(p[0]));
+		TypeTag subtype = TypeTag(uint8(p[1]));
+		bool optional = p[2] != 0;
+		p += 3;
+
+		f.push_back(new Field(name.c_str(), 0, type, subtype, optional));
+		}
+
+	if ( f.size() != n || p != end )
+		{
+		for ( size_t i = 0; i < f.size(); ++i )
+			delete f[i];
+
+		return -1;
+		}
+
+	fields->insert(fields->end(), f.begin(), f.end());
+	return prefix + hlen;
+	}
+
+int Columnar::RowGroupSize(const char* data, int len)
+	{
+	if ( len < 4 )
+		return 0;
+
+	return 4 + get_u32(data);
+	}
+
+bool Columnar::DecodeRowGroup(const char* data, int len,
+			      const vector<int>& columns,
+			      vector<threading::Value**>* records) const
+	{
+	if ( len < ROW_GROUP_PREFIX || RowGroupSize(data, len) != len )
+		return false;
+
+	int n = get_u32(data + 4);
+	uint8 codec = uint8(data[8]);
+	uint32 raw_len = get_u32(data + 9);
+
+	const char* payload = data + ROW_GROUP_PREFIX;
+	uint32 payload_len = len - ROW_GROUP_PREFIX;
+
+	string raw;
+
+	if ( codec == CODEC_ZLIB )
+		{
+		// Deflate can't compress better than about 1:1032, so
+		// anything claiming more is corrupt.
+		if ( raw_len / 1032 > payload_len )
+			return false;
+
+		raw.resize(raw_len);
+		uLongf rlen = raw_len;
+
+		if ( uncompress((Bytef*) &raw[0], &rlen, (const Bytef*) payload,
+				payload_len) != Z_OK || rlen != raw_len )
+			return false;
+		}
+
+	else if ( codec == CODEC_NONE && raw_len == payload_len )
+		raw.assign(payload, payload_len);
+
+	else
+		return false;
+
+	// Every record takes at least a bit per column.
+	if ( n < 0 || uint64(n) > uint64(raw.size()) * 8 )
+		return false;
+
+	// Decode the columns we need and skip over the others.
+	vector<int> wanted(num_fields, 0);
+
+	for ( size_t i = 0; i < columns.size(); ++i )
+		{
+		int c = columns[i];
+
+		if ( c < 0 )
+			continue;
+
+		if ( c >= num_fields || wanted[c] )
+			return false;
+
+		wanted[c] = 1;
+		}
+
+	vector<vector<Value*> > vals(num_fields);
+	const char* p = raw.data();
+	const char* end = p + raw.size();
+	bool ok = true;
+
+	for ( int i = 0; i < num_fields && ok; ++i )
+		{
+		if ( wanted[i] )
+			{
+			ok = decode_column(p, end, fields[i]->type,
+					   fields[i]->subtype, n, &vals[i]);
+			continue;
+			}
+
+		if ( end - p < 4 || uint32(end - p - 4) < get_u32(p) )
+			ok = false;
+		else
+			p += 4 + get_u32(p);
+		}
+
+	if ( ! ok || p != end )
+		{
+		for ( int i = 0; i < num_fields; ++i )
+			delete_values(&vals[i], 0);
+
+		return false;
+		}
+
+	for ( int r = 0; r < n; ++r )
+		{
+		Value** rec = new Value*[columns.size()];
+
+		for ( size_t i = 0; i < columns.size(); ++i )
+			rec[i] = columns[i] >= 0 ? vals[columns[i]][r] : 0;
+
+		records->push_back(rec);
+		}
+
+	return true;
+	}
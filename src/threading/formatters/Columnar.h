@@ -0,0 +1,150 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#ifndef THREADING_FORMATTERS_COLUMNAR_H
+#define THREADING_FORMATTERS_COLUMNAR_H
+
+#include <string>
+#include <vector>
+
+#include "../SerialTypes.h"
+
+namespace threading { class MsgThread; }
+
+namespace threading { namespace formatter {
+
+/**
+ * A thread-safe codec for the column-oriented binary log format that the
+ * Columnar log writer produces and the Columnar input reader consumes.
+ *
+ * A file starts with an 8-byte magic, followed by a header block listing
+ * the fields (name, type tag, inner type tag, optional flag).  After that
+ * come any number of row groups.  Each row group stores its records
+ * column by column, optionally compressed with zlib:
+ *
+ *   - every column begins with its length and a bitmap of the rows that
+ *     have a value;
+ *   - counts, ints, bools, doubles, times, and intervals are 8-byte
+ *     little-endian values, ports are 4 bytes (protocol and number),
+ *     addresses are 16 bytes (IPv4 mapped into IPv6), and subnets are an
+ *     address plus a length byte;
+ *   - strings, enums, files, and functions are an array of end offsets
+ *     followed by the concatenated bytes;
+ *   - sets and vectors are an array of element counts followed by a
+ *     nested column holding all their elements.
+ *
+ * Only rows with a value occupy space in the arrays.  All blocks are
+ * prefixed with their length, so that a reader can skip columns it
+ * doesn't need and recognize a row group that's still being written.
+ */
+class Columnar {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param t The thread that uses this codec; used for reporting
+	 * errors.
+	 *
+	 * @param num_fields The number of fields per record.
+	 *
+	 * @param fields The fields. The codec keeps a reference to the
+	 * array, so it must stay valid for its lifetime.
+	 */
+	Columnar(threading::MsgThread* t, int num_fields,
+		 const threading::Field* const* fields);
+	~Columnar();
+
+	/**
+	 * Appends a record to the current row group. Doesn't take ownership
+	 * of the values.
+	 */
+	void AddRecord(threading::Value** vals);
+
+	/**
+	 * Returns the number of records in the current row group.
+	 */
+	int NumRecords() const	{ return num_records; }
+
+	/**
+	 * Encodes the current row group, appends it to a buffer, and starts
+	 * a new one.
+	 *
+	 * @param out The buffer to append to.
+	 *
+	 * @param compression_level The zlib compression level to use, zero
+	 * for none.
+	 *
+	 * @return False if an error occured.
+	 */
+	bool EncodeRowGroup(std::string* out, int compression_level);
+
+	/**
+	 * Appends the file magic and the header describing a set of fields
+	 * to a buffer.
+	 */
+	static void EncodeHeader(std::string* out, int num_fields,
+				 const threading::Field* const* fields);
+
+	/**
+	 * Parses the beginning of a file.
+	 *
+	 * @param data The data to parse.
+	 *
+	 * @param len The number of bytes available.
+	 *
+	 * @param fields Receives the fields listed in the header. The caller
+	 * takes ownership.
+	 *
+	 * @return The number of bytes the magic and header take up, zero if
+	 * more data is needed, or -1 if the data isn't a valid header.
+	 */
+	static int DecodeHeader(const char* data, int len,
+				std::vector<threading::Field*>* fields);
+
+	/**
+	 * Returns the size of the row group starting at the given data.
+	 *
+	 * @return The total number of bytes of the row group, or zero if
+	 * fewer than the 4 bytes needed to tell are available.
+	 */
+	static int RowGroupSize(const char* data, int len);
+
+	/**
+	 * Decodes a row group into records.
+	 *
+	 * @param data The row group, as returned by EncodeRowGroup().
+	 *
+	 * @param len Its size, as returned by RowGroupSize().
+	 *
+	 * @param columns For each field of the records to build, the index
+	 * of the file's column to take its value from, or -1 to leave it
+	 * to the caller. Each column may appear only once.
+	 *
+	 * @param records Receives one array of values per decoded record,
+	 * ordered like \a columns, with null entries where the index was
+	 * -1. The caller takes ownership.
+	 *
+	 * @return False if the data is corrupt, in which case \a records
+	 * remains unchanged.
+	 */
+	bool DecodeRowGroup(const char* data, int len,
+			    const std::vector<int>& columns,
+			    std::vector<threading::Value**>* records) const;
+
+	/**
+	 * The 8 bytes each file starts with.
+	 */
+	static const char MAGIC[8];
+
+private:
+	class Column;
+
+	threading::MsgThread* thread;
+	int num_fields;
+	const threading::Field* const* fields;
+	std::vector<Column*> columns;
+	int num_records;
+};
+
+}}
+
+#endif /* THREADING_FORMATTERS_COLUMNAR_H */